@@ -0,0 +1,360 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Compare two benchmark record files (cnn_prof_write_record()) and
+ fail on regressions beyond a threshold
+==================================================================
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#define BENCH_MAX_RECORDS       8192    // a full kernel_bench sweep is ~1000
+#define BENCH_MAX_FIELDS        32
+#define BENCH_MAX_METRICS       16
+#define BENCH_MAX_GATES         8
+#define BENCH_LINE_SIZE         1024
+#define BENCH_NAME_SIZE         32
+#define BENCH_KEY_SIZE          64
+
+#define DEFAULT_THRESHOLD       5.0     // percent
+#define DEFAULT_GATE            "cycles"
+
+// Every numeric field that is not part of the key or a tag is a metric;
+// a metric a record did not count is < 0
+typedef struct {
+    char key[BENCH_KEY_SIZE];           // conv_mode/core/layer
+    char unit[BENCH_NAME_SIZE];
+    double value[BENCH_MAX_METRICS];
+} bench_record;
+
+typedef struct {
+    const char *path;
+    bench_record *record;
+    unsigned int record_num;
+} bench_file;
+
+static char metric_names[BENCH_MAX_METRICS][BENCH_NAME_SIZE];
+static unsigned int metric_num;
+static unsigned int key_by_layer;       // -a: leave the conv mode out of the key
+
+static int bench_metric(const char *name)
+{
+    unsigned int idx;
+
+    for (idx = 0; idx < metric_num; idx++) {
+        if (!strcmp(metric_names[idx], name)) {
+            return idx;
+        }
+    }
+    if (metric_num == BENCH_MAX_METRICS) {
+        return -1;
+    }
+    strncpy(metric_names[metric_num], name, BENCH_NAME_SIZE - 1);
+    return metric_num++;
+}
+
+static bench_record *bench_find(bench_file *file, const char *key)
+{
+    unsigned int idx;
+
+    for (idx = 0; idx < file->record_num; idx++) {
+        if (!strcmp(file->record[idx].key, key)) {
+            return &file->record[idx];
+        }
+    }
+    return 0;
+}
+
+/*
+ * One record from its field names and values. A later record with the
+ * same key replaces an earlier one, so appended runs keep the last.
+ */
+static int bench_add(bench_file *file, char **names, char **values, unsigned int num)
+{
+    const char *conv_mode = "", *core = "", *layer = "";
+    bench_record rec, *old;
+    unsigned int idx;
+    int metric;
+    char *end;
+    double value;
+
+    memset(&rec, 0, sizeof(rec));
+    for (idx = 0; idx < BENCH_MAX_METRICS; idx++) {
+        rec.value[idx] = -1.0;
+    }
+    for (idx = 0; idx < num; idx++) {
+        if (!strcmp(names[idx], "conv_mode")) conv_mode = values[idx];
+        else if (!strcmp(names[idx], "core")) core = values[idx];
+        else if (!strcmp(names[idx], "layer")) layer = values[idx];
+        else if (!strcmp(names[idx], "unit")) strncpy(rec.unit, values[idx], BENCH_NAME_SIZE - 1);
+        else if (strcmp(names[idx], "opt_level") && strcmp(names[idx], "macs") && strcmp(names[idx], "runs")) {
+            metric = bench_metric(names[idx]);
+            if (metric < 0) {
+                continue;
+            }
+            value = strtod(values[idx], &end);
+            if (end != values[idx] && *end == '\0') {
+                rec.value[metric] = value;
+            }
+        }
+    }
+    if (key_by_layer) {
+        snprintf(rec.key, sizeof(rec.key), "%s/%s", core, layer);
+    }
+    else {
+        snprintf(rec.key, sizeof(rec.key), "%s/%s/%s", conv_mode, core, layer);
+    }
+
+    old = bench_find(file, rec.key);
+    if (old) {
+        *old = rec;
+        return 0;
+    }
+    if (file->record_num == BENCH_MAX_RECORDS) {
+        fprintf(stderr, "Error: %s has more than %u records\n", file->path, BENCH_MAX_RECORDS);
+        return -1;
+    }
+    file->record[file->record_num++] = rec;
+    return 0;
+}
+
+// Split a CSV line in place, returns the number of fields
+static unsigned int bench_split_csv(char *line, char **fields)
+{
+    unsigned int num = 0;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    fields[num++] = line;
+    while (num < BENCH_MAX_FIELDS && (line = strchr(line, ',')) != 0) {
+        *line++ = '\0';
+        fields[num++] = line;
+    }
+    return num;
+}
+
+/*
+ * Parse one flat JSON object in place: string, number and null values,
+ * no nesting, as cnn_prof_write_record() writes them. null reads as an
+ * empty value. Returns the number of fields, or 0 if it is not one.
+ */
+static unsigned int bench_split_json(char *line, char **names, char **values)
+{
+    unsigned int num = 0;
+    char *p = strchr(line, '{') + 1;
+    int last;
+
+    while (num < BENCH_MAX_FIELDS) {
+        while (isspace((unsigned char)*p) || *p == ',') p++;
+        if (*p == '}') {
+            return num;
+        }
+        if (*p != '"') {
+            return 0;
+        }
+        names[num] = ++p;
+        p = strchr(p, '"');
+        if (!p) {
+            return 0;
+        }
+        *p++ = '\0';
+        while (isspace((unsigned char)*p)) p++;
+        if (*p++ != ':') {
+            return 0;
+        }
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '"') {
+            values[num] = ++p;
+            p = strchr(p, '"');
+            if (!p) {
+                return 0;
+            }
+            *p++ = '\0';
+        }
+        else {
+            values[num] = p;
+            p += strcspn(p, ",} \t\r\n");
+            last = (*p == '}');
+            if (*p) {
+                *p++ = '\0';
+            }
+            if (!strcmp(values[num], "null")) {
+                values[num][0] = '\0';
+            }
+            if (last) {
+                return num + 1;
+            }
+        }
+        num++;
+    }
+    return 0;
+}
+
+/*
+ * Read the records of a CSV or JSON-lines file, or of a console log with
+ * records in it: every line that is not a record or a CSV header is
+ * skipped.
+ */
+static int bench_load(bench_file *file, const char *path)
+{
+    char line[BENCH_LINE_SIZE];
+    char header[BENCH_LINE_SIZE];
+    char *names[BENCH_MAX_FIELDS];
+    char *values[BENCH_MAX_FIELDS];
+    unsigned int name_num = 0, num;
+    int err = 0;
+    FILE *fp;
+
+    file->path = path;
+    file->record_num = 0;
+    file->record = malloc(BENCH_MAX_RECORDS * sizeof(bench_record));
+    if (!file->record) {
+        return -1;
+    }
+    fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "Error: cannot open %s\n", path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        if (!strncmp(line, "conv_mode,", 10)) {
+            strcpy(header, line);
+            name_num = bench_split_csv(header, names);
+        }
+        else if (line[0] == '{' && strstr(line, "\"conv_mode\"")) {
+            num = bench_split_json(line, names, values);
+            if (num && (err = bench_add(file, names, values, num)) != 0) {
+                break;
+            }
+            name_num = 0;
+        }
+        else if (name_num && isdigit((unsigned char)line[0])) {
+            num = bench_split_csv(line, values);
+            if (num == name_num && (err = bench_add(file, names, values, num)) != 0) {
+                break;
+            }
+        }
+    }
+    fclose(fp);
+
+    if (err) {
+        return -1;
+    }
+    if (!file->record_num) {
+        fprintf(stderr, "Error: no records in %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static void usage(const char *app)
+{
+    printf("usage: %s [-t threshold] [-m metric]... [-a] base new\n", app);
+    printf("  base, new   records from mnist_host -o, or console logs with cnn_prof_write() records\n");
+    printf("  -t   regression threshold in percent (default %.1f)\n", DEFAULT_THRESHOLD);
+    printf("  -m   metric that fails on a regression, repeatable (default %s)\n", DEFAULT_GATE);
+    printf("  -a   match records by core and layer only, to compare conv modes\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *gates[BENCH_MAX_GATES];
+    unsigned int gate_num = 0;
+    double threshold = DEFAULT_THRESHOLD;
+    bench_file base, cur;
+    bench_record *b, *n;
+    unsigned int idx, metric, gate, gated;
+    unsigned int compared = 0, regressions = 0, missing = 0;
+    double delta;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:m:ah")) != -1) {
+        switch (opt) {
+        case 't': threshold = strtod(optarg, NULL); break;
+        case 'm':
+            if (gate_num == BENCH_MAX_GATES) {
+                fprintf(stderr, "Error: at most %u -m metrics\n", BENCH_MAX_GATES);
+                return 2;
+            }
+            gates[gate_num++] = optarg;
+            break;
+        case 'a': key_by_layer = 1; break;
+        default:
+            usage(argv[0]);
+            return (opt == 'h') ? 0 : 2;
+        }
+    }
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (!gate_num) {
+        gates[gate_num++] = DEFAULT_GATE;
+    }
+    if (bench_load(&base, argv[optind]) || bench_load(&cur, argv[optind + 1])) {
+        return 2;
+    }
+
+    printf("%-24s %-10s %14s %14s %9s\n", "record", "metric", "base", "new", "delta");
+    for (idx = 0; idx < base.record_num; idx++) {
+        b = &base.record[idx];
+        n = bench_find(&cur, b->key);
+        if (!n) {
+            printf("%-24s only in %s\n", b->key, base.path);
+            missing++;
+            continue;
+        }
+        for (metric = 0; metric < metric_num; metric++) {
+            if (b->value[metric] < 0.0 || n->value[metric] < 0.0) {
+                continue;
+            }
+            gated = 0;
+            for (gate = 0; gate < gate_num; gate++) {
+                gated |= !strcmp(gates[gate], metric_names[metric]);
+            }
+            // cycles on one side, ns (no cycle counter) on the other
+            if (!strcmp(metric_names[metric], "cycles") && strcmp(b->unit, n->unit)) {
+                printf("%-24s %-10s %14s %14s %9s\n", b->key, b->unit, "", n->unit, "units");
+                continue;
+            }
+            printf("%-24s %-10s %14.1f %14.1f", b->key, metric_names[metric], b->value[metric], n->value[metric]);
+            if (b->value[metric] > 0.0) {
+                delta = 100.0 * (n->value[metric] - b->value[metric]) / b->value[metric];
+                printf(" %+8.1f%%", delta);
+                if (gated && delta > threshold) {
+                    printf("  [Regression]");
+                    regressions++;
+                }
+            }
+            else {
+                printf(" %9s", "-");
+            }
+            printf("\n");
+            compared += gated;
+        }
+    }
+    for (idx = 0; idx < cur.record_num; idx++) {
+        if (!bench_find(&base, cur.record[idx].key)) {
+            printf("%-24s only in %s\n", cur.record[idx].key, cur.path);
+        }
+    }
+
+    if (!compared) {
+        fprintf(stderr, "Error: no %s values to compare (-a to match across conv modes)\n", gates[0]);
+        return 2;
+    }
+    printf("\n%u/%u gated values regressed by more than %.1f%%", regressions, compared, threshold);
+    if (missing) {
+        printf(", %u records missing from %s", missing, cur.path);
+    }
+    printf("\n");
+
+    free(base.record);
+    free(cur.record);
+
+    return regressions ? 1 : 0;
+}
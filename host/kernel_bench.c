@@ -0,0 +1,676 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Host (Linux) microbenchmarks of the conv, pooling and FC kernels,
+ each timed in isolation over a sweep of layer shapes
+==================================================================
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arm_cnn_inference.h"
+#include "mnist.h"
+#include "cnn_api_c.h"
+#include "cnn_prof.h"
+
+#define BENCH_MAX_LIST          16
+#define BENCH_MAX_REPS          1001
+#define BENCH_MIN_REPS          5       // taken even past BENCH_MAX_NS
+#define BENCH_MAX_NS            200e6   // timed runs per kernel and shape
+
+#define DEFAULT_SIZES           "8,14,28,56"
+#define DEFAULT_CHANNELS        "1,8,32,64"
+#define DEFAULT_OUTPUTS         "16,32,64"
+#define DEFAULT_FILTERS         "3,5"
+#define DEFAULT_FC_INPUTS       "128,512,2048,8192"
+#define DEFAULT_BATCHES         "1,2,4,8,16"
+#define DEFAULT_REPS            51
+#define DEFAULT_WARMUP          3
+
+// The kernels only reach the DDR window for the config bytes below
+// cnn_host_eval_base; the buffers are allocated per shape.
+unsigned long cnn_host_eval_base;
+static unsigned char bench_config[CNN_HOST_CONFIG_SIZE];
+
+#define BENCH_CONV      0
+#define BENCH_POOL      1
+#define BENCH_FC        2
+#define BENCH_FC_BATCH  3       // FC over -b images per call
+
+enum {
+    K_CONV,
+    K_CONV_NEON,
+    K_CONV2,
+    K_CONV2_NEON,
+    K_CONV4,
+    K_CONV4_NEON,
+    K_CONV_INT8,
+    K_CONV_POOL,
+    K_CONV_POOL_NEON,
+    K_WINOGRAD,
+    K_CONV_FP16,
+    K_POOL,
+    K_POOL_NEON,
+    K_POOL_FP16,
+    K_FC,
+    K_FC_NEON,
+    K_FC_PACKED,
+    K_FC_PACKED_NEON,
+    K_FC_INT8,
+    K_FC_FP16,
+    K_FC_BATCH,
+    K_FC_BATCH_NEON,
+    K_FC_BATCH_PACKED,
+    K_FC_BATCH_PACKED_NEON
+};
+
+// The conv mode each kernel belongs to, 0 for the pooling and FC kernels
+// every float mode shares; act_bytes and weight_bytes size the traffic.
+// Mode #3 is left out: its products are done by the FVP engine model,
+// which the host build only stands in for.
+typedef struct {
+    unsigned int id;
+    const char *name;
+    unsigned int type;
+    unsigned int conv_mode;
+    unsigned int act_bytes;
+    unsigned int weight_bytes;
+} bench_kernel;
+
+static const bench_kernel bench_kernels[] = {
+#ifdef CNN_CONV_1
+    { K_CONV,           "convolution",              BENCH_CONV, 1, 4, 4 },
+#ifdef CNN_NEON
+    { K_CONV_NEON,      "convolution_neon",         BENCH_CONV, 1, 4, 4 },
+#endif
+#endif
+#ifdef CNN_CONV_2
+    { K_CONV2,          "convolution_conv2",        BENCH_CONV, 2, 4, 4 },
+#ifdef CNN_NEON
+    { K_CONV2_NEON,     "convolution_conv2_neon",   BENCH_CONV, 2, 4, 4 },
+#endif
+#endif
+#ifdef CNN_CONV_4
+    { K_CONV4,          "convolution_conv4",        BENCH_CONV, 4, 4, 4 },
+#ifdef CNN_NEON
+    { K_CONV4_NEON,     "convolution_conv4_neon",   BENCH_CONV, 4, 4, 4 },
+#endif
+#endif
+#ifdef CNN_CONV_5
+    { K_CONV_INT8,      "convolution_int8",         BENCH_CONV, 5, 4, 1 },
+#endif
+#ifdef CNN_FUSED
+    { K_CONV_POOL,      "convolution_pool",         BENCH_CONV, 6, 4, 4 },
+#ifdef CNN_NEON
+    { K_CONV_POOL_NEON, "convolution_pool_neon",    BENCH_CONV, 6, 4, 4 },
+#endif
+#endif
+#ifdef CNN_CONV_7
+    { K_WINOGRAD,       "convolution_winograd",     BENCH_CONV, 7, 4, 4 },
+#endif
+#ifdef CNN_FP16
+    { K_CONV_FP16,      "convolution_fp16",         BENCH_CONV, 8, 2, 2 },
+#endif
+    { K_POOL,           "max_pooling",              BENCH_POOL, 0, 4, 0 },
+#ifdef CNN_NEON
+    { K_POOL_NEON,      "max_pooling_neon",         BENCH_POOL, 0, 4, 0 },
+#endif
+#ifdef CNN_FP16
+    { K_POOL_FP16,      "max_pooling_fp16",         BENCH_POOL, 8, 2, 0 },
+#endif
+    { K_FC,             "fully_connected",          BENCH_FC,   0, 4, 4 },
+    { K_FC_PACKED,      "fully_connected_packed",   BENCH_FC,   0, 4, 4 },
+#ifdef CNN_NEON
+    { K_FC_NEON,        "fully_connected_neon",     BENCH_FC,   0, 4, 4 },
+    { K_FC_PACKED_NEON, "fully_connected_packed_neon", BENCH_FC, 0, 4, 4 },
+#endif
+#ifdef CNN_CONV_5
+    { K_FC_INT8,        "fully_connected_int8",     BENCH_FC,   5, 4, 1 },
+#endif
+#ifdef CNN_FP16
+    { K_FC_FP16,        "fully_connected_fp16",     BENCH_FC,   8, 2, 2 },
+#endif
+#ifdef CNN_BATCH
+    { K_FC_BATCH,       "fully_connected_batch",    BENCH_FC_BATCH, 0, 4, 4 },
+    { K_FC_BATCH_PACKED, "fully_connected_batch_packed", BENCH_FC_BATCH, 0, 4, 4 },
+#ifdef CNN_NEON
+    { K_FC_BATCH_NEON,  "fully_connected_batch_neon", BENCH_FC_BATCH, 0, 4, 4 },
+    { K_FC_BATCH_PACKED_NEON, "fully_connected_batch_packed_neon", BENCH_FC_BATCH, 0, 4, 4 },
+#endif
+#endif
+};
+
+#define BENCH_KERNEL_NUM    (sizeof(bench_kernels) / sizeof(bench_kernels[0]))
+
+// One shape: the float tensors, and whatever form of them the kernel
+// under test takes, converted before it is timed
+typedef struct {
+    layer_structure lay;
+    unsigned int batch;         // images per call, BENCH_FC_BATCH
+    unsigned long in_len, out_len, weight_len;
+    float *inputs;
+    float *outputs;
+    float *weights;
+    float *biases;
+    float *packed;              // Winograd or FC panels
+    float *workspace;
+    signed char *int8_weights;
+    float *int8_scales;
+#ifdef CNN_FP16
+    cnn_half *h_inputs;
+    cnn_half *h_outputs;
+    cnn_half *h_weights;
+    cnn_half *h_biases;
+#endif
+} bench_layer;
+
+static void *bench_alloc(unsigned long size)
+{
+    void *p;
+
+    if (posix_memalign(&p, 64, size ? size : 64)) {
+        fprintf(stderr, "Error: cannot allocate %lu bytes\n", size);
+        exit(1);
+    }
+    return p;
+}
+
+// Deterministic values in [-1, 1)
+static void bench_fill(float *buf, unsigned long len, unsigned int seed)
+{
+    unsigned long i;
+
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (float)((seed >> 8) & 0xFFFF) / 32768.0f - 1.0f;
+    }
+}
+
+static unsigned long bench_round_up(unsigned long x, unsigned long a)
+{
+    return (x + a - 1) / a * a;
+}
+
+static void bench_layer_init(bench_layer *b, unsigned int type, unsigned int size,
+                             unsigned int channels, unsigned int outputs, unsigned int filter,
+                             unsigned int batch)
+{
+    layer_structure *lay = &b->lay;
+    unsigned long np, kp, ws;
+
+    memset(b, 0, sizeof(*b));
+    b->batch = batch;
+    lay->relu_activation = 1;
+    if (type == BENCH_CONV) {
+        lay->input_rows = lay->input_columns = size;
+        lay->input_channel = channels;
+        lay->filter_rows = lay->filter_columns = filter;
+        lay->output_rows = lay->output_columns = size - filter + 1;
+        lay->output_channel = outputs;
+        b->weight_len = (unsigned long)filter * filter * channels * outputs;
+    }
+    else if (type == BENCH_POOL) {
+        lay->input_rows = lay->input_columns = size;
+        lay->input_channel = lay->output_channel = channels;
+        lay->filter_rows = lay->filter_columns = 2;
+        lay->output_rows = lay->output_columns = size / 2;
+    }
+    else {
+        lay->input_rows = lay->input_columns = 1;
+        lay->output_rows = lay->output_columns = 1;
+        lay->input_channel = channels;
+        lay->filter_rows = channels;
+        lay->filter_columns = outputs;
+        lay->output_channel = outputs;
+        b->weight_len = (unsigned long)channels * outputs;
+    }
+    b->in_len = (unsigned long)lay->input_rows * lay->input_columns * lay->input_channel * batch;
+    b->out_len = (unsigned long)lay->output_rows * lay->output_columns * lay->output_channel * batch;
+
+    b->inputs = bench_alloc(b->in_len * sizeof(float));
+    b->outputs = bench_alloc(b->out_len * sizeof(float));
+    b->weights = bench_alloc(b->weight_len * sizeof(float));
+    b->biases = bench_alloc(lay->output_channel * sizeof(float));
+    bench_fill(b->inputs, b->in_len, 1);
+    bench_fill(b->weights, b->weight_len, 2);
+    bench_fill(b->biases, lay->output_channel, 3);
+
+    // the largest scratch of conv modes #4, #5 and #7 for this shape
+    np = bench_round_up(lay->output_channel, 4);
+    kp = bench_round_up((unsigned long)lay->filter_rows * lay->filter_columns * lay->input_channel, 4);
+    ws = bench_round_up(b->in_len, 16) + bench_round_up(kp, 16) + (np * sizeof(int));
+    if (ws < 32 * 128 * sizeof(float)) {
+        ws = 32 * 128 * sizeof(float);
+    }
+    if (ws < WINOGRAD_WORKSPACE_SIZE(lay->input_channel) * sizeof(float)) {
+        ws = WINOGRAD_WORKSPACE_SIZE(lay->input_channel) * sizeof(float);
+    }
+    b->workspace = bench_alloc(ws);
+}
+
+static void bench_layer_free(bench_layer *b)
+{
+    free(b->inputs);
+    free(b->outputs);
+    free(b->weights);
+    free(b->biases);
+    free(b->packed);
+    free(b->workspace);
+    free(b->int8_weights);
+    free(b->int8_scales);
+#ifdef CNN_FP16
+    free(b->h_inputs);
+    free(b->h_outputs);
+    free(b->h_weights);
+    free(b->h_biases);
+#endif
+}
+
+/*
+ * Whether kernel k takes this shape, and its weights in the form it
+ * runs on (repacked, transformed, quantized or fp16), untimed. Returns
+ * 0 if the kernel does not support the shape.
+ */
+static int bench_prepare(const bench_kernel *k, bench_layer *b)
+{
+    layer_structure *lay = &b->lay;
+    unsigned long np, kp, idx;
+
+    switch (k->id) {
+    case K_CONV_POOL:
+    case K_CONV_POOL_NEON:
+        return (lay->output_rows % 2) == 0 && (lay->output_columns % 2) == 0;
+#ifdef CNN_CONV_7
+    case K_WINOGRAD:
+        if (!convolution_winograd_tile(lay)) {
+            return 0;
+        }
+        free(b->packed);
+        b->packed = bench_alloc(WINOGRAD_WEIGHTS_SIZE(lay->input_channel, lay->output_channel) * sizeof(float));
+        return convolution_winograd_transform(lay, b->weights, b->packed) == 0;
+#endif
+    case K_FC_PACKED:
+    case K_FC_PACKED_NEON:
+    case K_FC_BATCH_PACKED:
+    case K_FC_BATCH_PACKED_NEON:
+        free(b->packed);
+        b->packed = bench_alloc(FC_PACKED_SIZE(lay->input_channel, lay->output_channel) * sizeof(float));
+        return fully_connected_pack(lay, b->weights, b->biases, b->packed) == 0;
+    case K_CONV_INT8:
+    case K_FC_INT8:
+        // random weights time the same as quantized ones
+        np = bench_round_up(lay->output_channel, 4);
+        kp = bench_round_up((unsigned long)lay->filter_rows * lay->filter_columns * lay->input_channel, 4);
+        if (k->id == K_FC_INT8) {
+            kp = bench_round_up(lay->input_channel, 4);
+        }
+        if (!b->int8_weights) {
+            b->int8_weights = bench_alloc(np * kp);
+            b->int8_scales = bench_alloc(np * sizeof(float));
+            for (idx = 0; idx < np * kp; idx++) {
+                b->int8_weights[idx] = (signed char)((int)((idx * 2654435761u) >> 24) - 128);
+            }
+            for (idx = 0; idx < np; idx++) {
+                b->int8_scales[idx] = 1.0f / 127.0f;
+            }
+        }
+        return 1;
+#ifdef CNN_FP16
+    case K_CONV_FP16:
+    case K_POOL_FP16:
+    case K_FC_FP16:
+        if (!b->h_inputs) {
+            b->h_inputs = bench_alloc(b->in_len * sizeof(cnn_half));
+            b->h_outputs = bench_alloc(b->out_len * sizeof(cnn_half));
+            b->h_weights = bench_alloc(b->weight_len * sizeof(cnn_half));
+            b->h_biases = bench_alloc(lay->output_channel * sizeof(cnn_half));
+            cnn_fp32_to_fp16(b->inputs, b->h_inputs, b->in_len);
+            cnn_fp32_to_fp16(b->weights, b->h_weights, b->weight_len);
+            cnn_fp32_to_fp16(b->biases, b->h_biases, lay->output_channel);
+        }
+        return 1;
+#endif
+    default:
+        return 1;
+    }
+}
+
+static void bench_run(const bench_kernel *k, bench_layer *b)
+{
+    layer_structure *lay = &b->lay;
+
+    switch (k->id) {
+#ifdef CNN_CONV_1
+    case K_CONV:            convolution(lay, b->inputs, b->outputs, b->weights, b->biases); break;
+#ifdef CNN_NEON
+    case K_CONV_NEON:       convolution_neon(lay, b->inputs, b->outputs, b->weights, b->biases); break;
+#endif
+#endif
+#ifdef CNN_CONV_2
+    case K_CONV2:           convolution_conv2(lay, b->inputs, b->outputs, b->weights, b->biases); break;
+#ifdef CNN_NEON
+    case K_CONV2_NEON:      convolution_conv2_neon(lay, b->inputs, b->outputs, b->weights, b->biases); break;
+#endif
+#endif
+#ifdef CNN_CONV_4
+    case K_CONV4:           convolution_conv4(lay, b->inputs, b->outputs, b->weights, b->biases, b->workspace); break;
+#ifdef CNN_NEON
+    case K_CONV4_NEON:      convolution_conv4_neon(lay, b->inputs, b->outputs, b->weights, b->biases, b->workspace); break;
+#endif
+#endif
+#ifdef CNN_CONV_5
+    case K_CONV_INT8:
+        convolution_int8(lay, b->inputs, b->outputs, b->int8_weights, b->int8_scales, b->biases, (signed char*)b->workspace);
+        break;
+    case K_FC_INT8:
+        fully_connected_int8(lay, b->inputs, b->outputs, b->int8_weights, b->int8_scales, b->biases, (signed char*)b->workspace);
+        break;
+#endif
+#ifdef CNN_FUSED
+    case K_CONV_POOL:       convolution_pool(lay, b->inputs, b->outputs, b->weights, b->biases); break;
+#ifdef CNN_NEON
+    case K_CONV_POOL_NEON:  convolution_pool_neon(lay, b->inputs, b->outputs, b->weights, b->biases); break;
+#endif
+#endif
+#ifdef CNN_CONV_7
+    case K_WINOGRAD:        convolution_winograd(lay, b->inputs, b->outputs, b->packed, b->biases, b->workspace); break;
+#endif
+#ifdef CNN_FP16
+    case K_CONV_FP16:       convolution_fp16(lay, b->h_inputs, b->h_outputs, b->h_weights, b->h_biases, 1.0f); break;
+    case K_POOL_FP16:       max_pooling_fp16(lay, b->h_inputs, b->h_outputs); break;
+    case K_FC_FP16:         fully_connected_fp16(lay, b->h_inputs, b->h_outputs, b->h_weights, b->h_biases, 1.0f); break;
+#endif
+#ifdef CNN_BATCH
+    case K_FC_BATCH:        fully_connected_batch(lay, b->inputs, b->outputs, b->weights, b->biases, b->batch); break;
+    case K_FC_BATCH_PACKED: fully_connected_batch_packed(lay, b->inputs, b->outputs, b->packed, b->batch); break;
+#ifdef CNN_NEON
+    case K_FC_BATCH_NEON:   fully_connected_batch_neon(lay, b->inputs, b->outputs, b->weights, b->biases, b->batch); break;
+    case K_FC_BATCH_PACKED_NEON: fully_connected_batch_packed_neon(lay, b->inputs, b->outputs, b->packed, b->batch); break;
+#endif
+#endif
+    case K_POOL:            max_pooling(lay, b->inputs, b->outputs); break;
+    case K_FC:              fully_connected(lay, b->inputs, b->outputs, b->weights, b->biases); break;
+    case K_FC_PACKED:       fully_connected_packed(lay, b->inputs, b->outputs, b->packed, 0, lay->output_channel); break;
+#ifdef CNN_NEON
+    case K_POOL_NEON:       max_pooling_neon(lay, b->inputs, b->outputs); break;
+    case K_FC_NEON:         fully_connected_neon(lay, b->inputs, b->outputs, b->weights, b->biases); break;
+    case K_FC_PACKED_NEON:  fully_connected_packed_neon(lay, b->inputs, b->outputs, b->packed, 0, lay->output_channel); break;
+#endif
+    default:
+        break;
+    }
+}
+
+static double bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int bench_cmp(const void *a, const void *b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * warmup untimed runs, then up to reps timed ones, each on its own
+ * clock reads; stops early once BENCH_MAX_NS is spent. Returns the
+ * number of samples, sorted.
+ */
+static unsigned int bench_time(const bench_kernel *k, bench_layer *b, unsigned int warmup,
+                               unsigned int reps, double *samples)
+{
+    double start, spent = 0.0;
+    unsigned int rep;
+
+    for (rep = 0; rep < warmup; rep++) {
+        bench_run(k, b);
+    }
+    for (rep = 0; rep < reps; rep++) {
+        start = bench_now_ns();
+        bench_run(k, b);
+        samples[rep] = bench_now_ns() - start;
+        spent += samples[rep];
+        if (rep + 1 >= BENCH_MIN_REPS && spent > BENCH_MAX_NS) {
+            rep++;
+            break;
+        }
+    }
+    qsort(samples, rep, sizeof(double), bench_cmp);
+
+    return rep;
+}
+
+// Comma separated unsigned list, returns the number of entries
+static unsigned int bench_parse_list(const char *arg, unsigned int *list)
+{
+    unsigned int num = 0;
+    char *end;
+
+    while (*arg && num < BENCH_MAX_LIST) {
+        list[num] = strtoul(arg, &end, 0);
+        if (end == arg || !list[num]) {
+            return 0;
+        }
+        num++;
+        arg = (*end == ',') ? end + 1 : end;
+    }
+    return num;
+}
+
+// -k: every kernel, or those whose name contains one of the names
+static int bench_selected(const bench_kernel *k, const char *filter)
+{
+    char name[64];
+    const char *p = filter;
+    unsigned long len;
+
+    if (!filter) {
+        return 1;
+    }
+    while (*p) {
+        len = strcspn(p, ",");
+        if (len && len < sizeof(name)) {
+            memcpy(name, p, len);
+            name[len] = '\0';
+            if (strstr(k->name, name)) {
+                return 1;
+            }
+        }
+        p += len + (p[len] == ',');
+    }
+    return 0;
+}
+
+typedef struct {
+    unsigned int warmup;
+    unsigned int reps;
+    const char *filter;
+    FILE *records;
+    unsigned int format;
+} bench_options;
+
+static double bench_samples[BENCH_MAX_REPS];
+
+// Every selected kernel of type on one shape: a table line, and a record
+static void bench_shape(const bench_options *opt, unsigned int type, unsigned int size,
+                        unsigned int channels, unsigned int outputs, unsigned int filter,
+                        unsigned int batch)
+{
+    const bench_kernel *k;
+    bench_layer b;
+    layer_structure *lay = &b.lay;
+    char shape[48], layer[96];
+    unsigned long long macs;
+    double bytes, median, p99;
+    unsigned int idx, num;
+
+    bench_layer_init(&b, type, size, channels, outputs, filter, batch);
+    if (type == BENCH_CONV) {
+        snprintf(shape, sizeof(shape), "%ux%ux%u-k%u-n%u", size, size, channels, filter, outputs);
+        macs = (unsigned long long)lay->output_rows * lay->output_columns * b.weight_len;
+    }
+    else if (type == BENCH_POOL) {
+        snprintf(shape, sizeof(shape), "%ux%ux%u", size, size, channels);
+        macs = 0;
+    }
+    else if (type == BENCH_FC) {
+        snprintf(shape, sizeof(shape), "%u-n%u", channels, outputs);
+        macs = b.weight_len;
+    }
+    else {
+        snprintf(shape, sizeof(shape), "%u-n%u-b%u", channels, outputs, batch);
+        macs = b.weight_len * batch;
+    }
+
+    for (idx = 0; idx < BENCH_KERNEL_NUM; idx++) {
+        k = &bench_kernels[idx];
+        if (k->type != type || !bench_selected(k, opt->filter) || !bench_prepare(k, &b)) {
+            continue;
+        }
+        num = bench_time(k, &b, opt->warmup, opt->reps, bench_samples);
+        median = (num % 2) ? bench_samples[num / 2] : (bench_samples[num / 2 - 1] + bench_samples[num / 2]) / 2.0;
+        p99 = bench_samples[(num * 99 + 99) / 100 - 1];
+        // compulsory traffic: every input, weight, bias and output once
+        bytes = (double)(b.in_len + b.out_len) * k->act_bytes +
+                (double)b.weight_len * k->weight_bytes +
+                (double)(b.weight_len ? lay->output_channel : 0) * k->act_bytes;
+        if (k->id == K_CONV_POOL || k->id == K_CONV_POOL_NEON) {
+            bytes -= (double)b.out_len * k->act_bytes * 3 / 4;
+        }
+
+        printf("%-33s %2u %-18s %11llu %4u %10.2f %10.2f", k->name, k->conv_mode, shape, macs, num, median / 1e3, p99 / 1e3);
+        if (macs) {
+            printf(" %8.2f", 2.0 * macs / median);
+        }
+        else {
+            printf(" %8s", "-");
+        }
+        printf(" %10.1f %8.2f\n", bytes / 1024.0, bytes / median);
+
+        if (opt->records) {
+            snprintf(layer, sizeof(layer), "%s/%s", k->name, shape);
+            cnn_prof_write_record(opt->records, opt->format, k->conv_mode, 0, layer, macs, num, "ns", median, 0);
+        }
+    }
+
+    bench_layer_free(&b);
+}
+
+static void usage(const char *app)
+{
+    printf("usage: %s [-k kernels] [-s sizes] [-c channels] [-n outputs] [-f filters] [-K fc_inputs] [-b batches] [-r reps] [-w warmup] [-o records]\n", app);
+    printf("  -k   kernels whose name contains one of these, comma separated (default all)\n");
+    printf("  -s   conv and pooling input rows = columns (default %s)\n", DEFAULT_SIZES);
+    printf("  -c   conv and pooling input channels (default %s)\n", DEFAULT_CHANNELS);
+    printf("  -n   conv and FC output channels (default %s)\n", DEFAULT_OUTPUTS);
+    printf("  -f   conv filter rows = columns (default %s)\n", DEFAULT_FILTERS);
+    printf("  -K   FC input channels (default %s)\n", DEFAULT_FC_INPUTS);
+    printf("  -b   images per call of the batched FC kernels (default %s)\n", DEFAULT_BATCHES);
+    printf("  -r   timed runs per kernel and shape, at most %u (default %u)\n", BENCH_MAX_REPS, DEFAULT_REPS);
+    printf("  -w   untimed warmup runs (default %u)\n", DEFAULT_WARMUP);
+    printf("  -o   also write the medians as records for bench_compare, JSON for *.json, else CSV\n");
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int sizes[BENCH_MAX_LIST], channels[BENCH_MAX_LIST], outputs[BENCH_MAX_LIST];
+    unsigned int filters[BENCH_MAX_LIST], fc_inputs[BENCH_MAX_LIST], batches[BENCH_MAX_LIST];
+    unsigned int size_num, channel_num, output_num, filter_num, fc_num, batch_num;
+    unsigned int s, c, n, f, b;
+    const char *size_arg = DEFAULT_SIZES, *channel_arg = DEFAULT_CHANNELS;
+    const char *output_arg = DEFAULT_OUTPUTS, *filter_arg = DEFAULT_FILTERS;
+    const char *fc_arg = DEFAULT_FC_INPUTS, *batch_arg = DEFAULT_BATCHES;
+    const char *record_file = 0, *ext;
+    bench_options opt;
+    int o;
+
+    memset(&opt, 0, sizeof(opt));
+    opt.warmup = DEFAULT_WARMUP;
+    opt.reps = DEFAULT_REPS;
+
+    while ((o = getopt(argc, argv, "k:s:c:n:f:K:b:r:w:o:h")) != -1) {
+        switch (o) {
+        case 'k': opt.filter = optarg; break;
+        case 's': size_arg = optarg; break;
+        case 'c': channel_arg = optarg; break;
+        case 'n': output_arg = optarg; break;
+        case 'f': filter_arg = optarg; break;
+        case 'K': fc_arg = optarg; break;
+        case 'b': batch_arg = optarg; break;
+        case 'r': opt.reps = strtoul(optarg, NULL, 0); break;
+        case 'w': opt.warmup = strtoul(optarg, NULL, 0); break;
+        case 'o': record_file = optarg; break;
+        default:
+            usage(argv[0]);
+            return (o == 'h') ? 0 : 2;
+        }
+    }
+    size_num = bench_parse_list(size_arg, sizes);
+    channel_num = bench_parse_list(channel_arg, channels);
+    output_num = bench_parse_list(output_arg, outputs);
+    filter_num = bench_parse_list(filter_arg, filters);
+    fc_num = bench_parse_list(fc_arg, fc_inputs);
+    batch_num = bench_parse_list(batch_arg, batches);
+    if (!size_num || !channel_num || !output_num || !filter_num || !fc_num || !batch_num) {
+        fprintf(stderr, "Error: lists are 1 - %u positive numbers, comma separated\n", BENCH_MAX_LIST);
+        return 2;
+    }
+    if (opt.reps == 0 || opt.reps > BENCH_MAX_REPS) {
+        fprintf(stderr, "Error: reps must be 1 - %u\n", BENCH_MAX_REPS);
+        return 2;
+    }
+    if (record_file) {
+        ext = strrchr(record_file, '.');
+        opt.format = (ext && !strcmp(ext, ".json")) ? CNN_PROF_JSON : CNN_PROF_CSV;
+        opt.records = fopen(record_file, "w");
+        if (!opt.records) {
+            fprintf(stderr, "Error: cannot create %s\n", record_file);
+            return 1;
+        }
+        cnn_prof_write_header(opt.records, opt.format);
+    }
+
+    memset(bench_config, 0, sizeof(bench_config));
+    cnn_host_eval_base = (unsigned long)(bench_config + CNN_HOST_CONFIG_SIZE);
+
+    printf("%-33s %2s %-18s %11s %4s %10s %10s %8s %10s %8s\n",
+           "kernel", "m", "shape", "MACs", "runs", "median us", "p99 us", "GFLOP/s", "KB moved", "GB/s");
+    for (s = 0; s < size_num; s++) {
+        for (c = 0; c < channel_num; c++) {
+            for (f = 0; f < filter_num; f++) {
+                if (filters[f] > sizes[s]) {
+                    continue;
+                }
+                for (n = 0; n < output_num; n++) {
+                    bench_shape(&opt, BENCH_CONV, sizes[s], channels[c], outputs[n], filters[f], 1);
+                }
+            }
+            if (sizes[s] % 2 == 0) {
+                bench_shape(&opt, BENCH_POOL, sizes[s], channels[c], 0, 0, 1);
+            }
+        }
+    }
+    for (c = 0; c < fc_num; c++) {
+        for (n = 0; n < output_num; n++) {
+            bench_shape(&opt, BENCH_FC, 0, fc_inputs[c], outputs[n], 0, 1);
+            for (b = 0; b < batch_num; b++) {
+                bench_shape(&opt, BENCH_FC_BATCH, 0, fc_inputs[c], outputs[n], 0, batches[b]);
+            }
+        }
+    }
+
+    if (opt.records) {
+        fclose(opt.records);
+    }
+
+    return 0;
+}
@@ -0,0 +1,1146 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Host (Linux) runner for the MNIST CNN inference core
+==================================================================
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "arm_cnn_inference.h"
+#include "mnist.h"
+#include "mnist_aot.h"
+#include "cnn_api_c.h"
+#include "cnn_graph.h"
+#include "cnn_sched.h"
+#include "cnn_log.h"
+#include "cnn_prof.h"
+#include "cnn_trace.h"
+#include "cnn_model.h"
+#include "cnn_selftest.h"
+
+#define DEFAULT_PARAMETER_FILE  "mnist/mnist_cnn_parameter.bin"
+#define DEFAULT_INT8_FILE       "mnist/mnist_cnn_parameter_int8.bin"
+#define DEFAULT_GRAPH_FILE      "mnist/mnist_cnn_graph.bin"
+#define DEFAULT_IMAGE_FILE      "mnist/mnist_autotest_images.bin"
+#define DEFAULT_IMAGE_LABELS    "734618"    // labels of the autotest images
+
+#define PARAMETER_MAX_SIZE      (MNIST_TESTIMAGE_BASE - MNIST_PARAMETER_BASE)
+#define TESTIMAGE_SLOT_SIZE     0x1000
+#define TESTIMAGE_MAX_NUM       ((MNIST_WORKSPACE_BASE - MNIST_TESTIMAGE_BASE) / TESTIMAGE_SLOT_SIZE)
+#define TESTIMAGE_U8_SIZE       (MNIST_IMAGE_ROWS * MNIST_IMAGE_COLUMNS)
+
+// Start of the mirrored FVP DDR window, see arm_cnn_inference.h
+unsigned long cnn_host_eval_base;
+
+static unsigned char *host_arena;
+
+/*
+ * Allocate the arena that stands in for the FVP DDR window. The host
+ * config bytes (AUTOTESTIMG, CNNSELECTING, CONVMODE, IMAGEFORMAT) live
+ * just below cnn_host_eval_base, exactly as they do below 0x80100000 on
+ * the FVP.
+ */
+static int host_arena_init(void)
+{
+    if (posix_memalign((void**)&host_arena, 0x1000, CNN_HOST_CONFIG_SIZE + CNN_HOST_WINDOW_SIZE)) {
+        return -1;
+    }
+    memset(host_arena, 0, CNN_HOST_CONFIG_SIZE + CNN_HOST_WINDOW_SIZE);
+    cnn_host_eval_base = (unsigned long)(host_arena + CNN_HOST_CONFIG_SIZE);
+
+    return 0;
+}
+
+/*
+ * Copy a binary file into the window, the same way the DS-5 scripts
+ * restore it into target memory. Returns the number of bytes loaded.
+ */
+static long host_load_file(const char *path, unsigned long addr, unsigned long max_size)
+{
+    FILE *fp;
+    long len;
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "Error: cannot open %s\n", path);
+        return -1;
+    }
+    len = fread((void*)addr, 1, max_size, fp);
+    if (!feof(fp) && fgetc(fp) != EOF) {
+        fprintf(stderr, "Error: %s is larger than 0x%lx bytes\n", path, max_size);
+        len = -1;
+    }
+    fclose(fp);
+
+    return len;
+}
+
+#ifdef CNN_MODEL
+/*
+ * Map a model container read-only, in place of copying the parameter
+ * and graph blobs into the window: pages come straight from the page
+ * cache, so start-up does not grow with the model. Returns its size.
+ */
+static long host_map_model(const char *path, const void **blob)
+{
+    struct stat st;
+    void *addr;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: cannot open %s\n", path);
+        return -1;
+    }
+    if (fstat(fd, &st) || st.st_size == 0) {
+        fprintf(stderr, "Error: %s is empty\n", path);
+        close(fd);
+        return -1;
+    }
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "Error: cannot map %s\n", path);
+        return -1;
+    }
+    *blob = addr;
+
+    return st.st_size;
+}
+#endif
+
+/*
+ * Load packed uint8 images (TESTIMAGE_U8_SIZE bytes each, see
+ * mnist/mnist_image_u8.py) into the image slots. Returns the number of
+ * images loaded.
+ */
+static long host_load_images_u8(const char *path)
+{
+    unsigned char *pixels;
+    long len;
+    long idx;
+
+    pixels = malloc(TESTIMAGE_MAX_NUM * TESTIMAGE_U8_SIZE);
+    if (!pixels) {
+        return -1;
+    }
+    len = host_load_file(path, (unsigned long)pixels, TESTIMAGE_MAX_NUM * TESTIMAGE_U8_SIZE);
+    if (len >= 0 && len % TESTIMAGE_U8_SIZE) {
+        fprintf(stderr, "Error: %s is not a whole number of %u-byte images\n", path, TESTIMAGE_U8_SIZE);
+        len = -1;
+    }
+    for (idx = 0; len > 0 && idx < len / TESTIMAGE_U8_SIZE; idx++) {
+        memcpy((void*)TEST_IMAGE_X(idx), pixels + (idx * TESTIMAGE_U8_SIZE), TESTIMAGE_U8_SIZE);
+    }
+    free(pixels);
+
+    return (len < 0) ? -1 : len / TESTIMAGE_U8_SIZE;
+}
+
+static double host_elapsed_us(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e6 + (end->tv_nsec - start->tv_nsec) / 1e3;
+}
+
+#ifdef CNN_TRACE
+static cnn_trace host_trace;
+static unsigned int host_tracing;       // -T
+
+// The trace buffer of a thread standing in for an FVP core, 0 without -T
+static cnn_trace_buf *host_trace_cpu(unsigned int cpu)
+{
+    return host_tracing ? cnn_trace_cpu(&host_trace, cpu) : 0;
+}
+#endif
+
+#ifdef CNN_SCHED
+static cnn_sched host_sched;
+static cnn_team host_team;
+
+typedef struct {
+    pthread_t thread;
+    unsigned int cpu;
+} host_worker;
+
+static void *host_worker_main(void *arg)
+{
+    unsigned int cpu = ((host_worker*)arg)->cpu;
+
+#ifdef CNN_TRACE
+    cnn_trace_begin(host_trace_cpu(cpu), "sched worker");
+#endif
+    cnn_sched_worker(&host_sched, cpu);
+#ifdef CNN_TRACE
+    cnn_trace_end(host_trace_cpu(cpu));
+#endif
+    return NULL;
+}
+
+static void *host_helper_main(void *arg)
+{
+    unsigned int cpu = ((host_worker*)arg)->cpu;
+
+#ifdef CNN_TRACE
+    cnn_trace_begin(host_trace_cpu(cpu), "team helper");
+#endif
+    cnn_team_helper(&host_team, cpu);
+#ifdef CNN_TRACE
+    cnn_trace_end(host_trace_cpu(cpu));
+#endif
+    return NULL;
+}
+
+// Start threads - 1 helpers for mnist_cnn_eval_team(), the caller is cpu 0
+static void host_team_start(host_worker *helpers, unsigned int threads)
+{
+    unsigned int idx;
+
+    memset(&host_team, 0, sizeof(host_team));
+    for (idx = 1; idx < threads; idx++) {
+        helpers[idx].cpu = idx;
+        if (pthread_create(&helpers[idx].thread, NULL, host_helper_main, &helpers[idx])) {
+            fprintf(stderr, "Error: cannot start helper %u\n", idx);
+            exit(1);
+        }
+    }
+}
+
+static void host_team_stop(host_worker *helpers, unsigned int threads)
+{
+    unsigned int idx;
+
+    cnn_team_release(&host_team);
+    for (idx = 1; idx < threads; idx++) {
+        pthread_join(helpers[idx].thread, NULL);
+    }
+    for (idx = 0; idx < threads; idx++) {
+        printf("\thelper %u: %u tiles\n", idx, host_team.executed[idx]);
+    }
+}
+
+/*
+ * Evaluate all images with the work-stealing scheduler, one pthread per
+ * FVP core. Returns the wall time in microseconds, or < 0 on error.
+ */
+static double host_sched_eval(unsigned int image_num, unsigned int threads, cnn_result *results)
+{
+    host_worker workers[CNN_SCHED_MAX_CPUS];
+    unsigned int *images[TESTIMAGE_MAX_NUM];
+    mnist_sched_job job;
+    struct timespec start, end;
+    unsigned int idx;
+
+    for (idx = 0; idx < image_num; idx++) {
+        images[idx] = (unsigned int*)TEST_IMAGE_X(idx);
+    }
+    job.test_images = images;
+    job.results = results;
+    if (mnist_cnn_sched_init(&host_sched, &job, image_num, threads)) {
+        exit(1);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (idx = 0; idx < threads; idx++) {
+        workers[idx].cpu = idx;
+        if (pthread_create(&workers[idx].thread, NULL, host_worker_main, &workers[idx])) {
+            fprintf(stderr, "Error: cannot start worker %u\n", idx);
+            exit(1);
+        }
+    }
+    for (idx = 0; idx < threads; idx++) {
+        pthread_join(workers[idx].thread, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return host_elapsed_us(&start, &end);
+}
+#endif
+
+/*
+ * MNIST IDX test set (t10k-images-idx3-ubyte, t10k-labels-idx1-ubyte),
+ * streamed HOST_DATASET_CHUNK images at a time. IDX pixels are already
+ * the packed bytes of CNN_PIXEL_U8, so a chunk is evaluated where it was
+ * read. Each thread stands in for one core: it claims the next -b images
+ * of the chunk and runs them with mnist_cnn_eval() (or
+ * mnist_cnn_eval_batch()) in its own workspace, timing every call.
+ */
+#define HOST_DATASET_CHUNK      1000
+#define IDX_IMAGES_MAGIC        0x00000803  // unsigned byte, 3 dimensions
+#define IDX_LABELS_MAGIC        0x00000801  // unsigned byte, 1 dimension
+
+typedef struct {
+    FILE *images;
+    FILE *labels;
+    unsigned int image_num;
+} host_dataset;
+
+typedef struct {
+    unsigned char *pixels;      // pixels[HOST_DATASET_CHUNK][TESTIMAGE_U8_SIZE]
+    cnn_result *results;        // results[HOST_DATASET_CHUNK]
+    double *latency_us;         // per image: the mnist_cnn_eval*() call it was in
+    unsigned int image_num;     // in this chunk
+    unsigned int batch;
+    unsigned int next __attribute__ ((aligned (64)));
+} host_dataset_chunk;
+
+typedef struct {
+    pthread_t thread;
+    unsigned int cpu;
+    host_dataset_chunk *chunk;
+    double first_us;            // first call of the thread, caches cold
+} host_dataset_worker;
+
+static int host_read_be32(FILE *fp, unsigned int *value)
+{
+    unsigned char b[4];
+
+    if (fread(b, 1, 4, fp) != 4) {
+        return -1;
+    }
+    *value = ((unsigned int)b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+
+    return 0;
+}
+
+static int host_dataset_open(host_dataset *set, const char *image_path, const char *label_path)
+{
+    unsigned int magic, num, rows, columns, label_num;
+
+    set->images = fopen(image_path, "rb");
+    set->labels = fopen(label_path, "rb");
+    if (!set->images || !set->labels) {
+        fprintf(stderr, "Error: cannot open %s\n", set->images ? label_path : image_path);
+        return -1;
+    }
+    if (host_read_be32(set->images, &magic) || magic != IDX_IMAGES_MAGIC ||
+        host_read_be32(set->images, &num) || host_read_be32(set->images, &rows) ||
+        host_read_be32(set->images, &columns) || rows != MNIST_IMAGE_ROWS || columns != MNIST_IMAGE_COLUMNS) {
+        fprintf(stderr, "Error: %s is not an IDX file of %ux%u images\n", image_path, MNIST_IMAGE_ROWS, MNIST_IMAGE_COLUMNS);
+        return -1;
+    }
+    if (host_read_be32(set->labels, &magic) || magic != IDX_LABELS_MAGIC ||
+        host_read_be32(set->labels, &label_num) || label_num != num) {
+        fprintf(stderr, "Error: %s is not an IDX file of %u labels\n", label_path, num);
+        return -1;
+    }
+    set->image_num = num;
+
+    return 0;
+}
+
+static void host_dataset_close(host_dataset *set)
+{
+    if (set->images) fclose(set->images);
+    if (set->labels) fclose(set->labels);
+}
+
+static void *host_dataset_main(void *arg)
+{
+    host_dataset_worker *worker = (host_dataset_worker*)arg;
+    host_dataset_chunk *chunk = worker->chunk;
+    unsigned int *images[MNIST_BATCH_MAX];
+    struct timespec start, end;
+    unsigned int first, num, idx;
+    double us;
+
+    for (;;) {
+        first = __atomic_fetch_add(&chunk->next, chunk->batch, __ATOMIC_RELAXED);
+        if (first >= chunk->image_num) {
+            break;
+        }
+        num = (chunk->image_num - first < chunk->batch) ? chunk->image_num - first : chunk->batch;
+        for (idx = 0; idx < num; idx++) {
+            images[idx] = (unsigned int*)(chunk->pixels + (first + idx) * TESTIMAGE_U8_SIZE);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (chunk->batch == 1) {
+            mnist_cnn_eval(images[0], worker->cpu, &chunk->results[first]);
+        }
+        else {
+            mnist_cnn_eval_batch(images, num, worker->cpu, &chunk->results[first]);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        us = host_elapsed_us(&start, &end);
+        for (idx = 0; idx < num; idx++) {
+            chunk->latency_us[first + idx] = us;
+        }
+        if (worker->first_us < 0.0) {
+            worker->first_us = us;
+        }
+    }
+    return NULL;
+}
+
+static int host_cmp_double(const void *a, const void *b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted[num]
+static double host_percentile(const double *sorted, unsigned int num, double pct)
+{
+    unsigned int rank = (unsigned int)ceil(pct / 100.0 * num);
+
+    return sorted[rank ? rank - 1 : 0];
+}
+
+// Stream the set through the workers chunk by chunk and report on it
+static long host_dataset_run(host_dataset *set, host_dataset_chunk *chunk, double *latency_us,
+                             unsigned int threads, unsigned int *run_mode, double *eval_us)
+{
+    host_dataset_worker workers[CNN_SCHED_MAX_CPUS];
+    unsigned char labels[HOST_DATASET_CHUNK];
+    unsigned int class_total[MNIST_CLASSES], class_wrong[MNIST_CLASSES];
+    double cold_us = 0.0, load_us = 0.0;
+    struct timespec start, end;
+    unsigned int done, idx, num;
+    long wrong = 0;
+
+    memset(class_total, 0, sizeof(class_total));
+    memset(class_wrong, 0, sizeof(class_wrong));
+    for (idx = 0; idx < threads; idx++) {
+        workers[idx].cpu = idx;
+        workers[idx].chunk = chunk;
+        workers[idx].first_us = -1.0;
+    }
+
+    for (done = 0; done < set->image_num; done += num) {
+        num = (set->image_num - done < HOST_DATASET_CHUNK) ? set->image_num - done : HOST_DATASET_CHUNK;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (fread(chunk->pixels, TESTIMAGE_U8_SIZE, num, set->images) != num ||
+            fread(labels, 1, num, set->labels) != num) {
+            fprintf(stderr, "Error: the dataset ends after %u images\n", done);
+            return -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        load_us += host_elapsed_us(&start, &end);
+
+        chunk->image_num = num;
+        chunk->latency_us = latency_us + done;
+        chunk->next = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (idx = 1; idx < threads; idx++) {
+            if (pthread_create(&workers[idx].thread, NULL, host_dataset_main, &workers[idx])) {
+                fprintf(stderr, "Error: cannot start worker %u\n", idx);
+                exit(1);
+            }
+        }
+        host_dataset_main(&workers[0]);
+        for (idx = 1; idx < threads; idx++) {
+            pthread_join(workers[idx].thread, NULL);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        *eval_us += host_elapsed_us(&start, &end);
+
+        for (idx = 0; idx < num; idx++) {
+            class_total[labels[idx] % MNIST_CLASSES]++;
+            if (chunk->results[idx].class_idx != labels[idx]) {
+                class_wrong[labels[idx] % MNIST_CLASSES]++;
+                wrong++;
+            }
+        }
+        *run_mode = chunk->results[0].conv_mode;
+        printf("\timages %5u - %5u: %ld wrong so far\n", done, done + num - 1, wrong);
+    }
+
+    printf("\n---------------------------------------\n");
+    printf("Dataset: %u images, %u threads, %u images per call\n", set->image_num, threads, chunk->batch);
+    printf("\taccuracy   %.2f%% (%ld wrong)\n", 100.0 * (set->image_num - wrong) / set->image_num, wrong);
+    printf("\tper digit ");
+    for (idx = 0; idx < MNIST_CLASSES; idx++) {
+        printf(" %u:%.1f%%", idx, class_total[idx] ? 100.0 * (class_total[idx] - class_wrong[idx]) / class_total[idx] : 0.0);
+    }
+    printf("\n");
+    printf("\tthroughput %.0f images/s (%.1f ms evaluating, %.1f ms reading the files)\n",
+           (*eval_us > 0.0) ? set->image_num / (*eval_us / 1e6) : 0.0, *eval_us / 1e3, load_us / 1e3);
+
+    for (idx = 0; idx < threads; idx++) {
+        cold_us += (workers[idx].first_us > 0.0) ? workers[idx].first_us : 0.0;
+    }
+    qsort(latency_us, set->image_num, sizeof(double), host_cmp_double);
+    printf("\tlatency us per %s: p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+           (chunk->batch == 1) ? "image" : "call",
+           host_percentile(latency_us, set->image_num, 50.0), host_percentile(latency_us, set->image_num, 90.0),
+           host_percentile(latency_us, set->image_num, 99.0), host_percentile(latency_us, set->image_num, 99.9),
+           latency_us[set->image_num - 1]);
+    printf("\tfirst call per thread (cold caches) %.1f us on average\n", cold_us / threads);
+
+    return wrong;
+}
+
+/*
+ * Evaluate the whole set on threads threads (1 if 0), batch images per
+ * call. Returns the number of misclassified images, or < 0 on error;
+ * eval_us is the time spent evaluating, without reading the files.
+ */
+static long host_dataset_eval(host_dataset *set, unsigned int threads, unsigned int batch, unsigned int *run_mode, double *eval_us)
+{
+    host_dataset_chunk chunk;
+    double *latency_us;
+    long wrong = -1;
+
+    memset(&chunk, 0, sizeof(chunk));
+    chunk.batch = batch;
+    chunk.pixels = malloc(HOST_DATASET_CHUNK * TESTIMAGE_U8_SIZE);
+    chunk.results = malloc(HOST_DATASET_CHUNK * sizeof(cnn_result));
+    latency_us = malloc(set->image_num * sizeof(double));
+    *eval_us = 0.0;
+    if (!chunk.pixels || !chunk.results || !latency_us) {
+        fprintf(stderr, "Error: cannot allocate the dataset buffers\n");
+    }
+    else {
+        wrong = host_dataset_run(set, &chunk, latency_us, threads ? threads : 1, run_mode, eval_us);
+    }
+    free(chunk.pixels);
+    free(chunk.results);
+    free(latency_us);
+
+    return wrong;
+}
+#ifdef CNN_LOG
+#define HOST_LOG_PRODUCERS      4
+#define HOST_LOG_RECORDS        20000   // per producer
+
+static cnn_log host_log;
+static const char host_log_fmt[] = "cpu %llu record %llu\n";
+static unsigned int host_log_running;
+
+typedef struct {
+    unsigned long long next[CNN_LOG_MAX_CPUS];
+    unsigned int mismatch;
+    unsigned int records;
+} host_log_check;
+
+static void *host_log_producer(void *arg)
+{
+    unsigned int cpu = *(unsigned int*)arg;
+    unsigned int idx;
+
+    for (idx = 0; idx < HOST_LOG_RECORDS; idx++) {
+        // a full ring drops, so wait for the drainer to keep every record
+        while (!CNN_LOG2(&host_log, cpu, host_log_fmt, cpu, idx)) {
+            sched_yield();
+        }
+    }
+    __atomic_sub_fetch(&host_log_running, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+static void host_log_emit(void *ctx, unsigned int cpu, const cnn_log_record *rec)
+{
+    host_log_check *check = (host_log_check*)ctx;
+
+    if (rec->fmt != host_log_fmt && rec->args[0] == cpu) {
+        return;     // overflow notice, the producer retries those records
+    }
+    if (rec->fmt != host_log_fmt || rec->args[0] != cpu || rec->args[1] != check->next[cpu]) {
+        check->mismatch++;
+    }
+    check->next[cpu] = rec->args[1] + 1;
+    check->records++;
+}
+
+/*
+ * The log rings under real concurrency: producer threads log as fast as
+ * they can while this thread drains, and every record must come out
+ * once, in order per producer, with nothing dropped.
+ */
+static unsigned int host_log_selftest(void)
+{
+    pthread_t producers[HOST_LOG_PRODUCERS];
+    unsigned int cpus[HOST_LOG_PRODUCERS];
+    host_log_check check;
+    unsigned int idx, mismatch;
+
+    cnn_log_init(&host_log);
+    memset(&check, 0, sizeof(check));
+    host_log_running = HOST_LOG_PRODUCERS;
+    for (idx = 0; idx < HOST_LOG_PRODUCERS; idx++) {
+        cpus[idx] = idx;
+        if (pthread_create(&producers[idx], NULL, host_log_producer, &cpus[idx])) {
+            fprintf(stderr, "Error: cannot start log producer %u\n", idx);
+            exit(1);
+        }
+    }
+    while (__atomic_load_n(&host_log_running, __ATOMIC_ACQUIRE)) {
+        cnn_log_drain(&host_log, host_log_emit, &check);
+    }
+    for (idx = 0; idx < HOST_LOG_PRODUCERS; idx++) {
+        pthread_join(producers[idx], NULL);
+    }
+    cnn_log_drain(&host_log, host_log_emit, &check);
+
+    mismatch = check.mismatch + (check.records != HOST_LOG_PRODUCERS * HOST_LOG_RECORDS);
+    printf("    %-22s %s (%u/%u mismatches)\n", "cnn_log_drain (threads)",
+           mismatch ? "[Fail !!!]" : "[Pass]", mismatch, check.records);
+
+    return mismatch;
+}
+#endif
+
+// Kernel self-tests, shared with test_scalar_neon() on the target, then
+// the host-only threaded ones
+static unsigned int host_selftest(void)
+{
+    unsigned int mismatch = 0;
+
+#ifdef CNN_SELFTEST
+    mismatch += cnn_selftest();
+#endif
+#ifdef CNN_LOG
+    mismatch += host_log_selftest();
+#endif
+
+    return mismatch;
+}
+
+/*
+ * Largest score difference against the reference mode, relative to the
+ * largest reference score. Returns 1 if the predicted class differs.
+ */
+static unsigned int host_compare_scores(float *ref, float *out, float *rel_err)
+{
+    unsigned int idx, ref_max = 0, out_max = 0;
+    float amax = 0.0f, diff = 0.0f;
+
+    for (idx = 0; idx < MNIST_CLASSES; idx++) {
+        if (ref[idx] > ref[ref_max]) ref_max = idx;
+        if (out[idx] > out[out_max]) out_max = idx;
+        if (fabsf(ref[idx]) > amax) amax = fabsf(ref[idx]);
+        if (fabsf(ref[idx] - out[idx]) > diff) diff = fabsf(ref[idx] - out[idx]);
+    }
+    *rel_err = (amax > 0.0f) ? diff / amax : diff;
+
+    return ref_max != out_max;
+}
+
+#ifdef CNN_PROF
+static cnn_prof host_prof;
+#endif
+
+/*
+ * Write the benchmark records for host/bench_compare: the time per
+ * image, plus the per-layer profile with -P. A .json file gets one
+ * object per line, anything else CSV.
+ */
+static int host_write_records(const char *path, unsigned int conv_mode, unsigned long long runs, double us_per_image, unsigned int profile)
+{
+    const char *ext = strrchr(path, '.');
+    unsigned int format = (ext && !strcmp(ext, ".json")) ? CNN_PROF_JSON : CNN_PROF_CSV;
+    FILE *fp;
+
+    fp = fopen(path, "w");
+    if (!fp) {
+        fprintf(stderr, "Error: cannot create %s\n", path);
+        return -1;
+    }
+    cnn_prof_write_header(fp, format);
+    cnn_prof_write_record(fp, format, conv_mode, 0, "inference", 0, runs, "ns", us_per_image * 1e3, 0);
+#ifdef CNN_PROF
+    if (profile) {
+        cnn_prof_write(&host_prof, fp, format, conv_mode, 0);
+    }
+#else
+    (void)profile;
+#endif
+    fclose(fp);
+
+    return 0;
+}
+
+#ifdef CNN_TRACE
+static int host_write_trace(const char *path)
+{
+    unsigned int dropped;
+    FILE *fp;
+
+    fp = fopen(path, "w");
+    if (!fp) {
+        fprintf(stderr, "Error: cannot create %s\n", path);
+        return -1;
+    }
+    dropped = cnn_trace_write(&host_trace, fp);
+    fclose(fp);
+    printf("Trace: %s", path);
+    if (dropped) {
+        printf(" (%u events dropped, a buffer holds %u per thread)", dropped, CNN_TRACE_EVENTS);
+    }
+    printf("\n");
+
+    return 0;
+}
+#endif
+
+static void usage(const char *app)
+{
+    printf("usage: %s [-p params.bin] [-q int8.bin] [-g graph.bin] [-M model.bin] [-i images.bin] [-f 32|8] [-l labels] [-D images.idx -L labels.idx] [-m conv_mode] [-c ref_mode] [-r repeat] [-b batch] [-j threads] [-s threads] [-u] [-P] [-o records] [-T trace.json] [-t]\n", app);
+    printf("  -p   parameter blob (default %s)\n", DEFAULT_PARAMETER_FILE);
+    printf("  -q   INT8 parameter blob for conv mode #5 (default %s)\n", DEFAULT_INT8_FILE);
+    printf("  -g   network description run by mnist_cnn_eval() (default %s)\n", DEFAULT_GRAPH_FILE);
+    printf("  -M   model container (mnist/mnist_cnn_model.py), mapped in place of -p, -q and -g\n");
+    printf("  -i   test image slots, 0x%x bytes each (default %s)\n", TESTIMAGE_SLOT_SIZE, DEFAULT_IMAGE_FILE);
+    printf("  -f   image pixel format: 32 (one word per pixel, in slots, default) or 8 (packed bytes)\n");
+    printf("  -l   expected digit per image (default %s)\n", DEFAULT_IMAGE_LABELS);
+    printf("  -D   MNIST IDX test set (t10k-images-idx3-ubyte) streamed %u images at a time, in place of -i\n", HOST_DATASET_CHUNK);
+    printf("  -L   its IDX labels (t10k-labels-idx1-ubyte); reports accuracy, images/s and latency percentiles\n");
+    printf("  -m   conv mode written to CONVMODE (default 0 -> mode #2)\n");
+#ifdef CNN_AOT
+    printf("       #%u runs the model compiled into this build (make AOT=1)\n", MNIST_AOT_CONV_MODE);
+#endif
+    printf("  -c   also run ref_mode and compare the class scores\n");
+    printf("  -r   inferences per image, for profiling (default 1)\n");
+    printf("  -b   images per mnist_cnn_eval_batch() call (default 1, mnist_cnn_eval())\n");
+    printf("  -j   run all images on the work-stealing scheduler with 1 - %u threads (-D: one image per thread)\n", CNN_SCHED_MAX_CPUS);
+    printf("  -s   split each image's layers across 1 - %u threads (mnist_cnn_eval_team())\n", CNN_SCHED_MAX_CPUS);
+    printf("  -u   leave the weights unpacked (no mnist_cnn_load(), modes #7 and #8 run mode #1)\n");
+    printf("  -P   per-layer counters of mnist_cnn_eval(), events rotate across the -r runs\n");
+    printf("  -o   write the time per image (and -P layers) as records, JSON for *.json, else CSV\n");
+    printf("  -T   per-thread image, layer and task spans as Chrome trace JSON (chrome://tracing, Perfetto)\n");
+    printf("  -t   run the kernel and log ring self-tests and exit\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *param_file = DEFAULT_PARAMETER_FILE;
+    const char *int8_file = DEFAULT_INT8_FILE;
+    const char *graph_file = DEFAULT_GRAPH_FILE;
+    const char *model_file = 0;
+#ifdef CNN_MODEL
+    const void *model_blob = 0;
+    long model_size = 0;
+    int err;
+#endif
+    const cnn_graph *graph;
+    const char *image_file = DEFAULT_IMAGE_FILE;
+    const char *labels = DEFAULT_IMAGE_LABELS;
+    const char *dataset_file = 0;
+    const char *dataset_labels = 0;
+    host_dataset dataset;
+    long wrong;
+    unsigned int conv_mode = 0;
+    int ref_mode = -1;
+    float ref_scores[MNIST_BATCH_MAX][MNIST_CLASSES];
+    float *scores;
+    float rel_err, rel_err_max = 0.0f;
+    unsigned int class_mismatch = 0;
+    unsigned int repeat = 1;
+    unsigned int image_num;
+    unsigned int image_idx;
+    unsigned int image_result;
+    cnn_result ref_result;
+    unsigned int batch = 1;
+    unsigned int threads = 0;
+    unsigned int team_threads = 0;
+#ifdef CNN_SCHED
+    host_worker helpers[CNN_SCHED_MAX_CPUS];
+#endif
+    unsigned int batch_num, batch_idx;
+    unsigned int *batch_images[MNIST_BATCH_MAX];
+    cnn_result batch_results[MNIST_BATCH_MAX];
+    unsigned int fail_count = 0;
+    unsigned int rep;
+    long len;
+    double elapsed_us, total_us = 0.0;
+    struct timespec start, end;
+    cnn_graph_plan plan;
+    unsigned int pack_weights = 1;
+    unsigned int image_bits = 32;
+    unsigned int profile = 0;
+    const char *record_file = 0;
+    const char *trace_file = 0;
+    unsigned int run_mode = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:q:g:M:i:f:l:D:L:m:c:r:b:j:s:uPo:T:th")) != -1) {
+        switch (opt) {
+        case 'p': param_file = optarg; break;
+        case 'q': int8_file = optarg; break;
+        case 'g': graph_file = optarg; break;
+        case 'M': model_file = optarg; break;
+        case 'c': ref_mode = strtol(optarg, NULL, 0); break;
+        case 'i': image_file = optarg; break;
+        case 'f': image_bits = strtoul(optarg, NULL, 0); break;
+        case 'l': labels = optarg; break;
+        case 'D': dataset_file = optarg; break;
+        case 'L': dataset_labels = optarg; break;
+        case 'm': conv_mode = strtoul(optarg, NULL, 0); break;
+        case 'r': repeat = strtoul(optarg, NULL, 0); break;
+        case 'b': batch = strtoul(optarg, NULL, 0); break;
+        case 'j': threads = strtoul(optarg, NULL, 0); break;
+        case 's': team_threads = strtoul(optarg, NULL, 0); break;
+        case 'u': pack_weights = 0; break;
+        case 'P': profile = 1; break;
+        case 'o': record_file = optarg; break;
+        case 'T': trace_file = optarg; break;
+        case 't': return host_selftest() ? 1 : 0;
+        default:
+            usage(argv[0]);
+            return (opt == 'h') ? 0 : 2;
+        }
+    }
+    if (repeat == 0) {
+        repeat = 1;
+    }
+    if (batch == 0 || batch > MNIST_BATCH_MAX) {
+        fprintf(stderr, "Error: batch must be 1 - %u\n", MNIST_BATCH_MAX);
+        return 2;
+    }
+    if (threads > CNN_SCHED_MAX_CPUS || team_threads > CNN_SCHED_MAX_CPUS) {
+        fprintf(stderr, "Error: threads must be 1 - %u\n", CNN_SCHED_MAX_CPUS);
+        return 2;
+    }
+    if (image_bits != 32 && image_bits != 8) {
+        fprintf(stderr, "Error: image format must be 32 or 8\n");
+        return 2;
+    }
+    if (dataset_file && (!dataset_labels || team_threads || ref_mode >= 0)) {
+        fprintf(stderr, "Error: -D needs its -L labels, and runs without -s and -c\n");
+        return 2;
+    }
+    if (team_threads && batch > 1) {
+        fprintf(stderr, "Error: -s evaluates one image at a time, drop -b\n");
+        return 2;
+    }
+#ifdef CNN_PROF
+    if (profile && (batch > 1 || threads || team_threads)) {
+        fprintf(stderr, "Error: -P profiles mnist_cnn_eval(), drop -b, -j and -s\n");
+        return 2;
+    }
+    if (profile) {
+        cnn_prof_init(&host_prof);
+    }
+#else
+    if (profile) {
+        fprintf(stderr, "Error: -P needs CNN_PROF\n");
+        return 2;
+    }
+#endif
+#ifdef CNN_TRACE
+    if (trace_file) {
+        cnn_trace_init(&host_trace);
+        host_tracing = 1;
+    }
+#else
+    if (trace_file) {
+        fprintf(stderr, "Error: -T needs CNN_TRACE\n");
+        return 2;
+    }
+#endif
+#ifndef CNN_MODEL
+    if (model_file) {
+        fprintf(stderr, "Error: -M needs CNN_MODEL\n");
+        return 2;
+    }
+#endif
+
+    if (host_arena_init()) {
+        fprintf(stderr, "Error: cannot allocate the DDR window\n");
+        return 1;
+    }
+
+#ifdef CNN_MODEL
+    if (model_file) {
+        model_size = host_map_model(model_file, &model_blob);
+        if (model_size < 0) {
+            return 1;
+        }
+        err = mnist_cnn_model(model_blob, model_size);
+        if (err) {
+            fprintf(stderr, "Error: %s: %s (run mnist/mnist_cnn_model.py)\n", model_file, cnn_model_error(err));
+            return 1;
+        }
+        printf("Model: %s (%ld bytes, %u tensors, mapped)\n", model_file, model_size, ((const cnn_model_header*)model_blob)->tensor_num);
+        graph = mnist_cnn_network();
+        graph_file = model_file;
+    }
+    else
+#endif
+    {
+        len = host_load_file(param_file, MNIST_EVAL_BASE + MNIST_PARAMETER_BASE, PARAMETER_MAX_SIZE);
+        if (len < 0) {
+            return 1;
+        }
+        printf("Parameters: %s (%ld bytes)\n", param_file, len);
+
+        if (conv_mode == 5 || ref_mode == 5) {
+            len = host_load_file(int8_file, MNIST_EVAL_BASE + MNIST_PARAMETER_INT8_BASE, MNIST_PARAMETER_INT8_SIZE);
+            if (len != MNIST_PARAMETER_INT8_SIZE) {
+                fprintf(stderr, "Error: %s is not an INT8 parameter blob (run mnist/mnist_cnn_quantize.py)\n", int8_file);
+                return 1;
+            }
+            printf("INT8 parameters: %s (%ld bytes)\n", int8_file, len);
+        }
+
+        len = host_load_file(graph_file, MNIST_EVAL_BASE + MNIST_GRAPH_BASE, MNIST_GRAPH_SIZE);
+        if (len < 0) {
+            return 1;
+        }
+        graph = (const cnn_graph*)(MNIST_EVAL_BASE + MNIST_GRAPH_BASE);
+    }
+    if (cnn_graph_plan_memory(graph, &plan, conv_mode ? conv_mode : 2)) {
+        fprintf(stderr, "Error: %s is not a usable network description (run mnist/mnist_cnn_graph.py)\n", graph_file);
+        return 1;
+    }
+    printf("Graph: %s (%u layers)\n", graph_file, graph->layer_num);
+    if (pack_weights) {
+        if (mnist_cnn_load()) {
+            fprintf(stderr, "Error: cannot pack the FC weights of %s\n", graph_file);
+            return 1;
+        }
+        printf("Packed weights: %lu bytes (FC panels, Winograd conv, fp16)\n", plan.packed_size);
+    }
+    else if (mnist_cnn_plan()) {
+        fprintf(stderr, "Error: cannot plan the workspace of %s\n", graph_file);
+        return 1;
+    }
+
+    memset(&dataset, 0, sizeof(dataset));
+    if (dataset_file) {
+        if (host_dataset_open(&dataset, dataset_file, dataset_labels)) {
+            host_dataset_close(&dataset);
+            return 1;
+        }
+        image_num = dataset.image_num;
+        image_bits = 8;
+        printf("Dataset: %s (%u images, streamed %u at a time)\n", dataset_file, image_num, HOST_DATASET_CHUNK);
+    }
+    else if (image_bits == 8) {
+        len = host_load_images_u8(image_file);
+        if (len < 0) {
+            return 1;
+        }
+        image_num = len;
+    }
+    else {
+        len = host_load_file(image_file, TEST_IMAGE_X(0), TESTIMAGE_MAX_NUM * TESTIMAGE_SLOT_SIZE);
+        if (len < 0) {
+            return 1;
+        }
+        image_num = (len + TESTIMAGE_SLOT_SIZE - 1) / TESTIMAGE_SLOT_SIZE;
+    }
+    if (!dataset_file) {
+        printf("Images: %s (%u images, %u-bit pixels)\n", image_file, image_num, image_bits);
+    }
+
+    // Host config, as set by the DS-5 launch scripts on the FVP
+    *AUTOTESTIMG = 0;
+    *CNNSELECTING = 0;
+    *CONVMODE = conv_mode;
+    *IMAGEFORMAT = (image_bits == 8) ? CNN_PIXEL_U8 : CNN_PIXEL_U32;
+    if (!mnist_cnn_workspace_size()) {
+        fprintf(stderr, "Error: %s does not fit a workspace\n", graph_file);
+        return 1;
+    }
+    printf("Activations: %lu bytes planned (%lu one buffer per tensor), %u workspaces of 0x%lx bytes\n",
+           plan.peak, plan.total, (unsigned int)(MNIST_WORKSPACE_SIZE / mnist_cnn_workspace_size()), mnist_cnn_workspace_size());
+    if (dataset_file && (threads ? threads : 1) > MNIST_WORKSPACE_SIZE / mnist_cnn_workspace_size()) {
+        fprintf(stderr, "Error: -D runs at most %lu threads, one per workspace\n", MNIST_WORKSPACE_SIZE / mnist_cnn_workspace_size());
+        return 2;
+    }
+    for (image_idx = 0; !dataset_file && image_idx < image_num; image_idx++) {
+        *TEST_IMAGE_RES(image_idx) = (image_idx < strlen(labels)) ? labels[image_idx] - '0' : 0xFF;
+    }
+
+#ifdef CNN_SCHED
+    if (team_threads) {
+        host_team_start(helpers, team_threads);
+    }
+#endif
+    if (dataset_file) {
+#ifdef CNN_PROF
+        mnist_cnn_profile(profile ? &host_prof : 0);
+#endif
+#ifdef CNN_TRACE
+        mnist_cnn_trace(trace_file ? &host_trace : 0);
+#endif
+        wrong = host_dataset_eval(&dataset, threads, batch, &run_mode, &total_us);
+#ifdef CNN_PROF
+        mnist_cnn_profile(0);
+#endif
+#ifdef CNN_TRACE
+        mnist_cnn_trace(0);
+#endif
+        host_dataset_close(&dataset);
+        if (wrong < 0) {
+            return 1;
+        }
+        fail_count = wrong;
+        repeat = 1;
+    }
+    else
+#ifdef CNN_SCHED
+    if (threads) {
+        cnn_result results[TESTIMAGE_MAX_NUM];
+
+#ifdef CNN_TRACE
+        mnist_cnn_trace(trace_file ? &host_trace : 0);
+#endif
+        for (rep = 0; rep < repeat; rep++) {
+            total_us += host_sched_eval(image_num, threads, results);
+        }
+#ifdef CNN_TRACE
+        mnist_cnn_trace(0);
+#endif
+        total_us /= repeat;
+        printf("\n---------------------------------------\n");
+        printf("Scheduler, %u threads\n", threads);
+        for (rep = 0; rep < threads; rep++) {
+            printf("\tworker %u: %u tasks, %u stolen\n", rep, host_sched.executed[rep], host_sched.stolen[rep]);
+        }
+        for (image_idx = 0; image_idx < image_num; image_idx++) {
+            image_result = *TEST_IMAGE_RES(image_idx);
+            post_proc_report(&results[image_idx]);
+            run_mode = results[image_idx].conv_mode;
+            printf("\timage[%d], result: %d, \t\t", image_result, results[image_idx].class_idx);
+            if (image_result != results[image_idx].class_idx) {
+                printf("[Fail !!!]\n");
+                fail_count++;
+            }
+            else {
+                printf("[Pass]\n");
+            }
+        }
+    }
+    else
+#endif
+    for (image_idx = 0; image_idx < image_num; image_idx += batch_num) {
+        batch_num = (image_num - image_idx < batch) ? (image_num - image_idx) : batch;
+        for (batch_idx = 0; batch_idx < batch_num; batch_idx++) {
+            batch_images[batch_idx] = (unsigned int*)TEST_IMAGE_X(image_idx + batch_idx);
+        }
+        printf("\n---------------------------------------\n");
+        printf("Inf images %u - %u of %u\n", image_idx, image_idx + batch_num - 1, image_num);
+
+        if (ref_mode >= 0) {
+            *CONVMODE = ref_mode;
+            for (batch_idx = 0; batch_idx < batch_num; batch_idx++) {
+                mnist_cnn_eval(batch_images[batch_idx], 0, &ref_result);
+                memcpy(ref_scores[batch_idx], mnist_cnn_eval_scores(0), sizeof(ref_scores[0]));
+            }
+            *CONVMODE = conv_mode;
+        }
+
+#ifdef CNN_PROF
+        mnist_cnn_profile(profile ? &host_prof : 0);
+#endif
+#ifdef CNN_TRACE
+        mnist_cnn_trace(trace_file ? &host_trace : 0);
+#endif
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (rep = 0; rep < repeat; rep++) {
+#ifdef CNN_SCHED
+            if (team_threads) {
+                mnist_cnn_eval_team(batch_images[0], &host_team, 0, &batch_results[0]);
+            }
+            else
+#endif
+            if (batch == 1) {
+                mnist_cnn_eval(batch_images[0], 0, &batch_results[0]);
+            }
+            else {
+                mnist_cnn_eval_batch(batch_images, batch_num, 0, batch_results);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+#ifdef CNN_PROF
+        mnist_cnn_profile(0);
+#endif
+#ifdef CNN_TRACE
+        mnist_cnn_trace(0);
+#endif
+        elapsed_us = host_elapsed_us(&start, &end) / repeat / batch_num;
+        total_us += elapsed_us * batch_num;
+
+        for (batch_idx = 0; batch_idx < batch_num; batch_idx++) {
+            image_result = *TEST_IMAGE_RES(image_idx + batch_idx);
+            post_proc_report(&batch_results[batch_idx]);
+            run_mode = batch_results[batch_idx].conv_mode;
+            printf("\timage[%d], result: %d, \t\t", image_result, batch_results[batch_idx].class_idx);
+            if (image_result != batch_results[batch_idx].class_idx) {
+                printf("[Fail !!!]\n");
+                fail_count++;
+            }
+            else {
+                printf("[Pass]\n");
+            }
+
+            if (ref_mode >= 0) {
+                if (team_threads || batch == 1) {
+                    scores = mnist_cnn_eval_scores(0);
+                }
+                else {
+                    scores = mnist_cnn_eval_batch_scores(0) + (batch_idx * MNIST_CLASSES);
+                }
+                class_mismatch += host_compare_scores(ref_scores[batch_idx], scores, &rel_err);
+                if (rel_err > rel_err_max) {
+                    rel_err_max = rel_err;
+                }
+                printf("\t\tScores vs mode #%d: max rel error %.5f\n", ref_mode, rel_err);
+            }
+        }
+        printf("\t\tTime per inference is %.1f us\n", elapsed_us);
+    }
+
+#ifdef CNN_SCHED
+    if (team_threads) {
+        printf("\n---------------------------------------\n");
+        printf("Layers split across %u threads\n", team_threads);
+        host_team_stop(helpers, team_threads);
+    }
+#endif
+#ifdef CNN_TRACE
+    if (trace_file && host_write_trace(trace_file)) {
+        return 1;
+    }
+#endif
+
+#ifdef CNN_PROF
+    if (profile) {
+        printf("\n---------------------------------------\n");
+        cnn_prof_report(&host_prof);
+    }
+#endif
+    if (record_file && image_num &&
+        host_write_records(record_file, run_mode, (unsigned long long)repeat * image_num, total_us / image_num, profile)) {
+        return 1;
+    }
+#ifdef CNN_PROF
+    if (profile) {
+        cnn_prof_close(&host_prof);
+    }
+#endif
+
+    printf("\n\nEnd of MNIST CNN Evaluation: %u/%u passed, avg %.1f us per image\n",
+           image_num - fail_count, image_num, image_num ? total_us / image_num : 0.0);
+
+    if (ref_mode >= 0) {
+        printf("Mode #%u vs mode #%d: %u/%u classes differ, max rel error %.5f\n",
+               conv_mode, ref_mode, class_mismatch, image_num, rel_err_max);
+    }
+
+    free(host_arena);
+#ifdef CNN_MODEL
+    if (model_blob) {
+        munmap((void*)model_blob, model_size);
+    }
+#endif
+
+    return fail_count ? 1 : 0;
+}
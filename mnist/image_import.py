@@ -4,6 +4,9 @@
 from arm_ds.debugger_v1 import Debugger
 from arm_ds.debugger_v1 import DebugException
 from javax.imageio import ImageIO
+import os
+import struct
+import tempfile
 
 
 def parseDScmdRetStr(retval):
@@ -28,26 +31,28 @@ def loadImage(filepath):
     
     return image
 
-def storeImage(ec, store_adr, image, result):
+def restoreBlob(ec, adr, blob):
+    # one bulk "restore" of a temporary file instead of a debugger command
+    # per pixel
+    fd, path = tempfile.mkstemp(suffix='.bin')
+    os.write(fd, blob)
+    os.close(fd)
+    dscmd = 'restore "%s" binary S:0x%08x' % (path.replace('\\', '/'), adr)
+    ec.executeDSCommand(dscmd)
+    os.remove(path)
 
-    adr = store_adr
+def storeImage(ec, store_adr, image, result):
 
-    # grayscale color image
-    start_adr = adr
+    # grayscale color image, then the result at end of area (0xFFC)
+    pixels = []
     for x in range(0, image.getWidth()):
         for y in range(0, image.getHeight()):
-            pixel = image.getRGB(y, x) & 0xFF   # grayscale and transform to [row][col]
-            dscmd = 'memory set_typed S:0x%08x (unsigned int) %d' % (adr, pixel)
-            ec.executeDSCommand(dscmd)
-            adr += 0x4
+            pixels.append(image.getRGB(y, x) & 0xFF)   # grayscale and transform to [row][col]
+    slot = struct.pack('<%dI' % len(pixels), *pixels)
+    slot += '\0' * (0xFFC - len(slot)) + struct.pack('<I', result & 0xFF)
+    restoreBlob(ec, store_adr, slot)
 
-    print ' image  S:0x%08x - S:0x%08x' % (start_adr, adr)
-
-    # Set the result at end of area (0x17FFF)
-    adr = start_adr + 0xFFC
-    pixel = result & 0xFF
-    dscmd = 'memory set_typed S:0x%08x (unsigned int) %d' % (adr, pixel)
-    ec.executeDSCommand(dscmd)
+    print ' image  S:0x%08x - S:0x%08x' % (store_adr, store_adr + len(pixels) * 4)
 
     # Force "selected" test mode
 #    adr = 0x801FFFFC
@@ -0,0 +1,337 @@
+#
+# Copyright (C) 2017 ARM Limited. All rights reserved.
+#
+# Ahead-of-time model compiler
+#
+# Writes the network of mnist_cnn_graph.py with its trained weights as
+# one C translation unit (interface in src/mnist_aot.h) for conv mode #9.
+# The interpreted kernels read every loop bound from a layer_structure;
+# here each layer is its own function with the shapes as constants:
+#
+#   conv     the filter window unrolled into one call per tap, each tap a
+#            constant [C] x [C][N] product into N accumulators
+#   maxpool  the pooling window unrolled, channels innermost
+#   fc       [K] x [K][N] with constant K and N
+#
+# Weights and biases become 64-byte aligned static const arrays in the
+# Keras layouts (HWIO conv, IO FC), with the 1/255 of pre-proc folded
+# into the first conv layer's weights as mnist_cnn_load() does it.
+# Every output sums its products in the order the mode #1 kernels do,
+# bias last. Activations ping-pong between two halves of the workspace.
+#
+# The model is the fp32 parameter blob (mnist_cnn_parameter.bin layout),
+# the Keras .h5 or the per-layer JSON dumps (see mnist_cnn_convert.py).
+#
+# usage: python mnist_cnn_compile.py [-o mnist_aot.c] [model.bin | model.h5 | layer0.json ...]
+#
+from __future__ import print_function
+import argparse
+import struct
+import zlib
+
+import mnist_cnn_graph as graph
+import mnist_cnn_convert as convert
+
+ALIGN = 'AOT_ALIGN'
+VALUES_PER_LINE = 8
+
+
+def c_name(name):
+    """keras_lay[0] -> aot_keras_lay_0"""
+    return 'aot_' + name.replace('[', '_').replace(']', '').replace('.', '_')
+
+
+def c_float(value):
+    text = '%.9g' % value
+    if '.' not in text and 'e' not in text:
+        text += '.0'
+    return text + 'f'
+
+
+def to_f32(value):
+    return struct.unpack('<f', struct.pack('<f', value))[0]
+
+
+def read_floats(blob, offset, count):
+    return list(struct.unpack_from('<%df' % count, blob, offset))
+
+
+def dims(shape):
+    return ''.join('[%d]' % d for d in shape)
+
+
+def emit_values(out, shape, values, depth):
+    """values of a [shape] array, one brace level per dimension"""
+    indent = '    ' * depth
+    if len(shape) == 1:
+        for start in range(0, len(values), VALUES_PER_LINE):
+            out.append(indent + ', '.join(c_float(v) for v in values[start:start + VALUES_PER_LINE]) + ',')
+        return
+    step = len(values) // shape[0]
+    for i in range(shape[0]):
+        out.append(indent + '{')
+        emit_values(out, shape[1:], values[i * step:(i + 1) * step], depth + 1)
+        out.append(indent + '},')
+
+
+def emit_array(out, name, shape, values):
+    out.append('static const float %s%s %s = {' % (name, dims(shape), ALIGN))
+    emit_values(out, shape, values, 1)
+    out.append('};')
+    out.append('')
+
+
+def tensor_shape(layer):
+    """HWC shape of the tensor a layer writes, flat for FC"""
+    name, kind, relu, inp, flt, outp, fp32, int8 = layer
+    if kind == graph.LAYER_FC:
+        return (outp[0],)
+    return (outp[1], outp[2], outp[0])
+
+
+def emit_conv(out, layer, prev_shape, blob, input_scale):
+    name, kind, relu, inp, flt, outp, fp32, int8 = layer
+    fn = c_name(name)
+    C, N = inp[0], outp[0]
+    K = flt[0] * flt[1] * C
+    weights = read_floats(blob, fp32[0], K * N)
+    if input_scale:
+        weights = [to_f32(to_f32(w) / 255.0) for w in weights]
+    biases = read_floats(blob, fp32[1], N)
+
+    out.append('// %s: %dx%d conv, %s -> %s%s' % (name, flt[0], flt[1], dims(prev_shape), dims(tensor_shape(layer)),
+                                                ', ReLU' if relu else ''))
+    if input_scale:
+        out.append('// (weights / 255: the input is the raw pixels)')
+    emit_array(out, fn + '_weights', (flt[0], flt[1], C, N), weights)
+    emit_array(out, fn + '_biases', (N,), biases)
+
+    out.append('static inline void %s_tap(float acc[%d], const float in[%d], const float w[%d][%d])' % (fn, N, C, C, N))
+    out.append('{')
+    out.append('    unsigned int i, o;')
+    out.append('')
+    out.append('    for (i = 0; i < %d; i++) {' % C)
+    out.append('        for (o = 0; o < %d; o++) {' % N)
+    out.append('            acc[o] += in[i] * w[i][o];')
+    out.append('        }')
+    out.append('    }')
+    out.append('}')
+    out.append('')
+    out.append('static void %s(float in%s, float out%s)' % (fn, dims(prev_shape), dims(tensor_shape(layer))))
+    out.append('{')
+    out.append('    float acc[%d];' % N)
+    out.append('    unsigned int r, c, o;')
+    out.append('')
+    out.append('    for (r = 0; r < %d; r++) {' % outp[1])
+    out.append('        for (c = 0; c < %d; c++) {' % outp[2])
+    out.append('            for (o = 0; o < %d; o++) {' % N)
+    out.append('                acc[o] = 0.0f;')
+    out.append('            }')
+    for fr in range(flt[0]):
+        for fc in range(flt[1]):
+            out.append('            %s_tap(acc, in[r + %d][c + %d], %s_weights[%d][%d]);' % (fn, fr, fc, fn, fr, fc))
+    out.append('            for (o = 0; o < %d; o++) {' % N)
+    out.append('                acc[o] += %s_biases[o];' % fn)
+    if relu:
+        out.append('                out[r][c][o] = (acc[o] < 0.0f) ? 0.0f : acc[o];')
+    else:
+        out.append('                out[r][c][o] = acc[o];')
+    out.append('            }')
+    out.append('        }')
+    out.append('    }')
+    out.append('}')
+    out.append('')
+    return flt[0] * flt[1] * C * N * outp[1] * outp[2]
+
+
+def emit_maxpool(out, layer, prev_shape):
+    name, kind, relu, inp, flt, outp, fp32, int8 = layer
+    fn = c_name(name)
+    out.append('// %s: %dx%d max-pool, %s -> %s' % (name, flt[0], flt[1], dims(prev_shape), dims(tensor_shape(layer))))
+    out.append('static void %s(float in%s, float out%s)' % (fn, dims(prev_shape), dims(tensor_shape(layer))))
+    out.append('{')
+    out.append('    float m, v;')
+    out.append('    unsigned int r, c, ch;')
+    out.append('')
+    out.append('    for (r = 0; r < %d; r++) {' % outp[1])
+    out.append('        for (c = 0; c < %d; c++) {' % outp[2])
+    out.append('            for (ch = 0; ch < %d; ch++) {' % outp[0])
+    for fr in range(flt[0]):
+        for fc in range(flt[1]):
+            tap = 'in[%d * r + %d][%d * c + %d][ch]' % (flt[0], fr, flt[1], fc)
+            if fr == 0 and fc == 0:
+                out.append('                m = %s;' % tap)
+            else:
+                out.append('                v = %s;' % tap)
+                out.append('                m = (m < v) ? v : m;')
+    out.append('                out[r][c][ch] = m;')
+    out.append('            }')
+    out.append('        }')
+    out.append('    }')
+    out.append('}')
+    out.append('')
+    return 0
+
+
+def emit_fc(out, layer, prev_shape, blob):
+    name, kind, relu, inp, flt, outp, fp32, int8 = layer
+    fn = c_name(name)
+    K, N = inp[0], outp[0]
+    out.append('// %s: fully connected, [%d] -> [%d]%s' % (name, K, N, ', ReLU' if relu else ''))
+    emit_array(out, fn + '_weights', (K, N), read_floats(blob, fp32[0], K * N))
+    emit_array(out, fn + '_biases', (N,), read_floats(blob, fp32[1], N))
+    out.append('static void %s(float in[%d], float out[%d])' % (fn, K, N))
+    out.append('{')
+    out.append('    float acc[%d];' % N)
+    out.append('    unsigned int i, o;')
+    out.append('')
+    out.append('    for (o = 0; o < %d; o++) {' % N)
+    out.append('        acc[o] = 0.0f;')
+    out.append('    }')
+    out.append('    for (i = 0; i < %d; i++) {' % K)
+    out.append('        for (o = 0; o < %d; o++) {' % N)
+    out.append('            acc[o] += in[i] * %s_weights[i][o];' % fn)
+    out.append('        }')
+    out.append('    }')
+    out.append('    for (o = 0; o < %d; o++) {' % N)
+    out.append('        acc[o] += %s_biases[o];' % fn)
+    if relu:
+        out.append('        out[o] = (acc[o] < 0.0f) ? 0.0f : acc[o];')
+    else:
+        out.append('        out[o] = acc[o];')
+    out.append('    }')
+    out.append('}')
+    out.append('')
+    return K * N
+
+
+def volume(shape):
+    count = 1
+    for d in shape:
+        count *= d
+    return count
+
+
+def compile_model(layers, blob, source):
+    assert layers[0][1] == graph.LAYER_INPUT and layers[1][1] == graph.LAYER_CONV
+    input_shape = tensor_shape(layers[0])
+    classes = layers[-1][5][0]
+
+    # tensor i (written by layer i) goes to region i % 2 of the workspace,
+    # the last layer writes the caller's outputs
+    region = [0, 0]
+    for i, layer in enumerate(layers[:-1]):
+        region[i % 2] = max(region[i % 2], volume(tensor_shape(layer)))
+    buffers = ['workspace', 'workspace + AOT_REGION_A']
+
+    out = []
+    out.append('/*')
+    out.append('==================================================================')
+    out.append(' Copyright ARM Ltd 2017. All rights reserved.')
+    out.append('')
+    out.append(' Simple CNN Application for Inference only')
+    out.append(' Generated by mnist/mnist_cnn_compile.py from %s' % source)
+    out.append(' (fp32 parameters CRC-32 0x%08x), do not edit' % (zlib.crc32(blob) & 0xFFFFFFFF))
+    out.append('==================================================================')
+    out.append('*/')
+    out.append('#include "arm_cnn_inference.h"')
+    out.append('#include "mnist.h"')
+    out.append('#include "cnn_api_c.h"')
+    out.append('#include "mnist_aot.h"')
+    out.append('')
+    out.append('#ifdef CNN_AOT')
+    out.append('#define AOT_ALIGN   __attribute__ ((aligned (64)))')
+    out.append('')
+    out.append('#define AOT_REGION_A    %d    // floats, the even layers\' outputs' % region[0])
+    out.append('#define AOT_REGION_B    %d    // floats, the odd layers\' outputs' % region[1])
+    out.append('')
+
+    macs = 0
+    prev_shape = input_shape
+    calls = []
+    for i, layer in enumerate(layers[1:], 1):
+        name, kind = layer[0], layer[1]
+        if kind == graph.LAYER_CONV:
+            macs += emit_conv(out, layer, prev_shape, blob, i == 1)
+        elif kind == graph.LAYER_MAXPOOL:
+            macs += emit_maxpool(out, layer, prev_shape)
+        elif kind == graph.LAYER_FC:
+            macs += emit_fc(out, layer, prev_shape, blob)
+        else:
+            raise ValueError('%s: layer type %d' % (name, kind))
+        dst = 'outputs' if i == len(layers) - 1 else buffers[i % 2]
+        in_shape = (layer[3][0],) if kind == graph.LAYER_FC else prev_shape
+        calls.append((c_name(name), in_shape, tensor_shape(layer), buffers[(i - 1) % 2], dst))
+        prev_shape = tensor_shape(layer)
+
+    rows, columns, channels = input_shape
+    out.append('unsigned long mnist_aot_workspace_size(void)')
+    out.append('{')
+    out.append('    return (AOT_REGION_A + AOT_REGION_B) * sizeof(float);')
+    out.append('}')
+    out.append('')
+    out.append('unsigned int mnist_aot_classes(void)')
+    out.append('{')
+    out.append('    return %d;' % classes)
+    out.append('}')
+    out.append('')
+    out.append('unsigned long long mnist_aot_macs(void)')
+    out.append('{')
+    out.append('    return %dULL;' % macs)
+    out.append('}')
+    out.append('')
+    out.append('void mnist_aot_eval(')
+    out.append('    const unsigned int *test_images,')
+    out.append('    unsigned int image_format,')
+    out.append('    float *workspace,')
+    out.append('    float *outputs')
+    out.append(') {')
+    out.append('    unsigned int i;')
+    out.append('')
+    out.append('    // raw pixels, the 1/255 is in %s_weights' % calls[0][0])
+    out.append('    if (image_format == CNN_PIXEL_U8) {')
+    out.append('        for (i = 0; i < %d; i++) {' % (rows * columns * channels))
+    out.append('            workspace[i] = (float)((const unsigned char*)test_images)[i];')
+    out.append('        }')
+    out.append('    }')
+    out.append('    else {')
+    out.append('        for (i = 0; i < %d; i++) {' % (rows * columns * channels))
+    out.append('            workspace[i] = (float)test_images[i];')
+    out.append('        }')
+    out.append('    }')
+    for fn, in_shape, out_shape, src, dst in calls:
+        if len(in_shape) > 1:
+            src = '(float (*)%s)(%s)' % (dims(in_shape[1:]), src)
+        if len(out_shape) > 1:
+            dst = '(float (*)%s)(%s)' % (dims(out_shape[1:]), dst)
+        out.append('    %s(%s, %s);' % (fn, src, dst))
+    out.append('}')
+    out.append('#endif')
+    return '\n'.join(out) + '\n', macs
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compile the MNIST CNN into C for conv mode #9')
+    parser.add_argument('model', nargs='*', default=['mnist_cnn_parameter.bin'],
+                        help='fp32 parameter blob, model.h5 or one JSON dump per layer (default %(default)s)')
+    parser.add_argument('-o', dest='out', default='mnist_aot.c', help='C file (default %(default)s)')
+    args = parser.parse_args()
+
+    if len(args.model) == 1 and args.model[0].endswith('.bin'):
+        with open(args.model[0], 'rb') as fp:
+            blob = fp.read()
+    else:
+        if len(args.model) == 1 and args.model[0].endswith('.h5'):
+            params = convert.read_h5(args.model[0])
+        else:
+            params = convert.read_json(args.model)
+        blob = convert.pack_fp32(graph.MNIST_LAYERS, params)
+
+    source, macs = compile_model(graph.MNIST_LAYERS, blob, ' '.join(p.split('/')[-1] for p in args.model))
+    with open(args.out, 'w') as fp:
+        fp.write(source)
+    print('%s: %d layers, %d MACs per image, %d bytes' % (args.out, len(graph.MNIST_LAYERS) - 1, macs, len(source)))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,168 @@
+#
+# Copyright (C) 2017 ARM Limited. All rights reserved.
+#
+# Keras model converter
+#
+# Converts a trained Keras model, either the .h5 file (needs h5py) or the
+# per-layer parameter dumps mnist_cnn_train121_params_layer{0,2,6,8}.json,
+# into the model container of mnist_cnn_model.py in one pass: the fp32
+# parameters are laid out as in src/mnist.h, quantized to INT8 with
+# mnist_cnn_quantize.py and packed with the graph of mnist_cnn_graph.py.
+#
+# mnist_cnn_import.py stored every float with its own "memory set_typed"
+# debugger command, which takes minutes for the 80k parameters. The
+# container is loaded instead with one bulk restore, from the DS-5 command
+# script written next to it:
+#
+#   source mnist_cnn_model.ds
+#   -> restore "mnist_cnn_model.bin" binary S:0x803C0000
+#
+# at MNIST_EVAL_BASE + MNIST_MODEL_BASE, where main.c picks it up. The
+# host build maps the same file (mnist_host -M mnist_cnn_model.bin).
+#
+# usage: python mnist_cnn_convert.py [-o out.bin] [--fp32 fp32.bin]
+#            [--int8 int8.bin] (model.h5 | layer0.json layer2.json ...)
+#
+from __future__ import print_function
+import argparse
+import json
+import os
+import struct
+import sys
+
+import mnist_cnn_graph as graph
+import mnist_cnn_model as model
+import mnist_cnn_quantize as quantize
+
+MNIST_EVAL_BASE = 0x80100000
+MNIST_MODEL_BASE = 0x2C0000
+MNIST_MODEL_SIZE = 0x80000
+
+JSON_LAYERS = ['mnist_cnn_train121_params_layer%d.json' % idx for idx in (0, 2, 6, 8)]
+
+
+def flatten(values):
+    """Row-major list of a nested list"""
+    if not isinstance(values, list):
+        return [float(values)]
+    out = []
+    for value in values:
+        out += flatten(value)
+    return out
+
+
+def shape_of(values):
+    shape = []
+    while isinstance(values, list):
+        shape.append(len(values))
+        values = values[0]
+    return tuple(shape)
+
+
+def read_json(paths):
+    """(weights shape, weights, biases) of every layer with parameters"""
+    params = []
+    for path in paths:
+        with open(path, 'r') as fp:
+            layer = json.load(fp)
+        params.append((shape_of(layer['weights']), flatten(layer['weights']), flatten(layer['biases'])))
+    return params
+
+
+def read_h5(path):
+    """(weights shape, weights, biases) of every layer with parameters, in
+    the order of the model's layer_names"""
+    import h5py
+
+    params = []
+    with h5py.File(path, 'r') as h5:
+        root = h5['model_weights'] if 'model_weights' in h5 else h5
+        for name in root.attrs['layer_names']:
+            layer = root[name.decode('utf8') if isinstance(name, bytes) else name]
+            weights = biases = None
+            for weight in layer.attrs['weight_names']:
+                weight = weight.decode('utf8') if isinstance(weight, bytes) else weight
+                data = layer[weight][()]
+                if 'kernel' in weight:
+                    weights = data
+                elif 'bias' in weight:
+                    biases = data
+            if weights is None:
+                continue
+            params.append((tuple(weights.shape), [float(v) for v in weights.ravel()],
+                           [float(v) for v in biases.ravel()]))
+    return params
+
+
+def pack_fp32(layers, params):
+    """fp32 parameter blob at the offsets the graph gives, checking every
+    layer's shapes against it"""
+    blob = bytearray()
+    trained = iter(params)
+    for name, kind, relu, inp, flt, outp, fp32, int8 in layers:
+        if kind not in (graph.LAYER_CONV, graph.LAYER_FC):
+            continue
+        try:
+            shape, weights, biases = next(trained)
+        except StopIteration:
+            sys.exit('Error: no parameters for %s' % name)
+        if kind == graph.LAYER_CONV:
+            expect = (flt[0], flt[1], inp[0], outp[0])
+        else:
+            expect = (inp[0], outp[0])
+        if shape != expect or len(biases) != outp[0]:
+            sys.exit('Error: %s weights %s biases %d, expected %s and %d' % (
+                name, 'x'.join(str(d) for d in shape), len(biases), 'x'.join(str(d) for d in expect), outp[0]))
+
+        weight_off, bias_off = fp32
+        for offset, values in ((bias_off, biases), (weight_off, weights)):
+            end = offset + len(values) * 4
+            if len(blob) < end:
+                blob += b'\0' * (end - len(blob))
+            blob[offset:end] = struct.pack('<%df' % len(values), *values)
+        print('%s biases{Array[%d]}, weights{Array[%s]}' % (name, len(biases), ']['.join(str(d) for d in shape)))
+    if next(trained, None) is not None:
+        sys.exit('Error: the model has more layers with parameters than the graph')
+    return bytes(blob)
+
+
+def write_restore_script(path, blob_path):
+    with open(path, 'w') as fp:
+        fp.write('# model container, written by mnist_cnn_convert.py\n')
+        fp.write('restore "%s" binary S:0x%08x\n' % (os.path.abspath(blob_path).replace('\\', '/'),
+                                                     MNIST_EVAL_BASE + MNIST_MODEL_BASE))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Convert a Keras MNIST CNN into a model container')
+    parser.add_argument('model', nargs='*', default=JSON_LAYERS,
+                        help='model.h5, or one JSON parameter dump per layer (default %s)' % ' '.join(JSON_LAYERS))
+    parser.add_argument('-o', dest='out', default='mnist_cnn_model.bin', help='container (default %(default)s)')
+    parser.add_argument('--fp32', help='also write the raw fp32 blob (mnist_cnn_parameter.bin layout)')
+    parser.add_argument('--int8', help='also write the raw INT8 blob (mnist_cnn_parameter_int8.bin layout)')
+    args = parser.parse_args()
+
+    if len(args.model) == 1 and args.model[0].endswith('.h5'):
+        params = read_h5(args.model[0])
+    else:
+        params = read_json(args.model)
+
+    fp32 = pack_fp32(graph.MNIST_LAYERS, params)
+    int8 = quantize.quantize_params(fp32)
+    out, tensors = model.pack_model(graph.MNIST_LAYERS, fp32, int8)
+    if len(out) > MNIST_MODEL_SIZE:
+        sys.exit('Error: %d bytes, more than the 0x%x reserved at MNIST_MODEL_BASE' % (len(out), MNIST_MODEL_SIZE))
+
+    with open(args.out, 'wb') as fp:
+        fp.write(out)
+    for path, blob in ((args.fp32, fp32), (args.int8, int8)):
+        if path:
+            with open(path, 'wb') as fp:
+                fp.write(blob)
+    script = os.path.splitext(args.out)[0] + '.ds'
+    write_restore_script(script, args.out)
+    print('%s: %d tensors, %d bytes, load with "source %s"' % (args.out, len(tensors), len(out), script))
+
+
+if __name__ == '__main__':
+    main()
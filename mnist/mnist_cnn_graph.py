@@ -0,0 +1,69 @@
+#
+# Copyright (C) 2017 ARM Limited. All rights reserved.
+#
+# Network description writer for the generic layer interpreter
+#
+# Writes the layer list that src/cnn_graph.c runs (format in
+# src/cnn_graph.h): a 16-byte header followed by one 64-byte record per
+# layer, every field a little-endian uint32. The blob is loaded at
+# MNIST_GRAPH_BASE next to the parameters; a retrained or different
+# network only needs a new description and parameter blob.
+#
+#   header  magic "CNNG", version, layer_num, classes
+#   layer   type, relu, input channel/rows/columns, filter rows/columns,
+#           output channel/rows/columns, weights, biases,
+#           int8 weights/scales/biases, reserved
+#
+# usage: python mnist_cnn_graph.py [out.bin]
+#
+from __future__ import print_function
+import struct
+import sys
+
+GRAPH_MAGIC = 0x474E4E43
+GRAPH_VERSION = 1
+GRAPH_MAX_LAYERS = 32
+NONE = 0xFFFFFFFF
+
+LAYER_INPUT = 0
+LAYER_CONV = 1
+LAYER_MAXPOOL = 2
+LAYER_FC = 3
+
+# (name, type, relu, (in c, r, c), (filter r, c), (out c, r, c),
+#  (fp32 weights, biases), (int8 weights, scales, biases))
+# fp32 offsets as in src/mnist.h, int8 offsets from mnist_cnn_quantize.py
+MNIST_LAYERS = [
+    ('input',        LAYER_INPUT,   0, (1, 28, 28),  (0, 0), (1, 28, 28),  (0, 0),             (NONE, NONE, NONE)),
+    ('keras_lay[0]', LAYER_CONV,    1, (1, 28, 28),  (5, 5), (16, 24, 24), (0x40, 0x0),        (0x80, 0x40, 0x0)),
+    ('keras_lay[1]', LAYER_MAXPOOL, 0, (16, 24, 24), (2, 2), (16, 12, 12), (0, 0),             (NONE, NONE, NONE)),
+    ('keras_lay[2]', LAYER_CONV,    1, (16, 12, 12), (5, 5), (32, 8, 8),   (0x700, 0x680),     (0x340, 0x2c0, 0x240)),
+    ('keras_lay[3]', LAYER_MAXPOOL, 0, (32, 8, 8),   (2, 2), (32, 4, 4),   (0, 0),             (NONE, NONE, NONE)),
+    ('keras_lay[6]', LAYER_FC,      1, (512, 0, 0),  (0, 0), (128, 0, 0),  (0xd100, 0xcf00),   (0x3940, 0x3740, 0x3540)),
+    ('keras_lay[8]', LAYER_FC,      0, (128, 0, 0),  (0, 0), (10, 0, 0),   (0x4d128, 0x4d100), (0x139a0, 0x13970, 0x13940)),
+]
+
+
+def pack_graph(layers):
+    assert 2 <= len(layers) <= GRAPH_MAX_LAYERS
+    classes = layers[-1][5][0]
+    out = struct.pack('<4I', GRAPH_MAGIC, GRAPH_VERSION, len(layers), classes)
+    for name, kind, relu, inp, flt, outp, fp32, int8 in layers:
+        out += struct.pack('<16I', kind, relu, inp[0], inp[1], inp[2], flt[0], flt[1],
+                           outp[0], outp[1], outp[2], fp32[0], fp32[1],
+                           int8[0], int8[1], int8[2], 0)
+        print('%-13s %d: %s -> %s' % (name, kind, inp, outp))
+    return out
+
+
+def main():
+    dst = sys.argv[1] if len(sys.argv) > 1 else 'mnist_cnn_graph.bin'
+
+    out = pack_graph(MNIST_LAYERS)
+    with open(dst, 'wb') as fp:
+        fp.write(out)
+    print('%s: %d layers, %d bytes' % (dst, len(MNIST_LAYERS), len(out)))
+
+
+if __name__ == '__main__':
+    main()
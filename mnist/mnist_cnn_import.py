@@ -1,9 +1,16 @@
 #
 # Copyright (C) 2017 ARM Limited. All rights reserved.
 #
+# Stores the Keras JSON parameter dumps at 0x80100000 from the debugger,
+# one restore per tensor, and dumps them as ds5_mnist_params_v2.bin.
+# mnist_cnn_convert.py builds the whole model container offline instead.
+#
 from arm_ds.debugger_v1 import Debugger
 from arm_ds.debugger_v1 import DebugException
 import json
+import os
+import struct
+import tempfile
 
 def parseDScmdRetStr(retval):
     # extract the path from '$10 = "path"' like format
@@ -28,34 +35,44 @@ def loadParams(filepath):
     return jsonObj
 
 
+def restoreBlob(ec, adr, blob):
+    # one bulk "restore" of a temporary file instead of a debugger command
+    # per value
+    fd, path = tempfile.mkstemp(suffix='.bin')
+    os.write(fd, blob)
+    os.close(fd)
+    dscmd = 'restore "%s" binary S:0x%08x' % (path.replace('\\', '/'), adr)
+    ec.executeDSCommand(dscmd)
+    os.remove(path)
+    return adr + len(blob)
+
+
+def flatten(values):
+    if not isinstance(values, list):
+        return [values]
+    out = []
+    for value in values:
+        out += flatten(value)
+    return out
+
+
 def storeParams(ec, store_adr, params, biases_max, weights_max0, weights_max1, weights_max2, weights_max3):
 
-    adr = store_adr
+    biases = flatten(params['biases'])
+    weights = flatten(params['weights'])
+    weights_num = weights_max0 * weights_max1
+    if weights_max2 != 0:  # biases[], weights[][][][]
+        weights_num *= weights_max2 * weights_max3
+    assert len(biases) == biases_max and len(weights) == weights_num
 
     # biases
-    start_adr = adr
-    for i in range(0, biases_max):
-        dscmd = 'memory set_typed S:0x%08x (float)  (float)(%.18f)' % (adr, params['biases'][i])
-        ec.executeDSCommand(dscmd)
-        adr += 0x4
+    start_adr = store_adr
+    adr = restoreBlob(ec, start_adr, struct.pack('<%df' % biases_max, *biases))
     print ' biases  S:0x%08x - S:0x%08x' % (start_adr, adr)
 
     # weights
     start_adr = adr
-    if weights_max2 != 0:  # biases[], weights[][][][]
-        for i in range(0, weights_max0):
-            for j in range(0, weights_max1):
-                for k in range(0, weights_max2):
-                    for l in range(0, weights_max3):
-                        dscmd = 'memory set_typed S:0x%08x (float)  (float)(%.18f)' % (adr, params['weights'][i][j][k][l])
-                        ec.executeDSCommand(dscmd)
-                        adr += 0x4
-    else:                 # biases[], weights[][]
-        for i in range(0, weights_max0):
-            for j in range(0, weights_max1):
-                dscmd = 'memory set_typed S:0x%08x (float)  (float)(%.18f)' % (adr, params['weights'][i][j])
-                ec.executeDSCommand(dscmd)
-                adr += 0x4
+    adr = restoreBlob(ec, start_adr, struct.pack('<%df' % weights_num, *weights))
     print ' weights S:0x%08x - S:0x%08x' % (start_adr, adr)
 
     return adr
@@ -0,0 +1,168 @@
+#
+# Copyright (C) 2017 ARM Limited. All rights reserved.
+#
+# Model container writer
+#
+# Packs the fp32 parameters, the INT8 parameters and the network
+# description into one versioned container (format in src/cnn_model.h):
+# a 64-byte header, a table of named tensors (dtype, layout, shape,
+# offset, size) and the tensor data, every tensor on a 64-byte boundary,
+# with a CRC-32 of everything after the header. The graph's parameter
+# offsets are rewritten to point at the tensors, so nothing depends on
+# the raw blob offsets in src/mnist.h any more. The host build maps the
+# container as is (mnist_host -M); the target reads it at
+# MNIST_MODEL_BASE.
+#
+#   header  magic "CNNM", version, header_size, tensor_num,
+#           table_offset, data_offset, file_size, crc32, reserved[8]
+#   tensor  name[28], dtype, layout, rank, shape[4], offset, size
+#
+# usage: python mnist_cnn_model.py [fp32.bin] [int8.bin] [out.bin]
+#
+from __future__ import print_function
+import struct
+import sys
+import zlib
+
+import mnist_cnn_graph as graph
+
+MODEL_MAGIC = 0x4D4E4E43
+MODEL_VERSION = 1
+MODEL_ALIGN = 64
+HEADER_SIZE = 64
+TENSOR_SIZE = 64
+NAME_SIZE = 28
+
+DTYPE_F32 = 1
+DTYPE_I8 = 2
+DTYPE_U32 = 3
+
+LAYOUT_FLAT = 0
+LAYOUT_HWIO = 1
+LAYOUT_IO = 2
+LAYOUT_SDOT = 3
+
+DTYPE_SIZE = {DTYPE_F32: 4, DTYPE_I8: 1, DTYPE_U32: 4}
+
+
+def round_up(value, align):
+    return (value + align - 1) // align * align
+
+
+class Tensor(object):
+    def __init__(self, name, dtype, layout, shape, data):
+        count = 1
+        for dim in shape:
+            count *= dim
+        assert len(name) < NAME_SIZE and 1 <= len(shape) <= 4
+        assert len(data) == count * DTYPE_SIZE[dtype], name
+        self.name = name
+        self.dtype = dtype
+        self.layout = layout
+        self.shape = list(shape)
+        self.data = data
+        self.offset = 0
+
+
+def layer_tensors(name, kind, inp, flt, outp, fp32, int8, params, int8_params):
+    """fp32 and INT8 tensors of one conv or FC layer, read at the raw
+    blob offsets the graph gives for it"""
+    N = outp[0]
+    if kind == graph.LAYER_CONV:
+        shape = (flt[0], flt[1], inp[0], N)
+        layout = LAYOUT_HWIO
+    else:
+        shape = (inp[0], N)
+        layout = LAYOUT_IO
+    K = shape[0] * shape[1] * shape[2] if kind == graph.LAYER_CONV else inp[0]
+    weights, biases = fp32
+    tensors = {
+        'weights': Tensor(name + '.weights', DTYPE_F32, layout, shape, params[weights:weights + K * N * 4]),
+        'biases': Tensor(name + '.biases', DTYPE_F32, LAYOUT_FLAT, (N,), params[biases:biases + N * 4]),
+    }
+    if int8[0] != graph.NONE:
+        Kp = round_up(K, 4)
+        Np = round_up(N, 4)
+        weights, scales, biases = int8
+        tensors['int8_weights'] = Tensor(name + '.int8_weights', DTYPE_I8, LAYOUT_SDOT, (Np // 4, Kp // 4, 4, 4),
+                                         int8_params[weights:weights + Np * Kp])
+        tensors['int8_scales'] = Tensor(name + '.int8_scales', DTYPE_F32, LAYOUT_FLAT, (Np,),
+                                        int8_params[scales:scales + Np * 4])
+        tensors['int8_biases'] = Tensor(name + '.int8_biases', DTYPE_F32, LAYOUT_FLAT, (Np,),
+                                        int8_params[biases:biases + Np * 4])
+    return tensors
+
+
+def pack_model(layers, params, int8_params):
+    """Container bytes for the layer list of mnist_cnn_graph.py, with its
+    fp32 and INT8 parameter blobs"""
+    tensors = []
+    per_layer = []
+    for name, kind, relu, inp, flt, outp, fp32, int8 in layers:
+        if kind in (graph.LAYER_CONV, graph.LAYER_FC):
+            lt = layer_tensors(name, kind, inp, flt, outp, fp32, int8, params, int8_params)
+            tensors += [lt[key] for key in ('weights', 'biases', 'int8_weights', 'int8_scales', 'int8_biases')
+                        if key in lt]
+            per_layer.append(lt)
+        else:
+            per_layer.append(None)
+
+    # the graph goes first; its size does not depend on the offsets
+    graph_size = 16 + len(layers) * 64
+    table_offset = HEADER_SIZE
+    data_offset = round_up(table_offset + (len(tensors) + 1) * TENSOR_SIZE, MODEL_ALIGN)
+    offset = round_up(data_offset + graph_size, MODEL_ALIGN)
+    for t in tensors:
+        t.offset = offset
+        offset = round_up(offset + len(t.data), MODEL_ALIGN)
+    file_size = tensors[-1].offset + len(tensors[-1].data)
+
+    relocated = []
+    for layer, lt in zip(layers, per_layer):
+        name, kind, relu, inp, flt, outp, fp32, int8 = layer
+        if lt is not None:
+            fp32 = (lt['weights'].offset, lt['biases'].offset)
+            if 'int8_weights' in lt:
+                int8 = (lt['int8_weights'].offset, lt['int8_scales'].offset, lt['int8_biases'].offset)
+        relocated.append((name, kind, relu, inp, flt, outp, fp32, int8))
+    graph_blob = graph.pack_graph(relocated)
+    assert len(graph_blob) == graph_size
+    graph_tensor = Tensor('graph', DTYPE_U32, LAYOUT_FLAT, (graph_size // 4,), graph_blob)
+    graph_tensor.offset = data_offset
+    tensors.insert(0, graph_tensor)
+
+    body = bytearray(file_size - HEADER_SIZE)
+    for idx, t in enumerate(tensors):
+        shape = t.shape + [1] * (4 - len(t.shape))
+        entry = struct.pack('<%ds3I4I2I' % NAME_SIZE, t.name.encode('ascii'), t.dtype, t.layout, len(t.shape),
+                            shape[0], shape[1], shape[2], shape[3], t.offset, len(t.data))
+        start = table_offset + idx * TENSOR_SIZE - HEADER_SIZE
+        body[start:start + TENSOR_SIZE] = entry
+        body[t.offset - HEADER_SIZE:t.offset - HEADER_SIZE + len(t.data)] = t.data
+
+    checksum = zlib.crc32(bytes(body)) & 0xFFFFFFFF
+    header = struct.pack('<8I8I', MODEL_MAGIC, MODEL_VERSION, HEADER_SIZE, len(tensors),
+                         table_offset, data_offset, file_size, checksum, *([0] * 8))
+    return header + bytes(body), tensors
+
+
+def main():
+    src = sys.argv[1] if len(sys.argv) > 1 else 'mnist_cnn_parameter.bin'
+    src_int8 = sys.argv[2] if len(sys.argv) > 2 else 'mnist_cnn_parameter_int8.bin'
+    dst = sys.argv[3] if len(sys.argv) > 3 else 'mnist_cnn_model.bin'
+
+    with open(src, 'rb') as fp:
+        params = fp.read()
+    with open(src_int8, 'rb') as fp:
+        int8_params = fp.read()
+
+    out, tensors = pack_model(graph.MNIST_LAYERS, params, int8_params)
+    for t in tensors:
+        print('%-26s 0x%06x %7d bytes %s' % (t.name, t.offset, len(t.data), 'x'.join(str(d) for d in t.shape)))
+    with open(dst, 'wb') as fp:
+        fp.write(out)
+    print('%s: %d tensors, %d bytes' % (dst, len(tensors), len(out)))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,100 @@
+#
+# Copyright (C) 2017 ARM Limited. All rights reserved.
+#
+# Offline INT8 quantizer for the MNIST CNN parameters
+#
+# Reads the fp32 parameter dump (mnist_cnn_parameter.bin, layout in
+# src/mnist.h) and writes per-output-channel symmetric int8 weights plus
+# their scales, packed for the SDOT kernels in src/cnn_api_int8.c:
+#
+#   biases  float[Np]                  (fp32, copied as-is, zero padded)
+#   scales  float[Np]                  (weight = int8 * scale)
+#   weights int8[Np/4][Kp/4][4][4]     (4 outputs x 4 inputs per SDOT)
+#
+# K = filter_rows * filter_columns * input_channel (or input_channel for
+# FC) padded to Kp, a multiple of 4; N = output_channel padded to Np, a
+# multiple of 4. Weights start on a 16-byte boundary.
+#
+# usage: python mnist_cnn_quantize.py [in.bin] [out.bin]
+#
+from __future__ import print_function
+import struct
+import sys
+
+# (name, fp32 biases offset, fp32 weights offset, K, N)
+FP32_LAYERS = [
+    ('keras_lay[0]', 0x0,     0x40,    5 * 5 * 1,  16),
+    ('keras_lay[2]', 0x680,   0x700,   5 * 5 * 16, 32),
+    ('keras_lay[6]', 0xcf00,  0xd100,  512,        128),
+    ('keras_lay[8]', 0x4d100, 0x4d128, 128,        10),
+]
+
+
+def round_up(value, align):
+    return (value + align - 1) // align * align
+
+
+def read_floats(blob, offset, count):
+    return list(struct.unpack_from('<%df' % count, blob, offset))
+
+
+def quantize_layer(blob, bias_off, weight_off, K, N):
+    Kp = round_up(K, 4)
+    Np = round_up(N, 4)
+
+    biases = read_floats(blob, bias_off, N) + [0.0] * (Np - N)
+    weights = read_floats(blob, weight_off, K * N)    # weights[K][N]
+
+    scales = []
+    for o in range(Np):
+        if o < N:
+            amax = max(abs(weights[k * N + o]) for k in range(K))
+        else:
+            amax = 0.0
+        scales.append(amax / 127.0 if amax > 0.0 else 1.0)
+
+    packed = bytearray(Np * Kp)
+    err_max = 0.0
+    for o in range(N):
+        for k in range(K):
+            w = weights[k * N + o]
+            q = int(round(w / scales[o]))
+            q = max(-127, min(127, q))
+            err_max = max(err_max, abs(q * scales[o] - w))
+            packed[(o // 4) * Kp * 4 + (k // 4) * 16 + (o % 4) * 4 + (k % 4)] = q & 0xFF
+
+    section = struct.pack('<%df' % Np, *biases) + struct.pack('<%df' % Np, *scales)
+    return section, bytes(packed), Kp, Np, err_max
+
+
+def quantize_params(blob):
+    """INT8 parameter blob for an fp32 parameter blob"""
+    out = bytearray()
+    for name, bias_off, weight_off, K, N in FP32_LAYERS:
+        section, packed, Kp, Np, err_max = quantize_layer(blob, bias_off, weight_off, K, N)
+        start = len(out)
+        out += section
+        out += b'\0' * (round_up(len(out), 16) - len(out))
+        weights_start = len(out)
+        out += packed
+        print('%s K=%d(%d) N=%d(%d)' % (name, K, Kp, N, Np))
+        print(' biases/scales 0x%05x - 0x%05x' % (start, weights_start))
+        print(' weights       0x%05x - 0x%05x  max abs error %.6f' % (weights_start, len(out), err_max))
+    return bytes(out)
+
+
+def main():
+    src = sys.argv[1] if len(sys.argv) > 1 else 'mnist_cnn_parameter.bin'
+    dst = sys.argv[2] if len(sys.argv) > 2 else 'mnist_cnn_parameter_int8.bin'
+
+    with open(src, 'rb') as fp:
+        blob = fp.read()
+
+    out = quantize_params(blob)
+    with open(dst, 'wb') as fp:
+        fp.write(out)
+    print('%s: %d bytes (fp32 %d bytes)' % (dst, len(out), len(blob)))
+
+
+if __name__ == '__main__':
+    main()
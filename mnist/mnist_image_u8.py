@@ -0,0 +1,52 @@
+#
+# Copyright (C) 2017 ARM Limited. All rights reserved.
+#
+# Image slot converter for the packed uint8 image format
+#
+# Reads image slots as stored at TEST_IMAGE_X() (one 0x1000-byte slot per
+# image: 784 little-endian uint32 pixels, label byte at 0xFFF) and writes
+# the pixels as packed bytes, 784 per image, for host/mnist_host -f 8 or
+# an IMAGEFORMAT = 1 (CNN_PIXEL_U8) target. The DS-5 memory dumps in
+# mnist/ hold each pixel in the top byte of its word; slots written by
+# image_import.py hold it in the bottom byte. Both convert to 0 - 255.
+#
+# usage: python mnist_image_u8.py [slots.bin] [out.bin]
+#
+from __future__ import print_function
+import struct
+import sys
+
+SLOT_SIZE = 0x1000
+PIXELS = 28 * 28
+LABEL_OFFSET = 0xFFF
+
+
+def slot_pixels(slot):
+    words = struct.unpack_from('<%dI' % PIXELS, slot)
+    if max(words) > 0xFF:
+        return bytearray(w >> 24 for w in words)
+    return bytearray(words)
+
+
+def main():
+    src = sys.argv[1] if len(sys.argv) > 1 else 'mnist_autotest_images.bin'
+    dst = sys.argv[2] if len(sys.argv) > 2 else 'mnist_autotest_images_u8.bin'
+
+    with open(src, 'rb') as fp:
+        data = fp.read()
+
+    out = bytearray()
+    labels = ''
+    for offset in range(0, len(data), SLOT_SIZE):
+        slot = data[offset:offset + SLOT_SIZE].ljust(SLOT_SIZE, b'\0')
+        out += slot_pixels(slot)
+        label = bytearray(slot[LABEL_OFFSET:LABEL_OFFSET + 1])[0]
+        labels += str(label) if label < 10 else '?'
+
+    with open(dst, 'wb') as fp:
+        fp.write(out)
+    print('%s: %d images, %d bytes, labels %s' % (dst, len(out) // PIXELS, len(out), labels))
+
+
+if __name__ == '__main__':
+    main()
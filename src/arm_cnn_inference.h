@@ -10,20 +10,56 @@
 #define MNIST_IMAGE_ROWS		28
 #define MNIST_IMAGE_COLUMNS	28
 
+#ifdef CNN_HOST_BUILD
+// Host (Linux) build: the FVP DDR window is mirrored by a heap arena,
+// see host/mnist_host.c. cnn_host_eval_base points at the window start
+// and the host config bytes sit just below it, as they do on the FVP.
+extern unsigned long cnn_host_eval_base;
+
+#define CNN_HOST_CONFIG_SIZE	0x100		// config bytes below the eval base
+#define CNN_HOST_WINDOW_SIZE	0x380000	// parameters, images, workspaces, packed weights, the model container and the trace rings
+
+#define MNIST_EVAL_BASE			(cnn_host_eval_base)
+#define CIFAR_EVAL_BASE			(cnn_host_eval_base)
+#else
 #define MNIST_EVAL_BASE			0x80100000   // CA55/CA53_CA73
+#define CIFAR_EVAL_BASE			0x80100000   // CA55/CA53_CA73
+#endif
 #define MNIST_PARAMETER_BASE	0x0
 #define MNIST_TESTIMAGE_BASE	0x50000   // CA55/CA53_CA73
 #define MNIST_WORKSPACE_BASE	0x60000
+#define MNIST_WORKSPACE_SIZE	0xC0000		// planned workspaces per core / scheduler slot; 8 x WORK_IMAGE_X() without CNN_GRAPH
+#define MNIST_PARAMETER_INT8_BASE	0x120000	// after 8 workspaces, see mnist_cnn_quantize.py
+#define MNIST_GRAPH_BASE		0x13F000	// network description, see mnist_cnn_graph.py
+#define MNIST_GRAPH_SIZE		0x1000
+#define MNIST_BATCH_BASE		0x140000	// per-core mnist_cnn_eval_batch() buffers
+#define MNIST_BATCH_SIZE		0x10000
+#define MNIST_SCRATCH_BASE		0x1C0000	// per-core conv scratch for scheduled tiles
+#define MNIST_PARAMETER_PACKED_BASE	0x200000	// weights repacked by mnist_cnn_load()
+#define MNIST_PARAMETER_PACKED_SIZE	0xC0000
+#define MNIST_MODEL_BASE		0x2C0000	// model container, see mnist_cnn_model.py
+#define MNIST_MODEL_SIZE		0x80000
+#define MNIST_TRACE_BASE		0x340000	// per-core trace rings of main.c (cnn_trace.h), kept out of the image
+#define MNIST_TRACE_SIZE		0x40000
 
-#define CIFAR_EVAL_BASE			0x80100000   // CA55/CA53_CA73
 #define CIFAR_PARAMETER_BASE	0x0
 #define CIFAR_TESTIMAGE_BASE	0x50000
 #define CIFAR_WORKSPACE_BASE	0x60000
 
 
+#ifdef CNN_HOST_BUILD
+#define HOST_CONFIG_AUTO_BASE        (MNIST_EVAL_BASE - 0x1)
+#define HOST_CONFIG_CNN_BASE         (MNIST_EVAL_BASE - 0x5)
+#define HOST_CONFIG_CONV_BASE        (MNIST_EVAL_BASE - 0x9)
+#define HOST_CONFIG_IMAGE_BASE       (MNIST_EVAL_BASE - 0xD)
+#define HOST_CONFIG_ENGINE_BASE      (MNIST_EVAL_BASE - 0x20)
+#else
 #define HOST_CONFIG_AUTO_BASE        0x800FFFFF // CA55/CA53_CA73
 #define HOST_CONFIG_CNN_BASE         0x800FFFFB // CA55/CA53_CA73
 #define HOST_CONFIG_CONV_BASE        0x800FFFF7 // CA55/CA53_CA73
+#define HOST_CONFIG_IMAGE_BASE       0x800FFFF3 // CA55/CA53_CA73
+#define HOST_CONFIG_ENGINE_BASE      0x800FFFE0 // CA55/CA53_CA73
+#endif
 
 #define TESTMODE_AUTO  0
 #define TESTMODE_IMAGE 1
@@ -43,19 +79,46 @@
 #define TEST_IMAGE_4 (MNIST_EVAL_BASE + MNIST_TESTIMAGE_BASE + 0x4000)	// (size 0xC40)   1
 #define TEST_IMAGE_5 (MNIST_EVAL_BASE + MNIST_TESTIMAGE_BASE + 0x5000)	// (size 0xC40)   8
 
-#define TEST_IMAGE_X(X) 	(MNIST_EVAL_BASE + MNIST_TESTIMAGE_BASE + 0x1000 * (X))		// (size 0xC40)
+#define TEST_IMAGE_X(X) 	(MNIST_EVAL_BASE + MNIST_TESTIMAGE_BASE + 0x1000 * (X))		// (size 0xC40, or 0x310 for CNN_PIXEL_U8)
 #define TEST_IMAGE_RES(X) 	((volatile unsigned char *) (TEST_IMAGE_X(X) + 0xFFF))
 
-#define WORK_IMAGE_X(X) 	(MNIST_EVAL_BASE + MNIST_WORKSPACE_BASE + 0x18000 * (X))
+#define WORK_IMAGE_X(X) 	(MNIST_EVAL_BASE + MNIST_WORKSPACE_BASE + 0x18000 * (X))		// hand-coded stages only (no CNN_GRAPH), and cifar10.c
+#define WORK_BATCH_X(X) 	(MNIST_EVAL_BASE + MNIST_BATCH_BASE + MNIST_BATCH_SIZE * (X))
+#define WORK_SCRATCH_X(X) 	(MNIST_EVAL_BASE + MNIST_SCRATCH_BASE + 0x4000 * (X))		// (size 0x4000)
 
 //#define AUTOTESTIMG ((volatile unsigned char *) (MNIST_EVAL_BASE + 0xFFFFF))
 //#define AUTOTESTIMG ((volatile unsigned char *) (MNIST_EVAL_BASE + 0x300FFFF))
 #define AUTOTESTIMG  ((volatile unsigned char *) (HOST_CONFIG_AUTO_BASE))
 #define CNNSELECTING ((volatile unsigned char *) (HOST_CONFIG_CNN_BASE))
 #define CONVMODE     ((volatile unsigned char *) (HOST_CONFIG_CONV_BASE))
+#define IMAGEFORMAT  ((volatile unsigned char *) (HOST_CONFIG_IMAGE_BASE))	// CNN_PIXEL_U32 (0) or CNN_PIXEL_U8
 
 
 #define CNN_CONV_1     1    // Original
 #define CNN_CONV_2     1	// API
 #define CNN_CONV_3     1	// API w/ Engine
-//#define CNN_CONV_4     1	// API w/ Engine
+#define CNN_CONV_4     1	// im2col + GEMM
+#define CNN_CONV_5     1	// INT8 conv + FC (SDOT)
+#define CNN_CONV_7     1	// Winograd F(2x2, 5x5) / F(4x4, 3x3), weights transformed at load
+#define CNN_FP16       1	// conv mode #8: fp16 weights and activations, fp32 accumulation
+#define CNN_INPUT_FOLD 1	// conv1 reads raw pixels, the 1/255 of pre-proc folded into its weights at load
+#define CNN_FUSED      1	// conv mode #6: conv + bias + ReLU + 2x2 max-pool in one pass
+#define CNN_BATCH      1	// mnist_cnn_eval_batch(), FC layers as matrix-matrix products (needs CNN_GRAPH)
+#define CNN_SCHED      1	// work-stealing (image, layer, row-tile) scheduler for autotest (needs CNN_GRAPH)
+#define CNN_LOG        1	// MainApp status lines through per-core lock-free log rings (cnn_log.c)
+#define CNN_PROF       1	// per-layer PMU profiling of mnist_cnn_eval() (cnn_prof.c)
+#define CNN_TRACE      1	// per-core layer/image begin/end events as Chrome trace JSON (cnn_trace.c)
+#define CNN_MODEL      1	// versioned model container with a tensor table and checksum (cnn_model.c)
+#define CNN_GRAPH      1	// mnist_cnn_eval() runs a loaded network description (cnn_graph.c)
+// CNN_AOT: conv mode #9, the model compiled into the image as C (mnist_aot.h);
+// set by make AOT=1, off by default as its weights add ~320 KB to the image
+// CNN_SELFTEST: kernel self-tests at start-up (cnn_selftest.c); set by make
+// SELFTEST=1 and by the host build (mnist_host -t)
+
+#define CNN_NEON       1	// float32x4_t conv #1/pool/FC kernels (portable fallback without __ARM_NEON)
+
+// conv mode #8 needs a half-precision type: __fp16 on Arm, _Float16 on
+// x86 hosts (GCC 12 or later, clang); without one it is left out
+#if defined(CNN_FP16) && !defined(__ARM_FP16_FORMAT_IEEE) && !defined(__FLT16_MAX__)
+#undef CNN_FP16
+#endif
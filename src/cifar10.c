@@ -15,7 +15,7 @@
 int cifar_cnn_eval(
     unsigned int *test_images,    // test_images[IMAGE_ROWS][IMAGE_COLUMNS]
 	unsigned long idx,
-    unsigned int *result
+    cnn_result *result
 ) {
 
 #if 0
@@ -44,8 +44,9 @@ typedef struct {
     char relu_activation;
 } layer_structure;
 
-int cifar10_cnn_eval(
+struct cnn_result;
+int cifar_cnn_eval(
 		unsigned int *test,
 		unsigned long idx,
-		unsigned int *result
+		struct cnn_result *result
 );
@@ -7,6 +7,7 @@
 */
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
 #include "arm_cnn_inference.h"
 #include "mnist.h"
 #include "cnn_api_c.h"
@@ -37,79 +38,68 @@ float relu(float value) {
 }
 
 #ifdef CNN_CONV_2
-int convolution_filter2(
+// Direct conv, one output tile at a time: up to CONV2_TILE_COLS pixels
+// of one row x CONV2_TILE_OC channels are seeded with the biases and
+// accumulated across the whole filter window, then written once, so the
+// output is neither zeroed beforehand nor read back per MAC.
+static void convolution_filter2(
+    layer_structure *lay,
     float *inputs,
     float *outputs,
-    unsigned int input_channel,
-    unsigned int intput_columns,
-    unsigned int output_channel,
-    unsigned int output_columns,
-    unsigned int filter_rows,
-	unsigned int filter_cols,
-    unsigned int stride_row,
-	unsigned int stride_col,
-	float *weights,
+    float *weights,
     float *biases,
-	char  relu_activation
+    unsigned int stride_row,
+    unsigned int stride_col,
+    unsigned int cols,          // pixels in this tile, <= CONV2_TILE_COLS
+    unsigned int out_ch,
+    unsigned int out_chs        // channels in this tile, <= CONV2_TILE_OC
 ) {
-	//	*inputs
-	//	*outputs
-	//	input_channel
-	//  intput_columns
-	//	output_channel
-	//  output_columns
-	//	filter_row
-	//	filter_col
-	//	stride_row
-	//	stride_col
-	//	*weights,
-	//	*biases,
-
-	unsigned int out_ch;
-    unsigned int in_ch;
-    unsigned int current_filter_row;
-    unsigned int current_filter_col;
-    float current_weight;
-    float current_biase;
+    unsigned int C = lay->input_channel;
+    unsigned int N = lay->output_channel;
+    unsigned int filter_row_len = lay->filter_columns * C;
+    unsigned int input_row_len = lay->input_columns * C;
+    unsigned int filter_row;
+    unsigned int k;
+    unsigned int px;
+    unsigned int oc;
+    float *in_row;
+    float *w_row;
+    float *out;
     float current_input;
-    float current_result;
     float kernel_result;
-    unsigned int kernel_output_addr;
+    float acc[CONV2_TILE_COLS][CONV2_TILE_OC];
 
-    for (current_filter_row = 0; current_filter_row < filter_rows; current_filter_row++) {
-        for (current_filter_col = 0; current_filter_col < filter_cols; current_filter_col++) {
-            for (in_ch = 0; in_ch < input_channel; in_ch++) {
-                current_input = ((float*)inputs)[  ((stride_row + current_filter_row) * intput_columns * input_channel)
-                                                 + ((stride_col + current_filter_col) * input_channel)
-                                                 + in_ch];
-                for (out_ch = 0; out_ch < output_channel; out_ch++) {
-                    current_weight = ((float*)weights)[  (current_filter_row * filter_cols * input_channel * output_channel)
-                                                       + (current_filter_col * input_channel * output_channel)
-                                                       + (in_ch              * output_channel)
-                                                       + out_ch];
-                    current_result = current_input * current_weight;
-                    ((float*)outputs)[  (stride_row * output_columns * output_channel)
-                                      + (stride_col * output_channel)
-                                      + out_ch]
-                    += current_result;
-                }
+    for (px = 0; px < cols; px++) {
+        for (oc = 0; oc < out_chs; oc++) {
+            acc[px][oc] = biases[out_ch + oc];
+        }
+    }
 
+    for (filter_row = 0; filter_row < lay->filter_rows; filter_row++) {
+        // filter_columns * input_channel inputs are contiguous in HWC
+        in_row = inputs + ((stride_row + filter_row) * input_row_len) + (stride_col * C);
+        w_row = weights + (filter_row * filter_row_len * N) + out_ch;
+        for (k = 0; k < filter_row_len; k++) {
+            for (px = 0; px < cols; px++) {
+                current_input = in_row[k + (px * C)];
+                for (oc = 0; oc < out_chs; oc++) {
+                    acc[px][oc] += current_input * w_row[oc];
+                }
             }
+            w_row += N;
         }
     }
 
-    for (out_ch = 0; out_ch < output_channel; out_ch++) {
-        current_biase = ((float*)biases)[out_ch];
-        kernel_output_addr = (stride_row * output_columns * output_channel) + (stride_col * output_channel) + out_ch;
-        kernel_result = ((float*)outputs)[kernel_output_addr];
-        kernel_result += current_biase;
-        if (relu_activation) {
-        	kernel_result = relu(kernel_result);
+    out = outputs + (((stride_row * lay->output_columns) + stride_col) * N) + out_ch;
+    for (px = 0; px < cols; px++) {
+        for (oc = 0; oc < out_chs; oc++) {
+            kernel_result = acc[px][oc];
+            if (lay->relu_activation == 1) {
+                kernel_result = relu(kernel_result);
+            }
+            out[(px * N) + oc] = kernel_result;
         }
-    	((float*)outputs)[kernel_output_addr] = kernel_result;
     }
-
-    return 0;
 }
 
 int convolution_conv2(
@@ -120,58 +110,25 @@ int convolution_conv2(
     float *biases
 ) {
     unsigned int out_ch;
-    unsigned int in_ch;
     unsigned int stride_row;
     unsigned int stride_col;
-    unsigned int filter_row;
-    unsigned int filter_col;
-    float current_weight;
-    float current_biase;
-    float current_input;
-    float current_result;
-    float kernel_result;
+    unsigned int cols;
+    unsigned int out_chs;
 
     for (stride_row = 0; stride_row < lay->output_rows; stride_row++) {
-        for (stride_col = 0; stride_col < lay->output_columns; stride_col++) {
-            for (out_ch = 0; out_ch < lay->output_channel; out_ch++) {
-                ((float*)outputs)[((stride_row * lay->output_columns * lay->output_channel)
-                                                +(stride_col * lay->output_channel)
-                                                + out_ch)]
-                = 0.0f;
+        for (stride_col = 0; stride_col < lay->output_columns; stride_col += CONV2_TILE_COLS) {
+            cols = lay->output_columns - stride_col;
+            if (cols > CONV2_TILE_COLS) {
+                cols = CONV2_TILE_COLS;
+            }
+            for (out_ch = 0; out_ch < lay->output_channel; out_ch += CONV2_TILE_OC) {
+                out_chs = lay->output_channel - out_ch;
+                if (out_chs > CONV2_TILE_OC) {
+                    out_chs = CONV2_TILE_OC;
+                }
+                convolution_filter2(lay, inputs, outputs, weights, biases,
+                                    stride_row, stride_col, cols, out_ch, out_chs);
             }
-        }
-    }
-
-    for (stride_row = 0; stride_row < lay->output_rows; stride_row++) {
-        for (stride_col = 0; stride_col < lay->output_columns; stride_col++) {
-
-        	//	*inputs
-        	//	*outputs
-        	//	input_channel
-        	//  intput_columns
-        	//	output_channel
-        	//  output_columns
-        	//	filter_rows
-        	//	filter_cols
-        	//	stride_row
-        	//	stride_col
-        	//	*weights,
-        	//	*biases,
-        	convolution_filter2(
-    			(float*)inputs,
-    			(float*)outputs,
-				lay->input_channel,
-				lay->input_columns,
-				lay->output_channel,
-				lay->output_columns,
-        		lay->filter_rows,
-				lay->filter_columns,
-				stride_row,
-				stride_col,
-				(float*)weights,
-				(float*)biases,
-				lay->relu_activation
-        	);
         }
     }
 
@@ -182,9 +139,9 @@ int convolution_conv2(
 
 #ifdef CNN_CONV_3
 
-#define CONV3_Eng_X  ((volatile unsigned char *) (0x800FFFE0))
-#define CONV3_Eng_Y  ((volatile unsigned char *) (0x800FFFE4))
-#define CONV3_Eng_Z  ((volatile unsigned char *) (0x800FFFE8))
+#define CONV3_Eng_X  ((volatile unsigned char *) (HOST_CONFIG_ENGINE_BASE + 0x0))
+#define CONV3_Eng_Y  ((volatile unsigned char *) (HOST_CONFIG_ENGINE_BASE + 0x4))
+#define CONV3_Eng_Z  ((volatile unsigned char *) (HOST_CONFIG_ENGINE_BASE + 0x8))
 
 int convolution_filter3(
     unsigned int stride_row,
@@ -193,7 +150,7 @@ int convolution_filter3(
 	//	stride_row
 	//	stride_col
 #if 1
-    float kernel_result;
+    float kernel_result = 0.0f;
     unsigned int current_filter_row;
     unsigned int current_filter_col;
 
@@ -262,17 +219,8 @@ int convolution_conv3(
     float *weights,
     float *biases
 ) {
-    unsigned int out_ch;
-    unsigned int in_ch;
     unsigned int stride_row;
     unsigned int stride_col;
-    unsigned int filter_row;
-    unsigned int filter_col;
-    float current_weight;
-    float current_biase;
-    float current_input;
-    float current_result;
-    float kernel_result;
 
     con_filter_inputs  = (float*)inputs;
     con_filter_outputs  = (float*)outputs;
@@ -316,6 +264,196 @@ int convolution_conv3(
 
 #endif
 
+#ifdef CNN_CONV_4
+
+// im2col + GEMM convolution
+//
+// A conv layer is the product of the im2col matrix A[M][K] and the
+// weights B[K][N], with
+//    M = output_rows * output_columns   (one row per output pixel)
+//    K = filter_rows * filter_columns * input_channel
+//    N = output_channel
+// B is the keras weight array as it sits in memory, and C[M][N] is the
+// output tensor, so neither needs reordering. A is never built in full:
+// each MC x KC block is gathered straight from the input image into a
+// packed panel in the workspace, then multiplied by a register-tiled
+// MR x NR micro-kernel. Bias is folded into the first K block and ReLU
+// into the last one, so each output is written once per K block.
+// convolution_conv4_neon() shares the packing and the edge kernel.
+
+void conv_gemm_pack_a(
+    layer_structure *lay,
+    float *inputs,
+    float *packed,        // packed[mc/MR][kc][MR]
+    unsigned int m0,
+    unsigned int mc,
+    unsigned int k0,
+    unsigned int kc
+) {
+    unsigned int filter_row_len = lay->filter_columns * lay->input_channel;
+    unsigned int input_row_len = lay->input_columns * lay->input_channel;
+    unsigned int i, k, m;
+    unsigned int out_row, out_col;
+    unsigned int filter_row, filter_off;
+    float *row_base;
+
+    for (i = 0; i < ((mc + CONV_GEMM_MR - 1) / CONV_GEMM_MR) * CONV_GEMM_MR; i++) {
+        float *dst = packed + (i / CONV_GEMM_MR) * kc * CONV_GEMM_MR + (i % CONV_GEMM_MR);
+
+        if (i >= mc) {
+            // zero-pad the last sliver so the micro-kernel never branches
+            for (k = 0; k < kc; k++) {
+                dst[k * CONV_GEMM_MR] = 0.0f;
+            }
+            continue;
+        }
+
+        m = m0 + i;
+        out_row = m / lay->output_columns;
+        out_col = m % lay->output_columns;
+        filter_row = k0 / filter_row_len;
+        filter_off = k0 % filter_row_len;
+        row_base = inputs + ((out_row + filter_row) * input_row_len) + (out_col * lay->input_channel);
+
+        // each filter row is one contiguous run of filter_columns * input_channel floats
+        for (k = 0; k < kc; k++) {
+            dst[k * CONV_GEMM_MR] = row_base[filter_off];
+            if (++filter_off == filter_row_len) {
+                filter_off = 0;
+                row_base += input_row_len;
+            }
+        }
+    }
+}
+
+// Full MR x NR tile: constant trip counts let the compiler keep the
+// whole accumulator tile in registers across the K loop.
+static void conv_gemm_micro_kernel(
+    unsigned int kc,
+    const float *a,       // a[kc][MR]
+    const float *b,       // b[kc][ldb]
+    unsigned int ldb,
+    float *c,             // c[MR][ldc]
+    unsigned int ldc,
+    const float *biases,  // biases[NR] on the first K block, else 0
+    char relu_activation  // apply ReLU, only on the last K block
+) {
+    float acc[CONV_GEMM_MR][CONV_GEMM_NR];
+    unsigned int i, j, k;
+
+    for (i = 0; i < CONV_GEMM_MR; i++) {
+        for (j = 0; j < CONV_GEMM_NR; j++) {
+            acc[i][j] = biases ? biases[j] : c[i * ldc + j];
+        }
+    }
+
+    // rank-1 update per k: one B row (NR outputs) times MR pixels
+    for (k = 0; k < kc; k++) {
+        for (i = 0; i < CONV_GEMM_MR; i++) {
+            for (j = 0; j < CONV_GEMM_NR; j++) {
+                acc[i][j] += a[i] * b[j];
+            }
+        }
+        a += CONV_GEMM_MR;
+        b += ldb;
+    }
+
+    for (i = 0; i < CONV_GEMM_MR; i++) {
+        for (j = 0; j < CONV_GEMM_NR; j++) {
+            c[i * ldc + j] = relu_activation ? relu(acc[i][j]) : acc[i][j];
+        }
+    }
+}
+
+// Partial tile at the M or N edge
+void conv_gemm_edge_kernel(
+    unsigned int kc,
+    const float *a,
+    const float *b,
+    unsigned int ldb,
+    float *c,
+    unsigned int ldc,
+    unsigned int mr,
+    unsigned int nr,
+    const float *biases,
+    char relu_activation
+) {
+    float acc;
+    unsigned int i, j, k;
+
+    for (i = 0; i < mr; i++) {
+        for (j = 0; j < nr; j++) {
+            acc = biases ? biases[j] : c[i * ldc + j];
+            for (k = 0; k < kc; k++) {
+                acc += a[k * CONV_GEMM_MR + i] * b[k * ldb + j];
+            }
+            c[i * ldc + j] = relu_activation ? relu(acc) : acc;
+        }
+    }
+}
+
+int convolution_conv4(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs,
+    float *weights,
+    float *biases,
+    float *workspace      // workspace[CONV_GEMM_MC * CONV_GEMM_KC]
+) {
+    unsigned int M = lay->output_rows * lay->output_columns;
+    unsigned int K = lay->filter_rows * lay->filter_columns * lay->input_channel;
+    unsigned int N = lay->output_channel;
+    unsigned int m0, k0, mc, kc, ir, jr, mr, nr;
+    char last_k;
+
+    for (k0 = 0; k0 < K; k0 += CONV_GEMM_KC) {
+        kc = (K - k0 < CONV_GEMM_KC) ? (K - k0) : CONV_GEMM_KC;
+        last_k = (k0 + kc == K);
+
+        for (m0 = 0; m0 < M; m0 += CONV_GEMM_MC) {
+            mc = (M - m0 < CONV_GEMM_MC) ? (M - m0) : CONV_GEMM_MC;
+            conv_gemm_pack_a(lay, inputs, workspace, m0, mc, k0, kc);
+
+            for (jr = 0; jr < N; jr += CONV_GEMM_NR) {
+                nr = (N - jr < CONV_GEMM_NR) ? (N - jr) : CONV_GEMM_NR;
+                for (ir = 0; ir < mc; ir += CONV_GEMM_MR) {
+                    mr = (mc - ir < CONV_GEMM_MR) ? (mc - ir) : CONV_GEMM_MR;
+                    if (mr == CONV_GEMM_MR && nr == CONV_GEMM_NR) {
+                        conv_gemm_micro_kernel(
+                            kc,
+                            workspace + ir * kc,
+                            weights + (k0 * N) + jr,
+                            N,
+                            outputs + ((m0 + ir) * N) + jr,
+                            N,
+                            (k0 == 0) ? biases + jr : 0,
+                            last_k && (lay->relu_activation == 1)
+                        );
+                    }
+                    else {
+                        conv_gemm_edge_kernel(
+                            kc,
+                            workspace + ir * kc,
+                            weights + (k0 * N) + jr,
+                            N,
+                            outputs + ((m0 + ir) * N) + jr,
+                            N,
+                            mr,
+                            nr,
+                            (k0 == 0) ? biases + jr : 0,
+                            last_k && (lay->relu_activation == 1)
+                        );
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+#endif
+
 #ifdef CNN_CONV_1
 int convolution(
     layer_structure *lay,
@@ -409,7 +547,7 @@ int max_pooling(
     unsigned int output_col;
     unsigned int filter_row;
     unsigned int filter_col;
-    float current_max;
+    float current_max = 0.0f;
     float current_value;
 
     for (ch = 0; ch < lay->input_channel; ch++) {
@@ -445,6 +583,67 @@ int max_pooling(
     return 0;
 }
 
+#ifdef CNN_FUSED
+// conv + bias + ReLU + 2x2/2 max-pool, without storing the conv output.
+// lay describes the conv; outputs[output_rows/2][output_columns/2][N].
+int convolution_pool(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs,
+    float *weights,
+    float *biases
+) {
+    unsigned int out_ch;
+    unsigned int pool_row;
+    unsigned int pool_col;
+    unsigned int stride_row;
+    unsigned int stride_col;
+    unsigned int filter_row;
+    unsigned int filter_col;
+    unsigned int in_ch;
+    float current_input;
+    float current_weight;
+    float kernel_result;
+    float pool_result;
+
+    for (pool_row = 0; pool_row < lay->output_rows / 2; pool_row++) {
+        for (pool_col = 0; pool_col < lay->output_columns / 2; pool_col++) {
+            for (out_ch = 0; out_ch < lay->output_channel; out_ch++) {
+                pool_result = 0.0f;
+                for (stride_row = 2 * pool_row; stride_row < (2 * pool_row) + 2; stride_row++) {
+                    for (stride_col = 2 * pool_col; stride_col < (2 * pool_col) + 2; stride_col++) {
+                        kernel_result = ((float*)biases)[out_ch];
+                        for (filter_row = 0; filter_row < lay->filter_rows; filter_row++) {
+                            for (filter_col = 0; filter_col < lay->filter_columns; filter_col++) {
+                                for (in_ch = 0; in_ch < lay->input_channel; in_ch++) {
+                                    current_input = ((float*)inputs)[  ((stride_row + filter_row) * lay->input_columns * lay->input_channel)
+                                                                     + ((stride_col + filter_col)                      * lay->input_channel)
+                                                                     + in_ch];
+                                    current_weight = ((float*)weights)[  (filter_row * lay->filter_columns * lay->input_channel * lay->output_channel)
+                                                                       + (filter_col                       * lay->input_channel * lay->output_channel)
+                                                                       + (in_ch                                                 * lay->output_channel)
+                                                                       + out_ch];
+                                    kernel_result += current_input * current_weight;
+                                }
+                            }
+                        }
+                        if (lay->relu_activation == 1) {
+                            kernel_result = relu(kernel_result);
+                        }
+                        if ((stride_row == 2 * pool_row && stride_col == 2 * pool_col) || pool_result < kernel_result) {
+                            pool_result = kernel_result;
+                        }
+                    }
+                }
+                ((float*)outputs)[(((pool_row * (lay->output_columns / 2)) + pool_col) * lay->output_channel) + out_ch] = pool_result;
+            }
+        }
+    }
+
+    return 0;
+}
+#endif
+
 // keras_lay[6]
 // (Channel:512)
 // (Channel:128)
@@ -463,6 +662,19 @@ int fully_connected(
     float *outputs,   // outputs[lay->output_channel]
     float *weights,   // weights[lay->filter_rows][lay->filter_columns]
     float *biases     // biases[lay->output_channnel]
+) {
+    return fully_connected_range(lay, inputs, outputs, weights, biases, 0, lay->output_channel);
+}
+
+// Outputs [out_begin, out_end) only, so a layer can be split across cores
+int fully_connected_range(
+    layer_structure *lay,
+    float *inputs,    // inputs[lay->input_channel]
+    float *outputs,   // outputs[lay->output_channel]
+    float *weights,   // weights[lay->input_channel][lay->output_channel]
+    float *biases,    // biases[lay->output_channnel]
+    unsigned int out_begin,
+    unsigned int out_end
 ) {
     unsigned int o;
     unsigned int i;
@@ -471,7 +683,7 @@ int fully_connected(
     float current_input;
     float current_out;
 
-    for (o = 0; o < lay->output_channel; o++) {    // (keras_lay[6]=128, keras_lay[8]=10)
+    for (o = out_begin; o < out_end; o++) {    // (keras_lay[6]=128, keras_lay[8]=10)
         current_biase = ((float*)biases)[o];
         current_out = 0.0f;
         for (i = 0; i < lay->input_channel; i++) {    // (keras_lay[6]=512, keras_lay[8]=128)
@@ -489,8 +701,192 @@ int fully_connected(
     return 0;
 }
 
+// One-time repack of [K][N] weights and their biases into FC_PANEL
+// output panels. fully_connected() reads weights N floats apart; the
+// panel kernels read them in order, one cache line after another.
+int fully_connected_pack(
+    layer_structure *lay,
+    float *weights,
+    float *biases,
+    float *packed
+) {
+    unsigned int K = lay->input_channel;
+    unsigned int N = lay->output_channel;
+    unsigned int panel;
+    unsigned int i;
+    unsigned int j;
+    float *dst;
+
+    for (panel = 0; panel < N; panel += FC_PANEL) {
+        dst = packed + ((panel / FC_PANEL) * (K + 1) * FC_PANEL);
+        for (j = 0; j < FC_PANEL; j++) {
+            dst[j] = (panel + j < N) ? biases[panel + j] : 0.0f;
+        }
+        dst += FC_PANEL;
+        for (i = 0; i < K; i++) {
+            for (j = 0; j < FC_PANEL; j++) {
+                dst[j] = (panel + j < N) ? weights[(i * N) + panel + j] : 0.0f;
+            }
+            dst += FC_PANEL;
+        }
+    }
+
+    return 0;
+}
+
+// FC over packed panels, outputs [out_begin, out_end)
+int fully_connected_packed(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs,
+    float *packed,
+    unsigned int out_begin,
+    unsigned int out_end
+) {
+    unsigned int K = lay->input_channel;
+    unsigned int panel;
+    unsigned int i;
+    unsigned int j;
+    float acc[FC_PANEL];
+    float current_input;
+    float *w;
+
+    for (panel = out_begin; panel < out_end; panel += FC_PANEL) {
+        w = packed + ((panel / FC_PANEL) * (K + 1) * FC_PANEL);
+        for (j = 0; j < FC_PANEL; j++) {
+            acc[j] = w[j];
+        }
+        w += FC_PANEL;
+        for (i = 0; i < K; i++) {
+            current_input = inputs[i];
+            for (j = 0; j < FC_PANEL; j++) {
+                acc[j] += current_input * w[j];
+            }
+            w += FC_PANEL;
+        }
+        for (j = 0; j < FC_PANEL && panel + j < out_end; j++) {
+            outputs[panel + j] = (lay->relu_activation == 1) ? relu(acc[j]) : acc[j];
+        }
+    }
+
+    return 0;
+}
+
+#ifdef CNN_BATCH
+// FC over a batch: outputs[batch][N] = inputs[batch][K] x weights[K][N].
+// The outputs are the outer loop: for each block of FC_BATCH_OC outputs
+// every image of a pass (up to FC_BATCH_MAX) keeps its accumulators
+// while the K weight rows stream by, so the weights, which is what
+// bounds the 512x128 layer, are read once per pass rather than once per
+// image. Each output sums in the order fully_connected_range() does.
+int fully_connected_batch(
+    layer_structure *lay,
+    float *inputs,    // inputs[batch][lay->input_channel]
+    float *outputs,   // outputs[batch][lay->output_channel]
+    float *weights,   // weights[lay->input_channel][lay->output_channel]
+    float *biases,    // biases[lay->output_channnel]
+    unsigned int batch
+) {
+    unsigned int K = lay->input_channel;
+    unsigned int N = lay->output_channel;
+    unsigned int b, o, i, j, m, mb, nb;
+    float acc[FC_BATCH_MAX][FC_BATCH_OC];
+    float current_input;
+    float current_out;
+    float *w;
+
+    for (b = 0; b < batch; b += FC_BATCH_MAX) {
+        mb = (batch - b < FC_BATCH_MAX) ? (batch - b) : FC_BATCH_MAX;
+        for (o = 0; o < N; o += FC_BATCH_OC) {
+            nb = (N - o < FC_BATCH_OC) ? (N - o) : FC_BATCH_OC;
+            for (m = 0; m < mb; m++) {
+                for (j = 0; j < nb; j++) {
+                    acc[m][j] = 0.0f;
+                }
+            }
+            for (i = 0; i < K; i++) {
+                w = weights + (i * N) + o;
+                for (m = 0; m < mb; m++) {
+                    current_input = inputs[((b + m) * K) + i];
+                    for (j = 0; j < nb; j++) {
+                        acc[m][j] += current_input * w[j];
+                    }
+                }
+            }
+            for (m = 0; m < mb; m++) {
+                for (j = 0; j < nb; j++) {
+                    current_out = acc[m][j] + biases[o + j];
+                    if (lay->relu_activation == 1) {
+                        current_out = relu(current_out);
+                    }
+                    outputs[((b + m) * N) + o + j] = current_out;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Batched FC over fully_connected_pack() panels: as
+// fully_connected_batch(), but each block of FC_BATCH_OC outputs reads
+// its weights and biases from one contiguous panel. The panels are zero
+// padded, so only the stores check for the last output.
+int fully_connected_batch_packed(
+    layer_structure *lay,
+    float *inputs,    // inputs[batch][lay->input_channel]
+    float *outputs,   // outputs[batch][lay->output_channel]
+    float *packed,    // from fully_connected_pack()
+    unsigned int batch
+) {
+    unsigned int K = lay->input_channel;
+    unsigned int N = lay->output_channel;
+    unsigned int b, o, i, j, m, mb, nb;
+    float acc[FC_BATCH_MAX][FC_BATCH_OC];
+    float current_input;
+    float current_out;
+    float *panel;
+    float *w;
+
+    for (b = 0; b < batch; b += FC_BATCH_MAX) {
+        mb = (batch - b < FC_BATCH_MAX) ? (batch - b) : FC_BATCH_MAX;
+        for (o = 0; o < N; o += FC_BATCH_OC) {
+            nb = (N - o < FC_BATCH_OC) ? (N - o) : FC_BATCH_OC;
+            panel = packed + ((o / FC_PANEL) * (K + 1) * FC_PANEL) + (o % FC_PANEL);
+            for (m = 0; m < mb; m++) {
+                for (j = 0; j < FC_BATCH_OC; j++) {
+                    acc[m][j] = panel[j];
+                }
+            }
+            w = panel + FC_PANEL;
+            for (i = 0; i < K; i++) {
+                for (m = 0; m < mb; m++) {
+                    current_input = inputs[((b + m) * K) + i];
+                    for (j = 0; j < FC_BATCH_OC; j++) {
+                        acc[m][j] += current_input * w[j];
+                    }
+                }
+                w += FC_PANEL;
+            }
+            for (m = 0; m < mb; m++) {
+                for (j = 0; j < nb; j++) {
+                    current_out = acc[m][j];
+                    if (lay->relu_activation == 1) {
+                        current_out = relu(current_out);
+                    }
+                    outputs[((b + m) * N) + o + j] = current_out;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+#endif
+
 int mnist_pre_proc(
     unsigned int *test_images,    // test_images[IMAGE_ROWS][IMAGE_COLUMNS]
+    unsigned int pixel_format,    // CNN_PIXEL_U32 or CNN_PIXEL_U8
     float *outputs                // output[IMAGE_ROWS][IMAGE_COLUMNS]
 ) {
     unsigned int current_input;
@@ -499,7 +895,12 @@ int mnist_pre_proc(
 
     for (row = 0; row < MNIST_IMAGE_ROWS; row++) {
         for (col = 0; col < MNIST_IMAGE_COLUMNS; col++) {
-            current_input = ((unsigned int*)test_images)[row * MNIST_IMAGE_COLUMNS + col];
+            if (pixel_format == CNN_PIXEL_U8) {
+                current_input = ((unsigned char*)test_images)[row * MNIST_IMAGE_COLUMNS + col];
+            }
+            else {
+                current_input = ((unsigned int*)test_images)[row * MNIST_IMAGE_COLUMNS + col];
+            }
             normalized = (float)current_input / 255.0;
             ((float*)outputs)[(row * MNIST_IMAGE_COLUMNS + col)] = normalized;
         }
@@ -508,45 +909,73 @@ int mnist_pre_proc(
     return 0;
 }
 
-int post_proc(
-    float *outlay,
-    unsigned int channel
+// Classify from the class scores without any I/O, so it can sit inside
+// a timed region or a scheduler task; post_proc_report() prints it later
+unsigned int post_proc(
+    const float *outlay,
+    unsigned int channel,
+    cnn_result *result
 ) {
     unsigned int idx, idx_max, idx_max_2nd;
-    float conf, conf_max, conf_max_2nd, average, std, stdiv;
-
-	printf("    prob [");
+    float conf, conf_max, conf_max_2nd, sum;
 
     idx_max = 0;
-    conf_max = 0.0f;
-    idx_max_2nd = 11;
-    conf_max_2nd = 5;
-
-    average = 0.0f;
-    stdiv = 0.0f;
-    std = 0.0f;
-
-    for( idx = 0; idx < channel; idx++ ){
-        conf = ((float*)outlay)[idx] /0x1000000;
-    	printf(" %.0f,", conf);
-        average = average + conf;
-    	if(conf_max < conf){
+    conf_max = outlay[0] / 0x1000000;
+    for (idx = 1; idx < channel; idx++) {
+        conf = outlay[idx] / 0x1000000;
+        if (conf_max < conf) {
             idx_max = idx;
             conf_max = conf;
         }
     }
 
+    idx_max_2nd = idx_max;
+    conf_max_2nd = conf_max;
+    sum = 0.0f;
+    for (idx = 0; idx < channel; idx++) {
+        conf = outlay[idx] / 0x1000000;
+        if (idx != idx_max && (idx_max_2nd == idx_max || conf_max_2nd < conf)) {
+            idx_max_2nd = idx;
+            conf_max_2nd = conf;
+        }
+        // softmax, relative to the top score so expf() cannot overflow
+        sum += expf(conf - conf_max);
+        if (idx < CNN_RESULT_MAX_CLASSES) {
+            result->scores[idx] = conf;
+        }
+    }
+
+    result->class_idx = idx_max;
+    result->second_idx = idx_max_2nd;
+    result->margin = conf_max - conf_max_2nd;
+    result->confidence = 1.0f / sum;
+    result->classes = (channel < CNN_RESULT_MAX_CLASSES) ? channel : CNN_RESULT_MAX_CLASSES;
+    result->conv_mode = 0;
+
+    return idx_max;
+}
+
+// Console report of one post_proc() result; keep it out of PMU windows
+void post_proc_report(
+    const cnn_result *result
+) {
+    unsigned int idx;
+    float conf, average, std, stdiv;
+
+	printf("    prob [");
+
+    average = 0.0f;
+    for (idx = 0; idx < result->classes; idx++) {
+        conf = result->scores[idx];
+    	printf(" %.0f,", conf);
+        average = average + conf;
+    }
     average /= 10;
+
 	// Standard Deviation
-    for( idx = 0; idx < channel; idx++ ){
-        conf = ((float*)outlay)[idx] /0x1000000;
-        if (
-        	(idx != idx_max) &&
-			(conf_max_2nd > (conf_max-conf))
-		) {
-        	conf_max_2nd = conf_max-conf;
-        	idx_max_2nd =idx;
-        }
+    stdiv = 0.0f;
+    for (idx = 0; idx < result->classes; idx++) {
+        conf = result->scores[idx];
         if (conf > average) {
         	std = conf-average;
         	std *= std;
@@ -557,11 +986,12 @@ int post_proc(
 	stdiv = sqrt(stdiv);
 	printf("], avg/std: %.0f/%.0f\n", average, stdiv);
 
-	if ( conf_max_2nd < 3 ) {
-		printf("        %d maybe another answer!!! \n", idx_max_2nd);
-		printf("        Try to inference [%d] & [%d] again\n", idx_max, idx_max_2nd);
+	if ( result->margin < 3 ) {
+		printf("        %d maybe another answer!!! \n", result->second_idx);
+		printf("        Try to inference [%d] & [%d] again\n", result->class_idx, result->second_idx);
+	}
+	if (result->conv_mode) {
+		printf("Conv_mode: %d", result->conv_mode);
 	}
-
-    return idx_max;
 }
 #endif
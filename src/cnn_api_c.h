@@ -6,6 +6,97 @@
 ==================================================================
 */
 
+// Kernels for conv modes #1/#2, pooling and FC, chosen at compile time
+#ifdef CNN_NEON
+#define CONVOLUTION         convolution_neon
+#define CONVOLUTION_CONV2   convolution_conv2_neon
+#define CONVOLUTION_CONV4   convolution_conv4_neon
+#define MAX_POOLING         max_pooling_neon
+#define FULLY_CONNECTED     fully_connected_neon
+#define FULLY_CONNECTED_RANGE   fully_connected_range_neon
+#define FULLY_CONNECTED_BATCH   fully_connected_batch_neon
+#define FULLY_CONNECTED_BATCH_PACKED    fully_connected_batch_packed_neon
+#define FULLY_CONNECTED_PACKED  fully_connected_packed_neon
+#define CONVOLUTION_POOL    convolution_pool_neon
+#else
+#define CONVOLUTION         convolution
+#define CONVOLUTION_CONV2   convolution_conv2
+#define CONVOLUTION_CONV4   convolution_conv4
+#define MAX_POOLING         max_pooling
+#define FULLY_CONNECTED     fully_connected
+#define FULLY_CONNECTED_RANGE   fully_connected_range
+#define FULLY_CONNECTED_BATCH   fully_connected_batch
+#define FULLY_CONNECTED_BATCH_PACKED    fully_connected_batch_packed
+#define FULLY_CONNECTED_PACKED  fully_connected_packed
+#define CONVOLUTION_POOL    convolution_pool
+#endif
+
+// Conv mode #2 output tile held in registers: pixels of one row x channels
+#define CONV2_TILE_COLS     4
+#define CONV2_TILE_OC       16
+
+// Conv mode #4 im2col + GEMM blocking: MR x NR register tile, MC x KC
+// packed A panel in the workspace
+#define CONV_GEMM_MR        4       // micro-tile rows (output pixels)
+#define CONV_GEMM_NR        8       // micro-tile columns (output channels)
+#define CONV_GEMM_MC        32      // A panel rows kept in L1
+#define CONV_GEMM_KC        128     // A panel depth kept in L1
+
+// Image pixel formats: one word per pixel, as the DS-5 scripts store
+// it, or packed bytes. cnn_convolution_input() keeps at most
+// CONV_INPUT_BAND_MAX widened pixels, at least filter_rows input rows.
+#define CNN_PIXEL_U32       0
+#define CNN_PIXEL_U8        1
+#define CONV_INPUT_BAND_MAX 1024
+
+// Classification of one image, filled by post_proc() with no I/O so
+// the evaluation entry points can return it from inside a PMU window
+#define CNN_RESULT_MAX_CLASSES  16
+typedef struct cnn_result {
+    unsigned int class_idx;         // top-1
+    unsigned int second_idx;        // top-2
+    float margin;                   // top-1 minus top-2 score
+    float confidence;               // softmax probability of class_idx
+    unsigned int conv_mode;         // kernels that produced it, 0 if not known
+    unsigned int classes;           // scores[] entries kept for the report
+    float scores[CNN_RESULT_MAX_CLASSES];   // class scores / 0x1000000
+} cnn_result;
+
+// Winograd conv mode #7: 6x6 input tiles, F(2x2, 5x5) and F(4x4, 3x3).
+// Transformed weights are [36][C][N] floats; the workspace holds one
+// transformed input tile and one 16-channel block of the 36 products.
+#define WINOGRAD_ALPHA      6
+#define WINOGRAD_OC_BLOCK   16
+#define WINOGRAD_MIN_INPUT_CHANNEL  4
+#define WINOGRAD_MAX_INPUT_CHANNEL  48      // workspace fits a 0x4000 scratch
+#define WINOGRAD_WEIGHTS_SIZE(C, N) (WINOGRAD_ALPHA * WINOGRAD_ALPHA * (C) * (N))
+#define WINOGRAD_WORKSPACE_SIZE(C)  ((WINOGRAD_ALPHA * WINOGRAD_ALPHA * ((2 * (C)) + WINOGRAD_OC_BLOCK)) + (C))
+
+// FP16 conv mode #8: weights and activations stored as IEEE half,
+// accumulation in fp32. Activations may be stored divided by a power of
+// two to stay inside the fp16 range; the conv and FC kernels then scale
+// the biases by bias_scale (the reciprocal) to match.
+#ifdef CNN_FP16
+#if defined(__ARM_FP16_FORMAT_IEEE)
+typedef __fp16 cnn_half;
+#else
+typedef _Float16 cnn_half;      // __FLT16_MAX__, see arm_cnn_inference.h
+#endif
+#define FP16_OC_BLOCK       16
+#define FP16_TILE_COLS      4
+#endif
+
+// FC weights repacked by fully_connected_pack(): one panel per
+// FC_PANEL outputs, each biases[FC_PANEL] then weights[K][FC_PANEL],
+// zero padded, so a panel streams contiguously. Size in floats.
+#define FC_PANEL            16
+#define FC_PACKED_SIZE(K, N)    ((((N) + FC_PANEL - 1) / FC_PANEL) * ((K) + 1) * FC_PANEL)
+
+// Batched FC: images per pass, each with FC_BATCH_OC outputs in flight
+// (one float32x4_t), so a pass reads every weight once
+#define FC_BATCH_MAX        16
+#define FC_BATCH_OC         4
+
 float relu(float value);
 int convolution(
     layer_structure *lay,
@@ -28,6 +119,42 @@ int convolution_conv3(
     float *weights,
     float *biases
 );
+int convolution_conv4(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs,
+    float *weights,
+    float *biases,
+    float *workspace    // workspace[CONV_GEMM_MC * CONV_GEMM_KC], im2col panel
+);
+void conv_gemm_pack_a(
+    layer_structure *lay,
+    float *inputs,
+    float *packed,      // packed[mc/MR][kc][MR]
+    unsigned int m0,
+    unsigned int mc,
+    unsigned int k0,
+    unsigned int kc
+);
+void conv_gemm_edge_kernel(
+    unsigned int kc,
+    const float *a,     // a[kc][MR]
+    const float *b,     // b[kc][ldb]
+    unsigned int ldb,
+    float *c,           // c[mr][ldc]
+    unsigned int ldc,
+    unsigned int mr,
+    unsigned int nr,
+    const float *biases,
+    char relu_activation
+);
+int convolution_pool(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs,     // outputs[lay->output_rows / 2][lay->output_columns / 2][N]
+    float *weights,
+    float *biases
+);
 int max_pooling(
     layer_structure *lay,
     float *inputs,
@@ -40,11 +167,214 @@ int fully_connected(
     float *weights,   // weights[lay->filter_rows][lay->filter_columns]
     float *biases     // biases[lay->output_channnel]
 );
+int fully_connected_range(
+    layer_structure *lay,
+    float *inputs,    // inputs[lay->input_channel]
+    float *outputs,   // outputs[lay->output_channel]
+    float *weights,   // weights[lay->input_channel][lay->output_channel]
+    float *biases,    // biases[lay->output_channnel]
+    unsigned int out_begin,
+    unsigned int out_end
+);
+int fully_connected_pack(
+    layer_structure *lay,
+    float *weights,   // weights[lay->input_channel][lay->output_channel]
+    float *biases,    // biases[lay->output_channnel]
+    float *packed     // packed[FC_PACKED_SIZE(K, N)]
+);
+int fully_connected_packed(
+    layer_structure *lay,
+    float *inputs,    // inputs[lay->input_channel]
+    float *outputs,   // outputs[lay->output_channel]
+    float *packed,    // from fully_connected_pack()
+    unsigned int out_begin,     // multiple of FC_PANEL
+    unsigned int out_end
+);
+int fully_connected_batch(
+    layer_structure *lay,
+    float *inputs,    // inputs[batch][lay->input_channel]
+    float *outputs,   // outputs[batch][lay->output_channel]
+    float *weights,   // weights[lay->input_channel][lay->output_channel]
+    float *biases,    // biases[lay->output_channnel]
+    unsigned int batch
+);
+int fully_connected_batch_packed(
+    layer_structure *lay,
+    float *inputs,    // inputs[batch][lay->input_channel]
+    float *outputs,   // outputs[batch][lay->output_channel]
+    float *packed,    // from fully_connected_pack()
+    unsigned int batch
+);
+int convolution_neon(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs,
+    float *weights,
+    float *biases
+);
+int convolution_conv2_neon(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs,
+    float *weights,
+    float *biases
+);
+int convolution_conv4_neon(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs,
+    float *weights,
+    float *biases,
+    float *workspace    // workspace[CONV_GEMM_MC * CONV_GEMM_KC], im2col panel
+);
+int convolution_pool_neon(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs,     // outputs[lay->output_rows / 2][lay->output_columns / 2][N]
+    float *weights,
+    float *biases
+);
+int max_pooling_neon(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs
+);
+int fully_connected_neon(
+    layer_structure *lay,
+    float *inputs,    // inputs[lay->input_channel]
+    float *outputs,   // outputs[lay->output_channel]
+    float *weights,   // weights[lay->input_channel][lay->output_channel]
+    float *biases     // biases[lay->output_channnel]
+);
+int fully_connected_range_neon(
+    layer_structure *lay,
+    float *inputs,    // inputs[lay->input_channel]
+    float *outputs,   // outputs[lay->output_channel]
+    float *weights,   // weights[lay->input_channel][lay->output_channel]
+    float *biases,    // biases[lay->output_channnel]
+    unsigned int out_begin,
+    unsigned int out_end
+);
+int fully_connected_packed_neon(
+    layer_structure *lay,
+    float *inputs,    // inputs[lay->input_channel]
+    float *outputs,   // outputs[lay->output_channel]
+    float *packed,    // from fully_connected_pack()
+    unsigned int out_begin,     // multiple of FC_PANEL
+    unsigned int out_end
+);
+int fully_connected_batch_neon(
+    layer_structure *lay,
+    float *inputs,    // inputs[batch][lay->input_channel]
+    float *outputs,   // outputs[batch][lay->output_channel]
+    float *weights,   // weights[lay->input_channel][lay->output_channel]
+    float *biases,    // biases[lay->output_channnel]
+    unsigned int batch
+);
+int fully_connected_batch_packed_neon(
+    layer_structure *lay,
+    float *inputs,    // inputs[batch][lay->input_channel]
+    float *outputs,   // outputs[batch][lay->output_channel]
+    float *packed,    // from fully_connected_pack()
+    unsigned int batch
+);
+// acc[Np] = weights[Np/4][Kp/4][4][4] . x[Kp], Kp and Np multiples of
+// 4: SDOT where the target has it, else the scalar reference
+void int8_gemv(
+    const signed char *x,
+    const signed char *weights,
+    unsigned int kp,
+    unsigned int np,
+    int *acc
+);
+void int8_gemv_ref(
+    const signed char *x,
+    const signed char *weights,
+    unsigned int kp,
+    unsigned int np,
+    int *acc
+);
+int convolution_int8(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs,
+    signed char *weights,   // weights[Np/4][Kp/4][4][4]
+    float *scales,          // scales[Np]
+    float *biases,          // biases[Np]
+    signed char *workspace
+);
+int fully_connected_int8(
+    layer_structure *lay,
+    float *inputs,          // inputs[lay->input_channel]
+    float *outputs,         // outputs[lay->output_channel]
+    signed char *weights,   // weights[Np/4][Kp/4][4][4]
+    float *scales,          // scales[Np]
+    float *biases,          // biases[Np]
+    signed char *workspace
+);
+unsigned int convolution_winograd_tile(
+    layer_structure *lay
+);
+int convolution_winograd_transform(
+    layer_structure *lay,
+    float *weights,
+    float *transformed      // transformed[WINOGRAD_WEIGHTS_SIZE(C, N)]
+);
+int convolution_winograd(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs,
+    float *transformed,     // from convolution_winograd_transform()
+    float *biases,
+    float *workspace        // workspace[WINOGRAD_WORKSPACE_SIZE(C)]
+);
+#ifdef CNN_FP16
+void cnn_fp32_to_fp16(
+    const float *src,
+    cnn_half *dst,
+    unsigned long n
+);
+void cnn_fp16_to_fp32(
+    const cnn_half *src,
+    float *dst,
+    unsigned long n
+);
+int convolution_fp16(
+    layer_structure *lay,
+    cnn_half *inputs,
+    cnn_half *outputs,
+    cnn_half *weights,      // weights[filter_rows][filter_columns][C][N]
+    cnn_half *biases,
+    float bias_scale        // 1.0f unless the activations are range scaled
+);
+int max_pooling_fp16(
+    layer_structure *lay,
+    cnn_half *inputs,
+    cnn_half *outputs
+);
+int fully_connected_fp16(
+    layer_structure *lay,
+    cnn_half *inputs,
+    cnn_half *outputs,
+    cnn_half *weights,      // weights[lay->input_channel][lay->output_channel]
+    cnn_half *biases,
+    float bias_scale        // 1.0f unless the activations are range scaled
+);
+#endif
 int pre_proc(
     unsigned int *test_images,    // test_images[IMAGE_ROWS][IMAGE_COLUMNS]
     float *outputs                // output[IMAGE_ROWS][IMAGE_COLUMNS]
 );
-int post_proc(
-    float *outlay,
-    unsigned int channel
+int mnist_pre_proc(
+    unsigned int *test_images,    // test_images[IMAGE_ROWS][IMAGE_COLUMNS]
+    unsigned int pixel_format,    // CNN_PIXEL_U32 or CNN_PIXEL_U8
+    float *outputs                // output[IMAGE_ROWS][IMAGE_COLUMNS]
+);
+unsigned int post_proc(
+    const float *outlay,
+    unsigned int channel,
+    cnn_result *result
+);
+void post_proc_report(
+    const cnn_result *result
 );
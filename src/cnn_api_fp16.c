@@ -0,0 +1,464 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Simple CNN Application for Inference only
+ FP16 conv, pooling and FC kernels (conv mode #8), fp32 accumulation
+==================================================================
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "arm_cnn_inference.h"
+#include "mnist.h"
+#include "cnn_api_c.h"
+#include "cnn_neon.h"
+
+#ifdef CNN_FP16
+
+// Weights, biases and activations are stored as IEEE half. Every kernel
+// widens on load and accumulates in fp32, so the only difference from
+// the fp32 kernels is the rounding of each stored tensor, while the
+// bytes moved are halved and a 16-byte load carries 8 values. Output
+// channels are processed FP16_OC_BLOCK at a time with a constant trip
+// count, which lets the compiler keep the fp32 accumulators in
+// registers and vectorize the widening loads (FCVTL on AArch64, F16C
+// on x86 hosts); conv widens each weight once per FP16_TILE_COLS pixels.
+// bias_scale lets the caller keep every activation divided by a power
+// of two: conv, ReLU, pooling and FC commute with that scale as long as
+// the biases are divided by it too.
+// With CNN_NEON on an Arm target, full blocks go through float16x8_t
+// kernels instead: FCVTL/FCVTL2 widening to four float32x4_t, FMLA, and
+// FCVTN back for the stores; partial blocks and x86 hosts stay scalar.
+#if defined(CNN_NEON) && defined(__ARM_NEON) && defined(__ARM_FP16_FORMAT_IEEE) && defined(__aarch64__)
+#define FP16_NEON   1
+#endif
+
+void cnn_fp32_to_fp16(
+    const float *src,
+    cnn_half *dst,
+    unsigned long n
+) {
+    unsigned long i;
+
+    for (i = 0; i < n; i++) {
+        dst[i] = (cnn_half)src[i];
+    }
+}
+
+void cnn_fp16_to_fp32(
+    const cnn_half *src,
+    float *dst,
+    unsigned long n
+) {
+    unsigned long i;
+
+    for (i = 0; i < n; i++) {
+        dst[i] = (float)src[i];
+    }
+}
+
+// Widen w[0, nb) into wf[]; the lanes from nb up stay zero, so the
+// multiply-accumulate loops below always run FP16_OC_BLOCK lanes
+static inline void fp16_widen_block(
+    const cnn_half *w,
+    float *wf,
+    unsigned int nb
+) {
+    unsigned int o;
+
+    if (nb == FP16_OC_BLOCK) {
+        for (o = 0; o < FP16_OC_BLOCK; o++) {
+            wf[o] = (float)w[o];
+        }
+    }
+    else {
+        for (o = 0; o < nb; o++) {
+            wf[o] = (float)w[o];
+        }
+    }
+}
+
+// Channels [out_ch, out_ch + nb) of output pixels [stride_col, stride_col
+// + cols) in row stride_row: every widened weight is used cols times
+static void fp16_conv_tile(
+    layer_structure *lay,
+    const cnn_half *inputs,
+    cnn_half *outputs,
+    const cnn_half *weights,
+    const cnn_half *biases,
+    float bias_scale,
+    unsigned int stride_row,
+    unsigned int stride_col,
+    unsigned int cols,
+    unsigned int out_ch,
+    unsigned int nb
+) {
+    unsigned int C = lay->input_channel;
+    unsigned int N = lay->output_channel;
+    unsigned int filter_row_len = lay->filter_columns * C;
+    unsigned int input_row_len = lay->input_columns * C;
+    unsigned int filter_row;
+    unsigned int k;
+    unsigned int o;
+    unsigned int px;
+    const cnn_half *in_row;
+    const cnn_half *w_row;
+    cnn_half *out;
+    float current_input;
+    float kernel_result;
+    float wf[FP16_OC_BLOCK] = { 0.0f };
+    float acc[FP16_TILE_COLS][FP16_OC_BLOCK];
+
+    for (px = 0; px < cols; px++) {
+        for (o = 0; o < FP16_OC_BLOCK; o++) {
+            acc[px][o] = (o < nb) ? (float)biases[out_ch + o] * bias_scale : 0.0f;
+        }
+    }
+    for (filter_row = 0; filter_row < lay->filter_rows; filter_row++) {
+        // filter_columns * input_channel inputs are contiguous in HWC
+        in_row = inputs + ((stride_row + filter_row) * input_row_len) + (stride_col * C);
+        w_row = weights + (filter_row * filter_row_len * N) + out_ch;
+        for (k = 0; k < filter_row_len; k++) {
+            fp16_widen_block(w_row, wf, nb);
+            for (px = 0; px < cols; px++) {
+                current_input = (float)in_row[(px * C) + k];
+                for (o = 0; o < FP16_OC_BLOCK; o++) {
+                    acc[px][o] += current_input * wf[o];
+                }
+            }
+            w_row += N;
+        }
+    }
+
+    for (px = 0; px < cols; px++) {
+        out = outputs + (((stride_row * lay->output_columns) + stride_col + px) * N) + out_ch;
+        for (o = 0; o < nb; o++) {
+            kernel_result = acc[px][o];
+            if (lay->relu_activation == 1) {
+                kernel_result = relu(kernel_result);
+            }
+            out[o] = (cnn_half)kernel_result;
+        }
+    }
+}
+
+#ifdef FP16_NEON
+// 8 halves from p as two float32x4_t
+static inline void fp16_neon_load8(const cnn_half *p, float32x4_t *lo, float32x4_t *hi)
+{
+    float16x8_t h = vld1q_f16(p);
+
+    *lo = vcvt_f32_f16(vget_low_f16(h));
+    *hi = vcvt_high_f32_f16(h);
+}
+
+// Rounds lo, hi to 8 halves at p, after the ReLU if relu_activation
+static inline void fp16_neon_store8(cnn_half *p, float32x4_t lo, float32x4_t hi, char relu_activation)
+{
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+
+    if (relu_activation == 1) {
+        lo = vmaxq_f32(lo, zero);
+        hi = vmaxq_f32(hi, zero);
+    }
+    vst1q_f16(p, vcombine_f16(vcvt_f16_f32(lo), vcvt_f16_f32(hi)));
+}
+
+// Lane-wise max; without the ARMv8.2-A half arithmetic it is done
+// widened, which is exact for max
+static inline float16x8_t fp16_neon_max8(float16x8_t a, float16x8_t b)
+{
+#ifdef __ARM_FEATURE_FP16_VECTOR_ARITHMETIC
+    return vmaxq_f16(a, b);
+#else
+    float32x4_t lo = vmaxq_f32(vcvt_f32_f16(vget_low_f16(a)), vcvt_f32_f16(vget_low_f16(b)));
+    float32x4_t hi = vmaxq_f32(vcvt_high_f32_f16(a), vcvt_high_f32_f16(b));
+
+    return vcombine_f16(vcvt_f16_f32(lo), vcvt_f16_f32(hi));
+#endif
+}
+
+// fp16_conv_tile() for cols == FP16_TILE_COLS, nb == FP16_OC_BLOCK:
+// 16 float32x4_t accumulators, each widened weight row used 4 times
+static void fp16_conv_tile_neon(
+    layer_structure *lay,
+    const cnn_half *inputs,
+    cnn_half *outputs,
+    const cnn_half *weights,
+    const cnn_half *biases,
+    float bias_scale,
+    unsigned int stride_row,
+    unsigned int stride_col,
+    unsigned int out_ch
+) {
+    unsigned int C = lay->input_channel;
+    unsigned int N = lay->output_channel;
+    unsigned int filter_row_len = lay->filter_columns * C;
+    unsigned int input_row_len = lay->input_columns * C;
+    unsigned int filter_row;
+    unsigned int k;
+    unsigned int px;
+    const cnn_half *in_row;
+    const cnn_half *w_row;
+    cnn_half *out;
+    float current_input;
+    float32x4_t w0, w1, w2, w3;
+    float32x4_t acc[FP16_TILE_COLS][4];
+
+    fp16_neon_load8(biases + out_ch, &w0, &w1);
+    fp16_neon_load8(biases + out_ch + 8, &w2, &w3);
+    for (px = 0; px < FP16_TILE_COLS; px++) {
+        acc[px][0] = vmulq_n_f32(w0, bias_scale);
+        acc[px][1] = vmulq_n_f32(w1, bias_scale);
+        acc[px][2] = vmulq_n_f32(w2, bias_scale);
+        acc[px][3] = vmulq_n_f32(w3, bias_scale);
+    }
+    for (filter_row = 0; filter_row < lay->filter_rows; filter_row++) {
+        // filter_columns * input_channel inputs are contiguous in HWC
+        in_row = inputs + ((stride_row + filter_row) * input_row_len) + (stride_col * C);
+        w_row = weights + (filter_row * filter_row_len * N) + out_ch;
+        for (k = 0; k < filter_row_len; k++) {
+            fp16_neon_load8(w_row, &w0, &w1);
+            fp16_neon_load8(w_row + 8, &w2, &w3);
+            for (px = 0; px < FP16_TILE_COLS; px++) {
+                current_input = (float)in_row[(px * C) + k];
+                acc[px][0] = vfmaq_n_f32(acc[px][0], w0, current_input);
+                acc[px][1] = vfmaq_n_f32(acc[px][1], w1, current_input);
+                acc[px][2] = vfmaq_n_f32(acc[px][2], w2, current_input);
+                acc[px][3] = vfmaq_n_f32(acc[px][3], w3, current_input);
+            }
+            w_row += N;
+        }
+    }
+
+    for (px = 0; px < FP16_TILE_COLS; px++) {
+        out = outputs + (((stride_row * lay->output_columns) + stride_col + px) * N) + out_ch;
+        fp16_neon_store8(out, acc[px][0], acc[px][1], lay->relu_activation);
+        fp16_neon_store8(out + 8, acc[px][2], acc[px][3], lay->relu_activation);
+    }
+}
+#endif
+
+int convolution_fp16(
+    layer_structure *lay,
+    cnn_half *inputs,
+    cnn_half *outputs,
+    cnn_half *weights,
+    cnn_half *biases,
+    float bias_scale
+) {
+    unsigned int N = lay->output_channel;
+    unsigned int stride_row;
+    unsigned int stride_col;
+    unsigned int cols;
+    unsigned int out_ch;
+
+    for (stride_row = 0; stride_row < lay->output_rows; stride_row++) {
+        for (stride_col = 0; stride_col < lay->output_columns; stride_col += FP16_TILE_COLS) {
+            cols = lay->output_columns - stride_col;
+            if (cols > FP16_TILE_COLS) {
+                cols = FP16_TILE_COLS;
+            }
+            for (out_ch = 0; out_ch < N; out_ch += FP16_OC_BLOCK) {
+#ifdef FP16_NEON
+                if (cols == FP16_TILE_COLS && N - out_ch >= FP16_OC_BLOCK) {
+                    fp16_conv_tile_neon(lay, inputs, outputs, weights, biases, bias_scale,
+                                        stride_row, stride_col, out_ch);
+                    continue;
+                }
+#endif
+                fp16_conv_tile(lay, inputs, outputs, weights, biases, bias_scale, stride_row, stride_col, cols,
+                               out_ch, (N - out_ch < FP16_OC_BLOCK) ? N - out_ch : FP16_OC_BLOCK);
+            }
+        }
+    }
+
+    return 0;
+}
+
+int max_pooling_fp16(
+    layer_structure *lay,
+    cnn_half *inputs,
+    cnn_half *outputs
+) {
+    unsigned int C = lay->input_channel;
+    unsigned int output_row;
+    unsigned int output_col;
+    unsigned int filter_row;
+    unsigned int filter_col;
+    unsigned int ch;
+    unsigned int ch_begin = 0;
+    const cnn_half *in;
+    cnn_half *out;
+#ifdef FP16_NEON
+    float16x8_t max;
+    unsigned int window;
+#endif
+
+    // max is exact in any precision, so compare the halves directly
+    for (output_row = 0; output_row < lay->output_rows; output_row++) {
+        for (output_col = 0; output_col < lay->output_columns; output_col++) {
+            out = outputs + (((output_row * lay->output_columns) + output_col) * C);
+#ifdef FP16_NEON
+            // 8 channels per float16x8_t, the window rows are C apart
+            in = inputs + ((((output_row * lay->filter_rows) * lay->input_columns)
+                            + (output_col * lay->filter_columns)) * C);
+            for (ch_begin = 0; ch_begin + 8 <= C; ch_begin += 8) {
+                max = vld1q_f16(in + ch_begin);
+                for (window = 1; window < lay->filter_rows * lay->filter_columns; window++) {
+                    filter_row = window / lay->filter_columns;
+                    filter_col = window % lay->filter_columns;
+                    max = fp16_neon_max8(max, vld1q_f16(in + (((filter_row * lay->input_columns) + filter_col) * C) + ch_begin));
+                }
+                vst1q_f16(out + ch_begin, max);
+            }
+#endif
+            for (filter_row = 0; filter_row < lay->filter_rows; filter_row++) {
+                for (filter_col = 0; filter_col < lay->filter_columns; filter_col++) {
+                    in = inputs + ((((output_row * lay->filter_rows) + filter_row) * lay->input_columns
+                                    + (output_col * lay->filter_columns) + filter_col) * C);
+                    for (ch = ch_begin; ch < C; ch++) {
+                        if ((filter_row == 0 && filter_col == 0) || out[ch] < in[ch]) {
+                            out[ch] = in[ch];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Outputs [out_ch, out_ch + nb) of an FC layer with weights[K][N]
+static void fp16_fc_block(
+    layer_structure *lay,
+    const cnn_half *inputs,
+    cnn_half *outputs,
+    const cnn_half *weights,
+    const cnn_half *biases,
+    float bias_scale,
+    unsigned int out_ch,
+    unsigned int nb
+) {
+    unsigned int K = lay->input_channel;
+    unsigned int N = lay->output_channel;
+    unsigned int k;
+    unsigned int o;
+    const cnn_half *w_row = weights + out_ch;
+    float current_input;
+    float kernel_result;
+    float wf[FP16_OC_BLOCK] = { 0.0f };
+    float acc[FP16_OC_BLOCK];
+
+    for (o = 0; o < FP16_OC_BLOCK; o++) {
+        acc[o] = (o < nb) ? (float)biases[out_ch + o] * bias_scale : 0.0f;
+    }
+    for (k = 0; k < K; k++) {
+        fp16_widen_block(w_row, wf, nb);
+        current_input = (float)inputs[k];
+        for (o = 0; o < FP16_OC_BLOCK; o++) {
+            acc[o] += current_input * wf[o];
+        }
+        w_row += N;
+    }
+    for (o = 0; o < nb; o++) {
+        kernel_result = acc[o];
+        if (lay->relu_activation == 1) {
+            kernel_result = relu(kernel_result);
+        }
+        outputs[out_ch + o] = (cnn_half)kernel_result;
+    }
+}
+
+#ifdef FP16_NEON
+// fp16_fc_block() for nb == FP16_OC_BLOCK: two inputs per step, each
+// with its own 4 float32x4_t accumulators, so 8 FMLA chains are in flight
+static void fp16_fc_block_neon(
+    layer_structure *lay,
+    const cnn_half *inputs,
+    cnn_half *outputs,
+    const cnn_half *weights,
+    const cnn_half *biases,
+    float bias_scale,
+    unsigned int out_ch
+) {
+    unsigned int K = lay->input_channel;
+    unsigned int N = lay->output_channel;
+    unsigned int k;
+    const cnn_half *w_row = weights + out_ch;
+    float input0, input1;
+    float32x4_t w0, w1, w2, w3;
+    float32x4_t acc0, acc1, acc2, acc3;
+    float32x4_t odd0, odd1, odd2, odd3;
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+
+    fp16_neon_load8(biases + out_ch, &w0, &w1);
+    fp16_neon_load8(biases + out_ch + 8, &w2, &w3);
+    acc0 = vmulq_n_f32(w0, bias_scale);
+    acc1 = vmulq_n_f32(w1, bias_scale);
+    acc2 = vmulq_n_f32(w2, bias_scale);
+    acc3 = vmulq_n_f32(w3, bias_scale);
+    odd0 = zero;
+    odd1 = zero;
+    odd2 = zero;
+    odd3 = zero;
+    for (k = 0; k + 2 <= K; k += 2) {
+        input0 = (float)inputs[k];
+        input1 = (float)inputs[k + 1];
+        fp16_neon_load8(w_row, &w0, &w1);
+        fp16_neon_load8(w_row + 8, &w2, &w3);
+        acc0 = vfmaq_n_f32(acc0, w0, input0);
+        acc1 = vfmaq_n_f32(acc1, w1, input0);
+        acc2 = vfmaq_n_f32(acc2, w2, input0);
+        acc3 = vfmaq_n_f32(acc3, w3, input0);
+        fp16_neon_load8(w_row + N, &w0, &w1);
+        fp16_neon_load8(w_row + N + 8, &w2, &w3);
+        odd0 = vfmaq_n_f32(odd0, w0, input1);
+        odd1 = vfmaq_n_f32(odd1, w1, input1);
+        odd2 = vfmaq_n_f32(odd2, w2, input1);
+        odd3 = vfmaq_n_f32(odd3, w3, input1);
+        w_row += 2 * N;
+    }
+    if (k < K) {
+        input0 = (float)inputs[k];
+        fp16_neon_load8(w_row, &w0, &w1);
+        fp16_neon_load8(w_row + 8, &w2, &w3);
+        acc0 = vfmaq_n_f32(acc0, w0, input0);
+        acc1 = vfmaq_n_f32(acc1, w1, input0);
+        acc2 = vfmaq_n_f32(acc2, w2, input0);
+        acc3 = vfmaq_n_f32(acc3, w3, input0);
+    }
+
+    fp16_neon_store8(outputs + out_ch, vaddq_f32(acc0, odd0), vaddq_f32(acc1, odd1), lay->relu_activation);
+    fp16_neon_store8(outputs + out_ch + 8, vaddq_f32(acc2, odd2), vaddq_f32(acc3, odd3), lay->relu_activation);
+}
+#endif
+
+int fully_connected_fp16(
+    layer_structure *lay,
+    cnn_half *inputs,
+    cnn_half *outputs,
+    cnn_half *weights,
+    cnn_half *biases,
+    float bias_scale
+) {
+    unsigned int N = lay->output_channel;
+    unsigned int out_ch;
+
+    for (out_ch = 0; out_ch < N; out_ch += FP16_OC_BLOCK) {
+#ifdef FP16_NEON
+        if (N - out_ch >= FP16_OC_BLOCK) {
+            fp16_fc_block_neon(lay, inputs, outputs, weights, biases, bias_scale, out_ch);
+            continue;
+        }
+#endif
+        fp16_fc_block(lay, inputs, outputs, weights, biases, bias_scale,
+                      out_ch, (N - out_ch < FP16_OC_BLOCK) ? N - out_ch : FP16_OC_BLOCK);
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,235 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Simple CNN Application for Inference only
+ INT8 conv and FC kernels (SDOT), weights from mnist_cnn_quantize.py
+==================================================================
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "arm_cnn_inference.h"
+#include "mnist.h"
+#include "cnn_api_c.h"
+#if defined(__ARM_FEATURE_DOTPROD)
+#include <arm_neon.h>
+#endif
+
+#ifdef CNN_CONV_5
+
+// Weights are symmetric int8 per output channel: w = q * scales[o].
+// Activations are quantized per tensor on the fly: x = q * scale_in,
+// with scale_in = max|x| / 127. A layer then needs only int8 dot
+// products, and dequantizes once per output:
+//    y[o] = acc[o] * scale_in * scales[o] + biases[o]
+//
+// Packed weight layout: weights[Np/4][Kp/4][4][4], i.e. 16 bytes hold 4
+// consecutive inputs for each of 4 consecutive outputs, which is what
+// one SDOT consumes.
+
+#define INT8_ROUND_UP(x, a)   (((x) + (a) - 1) / (a) * (a))
+
+static float int8_quantize(
+    const float *inputs,
+    signed char *outputs,
+    unsigned int len
+) {
+    unsigned int i;
+    float amax = 0.0f;
+    float scale, inv_scale, v;
+
+    for (i = 0; i < len; i++) {
+        v = fabsf(inputs[i]);
+        if (amax < v) {
+            amax = v;
+        }
+    }
+    scale = (amax > 0.0f) ? (amax / 127.0f) : 1.0f;
+    inv_scale = 1.0f / scale;
+
+    for (i = 0; i < len; i++) {
+        v = inputs[i] * inv_scale;
+        outputs[i] = (signed char)(int)(v + ((v >= 0.0f) ? 0.5f : -0.5f));
+    }
+
+    return scale;
+}
+
+// Scalar reference: acc[Np] = packed_weights[Np][Kp] . x[Kp]
+void int8_gemv_ref(
+    const signed char *x,
+    const signed char *weights,
+    unsigned int kp,
+    unsigned int np,
+    int *acc
+) {
+    unsigned int o, j, k, t;
+    const signed char *w;
+    int sum;
+
+    for (o = 0; o < np; o += 4) {
+        for (j = 0; j < 4; j++) {
+            // output o + j: 4 weights at each 16-byte step
+            w = weights + (o * kp) + (j * 4);
+            sum = 0;
+            for (k = 0; k < kp; k += 4) {
+                for (t = 0; t < 4; t++) {
+                    sum += x[k + t] * w[(k * 4) + t];
+                }
+            }
+            acc[o + j] = sum;
+        }
+    }
+}
+
+#if defined(__ARM_FEATURE_DOTPROD)
+static void int8_gemv_sdot(
+    const signed char *x,
+    const signed char *weights,
+    unsigned int kp,
+    unsigned int np,
+    int *acc
+) {
+    unsigned int o, k;
+    const int8_t *w;
+    int8x16_t xv;
+    int32x4_t sum;
+
+    for (o = 0; o < np; o += 4) {
+        w = (const int8_t *)weights + o * kp;
+        sum = vdupq_n_s32(0);
+        for (k = 0; k + 16 <= kp; k += 16) {
+            xv = vld1q_s8((const int8_t *)x + k);
+            sum = vdotq_laneq_s32(sum, vld1q_s8(w + 0), xv, 0);
+            sum = vdotq_laneq_s32(sum, vld1q_s8(w + 16), xv, 1);
+            sum = vdotq_laneq_s32(sum, vld1q_s8(w + 32), xv, 2);
+            sum = vdotq_laneq_s32(sum, vld1q_s8(w + 48), xv, 3);
+            w += 64;
+        }
+        for (; k < kp; k += 4) {
+            xv = vreinterpretq_s8_s32(vld1q_dup_s32((const int32_t *)(x + k)));
+            sum = vdotq_s32(sum, vld1q_s8(w), xv);
+            w += 16;
+        }
+        vst1q_s32(acc + o, sum);
+    }
+}
+#endif
+
+void int8_gemv(
+    const signed char *x,
+    const signed char *weights,
+    unsigned int kp,
+    unsigned int np,
+    int *acc
+) {
+#if defined(__ARM_FEATURE_DOTPROD)
+    int8_gemv_sdot(x, weights, kp, np, acc);
+#else
+    int8_gemv_ref(x, weights, kp, np, acc);
+#endif
+}
+
+static void int8_dequantize(
+    const int *acc,
+    float scale_in,
+    const float *scales,
+    const float *biases,
+    float *outputs,
+    unsigned int n,
+    char relu_activation
+) {
+    unsigned int o;
+    float v;
+
+    for (o = 0; o < n; o++) {
+        v = (float)acc[o] * (scale_in * scales[o]) + biases[o];
+        if (relu_activation == 1) {
+            v = relu(v);
+        }
+        outputs[o] = v;
+    }
+}
+
+int convolution_int8(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs,
+    signed char *weights,   // weights[Np/4][Kp/4][4][4]
+    float *scales,          // scales[Np]
+    float *biases,          // biases[Np]
+    signed char *workspace  // quantized input, im2col row and accumulators
+) {
+    unsigned int in_len = lay->input_rows * lay->input_columns * lay->input_channel;
+    unsigned int filter_row_len = lay->filter_columns * lay->input_channel;
+    unsigned int input_row_len = lay->input_columns * lay->input_channel;
+    unsigned int K = lay->filter_rows * filter_row_len;
+    unsigned int kp = INT8_ROUND_UP(K, 4);
+    unsigned int np = INT8_ROUND_UP(lay->output_channel, 4);
+    signed char *qin = workspace;
+    signed char *row = qin + INT8_ROUND_UP(in_len, 16);
+    int *acc = (int *)(row + INT8_ROUND_UP(kp, 16));
+    unsigned int stride_row, stride_col, filter_row, k;
+    signed char *src;
+    float scale_in;
+
+    scale_in = int8_quantize(inputs, qin, in_len);
+    for (k = K; k < kp; k++) {
+        row[k] = 0;
+    }
+
+    for (stride_row = 0; stride_row < lay->output_rows; stride_row++) {
+        for (stride_col = 0; stride_col < lay->output_columns; stride_col++) {
+            // im2col row for this output pixel
+            for (filter_row = 0; filter_row < lay->filter_rows; filter_row++) {
+                src = qin + ((stride_row + filter_row) * input_row_len) + (stride_col * lay->input_channel);
+                for (k = 0; k < filter_row_len; k++) {
+                    row[(filter_row * filter_row_len) + k] = src[k];
+                }
+            }
+
+            int8_gemv(row, weights, kp, np, acc);
+            int8_dequantize(
+                acc,
+                scale_in,
+                scales,
+                biases,
+                outputs + ((stride_row * lay->output_columns) + stride_col) * lay->output_channel,
+                lay->output_channel,
+                lay->relu_activation
+            );
+        }
+    }
+
+    return 0;
+}
+
+int fully_connected_int8(
+    layer_structure *lay,
+    float *inputs,          // inputs[lay->input_channel]
+    float *outputs,         // outputs[lay->output_channel]
+    signed char *weights,   // weights[Np/4][Kp/4][4][4]
+    float *scales,          // scales[Np]
+    float *biases,          // biases[Np]
+    signed char *workspace  // quantized input and accumulators
+) {
+    unsigned int kp = INT8_ROUND_UP(lay->input_channel, 4);
+    unsigned int np = INT8_ROUND_UP(lay->output_channel, 4);
+    signed char *qin = workspace;
+    int *acc = (int *)(qin + INT8_ROUND_UP(kp, 16));
+    unsigned int k;
+    float scale_in;
+
+    scale_in = int8_quantize(inputs, qin, lay->input_channel);
+    for (k = lay->input_channel; k < kp; k++) {
+        qin[k] = 0;
+    }
+
+    int8_gemv(qin, weights, kp, np, acc);
+    int8_dequantize(acc, scale_in, scales, biases, outputs, lay->output_channel, lay->relu_activation);
+
+    return 0;
+}
+
+#endif
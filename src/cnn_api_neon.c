@@ -0,0 +1,859 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Simple CNN Application for Inference only
+ NEON (float32x4_t) variants of the conv, pooling and FC kernels
+==================================================================
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "arm_cnn_inference.h"
+#include "mnist.h"
+#include "cnn_api_c.h"
+#include "cnn_neon.h"
+
+#ifdef CNN_NEON
+
+// Output channels accumulated in registers per pass: 4 x float32x4_t
+#define NEON_OC_BLOCK   16
+
+int convolution_neon(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs,
+    float *weights,
+    float *biases
+) {
+    unsigned int N = lay->output_channel;
+    unsigned int filter_row_len = lay->filter_columns * lay->input_channel;
+    unsigned int input_row_len = lay->input_columns * lay->input_channel;
+    unsigned int stride_row;
+    unsigned int stride_col;
+    unsigned int filter_row;
+    unsigned int out_ch;
+    unsigned int k;
+    float *in_row;
+    float *w_row;
+    float *out;
+    float current_input;
+    float32x4_t acc0, acc1, acc2, acc3;
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+
+    if (N % 4) {
+        return convolution(lay, inputs, outputs, weights, biases);
+    }
+
+    for (stride_row = 0; stride_row < lay->output_rows; stride_row++) {
+        for (stride_col = 0; stride_col < lay->output_columns; stride_col++) {
+            out = outputs + ((stride_row * lay->output_columns) + stride_col) * N;
+
+            for (out_ch = 0; out_ch + NEON_OC_BLOCK <= N; out_ch += NEON_OC_BLOCK) {
+                acc0 = vld1q_f32(biases + out_ch + 0);
+                acc1 = vld1q_f32(biases + out_ch + 4);
+                acc2 = vld1q_f32(biases + out_ch + 8);
+                acc3 = vld1q_f32(biases + out_ch + 12);
+
+                for (filter_row = 0; filter_row < lay->filter_rows; filter_row++) {
+                    // filter_columns * input_channel inputs are contiguous in HWC
+                    in_row = inputs + ((stride_row + filter_row) * input_row_len) + (stride_col * lay->input_channel);
+                    w_row = weights + (filter_row * filter_row_len * N) + out_ch;
+                    for (k = 0; k < filter_row_len; k++) {
+                        current_input = in_row[k];
+                        acc0 = vfmaq_n_f32(acc0, vld1q_f32(w_row + 0), current_input);
+                        acc1 = vfmaq_n_f32(acc1, vld1q_f32(w_row + 4), current_input);
+                        acc2 = vfmaq_n_f32(acc2, vld1q_f32(w_row + 8), current_input);
+                        acc3 = vfmaq_n_f32(acc3, vld1q_f32(w_row + 12), current_input);
+                        w_row += N;
+                    }
+                }
+
+                if (lay->relu_activation == 1) {
+                    acc0 = vmaxq_f32(acc0, zero);
+                    acc1 = vmaxq_f32(acc1, zero);
+                    acc2 = vmaxq_f32(acc2, zero);
+                    acc3 = vmaxq_f32(acc3, zero);
+                }
+                vst1q_f32(out + out_ch + 0, acc0);
+                vst1q_f32(out + out_ch + 4, acc1);
+                vst1q_f32(out + out_ch + 8, acc2);
+                vst1q_f32(out + out_ch + 12, acc3);
+            }
+
+            for (; out_ch < N; out_ch += 4) {
+                acc0 = vld1q_f32(biases + out_ch);
+
+                for (filter_row = 0; filter_row < lay->filter_rows; filter_row++) {
+                    in_row = inputs + ((stride_row + filter_row) * input_row_len) + (stride_col * lay->input_channel);
+                    w_row = weights + (filter_row * filter_row_len * N) + out_ch;
+                    for (k = 0; k < filter_row_len; k++) {
+                        acc0 = vfmaq_n_f32(acc0, vld1q_f32(w_row), in_row[k]);
+                        w_row += N;
+                    }
+                }
+
+                if (lay->relu_activation == 1) {
+                    acc0 = vmaxq_f32(acc0, zero);
+                }
+                vst1q_f32(out + out_ch, acc0);
+            }
+        }
+    }
+
+    return 0;
+}
+
+#ifdef CNN_CONV_2
+// Conv mode #2: CONV2_TILE_COLS (4) adjacent pixels x 16 channels are
+// held in 16 accumulators across the whole filter window, so each
+// weight vector loaded feeds 4 FMAs and each output is stored once.
+// Columns left over at the end of a row run through convolution_neon()
+// as a 1-row slice.
+int convolution_conv2_neon(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs,
+    float *weights,
+    float *biases
+) {
+    unsigned int N = lay->output_channel;
+    unsigned int C = lay->input_channel;
+    unsigned int filter_row_len = lay->filter_columns * C;
+    unsigned int input_row_len = lay->input_columns * C;
+    unsigned int tile_cols = lay->output_columns - (lay->output_columns % CONV2_TILE_COLS);
+    unsigned int stride_row;
+    unsigned int stride_col;
+    unsigned int filter_row;
+    unsigned int out_ch;
+    unsigned int k;
+    float *in_row;
+    float *w_row;
+    float *out;
+    float32x4_t w0, w1, w2, w3;
+    float32x4_t acc00, acc01, acc02, acc03;
+    float32x4_t acc10, acc11, acc12, acc13;
+    float32x4_t acc20, acc21, acc22, acc23;
+    float32x4_t acc30, acc31, acc32, acc33;
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    layer_structure slice;
+
+    if (N % 4) {
+        return convolution_conv2(lay, inputs, outputs, weights, biases);
+    }
+
+    for (stride_row = 0; stride_row < lay->output_rows; stride_row++) {
+        for (stride_col = 0; stride_col < tile_cols; stride_col += CONV2_TILE_COLS) {
+            out = outputs + ((stride_row * lay->output_columns) + stride_col) * N;
+
+            for (out_ch = 0; out_ch + NEON_OC_BLOCK <= N; out_ch += NEON_OC_BLOCK) {
+                // accPB: pixel stride_col + P, channels out_ch + 4 * B
+                acc00 = acc10 = acc20 = acc30 = vld1q_f32(biases + out_ch + 0);
+                acc01 = acc11 = acc21 = acc31 = vld1q_f32(biases + out_ch + 4);
+                acc02 = acc12 = acc22 = acc32 = vld1q_f32(biases + out_ch + 8);
+                acc03 = acc13 = acc23 = acc33 = vld1q_f32(biases + out_ch + 12);
+
+                for (filter_row = 0; filter_row < lay->filter_rows; filter_row++) {
+                    in_row = inputs + ((stride_row + filter_row) * input_row_len) + (stride_col * C);
+                    w_row = weights + (filter_row * filter_row_len * N) + out_ch;
+                    for (k = 0; k < filter_row_len; k++) {
+                        w0 = vld1q_f32(w_row + 0);
+                        w1 = vld1q_f32(w_row + 4);
+                        w2 = vld1q_f32(w_row + 8);
+                        w3 = vld1q_f32(w_row + 12);
+                        acc00 = vfmaq_n_f32(acc00, w0, in_row[k]);
+                        acc01 = vfmaq_n_f32(acc01, w1, in_row[k]);
+                        acc02 = vfmaq_n_f32(acc02, w2, in_row[k]);
+                        acc03 = vfmaq_n_f32(acc03, w3, in_row[k]);
+                        acc10 = vfmaq_n_f32(acc10, w0, in_row[k + C]);
+                        acc11 = vfmaq_n_f32(acc11, w1, in_row[k + C]);
+                        acc12 = vfmaq_n_f32(acc12, w2, in_row[k + C]);
+                        acc13 = vfmaq_n_f32(acc13, w3, in_row[k + C]);
+                        acc20 = vfmaq_n_f32(acc20, w0, in_row[k + (2 * C)]);
+                        acc21 = vfmaq_n_f32(acc21, w1, in_row[k + (2 * C)]);
+                        acc22 = vfmaq_n_f32(acc22, w2, in_row[k + (2 * C)]);
+                        acc23 = vfmaq_n_f32(acc23, w3, in_row[k + (2 * C)]);
+                        acc30 = vfmaq_n_f32(acc30, w0, in_row[k + (3 * C)]);
+                        acc31 = vfmaq_n_f32(acc31, w1, in_row[k + (3 * C)]);
+                        acc32 = vfmaq_n_f32(acc32, w2, in_row[k + (3 * C)]);
+                        acc33 = vfmaq_n_f32(acc33, w3, in_row[k + (3 * C)]);
+                        w_row += N;
+                    }
+                }
+
+                if (lay->relu_activation == 1) {
+                    acc00 = vmaxq_f32(acc00, zero);
+                    acc01 = vmaxq_f32(acc01, zero);
+                    acc02 = vmaxq_f32(acc02, zero);
+                    acc03 = vmaxq_f32(acc03, zero);
+                    acc10 = vmaxq_f32(acc10, zero);
+                    acc11 = vmaxq_f32(acc11, zero);
+                    acc12 = vmaxq_f32(acc12, zero);
+                    acc13 = vmaxq_f32(acc13, zero);
+                    acc20 = vmaxq_f32(acc20, zero);
+                    acc21 = vmaxq_f32(acc21, zero);
+                    acc22 = vmaxq_f32(acc22, zero);
+                    acc23 = vmaxq_f32(acc23, zero);
+                    acc30 = vmaxq_f32(acc30, zero);
+                    acc31 = vmaxq_f32(acc31, zero);
+                    acc32 = vmaxq_f32(acc32, zero);
+                    acc33 = vmaxq_f32(acc33, zero);
+                }
+                vst1q_f32(out + out_ch + 0, acc00);
+                vst1q_f32(out + out_ch + 4, acc01);
+                vst1q_f32(out + out_ch + 8, acc02);
+                vst1q_f32(out + out_ch + 12, acc03);
+                vst1q_f32(out + N + out_ch + 0, acc10);
+                vst1q_f32(out + N + out_ch + 4, acc11);
+                vst1q_f32(out + N + out_ch + 8, acc12);
+                vst1q_f32(out + N + out_ch + 12, acc13);
+                vst1q_f32(out + (2 * N) + out_ch + 0, acc20);
+                vst1q_f32(out + (2 * N) + out_ch + 4, acc21);
+                vst1q_f32(out + (2 * N) + out_ch + 8, acc22);
+                vst1q_f32(out + (2 * N) + out_ch + 12, acc23);
+                vst1q_f32(out + (3 * N) + out_ch + 0, acc30);
+                vst1q_f32(out + (3 * N) + out_ch + 4, acc31);
+                vst1q_f32(out + (3 * N) + out_ch + 8, acc32);
+                vst1q_f32(out + (3 * N) + out_ch + 12, acc33);
+            }
+
+            for (; out_ch < N; out_ch += 4) {
+                acc00 = acc10 = acc20 = acc30 = vld1q_f32(biases + out_ch);
+
+                for (filter_row = 0; filter_row < lay->filter_rows; filter_row++) {
+                    in_row = inputs + ((stride_row + filter_row) * input_row_len) + (stride_col * C);
+                    w_row = weights + (filter_row * filter_row_len * N) + out_ch;
+                    for (k = 0; k < filter_row_len; k++) {
+                        w0 = vld1q_f32(w_row);
+                        acc00 = vfmaq_n_f32(acc00, w0, in_row[k]);
+                        acc10 = vfmaq_n_f32(acc10, w0, in_row[k + C]);
+                        acc20 = vfmaq_n_f32(acc20, w0, in_row[k + (2 * C)]);
+                        acc30 = vfmaq_n_f32(acc30, w0, in_row[k + (3 * C)]);
+                        w_row += N;
+                    }
+                }
+
+                if (lay->relu_activation == 1) {
+                    acc00 = vmaxq_f32(acc00, zero);
+                    acc10 = vmaxq_f32(acc10, zero);
+                    acc20 = vmaxq_f32(acc20, zero);
+                    acc30 = vmaxq_f32(acc30, zero);
+                }
+                vst1q_f32(out + out_ch, acc00);
+                vst1q_f32(out + N + out_ch, acc10);
+                vst1q_f32(out + (2 * N) + out_ch, acc20);
+                vst1q_f32(out + (3 * N) + out_ch, acc30);
+            }
+        }
+
+        if (tile_cols < lay->output_columns) {
+            // input rows keep their stride, so one output row is a valid layer
+            slice = *lay;
+            slice.output_rows = 1;
+            slice.output_columns = lay->output_columns - tile_cols;
+            convolution_neon(&slice,
+                             inputs + (stride_row * input_row_len) + (tile_cols * C),
+                             outputs + ((stride_row * lay->output_columns) + tile_cols) * N,
+                             weights, biases);
+        }
+    }
+
+    return 0;
+}
+#endif
+
+#ifdef CNN_CONV_4
+// Conv mode #4 micro-kernel: the 4 x 8 tile is 8 accumulators (two
+// float32x4_t of output channels per pixel). Each k loads one B row as
+// two vectors and broadcasts the 4 packed pixels, 8 FMAs per 6 loads.
+static void conv_gemm_micro_kernel_neon(
+    unsigned int kc,
+    const float *a,       // a[kc][MR]
+    const float *b,       // b[kc][ldb]
+    unsigned int ldb,
+    float *c,             // c[MR][ldc]
+    unsigned int ldc,
+    const float *biases,  // biases[NR] on the first K block, else 0
+    char relu_activation  // apply ReLU, only on the last K block
+) {
+    float32x4_t b0, b1;
+    float32x4_t acc00, acc01, acc10, acc11, acc20, acc21, acc30, acc31;
+    float32x4_t zero = vdupq_n_f32(0.0f);
+    unsigned int k;
+
+    if (biases) {
+        acc00 = acc10 = acc20 = acc30 = vld1q_f32(biases);
+        acc01 = acc11 = acc21 = acc31 = vld1q_f32(biases + 4);
+    }
+    else {
+        acc00 = vld1q_f32(c);
+        acc01 = vld1q_f32(c + 4);
+        acc10 = vld1q_f32(c + ldc);
+        acc11 = vld1q_f32(c + ldc + 4);
+        acc20 = vld1q_f32(c + (2 * ldc));
+        acc21 = vld1q_f32(c + (2 * ldc) + 4);
+        acc30 = vld1q_f32(c + (3 * ldc));
+        acc31 = vld1q_f32(c + (3 * ldc) + 4);
+    }
+
+    for (k = 0; k < kc; k++) {
+        b0 = vld1q_f32(b);
+        b1 = vld1q_f32(b + 4);
+        acc00 = vfmaq_n_f32(acc00, b0, a[0]);
+        acc01 = vfmaq_n_f32(acc01, b1, a[0]);
+        acc10 = vfmaq_n_f32(acc10, b0, a[1]);
+        acc11 = vfmaq_n_f32(acc11, b1, a[1]);
+        acc20 = vfmaq_n_f32(acc20, b0, a[2]);
+        acc21 = vfmaq_n_f32(acc21, b1, a[2]);
+        acc30 = vfmaq_n_f32(acc30, b0, a[3]);
+        acc31 = vfmaq_n_f32(acc31, b1, a[3]);
+        a += CONV_GEMM_MR;
+        b += ldb;
+    }
+
+    if (relu_activation) {
+        acc00 = vmaxq_f32(acc00, zero);
+        acc01 = vmaxq_f32(acc01, zero);
+        acc10 = vmaxq_f32(acc10, zero);
+        acc11 = vmaxq_f32(acc11, zero);
+        acc20 = vmaxq_f32(acc20, zero);
+        acc21 = vmaxq_f32(acc21, zero);
+        acc30 = vmaxq_f32(acc30, zero);
+        acc31 = vmaxq_f32(acc31, zero);
+    }
+    vst1q_f32(c, acc00);
+    vst1q_f32(c + 4, acc01);
+    vst1q_f32(c + ldc, acc10);
+    vst1q_f32(c + ldc + 4, acc11);
+    vst1q_f32(c + (2 * ldc), acc20);
+    vst1q_f32(c + (2 * ldc) + 4, acc21);
+    vst1q_f32(c + (3 * ldc), acc30);
+    vst1q_f32(c + (3 * ldc) + 4, acc31);
+}
+
+// convolution_conv4() with the NEON micro-kernel: the same packing and
+// blocking, and the scalar edge kernel for partial tiles
+int convolution_conv4_neon(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs,
+    float *weights,
+    float *biases,
+    float *workspace      // workspace[CONV_GEMM_MC * CONV_GEMM_KC]
+) {
+    unsigned int M = lay->output_rows * lay->output_columns;
+    unsigned int K = lay->filter_rows * lay->filter_columns * lay->input_channel;
+    unsigned int N = lay->output_channel;
+    unsigned int m0, k0, mc, kc, ir, jr, mr, nr;
+    char last_k;
+
+    for (k0 = 0; k0 < K; k0 += CONV_GEMM_KC) {
+        kc = (K - k0 < CONV_GEMM_KC) ? (K - k0) : CONV_GEMM_KC;
+        last_k = (k0 + kc == K);
+
+        for (m0 = 0; m0 < M; m0 += CONV_GEMM_MC) {
+            mc = (M - m0 < CONV_GEMM_MC) ? (M - m0) : CONV_GEMM_MC;
+            conv_gemm_pack_a(lay, inputs, workspace, m0, mc, k0, kc);
+
+            for (jr = 0; jr < N; jr += CONV_GEMM_NR) {
+                nr = (N - jr < CONV_GEMM_NR) ? (N - jr) : CONV_GEMM_NR;
+                for (ir = 0; ir < mc; ir += CONV_GEMM_MR) {
+                    mr = (mc - ir < CONV_GEMM_MR) ? (mc - ir) : CONV_GEMM_MR;
+                    if (mr == CONV_GEMM_MR && nr == CONV_GEMM_NR) {
+                        conv_gemm_micro_kernel_neon(
+                            kc,
+                            workspace + ir * kc,
+                            weights + (k0 * N) + jr,
+                            N,
+                            outputs + ((m0 + ir) * N) + jr,
+                            N,
+                            (k0 == 0) ? biases + jr : 0,
+                            last_k && (lay->relu_activation == 1)
+                        );
+                    }
+                    else {
+                        conv_gemm_edge_kernel(
+                            kc,
+                            workspace + ir * kc,
+                            weights + (k0 * N) + jr,
+                            N,
+                            outputs + ((m0 + ir) * N) + jr,
+                            N,
+                            mr,
+                            nr,
+                            (k0 == 0) ? biases + jr : 0,
+                            last_k && (lay->relu_activation == 1)
+                        );
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+#endif
+
+#ifdef CNN_FUSED
+// conv + bias + ReLU + 2x2/2 max-pool in one pass. The 4 conv outputs
+// under one pooling window are accumulated side by side, so each weight
+// vector loaded feeds 4 FMAs, and only the pooled value is stored.
+// lay describes the conv; outputs[output_rows/2][output_columns/2][N].
+// Bias seeding and accumulation order match convolution_neon(), and
+// relu(max(x)) == max(relu(x)), so results are bit-identical to
+// convolution_neon() followed by max_pooling_neon().
+#define NEON_POOL_OC_BLOCK  8
+
+int convolution_pool_neon(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs,
+    float *weights,
+    float *biases
+) {
+    unsigned int N = lay->output_channel;
+    unsigned int C = lay->input_channel;
+    unsigned int filter_row_len = lay->filter_columns * C;
+    unsigned int input_row_len = lay->input_columns * C;
+    unsigned int pool_rows = lay->output_rows / 2;
+    unsigned int pool_cols = lay->output_columns / 2;
+    unsigned int pool_row;
+    unsigned int pool_col;
+    unsigned int filter_row;
+    unsigned int out_ch;
+    unsigned int k;
+    float *in_row0;
+    float *in_row1;
+    float *w_row;
+    float *out;
+    float32x4_t w0, w1;
+    float32x4_t acc00, acc01, acc10, acc11, acc20, acc21, acc30, acc31;
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+
+    if (N % 4) {
+        return convolution_pool(lay, inputs, outputs, weights, biases);
+    }
+
+    for (pool_row = 0; pool_row < pool_rows; pool_row++) {
+        for (pool_col = 0; pool_col < pool_cols; pool_col++) {
+            out = outputs + ((pool_row * pool_cols) + pool_col) * N;
+
+            for (out_ch = 0; out_ch + NEON_POOL_OC_BLOCK <= N; out_ch += NEON_POOL_OC_BLOCK) {
+                // accN: conv output (2 * pool_row + N / 2, 2 * pool_col + N % 2)
+                acc00 = acc10 = acc20 = acc30 = vld1q_f32(biases + out_ch + 0);
+                acc01 = acc11 = acc21 = acc31 = vld1q_f32(biases + out_ch + 4);
+
+                for (filter_row = 0; filter_row < lay->filter_rows; filter_row++) {
+                    in_row0 = inputs + (((2 * pool_row) + filter_row) * input_row_len) + (2 * pool_col * C);
+                    in_row1 = in_row0 + input_row_len;
+                    w_row = weights + (filter_row * filter_row_len * N) + out_ch;
+                    for (k = 0; k < filter_row_len; k++) {
+                        w0 = vld1q_f32(w_row + 0);
+                        w1 = vld1q_f32(w_row + 4);
+                        acc00 = vfmaq_n_f32(acc00, w0, in_row0[k]);
+                        acc01 = vfmaq_n_f32(acc01, w1, in_row0[k]);
+                        acc10 = vfmaq_n_f32(acc10, w0, in_row0[k + C]);
+                        acc11 = vfmaq_n_f32(acc11, w1, in_row0[k + C]);
+                        acc20 = vfmaq_n_f32(acc20, w0, in_row1[k]);
+                        acc21 = vfmaq_n_f32(acc21, w1, in_row1[k]);
+                        acc30 = vfmaq_n_f32(acc30, w0, in_row1[k + C]);
+                        acc31 = vfmaq_n_f32(acc31, w1, in_row1[k + C]);
+                        w_row += N;
+                    }
+                }
+
+                acc00 = vmaxq_f32(vmaxq_f32(acc00, acc10), vmaxq_f32(acc20, acc30));
+                acc01 = vmaxq_f32(vmaxq_f32(acc01, acc11), vmaxq_f32(acc21, acc31));
+                if (lay->relu_activation == 1) {
+                    acc00 = vmaxq_f32(acc00, zero);
+                    acc01 = vmaxq_f32(acc01, zero);
+                }
+                vst1q_f32(out + out_ch + 0, acc00);
+                vst1q_f32(out + out_ch + 4, acc01);
+            }
+
+            for (; out_ch < N; out_ch += 4) {
+                acc00 = acc10 = acc20 = acc30 = vld1q_f32(biases + out_ch);
+
+                for (filter_row = 0; filter_row < lay->filter_rows; filter_row++) {
+                    in_row0 = inputs + (((2 * pool_row) + filter_row) * input_row_len) + (2 * pool_col * C);
+                    in_row1 = in_row0 + input_row_len;
+                    w_row = weights + (filter_row * filter_row_len * N) + out_ch;
+                    for (k = 0; k < filter_row_len; k++) {
+                        w0 = vld1q_f32(w_row);
+                        acc00 = vfmaq_n_f32(acc00, w0, in_row0[k]);
+                        acc10 = vfmaq_n_f32(acc10, w0, in_row0[k + C]);
+                        acc20 = vfmaq_n_f32(acc20, w0, in_row1[k]);
+                        acc30 = vfmaq_n_f32(acc30, w0, in_row1[k + C]);
+                        w_row += N;
+                    }
+                }
+
+                acc00 = vmaxq_f32(vmaxq_f32(acc00, acc10), vmaxq_f32(acc20, acc30));
+                if (lay->relu_activation == 1) {
+                    acc00 = vmaxq_f32(acc00, zero);
+                }
+                vst1q_f32(out + out_ch, acc00);
+            }
+        }
+    }
+
+    return 0;
+}
+#endif
+
+int max_pooling_neon(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs
+) {
+    unsigned int C = lay->input_channel;
+    unsigned int ch;
+    unsigned int output_row;
+    unsigned int output_col;
+    unsigned int filter_row;
+    unsigned int filter_col;
+    float *in;
+    float *out;
+    float current_max;
+    float32x4_t vmax;
+
+    for (output_row = 0; output_row < lay->output_rows; output_row++) {
+        for (output_col = 0; output_col < lay->output_columns; output_col++) {
+            in = inputs + ((output_row * lay->filter_rows * lay->input_columns) + (output_col * lay->filter_columns)) * C;
+            out = outputs + ((output_row * lay->output_columns) + output_col) * lay->output_channel;
+
+            for (ch = 0; ch + 4 <= C; ch += 4) {
+                vmax = vld1q_f32(in + ch);
+                for (filter_row = 0; filter_row < lay->filter_rows; filter_row++) {
+                    for (filter_col = 0; filter_col < lay->filter_columns; filter_col++) {
+                        vmax = vmaxq_f32(vmax, vld1q_f32(in + ((filter_row * lay->input_columns) + filter_col) * C + ch));
+                    }
+                }
+                vst1q_f32(out + ch, vmax);
+            }
+
+            for (; ch < C; ch++) {
+                current_max = in[ch];
+                for (filter_row = 0; filter_row < lay->filter_rows; filter_row++) {
+                    for (filter_col = 0; filter_col < lay->filter_columns; filter_col++) {
+                        if (current_max < in[((filter_row * lay->input_columns) + filter_col) * C + ch]) {
+                            current_max = in[((filter_row * lay->input_columns) + filter_col) * C + ch];
+                        }
+                    }
+                }
+                out[ch] = current_max;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// weights[input_channel][output_channel]: for each input, the row of
+// weights for consecutive outputs is contiguous, so accumulate
+// NEON_OC_BLOCK outputs at a time and stream each row once.
+int fully_connected_neon(
+    layer_structure *lay,
+    float *inputs,    // inputs[lay->input_channel]
+    float *outputs,   // outputs[lay->output_channel]
+    float *weights,   // weights[lay->input_channel][lay->output_channel]
+    float *biases     // biases[lay->output_channnel]
+) {
+    return fully_connected_range_neon(lay, inputs, outputs, weights, biases, 0, lay->output_channel);
+}
+
+int fully_connected_range_neon(
+    layer_structure *lay,
+    float *inputs,    // inputs[lay->input_channel]
+    float *outputs,   // outputs[lay->output_channel]
+    float *weights,   // weights[lay->input_channel][lay->output_channel]
+    float *biases,    // biases[lay->output_channnel]
+    unsigned int out_begin,
+    unsigned int out_end
+) {
+    unsigned int N = lay->output_channel;
+    unsigned int o;
+    unsigned int i;
+    float *w;
+    float current_out;
+    float32x4_t x;
+    float32x4_t acc0, acc1, acc2, acc3;
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+
+    for (o = out_begin; o + NEON_OC_BLOCK <= out_end; o += NEON_OC_BLOCK) {
+        acc0 = vld1q_f32(biases + o + 0);
+        acc1 = vld1q_f32(biases + o + 4);
+        acc2 = vld1q_f32(biases + o + 8);
+        acc3 = vld1q_f32(biases + o + 12);
+        w = weights + o;
+        for (i = 0; i < lay->input_channel; i++) {
+            x = vdupq_n_f32(inputs[i]);
+            acc0 = vfmaq_f32(acc0, vld1q_f32(w + 0), x);
+            acc1 = vfmaq_f32(acc1, vld1q_f32(w + 4), x);
+            acc2 = vfmaq_f32(acc2, vld1q_f32(w + 8), x);
+            acc3 = vfmaq_f32(acc3, vld1q_f32(w + 12), x);
+            w += N;
+        }
+        if (lay->relu_activation == 1) {
+            acc0 = vmaxq_f32(acc0, zero);
+            acc1 = vmaxq_f32(acc1, zero);
+            acc2 = vmaxq_f32(acc2, zero);
+            acc3 = vmaxq_f32(acc3, zero);
+        }
+        vst1q_f32(outputs + o + 0, acc0);
+        vst1q_f32(outputs + o + 4, acc1);
+        vst1q_f32(outputs + o + 8, acc2);
+        vst1q_f32(outputs + o + 12, acc3);
+    }
+
+    for (; o + 4 <= out_end; o += 4) {
+        acc0 = vld1q_f32(biases + o);
+        w = weights + o;
+        for (i = 0; i < lay->input_channel; i++) {
+            acc0 = vfmaq_f32(acc0, vld1q_f32(w), vdupq_n_f32(inputs[i]));
+            w += N;
+        }
+        if (lay->relu_activation == 1) {
+            acc0 = vmaxq_f32(acc0, zero);
+        }
+        vst1q_f32(outputs + o, acc0);
+    }
+
+    for (; o < out_end; o++) {
+        current_out = biases[o];
+        for (i = 0; i < lay->input_channel; i++) {
+            current_out += inputs[i] * weights[(i * N) + o];
+        }
+        if (lay->relu_activation == 1) {
+            current_out = relu(current_out);
+        }
+        outputs[o] = current_out;
+    }
+
+    return 0;
+}
+
+// FC over fully_connected_pack() panels: same accumulation order as
+// fully_connected_range_neon(), but each panel's weights are one
+// contiguous stream instead of 64 bytes every N floats.
+int fully_connected_packed_neon(
+    layer_structure *lay,
+    float *inputs,    // inputs[lay->input_channel]
+    float *outputs,   // outputs[lay->output_channel]
+    float *packed,    // from fully_connected_pack()
+    unsigned int out_begin,
+    unsigned int out_end
+) {
+    unsigned int K = lay->input_channel;
+    unsigned int panel;
+    unsigned int i;
+    unsigned int j;
+    float *w;
+    float *dst;
+    float tail[FC_PANEL];
+    float32x4_t x;
+    float32x4_t acc0, acc1, acc2, acc3;
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+
+    for (panel = out_begin; panel < out_end; panel += FC_PANEL) {
+        // the last, partial panel goes through tail[]
+        dst = (panel + FC_PANEL <= out_end) ? outputs + panel : tail;
+        w = packed + ((panel / FC_PANEL) * (K + 1) * FC_PANEL);
+        acc0 = vld1q_f32(w + 0);
+        acc1 = vld1q_f32(w + 4);
+        acc2 = vld1q_f32(w + 8);
+        acc3 = vld1q_f32(w + 12);
+        w += FC_PANEL;
+        for (i = 0; i < K; i++) {
+            x = vdupq_n_f32(inputs[i]);
+            acc0 = vfmaq_f32(acc0, vld1q_f32(w + 0), x);
+            acc1 = vfmaq_f32(acc1, vld1q_f32(w + 4), x);
+            acc2 = vfmaq_f32(acc2, vld1q_f32(w + 8), x);
+            acc3 = vfmaq_f32(acc3, vld1q_f32(w + 12), x);
+            w += FC_PANEL;
+        }
+        if (lay->relu_activation == 1) {
+            acc0 = vmaxq_f32(acc0, zero);
+            acc1 = vmaxq_f32(acc1, zero);
+            acc2 = vmaxq_f32(acc2, zero);
+            acc3 = vmaxq_f32(acc3, zero);
+        }
+        vst1q_f32(dst + 0, acc0);
+        vst1q_f32(dst + 4, acc1);
+        vst1q_f32(dst + 8, acc2);
+        vst1q_f32(dst + 12, acc3);
+        if (dst == tail) {
+            for (j = 0; panel + j < out_end; j++) {
+                outputs[panel + j] = tail[j];
+            }
+        }
+    }
+
+    return 0;
+}
+
+#ifdef CNN_BATCH
+// One FC_BATCH_OC block of outputs for the mb images of a pass: one
+// accumulator per image, so each weight vector is loaded once and feeds
+// mb FMAs. mb is a constant at every call (fully_connected_batch_neon()
+// dispatches on it), which lets the compiler unroll the image loops and
+// keep the accumulators in registers. Weights w[i * ldw + 0..3], image m
+// at x + m * K, outputs at y + m * N.
+static inline __attribute__ ((always_inline)) void fc_batch_block_neon(
+    const float *x,
+    unsigned int K,
+    const float *w,
+    unsigned int ldw,
+    float32x4_t bias,
+    float *y,
+    unsigned int N,
+    unsigned int nb,            // outputs stored, 1 - FC_BATCH_OC
+    char relu_activation,
+    const unsigned int mb
+) {
+    float32x4_t acc[FC_BATCH_MAX];
+    float32x4_t wv;
+    float tail[FC_BATCH_OC];
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    unsigned int i, j, m;
+
+    for (m = 0; m < mb; m++) {
+        acc[m] = bias;
+    }
+    for (i = 0; i < K; i++) {
+        wv = vld1q_f32(w);
+        for (m = 0; m < mb; m++) {
+            acc[m] = vfmaq_n_f32(acc[m], wv, x[(m * K) + i]);
+        }
+        w += ldw;
+    }
+    for (m = 0; m < mb; m++) {
+        if (relu_activation) {
+            acc[m] = vmaxq_f32(acc[m], zero);
+        }
+        if (nb == FC_BATCH_OC) {
+            vst1q_f32(y + (m * N), acc[m]);
+        }
+        else {
+            vst1q_f32(tail, acc[m]);
+            for (j = 0; j < nb; j++) {
+                y[(m * N) + j] = tail[j];
+            }
+        }
+    }
+}
+
+// fc_batch_block_neon() with mb as a constant, 1 - FC_BATCH_MAX
+#define FC_BATCH_BLOCK_CASE(MB) \
+    case MB: fc_batch_block_neon(x, K, w, ldw, bias, y, N, nb, relu_activation, MB); break;
+
+static void fc_batch_block_dispatch_neon(
+    const float *x,
+    unsigned int K,
+    const float *w,
+    unsigned int ldw,
+    float32x4_t bias,
+    float *y,
+    unsigned int N,
+    unsigned int nb,
+    char relu_activation,
+    unsigned int mb
+) {
+    switch (mb) {
+    FC_BATCH_BLOCK_CASE(1)
+    FC_BATCH_BLOCK_CASE(2)
+    FC_BATCH_BLOCK_CASE(3)
+    FC_BATCH_BLOCK_CASE(4)
+    FC_BATCH_BLOCK_CASE(5)
+    FC_BATCH_BLOCK_CASE(6)
+    FC_BATCH_BLOCK_CASE(7)
+    FC_BATCH_BLOCK_CASE(8)
+    FC_BATCH_BLOCK_CASE(9)
+    FC_BATCH_BLOCK_CASE(10)
+    FC_BATCH_BLOCK_CASE(11)
+    FC_BATCH_BLOCK_CASE(12)
+    FC_BATCH_BLOCK_CASE(13)
+    FC_BATCH_BLOCK_CASE(14)
+    FC_BATCH_BLOCK_CASE(15)
+    FC_BATCH_BLOCK_CASE(16)
+    default:
+        break;
+    }
+}
+
+// Batched FC over [K][N] weights: blocks of 4 outputs outermost, up to
+// FC_BATCH_MAX images per pass innermost, so the weights stream once
+// per pass. Same accumulation order as fully_connected_range_neon();
+// outputs past the last multiple of 4 run as scalars.
+int fully_connected_batch_neon(
+    layer_structure *lay,
+    float *inputs,    // inputs[batch][lay->input_channel]
+    float *outputs,   // outputs[batch][lay->output_channel]
+    float *weights,   // weights[lay->input_channel][lay->output_channel]
+    float *biases,    // biases[lay->output_channnel]
+    unsigned int batch
+) {
+    unsigned int K = lay->input_channel;
+    unsigned int N = lay->output_channel;
+    unsigned int b, o, i, m, mb;
+    float *x;
+    float current_out;
+
+    for (b = 0; b < batch; b += FC_BATCH_MAX) {
+        mb = (batch - b < FC_BATCH_MAX) ? (batch - b) : FC_BATCH_MAX;
+        x = inputs + (b * K);
+        for (o = 0; o + FC_BATCH_OC <= N; o += FC_BATCH_OC) {
+            fc_batch_block_dispatch_neon(x, K, weights + o, N, vld1q_f32(biases + o),
+                                         outputs + (b * N) + o, N, FC_BATCH_OC, lay->relu_activation == 1, mb);
+        }
+        for (; o < N; o++) {
+            for (m = 0; m < mb; m++) {
+                current_out = biases[o];
+                for (i = 0; i < K; i++) {
+                    current_out += x[(m * K) + i] * weights[(i * N) + o];
+                }
+                if (lay->relu_activation == 1) {
+                    current_out = relu(current_out);
+                }
+                outputs[((b + m) * N) + o] = current_out;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Batched FC over fully_connected_pack() panels: the blocks of
+// fully_connected_batch_neon(), four per panel, with the weights at a
+// stride of FC_PANEL instead of N. The panels are zero padded, so the
+// last block loads a whole vector and only stores nb outputs.
+int fully_connected_batch_packed_neon(
+    layer_structure *lay,
+    float *inputs,    // inputs[batch][lay->input_channel]
+    float *outputs,   // outputs[batch][lay->output_channel]
+    float *packed,    // from fully_connected_pack()
+    unsigned int batch
+) {
+    unsigned int K = lay->input_channel;
+    unsigned int N = lay->output_channel;
+    unsigned int b, o, mb, nb;
+    float *x;
+    float *panel;
+
+    for (b = 0; b < batch; b += FC_BATCH_MAX) {
+        mb = (batch - b < FC_BATCH_MAX) ? (batch - b) : FC_BATCH_MAX;
+        x = inputs + (b * K);
+        for (o = 0; o < N; o += FC_BATCH_OC) {
+            nb = (N - o < FC_BATCH_OC) ? (N - o) : FC_BATCH_OC;
+            panel = packed + ((o / FC_PANEL) * (K + 1) * FC_PANEL) + (o % FC_PANEL);
+            fc_batch_block_dispatch_neon(x, K, panel + FC_PANEL, FC_PANEL, vld1q_f32(panel),
+                                         outputs + (b * N) + o, N, nb, lay->relu_activation == 1, mb);
+        }
+    }
+
+    return 0;
+}
+#endif
+
+#endif
@@ -0,0 +1,427 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Simple CNN Application for Inference only
+ Winograd conv kernels (conv mode #7): F(2x2, 5x5) and F(4x4, 3x3)
+==================================================================
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "arm_cnn_inference.h"
+#include "mnist.h"
+#include "cnn_api_c.h"
+#include "cnn_neon.h"
+
+#ifdef CNN_CONV_7
+
+// Both filter sizes use 6x6 input tiles and the same interpolation
+// points (0, 1, -1, 2, -2, inf), so B^T is shared:
+//    Y = A^T [ (G g G^T) . (B^T d B) ] A
+// A 5x5 filter gives a 2x2 output tile for 36 multiplies instead of
+// 100, a 3x3 filter a 4x4 tile for 36 instead of 144. The products
+// (G g G^T) are computed once at load by convolution_winograd_transform(),
+// so per tile only the input and output transforms remain, and the 36
+// element-wise products over input channels become 36 small GEMVs.
+//
+// Transformed weight layout: weights[36][C][N], one C x N matrix per
+// tile element, so the output channels stream contiguously.
+
+#define WINOGRAD_TILE_ELEMS     (WINOGRAD_ALPHA * WINOGRAD_ALPHA)
+
+// G for F(2x2, 5x5); F(4x4, 3x3) uses its first 3 columns
+static const float winograd_g[WINOGRAD_ALPHA][5] = {
+    {  1.0f / 4.0f,  0.0f,         0.0f,        0.0f,        0.0f        },
+    { -1.0f / 6.0f, -1.0f / 6.0f, -1.0f / 6.0f, -1.0f / 6.0f, -1.0f / 6.0f },
+    { -1.0f / 6.0f,  1.0f / 6.0f, -1.0f / 6.0f,  1.0f / 6.0f, -1.0f / 6.0f },
+    {  1.0f / 24.0f, 1.0f / 12.0f, 1.0f / 6.0f,  1.0f / 3.0f,  2.0f / 3.0f },
+    {  1.0f / 24.0f, -1.0f / 12.0f, 1.0f / 6.0f, -1.0f / 3.0f, 2.0f / 3.0f },
+    {  0.0f,         0.0f,         0.0f,        0.0f,        1.0f        },
+};
+
+static const float winograd_g3[WINOGRAD_ALPHA][3] = {
+    {  1.0f / 4.0f,   0.0f,         0.0f        },
+    { -1.0f / 6.0f,  -1.0f / 6.0f, -1.0f / 6.0f },
+    { -1.0f / 6.0f,   1.0f / 6.0f, -1.0f / 6.0f },
+    {  1.0f / 24.0f,  1.0f / 12.0f, 1.0f / 6.0f },
+    {  1.0f / 24.0f, -1.0f / 12.0f, 1.0f / 6.0f },
+    {  0.0f,          0.0f,         1.0f        },
+};
+
+// out[i] = (B^T in)[i] element-wise over n channels:
+//    B^T = [ 4  0 -5  0  1  0 ]
+//          [ 0 -4 -4  1  1  0 ]
+//          [ 0  4 -4 -1  1  0 ]
+//          [ 0 -2 -1  2  1  0 ]
+//          [ 0  2 -1 -2  1  0 ]
+//          [ 0  4  0 -5  0  1 ]
+static void winograd_bt(
+    const float *in[WINOGRAD_ALPHA],
+    float *out[WINOGRAD_ALPHA],
+    unsigned int n
+) {
+    unsigned int c = 0;
+    float d0, d1, d2, d3, d4, d5;
+#ifdef CNN_NEON
+    float32x4_t v0, v1, v2, v3, v4, v5;
+    const float32x4_t two = vdupq_n_f32(2.0f);
+    const float32x4_t four = vdupq_n_f32(4.0f);
+    const float32x4_t five = vdupq_n_f32(5.0f);
+
+    // the row pointers may alias as far as the compiler knows, so
+    // vectorize by hand
+    for (; c + 4 <= n; c += 4) {
+        v0 = vld1q_f32(in[0] + c);
+        v1 = vld1q_f32(in[1] + c);
+        v2 = vld1q_f32(in[2] + c);
+        v3 = vld1q_f32(in[3] + c);
+        v4 = vld1q_f32(in[4] + c);
+        v5 = vld1q_f32(in[5] + c);
+        vst1q_f32(out[0] + c, vfmsq_f32(vfmaq_f32(v4, four, v0), five, v2));
+        vst1q_f32(out[1] + c, vfmsq_f32(vaddq_f32(v3, v4), four, vaddq_f32(v1, v2)));
+        vst1q_f32(out[2] + c, vfmaq_f32(vsubq_f32(v4, v3), four, vsubq_f32(v1, v2)));
+        vst1q_f32(out[3] + c, vfmaq_f32(vsubq_f32(v4, v2), two, vsubq_f32(v3, v1)));
+        vst1q_f32(out[4] + c, vfmaq_f32(vsubq_f32(v4, v2), two, vsubq_f32(v1, v3)));
+        vst1q_f32(out[5] + c, vfmsq_f32(vfmaq_f32(v5, four, v1), five, v3));
+    }
+#endif
+    for (; c < n; c++) {
+        d0 = in[0][c];
+        d1 = in[1][c];
+        d2 = in[2][c];
+        d3 = in[3][c];
+        d4 = in[4][c];
+        d5 = in[5][c];
+        out[0][c] = (4.0f * d0) - (5.0f * d2) + d4;
+        out[1][c] = (d3 + d4) - (4.0f * (d1 + d2));
+        out[2][c] = (d4 - d3) + (4.0f * (d1 - d2));
+        out[3][c] = (d4 - d2) + (2.0f * (d3 - d1));
+        out[4][c] = (d4 - d2) + (2.0f * (d1 - d3));
+        out[5][c] = (4.0f * d1) - (5.0f * d3) + d5;
+    }
+}
+
+// out[i] = (A^T in)[i] for a 4 (F(4x4, 3x3)) or 2 (F(2x2, 5x5)) row A^T:
+//    [ 1  1  1  1  1  0 ]      [ 1  1  1  1  1  0 ]
+//    [ 0  1 -1  2 -2  0 ]      [ 0  1 -1  2 -2  1 ]
+//    [ 0  1  1  4  4  0 ]
+//    [ 0  1 -1  8 -8  1 ]
+static void winograd_at(
+    const float *in[WINOGRAD_ALPHA],
+    float *out[4],
+    unsigned int tile,
+    unsigned int n
+) {
+    unsigned int c = 0;
+    float s12, d12, s34, d34;
+#ifdef CNN_NEON
+    float32x4_t vs12, vd12, vs34, vd34, v0, v5;
+    const float32x4_t two = vdupq_n_f32(2.0f);
+    const float32x4_t four = vdupq_n_f32(4.0f);
+    const float32x4_t eight = vdupq_n_f32(8.0f);
+
+    for (; c + 4 <= n; c += 4) {
+        v0 = vld1q_f32(in[0] + c);
+        vs12 = vaddq_f32(vld1q_f32(in[1] + c), vld1q_f32(in[2] + c));
+        vd12 = vsubq_f32(vld1q_f32(in[1] + c), vld1q_f32(in[2] + c));
+        vs34 = vaddq_f32(vld1q_f32(in[3] + c), vld1q_f32(in[4] + c));
+        vd34 = vsubq_f32(vld1q_f32(in[3] + c), vld1q_f32(in[4] + c));
+        v5 = vld1q_f32(in[5] + c);
+        vst1q_f32(out[0] + c, vaddq_f32(vaddq_f32(v0, vs12), vs34));
+        if (tile == 4) {
+            vst1q_f32(out[1] + c, vfmaq_f32(vd12, two, vd34));
+            vst1q_f32(out[2] + c, vfmaq_f32(vs12, four, vs34));
+            vst1q_f32(out[3] + c, vaddq_f32(vfmaq_f32(vd12, eight, vd34), v5));
+        }
+        else {
+            vst1q_f32(out[1] + c, vaddq_f32(vfmaq_f32(vd12, two, vd34), v5));
+        }
+    }
+#endif
+    for (; c < n; c++) {
+        s12 = in[1][c] + in[2][c];
+        d12 = in[1][c] - in[2][c];
+        s34 = in[3][c] + in[4][c];
+        d34 = in[3][c] - in[4][c];
+        out[0][c] = in[0][c] + s12 + s34;
+        if (tile == 4) {
+            out[1][c] = d12 + (2.0f * d34);
+            out[2][c] = s12 + (4.0f * s34);
+            out[3][c] = d12 + (8.0f * d34) + in[5][c];
+        }
+        else {
+            out[1][c] = d12 + (2.0f * d34) + in[5][c];
+        }
+    }
+}
+
+// Output tile edge for lay's filter, 0 if the layer has no Winograd form.
+// With very few input channels the output transform costs about as much
+// as the direct conv it replaces, so such layers keep CONVOLUTION.
+unsigned int convolution_winograd_tile(
+    layer_structure *lay
+) {
+    if (lay->filter_rows != lay->filter_columns ||
+        lay->input_channel < WINOGRAD_MIN_INPUT_CHANNEL ||
+        lay->input_channel > WINOGRAD_MAX_INPUT_CHANNEL ||
+        lay->output_rows + lay->filter_rows - 1 != lay->input_rows ||
+        lay->output_columns + lay->filter_columns - 1 != lay->input_columns) {
+        return 0;
+    }
+    if (lay->filter_rows == 3) {
+        return 4;
+    }
+    if (lay->filter_rows == 5) {
+        return 2;
+    }
+
+    return 0;
+}
+
+// U = G g G^T for every (input, output) channel pair, from the HWC
+// weights[filter_rows][filter_columns][C][N]
+int convolution_winograd_transform(
+    layer_structure *lay,
+    float *weights,
+    float *transformed      // transformed[36][C][N]
+) {
+    unsigned int C = lay->input_channel;
+    unsigned int N = lay->output_channel;
+    unsigned int r = lay->filter_rows;
+    unsigned int in_ch, out_ch;
+    unsigned int i, j, k;
+    const float *g;
+    float tmp[WINOGRAD_ALPHA][5];
+    float acc;
+
+    if (!convolution_winograd_tile(lay)) {
+        return -1;
+    }
+
+    for (in_ch = 0; in_ch < C; in_ch++) {
+        for (out_ch = 0; out_ch < N; out_ch++) {
+            // tmp = G g
+            for (i = 0; i < WINOGRAD_ALPHA; i++) {
+                g = (r == 3) ? winograd_g3[i] : winograd_g[i];
+                for (j = 0; j < r; j++) {
+                    acc = 0.0f;
+                    for (k = 0; k < r; k++) {
+                        acc += g[k] * weights[(((k * r) + j) * C + in_ch) * N + out_ch];
+                    }
+                    tmp[i][j] = acc;
+                }
+            }
+            // U = tmp G^T
+            for (i = 0; i < WINOGRAD_ALPHA; i++) {
+                for (j = 0; j < WINOGRAD_ALPHA; j++) {
+                    g = (r == 3) ? winograd_g3[j] : winograd_g[j];
+                    acc = 0.0f;
+                    for (k = 0; k < r; k++) {
+                        acc += tmp[i][k] * g[k];
+                    }
+                    transformed[(((i * WINOGRAD_ALPHA) + j) * C + in_ch) * N + out_ch] = acc;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+// V[36][C] = B^T d B for the 6x6 input patch at (row, col), all
+// channels at once: HWC keeps the channels of a pixel contiguous. Pixels
+// past the bottom and right edges read as zeros.
+static void winograd_input_transform(
+    layer_structure *lay,
+    float *inputs,
+    unsigned int row,
+    unsigned int col,
+    float *v,               // v[36][C]
+    float *tmp,             // tmp[36][C]
+    const float *zeros      // zeros[C]
+) {
+    unsigned int C = lay->input_channel;
+    unsigned int i, j;
+    const float *in[WINOGRAD_ALPHA];
+    float *out[WINOGRAD_ALPHA];
+
+    // tmp = B^T d, one patch column at a time
+    for (j = 0; j < WINOGRAD_ALPHA; j++) {
+        for (i = 0; i < WINOGRAD_ALPHA; i++) {
+            if (row + i < lay->input_rows && col + j < lay->input_columns) {
+                in[i] = inputs + ((((row + i) * lay->input_columns) + col + j) * C);
+            }
+            else {
+                in[i] = zeros;
+            }
+            out[i] = tmp + (((i * WINOGRAD_ALPHA) + j) * C);
+        }
+        winograd_bt(in, out, C);
+    }
+    // V = tmp B, one row at a time
+    for (i = 0; i < WINOGRAD_ALPHA; i++) {
+        for (j = 0; j < WINOGRAD_ALPHA; j++) {
+            in[j] = tmp + (((i * WINOGRAD_ALPHA) + j) * C);
+            out[j] = v + (((i * WINOGRAD_ALPHA) + j) * C);
+        }
+        winograd_bt(in, out, C);
+    }
+}
+
+// M[36][WINOGRAD_OC_BLOCK] for output channels [out_ch, out_ch + 16):
+// the constant trip count keeps each row of M in registers across C
+static void winograd_product_block(
+    const float *v,             // v[36][C]
+    const float *transformed,   // transformed[36][C][N]
+    unsigned int C,
+    unsigned int N,
+    unsigned int out_ch,
+    float *m                    // m[36][WINOGRAD_OC_BLOCK]
+) {
+    float acc[WINOGRAD_OC_BLOCK];
+    const float *u;
+    unsigned int e, in_ch, o;
+
+    for (e = 0; e < WINOGRAD_TILE_ELEMS; e++) {
+        for (o = 0; o < WINOGRAD_OC_BLOCK; o++) {
+            acc[o] = 0.0f;
+        }
+        u = transformed + (e * C * N) + out_ch;
+        for (in_ch = 0; in_ch < C; in_ch++) {
+            for (o = 0; o < WINOGRAD_OC_BLOCK; o++) {
+                acc[o] += v[e * C + in_ch] * u[o];
+            }
+            u += N;
+        }
+        for (o = 0; o < WINOGRAD_OC_BLOCK; o++) {
+            m[e * WINOGRAD_OC_BLOCK + o] = acc[o];
+        }
+    }
+}
+
+// Partial block at the N edge
+static void winograd_product_edge(
+    const float *v,
+    const float *transformed,
+    unsigned int C,
+    unsigned int N,
+    unsigned int out_ch,
+    unsigned int nb,
+    float *m
+) {
+    const float *u;
+    unsigned int e, in_ch, o;
+    float acc;
+
+    for (e = 0; e < WINOGRAD_TILE_ELEMS; e++) {
+        for (o = 0; o < nb; o++) {
+            u = transformed + (e * C * N) + out_ch + o;
+            acc = 0.0f;
+            for (in_ch = 0; in_ch < C; in_ch++) {
+                acc += v[e * C + in_ch] * u[in_ch * N];
+            }
+            m[e * WINOGRAD_OC_BLOCK + o] = acc;
+        }
+    }
+}
+
+// Y = A^T M A + bias for nb channels, written where the tile is inside
+// the output
+static void winograd_output_transform(
+    layer_structure *lay,
+    const float *m,         // m[36][WINOGRAD_OC_BLOCK]
+    float *biases,
+    float *outputs,
+    unsigned int tile,
+    unsigned int row,
+    unsigned int col,
+    unsigned int out_ch,
+    unsigned int nb
+) {
+    unsigned int N = lay->output_channel;
+    unsigned int i, j, o;
+    const float *in[WINOGRAD_ALPHA];
+    float *out[4];
+    float tmp[4][WINOGRAD_ALPHA][WINOGRAD_OC_BLOCK];
+    float y[4][WINOGRAD_OC_BLOCK];
+    float *dst;
+    float kernel_result;
+
+    // tmp = A^T M, one column at a time
+    for (j = 0; j < WINOGRAD_ALPHA; j++) {
+        for (i = 0; i < WINOGRAD_ALPHA; i++) {
+            in[i] = m + (((i * WINOGRAD_ALPHA) + j) * WINOGRAD_OC_BLOCK);
+        }
+        for (i = 0; i < tile; i++) {
+            out[i] = tmp[i][j];
+        }
+        winograd_at(in, out, tile, nb);
+    }
+    // Y = tmp A, one output row at a time
+    for (i = 0; i < tile && row + i < lay->output_rows; i++) {
+        for (j = 0; j < WINOGRAD_ALPHA; j++) {
+            in[j] = tmp[i][j];
+        }
+        for (j = 0; j < tile; j++) {
+            out[j] = y[j];
+        }
+        winograd_at(in, out, tile, nb);
+
+        for (j = 0; j < tile && col + j < lay->output_columns; j++) {
+            dst = outputs + ((((row + i) * lay->output_columns) + col + j) * N) + out_ch;
+            for (o = 0; o < nb; o++) {
+                kernel_result = y[j][o] + biases[out_ch + o];
+                if (lay->relu_activation == 1) {
+                    kernel_result = relu(kernel_result);
+                }
+                dst[o] = kernel_result;
+            }
+        }
+    }
+}
+
+int convolution_winograd(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs,
+    float *transformed,     // from convolution_winograd_transform()
+    float *biases,
+    float *workspace        // workspace[WINOGRAD_WORKSPACE_SIZE(C)]
+) {
+    unsigned int C = lay->input_channel;
+    unsigned int N = lay->output_channel;
+    unsigned int tile = convolution_winograd_tile(lay);
+    unsigned int row, col, out_ch, nb;
+    float *v = workspace;
+    float *tmp = v + (WINOGRAD_TILE_ELEMS * C);
+    float *m = tmp + (WINOGRAD_TILE_ELEMS * C);
+    float *zeros = m + (WINOGRAD_TILE_ELEMS * WINOGRAD_OC_BLOCK);
+
+    if (!tile) {
+        return -1;
+    }
+    for (out_ch = 0; out_ch < C; out_ch++) {
+        zeros[out_ch] = 0.0f;
+    }
+
+    for (row = 0; row < lay->output_rows; row += tile) {
+        for (col = 0; col < lay->output_columns; col += tile) {
+            winograd_input_transform(lay, inputs, row, col, v, tmp, zeros);
+            for (out_ch = 0; out_ch < N; out_ch += WINOGRAD_OC_BLOCK) {
+                nb = (N - out_ch < WINOGRAD_OC_BLOCK) ? (N - out_ch) : WINOGRAD_OC_BLOCK;
+                if (nb == WINOGRAD_OC_BLOCK) {
+                    winograd_product_block(v, transformed, C, N, out_ch, m);
+                }
+                else {
+                    winograd_product_edge(v, transformed, C, N, out_ch, nb, m);
+                }
+                winograd_output_transform(lay, m, biases, outputs, tile, row, col, out_ch, nb);
+            }
+        }
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,1067 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Simple CNN Application for Inference only
+ Network description and generic layer interpreter
+==================================================================
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "arm_cnn_inference.h"
+#include "mnist.h"
+#include "cnn_api_c.h"
+#include "cnn_graph.h"
+#include "cnn_prof.h"
+#include "cnn_trace.h"
+
+// Conv kernel for conv_mode; mode #1 (and any mode not built in) runs
+// CONVOLUTION. INT8 parameter addresses are only used by mode #5, the
+// Winograd-transformed weights by mode #7, which runs CONVOLUTION for a
+// layer without them.
+void cnn_convolution(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs,
+    unsigned long weights,
+    unsigned long biases,
+    unsigned long int8_weights,
+    unsigned long int8_scales,
+    unsigned long int8_biases,
+    unsigned long winograd_weights,
+    unsigned long workspace_scratch,
+    unsigned int conv_mode
+) {
+#ifdef CNN_CONV_7
+    if (conv_mode == 7 && winograd_weights) {
+    	convolution_winograd(
+    			lay,
+				inputs,
+				outputs,
+				(float*)winograd_weights,
+				(float*)biases,
+				(float*)workspace_scratch
+    	);
+    } else
+#endif
+#ifdef CNN_CONV_2
+    if (conv_mode == 2) {
+    	CONVOLUTION_CONV2(
+    			lay,
+				inputs,
+				outputs,
+				(float*)weights,
+				(float*)biases
+    	);
+    } else
+#endif
+#ifdef CNN_CONV_5
+    if (conv_mode == 5) {
+    	convolution_int8(
+    			lay,
+				inputs,
+				outputs,
+				(signed char*)int8_weights,
+				(float*)int8_scales,
+				(float*)int8_biases,
+				(signed char*)workspace_scratch
+    	);
+    } else
+#endif
+#ifdef CNN_CONV_4
+    if (conv_mode == 4) {
+    	CONVOLUTION_CONV4(
+    			lay,
+				inputs,
+				outputs,
+				(float*)weights,
+				(float*)biases,
+				(float*)workspace_scratch
+    	);
+    } else
+#endif
+#ifdef CNN_CONV_3
+    if (conv_mode == 3) {
+    	convolution_conv3(
+    			lay,
+				inputs,
+				outputs,
+				(float*)weights,
+				(float*)biases
+    	);
+    } else
+#endif
+    {
+    	CONVOLUTION(
+    			lay,
+				inputs,
+				outputs,
+				(float*)weights,
+				(float*)biases
+    	);
+    }
+}
+
+#ifdef CNN_INPUT_FOLD
+// First conv straight from the image: input rows are widened into a
+// float band on the stack, times input_scale, and the conv_mode kernel
+// runs every output row the band holds. The band then keeps its last
+// filter_rows - 1 rows and takes the next ones, so each input row is
+// widened once (the whole image at once when it fits, as for MNIST).
+// The weights normally carry the 1/255 of pre-processing
+// (cnn_graph_pack_weights()), so no normalised copy of the image is
+// written. Stride 1, and filter_rows * input_columns * C <=
+// CONV_INPUT_BAND_MAX.
+void cnn_convolution_input(
+    layer_structure *lay,
+    const void *pixels,
+    unsigned int pixel_format,
+    float *outputs,
+    unsigned long weights,
+    unsigned long biases,
+    float input_scale,
+    unsigned long workspace_scratch,
+    unsigned int conv_mode
+) {
+    layer_structure band_lay = *lay;
+    unsigned long row_len = lay->input_columns * lay->input_channel;
+    unsigned int band_rows = CONV_INPUT_BAND_MAX / row_len;
+    unsigned int kept = 0;         // rows already widened at the band's start
+    unsigned int out_row = 0;
+    unsigned int rows;
+    unsigned long first;
+    unsigned long k;
+    float band[CONV_INPUT_BAND_MAX];
+
+    if (band_rows > lay->input_rows) {
+        band_rows = lay->input_rows;
+    }
+
+    while (out_row < lay->output_rows) {
+        rows = band_rows - lay->filter_rows + 1;
+        if (rows > lay->output_rows - out_row) {
+            rows = lay->output_rows - out_row;
+        }
+        first = out_row * row_len;
+        if (pixel_format == CNN_PIXEL_U8) {
+            for (k = kept * row_len; k < (rows + lay->filter_rows - 1) * row_len; k++) {
+                band[k] = (float)((const unsigned char*)pixels)[first + k] * input_scale;
+            }
+        }
+        else {
+            for (k = kept * row_len; k < (rows + lay->filter_rows - 1) * row_len; k++) {
+                band[k] = (float)((const unsigned int*)pixels)[first + k] * input_scale;
+            }
+        }
+        band_lay.output_rows = rows;
+        band_lay.input_rows = rows + lay->filter_rows - 1;
+        cnn_convolution(
+            &band_lay,
+            band,
+            outputs + (out_row * lay->output_columns * lay->output_channel),
+            weights,
+            biases,
+            0,
+            0,
+            0,
+            0,
+            workspace_scratch,
+            conv_mode
+        );
+        out_row += rows;
+        kept = lay->filter_rows - 1;
+        if (out_row < lay->output_rows) {
+            memmove(band, band + (rows * row_len), kept * row_len * sizeof(float));
+        }
+    }
+}
+#endif
+
+#ifdef CNN_GRAPH
+// Every tensor but the last lives in the workspace at an offset from
+// cnn_graph_plan_memory(); the last layer writes straight to the
+// caller's outputs.
+#define CNN_GRAPH_ALIGN     64
+
+static unsigned long cnn_graph_volume(const cnn_graph_layer *l)
+{
+    unsigned long rows = l->output_rows ? l->output_rows : 1;
+    unsigned long columns = l->output_columns ? l->output_columns : 1;
+
+    return rows * columns * l->output_channel;
+}
+
+// pixel idx of an image in image_format, as a float
+static float cnn_graph_pixel(const unsigned int *test_images, unsigned int image_format, unsigned long idx)
+{
+    if (image_format == CNN_PIXEL_U8) {
+        return (float)((const unsigned char*)test_images)[idx];
+    }
+
+    return (float)test_images[idx];
+}
+
+static unsigned long cnn_graph_buffer_size(const cnn_graph_layer *l, unsigned long element_size)
+{
+    unsigned long size = cnn_graph_volume(l) * element_size;
+
+    return (size + CNN_GRAPH_ALIGN - 1) & ~(unsigned long)(CNN_GRAPH_ALIGN - 1);
+}
+
+// weights of a conv or FC layer, in floats
+static unsigned long cnn_graph_weight_count(const cnn_graph_layer *l)
+{
+    if (l->type == CNN_LAYER_CONV) {
+        return (unsigned long)l->filter_rows * l->filter_columns * l->input_channel * l->output_channel;
+    }
+    if (l->type == CNN_LAYER_FC) {
+        return (unsigned long)l->input_channel * l->output_channel;
+    }
+    return 0;
+}
+
+#ifdef CNN_FP16
+// weights + biases
+static unsigned long cnn_graph_param_count(const cnn_graph_layer *l)
+{
+    unsigned long count = cnn_graph_weight_count(l);
+
+    return count ? count + l->output_channel : 0;
+}
+#endif
+
+static int cnn_graph_same_shape(const cnn_graph_layer *prev, const cnn_graph_layer *l)
+{
+    return l->input_channel == prev->output_channel &&
+           l->input_rows == prev->output_rows &&
+           l->input_columns == prev->output_columns;
+}
+
+// Shapes must chain. Returns 0 if the graph can be run, -1 otherwise.
+int cnn_graph_check(
+    const cnn_graph *graph
+) {
+    const cnn_graph_layer *l;
+    const cnn_graph_layer *prev;
+    unsigned int i;
+
+    if (graph->magic != CNN_GRAPH_MAGIC || graph->version != CNN_GRAPH_VERSION ||
+        graph->layer_num < 2 || graph->layer_num > CNN_GRAPH_MAX_LAYERS ||
+        graph->layer[0].type != CNN_LAYER_INPUT) {
+        return -1;
+    }
+
+    for (i = 0; i < graph->layer_num; i++) {
+        l = &graph->layer[i];
+        prev = &graph->layer[i ? i - 1 : 0];
+
+        switch (l->type) {
+        case CNN_LAYER_INPUT:
+            if (i != 0 || !cnn_graph_volume(l)) {
+                return -1;
+            }
+            break;
+
+        case CNN_LAYER_CONV:
+            if (!cnn_graph_same_shape(prev, l) || !l->filter_rows || !l->filter_columns ||
+                l->filter_rows > l->input_rows || l->filter_columns > l->input_columns ||
+                l->output_rows != l->input_rows - l->filter_rows + 1 ||
+                l->output_columns != l->input_columns - l->filter_columns + 1) {
+                return -1;
+            }
+            break;
+
+        case CNN_LAYER_MAXPOOL:
+            if (!cnn_graph_same_shape(prev, l) || !l->filter_rows || !l->filter_columns ||
+                l->output_channel != l->input_channel ||
+                l->output_rows != l->input_rows / l->filter_rows ||
+                l->output_columns != l->input_columns / l->filter_columns) {
+                return -1;
+            }
+            break;
+
+        case CNN_LAYER_FC:
+            if (l->input_channel != cnn_graph_volume(prev) || l->output_rows || l->output_columns) {
+                return -1;
+            }
+            break;
+
+        default:
+            return -1;
+        }
+    }
+
+    if (cnn_graph_volume(&graph->layer[graph->layer_num - 1]) != graph->classes) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static void cnn_graph_layer_structure(const cnn_graph_layer *l, layer_structure *lay)
+{
+    lay->input_channel = l->input_channel;
+    lay->input_rows = l->input_rows;
+    lay->input_columns = l->input_columns;
+    lay->filter_rows = l->filter_rows;
+    lay->filter_columns = l->filter_columns;
+    lay->output_channel = l->output_channel;
+    lay->output_rows = l->output_rows;
+    lay->output_columns = l->output_columns;
+    lay->relu_activation = (char)l->relu_activation;
+}
+
+#ifdef CNN_CONV_7
+// conv with a Winograd form: cnn_graph_pack_weights() transforms its
+// weights next to the FC panels
+static int cnn_graph_winograd(const cnn_graph_layer *l)
+{
+    layer_structure lay;
+
+    if (l->type != CNN_LAYER_CONV) {
+        return 0;
+    }
+    cnn_graph_layer_structure(l, &lay);
+
+    return convolution_winograd_tile(&lay) != 0;
+}
+#endif
+
+#ifdef CNN_FUSED
+// conv followed by a 2x2/2 max-pool that convolution_pool() can absorb
+static int cnn_graph_conv_pool(const cnn_graph_layer *conv, const cnn_graph_layer *pool)
+{
+    return pool->type == CNN_LAYER_MAXPOOL &&
+           pool->filter_rows == 2 && pool->filter_columns == 2 &&
+           (conv->output_rows % 2) == 0 && (conv->output_columns % 2) == 0;
+}
+#endif
+
+// layer[i] is a conv whose output only feeds the pool after it
+static int cnn_graph_fused(const cnn_graph *graph, unsigned int i, unsigned int conv_mode)
+{
+#ifdef CNN_FUSED
+    return conv_mode == 6 && graph->layer[i].type == CNN_LAYER_CONV &&
+           i + 1 < graph->layer_num && cnn_graph_conv_pool(&graph->layer[i], &graph->layer[i + 1]);
+#else
+    return 0;
+#endif
+}
+
+// layer[1] is a conv that cnn_convolution_input() can run on the image
+// itself, with the 1/255 of the input layer folded into its weights.
+// Modes #5 and #6 and #8 keep the input tensor for their own first
+// conv kernel.
+static int cnn_graph_input_folded(const cnn_graph *graph, unsigned int conv_mode)
+{
+#ifdef CNN_INPUT_FOLD
+    const cnn_graph_layer *l = &graph->layer[1];
+
+    return conv_mode != 5 && conv_mode != 6 && conv_mode != 8 && l->type == CNN_LAYER_CONV &&
+           l->filter_rows * l->input_columns * l->input_channel <= CONV_INPUT_BAND_MAX;
+#else
+    return 0;
+#endif
+}
+
+// Tensor i is written by layer i and read by layer i + 1, or by the
+// fused conv + pool step that writes tensor i + 2. Largest tensors are
+// placed first, each at the lowest offset that no tensor alive at the
+// same time occupies; for a layer chain this settles into two ping-pong
+// regions. Returns -1 if cnn_graph_check() rejects the graph.
+int cnn_graph_plan_memory(
+    const cnn_graph *graph,
+    cnn_graph_plan *plan,
+    unsigned int conv_mode
+) {
+    unsigned long size[CNN_GRAPH_MAX_LAYERS];
+    unsigned int first_use[CNN_GRAPH_MAX_LAYERS];
+    unsigned int last_use[CNN_GRAPH_MAX_LAYERS];
+    unsigned int order[CNN_GRAPH_MAX_LAYERS];
+    unsigned int tensors;
+    unsigned int placed;
+    unsigned int i, j, t, u;
+    unsigned long offset;
+    unsigned long element_size = sizeof(float);
+    int moved;
+
+    if (cnn_graph_check(graph)) {
+        return -1;
+    }
+#ifdef CNN_FP16
+    if (conv_mode == 8) {
+        element_size = sizeof(cnn_half);
+    }
+#endif
+
+    plan->peak = 0;
+    plan->total = 0;
+    plan->packed_size = 0;
+    plan->conv_mode = conv_mode;
+    plan->input_folded = cnn_graph_input_folded(graph, conv_mode);
+    tensors = graph->layer_num - 1;     // the last one goes to the caller's outputs
+
+    for (i = 0; i < graph->layer_num; i++) {
+        plan->packed_offset[i] = plan->packed_size;
+        if (graph->layer[i].type == CNN_LAYER_FC) {
+            plan->packed_size += FC_PACKED_SIZE(graph->layer[i].input_channel,
+                                                graph->layer[i].output_channel) * sizeof(float);
+        }
+#ifdef CNN_CONV_7
+        if (cnn_graph_winograd(&graph->layer[i])) {
+            plan->packed_size += WINOGRAD_WEIGHTS_SIZE(graph->layer[i].input_channel,
+                                                       graph->layer[i].output_channel) * sizeof(float);
+        }
+#endif
+    }
+    plan->input_offset = plan->packed_size;
+    if (graph->layer[1].type == CNN_LAYER_CONV) {
+        plan->packed_size += (cnn_graph_weight_count(&graph->layer[1]) * sizeof(float) + CNN_GRAPH_ALIGN - 1) &
+                             ~(unsigned long)(CNN_GRAPH_ALIGN - 1);
+    }
+#ifdef CNN_FP16
+    for (i = 0; i < graph->layer_num; i++) {
+        plan->half_offset[i] = plan->packed_size;
+        plan->packed_size += (cnn_graph_param_count(&graph->layer[i]) * sizeof(cnn_half) + CNN_GRAPH_ALIGN - 1) &
+                             ~(unsigned long)(CNN_GRAPH_ALIGN - 1);
+    }
+#endif
+
+    for (i = 0; i < tensors; i++) {
+        plan->offset[i] = 0;
+        first_use[i] = i;
+        last_use[i] = i + 1;
+        size[i] = cnn_graph_buffer_size(&graph->layer[i], element_size);
+    }
+    for (i = 0; i < tensors; i++) {
+        if (cnn_graph_fused(graph, i, conv_mode)) {
+            size[i] = 0;                // stays in registers
+            if (i > 0) {
+                last_use[i - 1] = i + 1;
+            }
+        }
+        plan->total += size[i];
+    }
+    if (plan->input_folded && tensors > 0) {
+        plan->total -= size[0];
+        size[0] = 0;                    // never written
+    }
+
+    // tensors by decreasing size (insertion sort, at most 31 of them)
+    for (i = 0; i < tensors; i++) {
+        for (j = i; j > 0 && size[order[j - 1]] < size[i]; j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+
+    for (placed = 0; placed < tensors && size[order[placed]]; placed++) {
+        t = order[placed];
+        offset = 0;
+        do {
+            moved = 0;
+            for (j = 0; j < placed; j++) {
+                u = order[j];
+                if (first_use[u] <= last_use[t] && first_use[t] <= last_use[u] &&
+                    offset < plan->offset[u] + size[u] && plan->offset[u] < offset + size[t]) {
+                    offset = plan->offset[u] + size[u];
+                    moved = 1;
+                }
+            }
+        } while (moved);
+
+        plan->offset[t] = offset;
+        if (offset + size[t] > plan->peak) {
+            plan->peak = offset + size[t];
+        }
+    }
+    plan->scale_offset = 0;
+#ifdef CNN_FP16
+    if (conv_mode == 8) {
+        // the input step's scale, read by every later layer of the image
+        plan->peak = (plan->peak + CNN_GRAPH_ALIGN - 1) & ~(unsigned long)(CNN_GRAPH_ALIGN - 1);
+        plan->scale_offset = plan->peak;
+        plan->peak += CNN_GRAPH_ALIGN;
+    }
+#endif
+
+    return 0;
+}
+
+// Repack every FC layer's weights into panels, transform the conv
+// weights that have a Winograd form, keep an fp16 copy of every layer's
+// parameters and fold the input scale into the first conv's weights,
+// at packed, once after the parameters are loaded
+int cnn_graph_pack_weights(
+    const cnn_graph *graph,
+    const cnn_graph_plan *plan,
+    unsigned long params,
+    unsigned long packed
+) {
+    const cnn_graph_layer *l;
+    layer_structure lay;
+    unsigned int i;
+
+    for (i = 0; i < graph->layer_num; i++) {
+        l = &graph->layer[i];
+        if (l->type == CNN_LAYER_FC) {
+            cnn_graph_layer_structure(l, &lay);
+            fully_connected_pack(
+                &lay,
+                (float*)(params + l->weights),
+                (float*)(params + l->biases),
+                (float*)(packed + plan->packed_offset[i])
+            );
+        }
+#ifdef CNN_CONV_7
+        if (cnn_graph_winograd(l)) {
+            cnn_graph_layer_structure(l, &lay);
+            convolution_winograd_transform(
+                &lay,
+                (float*)(params + l->weights),
+                (float*)(packed + plan->packed_offset[i])
+            );
+        }
+#endif
+#ifdef CNN_FP16
+        if (cnn_graph_param_count(l)) {
+            cnn_fp32_to_fp16(
+                (float*)(params + l->weights),
+                (cnn_half*)(packed + plan->half_offset[i]),
+                cnn_graph_weight_count(l)
+            );
+            cnn_fp32_to_fp16(
+                (float*)(params + l->biases),
+                (cnn_half*)(packed + plan->half_offset[i]) + cnn_graph_weight_count(l),
+                l->output_channel
+            );
+        }
+#endif
+    }
+
+    // the input layer's 1/255, for cnn_convolution_input()
+    l = &graph->layer[1];
+    if (l->type == CNN_LAYER_CONV) {
+        for (i = 0; i < cnn_graph_weight_count(l); i++) {
+            ((float*)(packed + plan->input_offset))[i] = ((float*)(params + l->weights))[i] / 255.0f;
+        }
+    }
+
+    return 0;
+}
+
+// Name layer[i .. last] (a conv fused with its pool) like "conv2",
+// "conv1+pool" or "fc1", for the profile and the trace
+static void cnn_graph_layer_name(
+    const cnn_graph *graph,
+    unsigned int i,
+    unsigned int last,
+    char *name
+) {
+    static const char *kind[] = { "pre-proc", "conv", "pool", "fc" };
+    const cnn_graph_layer *l = &graph->layer[i];
+    unsigned int nth = 1;
+    unsigned int j;
+
+    for (j = 0; j < i; j++) {
+        nth += (graph->layer[j].type == l->type);
+    }
+    if (l->type == CNN_LAYER_INPUT) {
+        sprintf(name, "%s", kind[l->type]);
+    }
+    else if (last != i) {
+        sprintf(name, "%s%u+pool", kind[l->type], nth);
+    }
+    else {
+        sprintf(name, "%s%u", kind[l->type], nth);
+    }
+}
+
+void cnn_graph_step_name(
+    const cnn_graph *graph,
+    const cnn_graph_plan *plan,
+    unsigned int i,
+    char *name
+) {
+    cnn_graph_layer_name(graph, i, cnn_graph_fused(graph, i, plan->conv_mode) ? i + 1 : i, name);
+}
+
+// Begin layer[i .. last] and count its multiply-accumulates per image.
+// Trace events bracket the counters, so that neither measures the other.
+static void cnn_graph_layer_begin(
+    cnn_prof *prof,
+    cnn_trace_buf *trace,
+    const cnn_graph *graph,
+    unsigned int i,
+    unsigned int last
+) {
+    const cnn_graph_layer *l = &graph->layer[i];
+    unsigned long long macs = 0;
+    char name[16];
+
+    if (!prof && !trace) {
+        return;
+    }
+    if (l->type == CNN_LAYER_CONV) {
+        macs = (unsigned long long)l->output_rows * l->output_columns * l->output_channel *
+               l->filter_rows * l->filter_columns * l->input_channel;
+    }
+    else if (l->type == CNN_LAYER_FC) {
+        macs = (unsigned long long)l->input_channel * l->output_channel;
+    }
+    cnn_graph_layer_name(graph, i, last, name);
+#ifdef CNN_TRACE
+    cnn_trace_begin(trace, name);
+#endif
+#ifdef CNN_PROF
+    if (prof) {
+        cnn_prof_layer_begin(prof, i, name, macs);
+    }
+#else
+    (void)macs;
+#endif
+}
+
+static void cnn_graph_layer_end(cnn_prof *prof, cnn_trace_buf *trace)
+{
+#ifdef CNN_PROF
+    if (prof) {
+        cnn_prof_layer_end(prof);
+    }
+#else
+    (void)prof;
+#endif
+#ifdef CNN_TRACE
+    cnn_trace_end(trace);
+#else
+    (void)trace;
+#endif
+}
+
+#ifdef CNN_FP16
+// Conv mode #8: every tensor is fp16 and every layer reads the fp16
+// parameters from cnn_graph_pack_weights(). Image words above 255 would
+// overflow fp16 after a few layers, so the whole network runs on
+// activations divided by a power of two that brings the input back to
+// [0, 1]; it is 1 for 8-bit pixels. The input step finds it from the
+// image and keeps it at plan->scale_offset in the workspace for the
+// later layers. The last layer goes to the scratch and is widened and
+// rescaled into the caller's fp32 outputs.
+static float cnn_graph_fp16_scale(
+    const cnn_graph *graph,
+    const unsigned int *test_images,
+    unsigned int image_format
+) {
+    unsigned long count;
+    unsigned int max_word = 0;
+    float scale = 1.0f;
+
+    for (count = 0; count < cnn_graph_volume(&graph->layer[0]) && image_format != CNN_PIXEL_U8; count++) {
+        if (max_word < test_images[count]) {
+            max_word = test_images[count];
+        }
+    }
+    while ((float)max_word / 255.0f > scale) {
+        scale *= 2.0f;
+    }
+
+    return scale;
+}
+
+static int cnn_graph_eval_fp16(
+    const cnn_graph *graph,
+    const cnn_graph_plan *plan,
+    unsigned long packed,
+    unsigned int *test_images,
+    unsigned int image_format,
+    unsigned long workspace,
+    unsigned long workspace_scratch,
+    float *outputs,
+    unsigned int i
+) {
+    const cnn_graph_layer *l = &graph->layer[i];
+    layer_structure lay;
+    cnn_half *inputs = (i > 0) ? (cnn_half*)(workspace + plan->offset[i - 1]) : NULL;
+    cnn_half *layer_outputs;
+    cnn_half *weights = (cnn_half*)(packed + plan->half_offset[i]);
+    unsigned long count;
+    float *scale_word = (float*)(workspace + plan->scale_offset);
+    float scale;
+
+    if (l->type == CNN_LAYER_INPUT) {
+        *scale_word = cnn_graph_fp16_scale(graph, test_images, image_format);
+    }
+    scale = *scale_word;
+
+    if (i + 1 == graph->layer_num) {
+        layer_outputs = (cnn_half*)workspace_scratch;
+    }
+    else {
+        layer_outputs = (cnn_half*)(workspace + plan->offset[i]);
+    }
+    cnn_graph_layer_structure(l, &lay);
+
+    switch (l->type) {
+    case CNN_LAYER_INPUT:
+        for (count = 0; count < cnn_graph_volume(l); count++) {
+            layer_outputs[count] = (cnn_half)(cnn_graph_pixel(test_images, image_format, count) / 255.0f / scale);
+        }
+        break;
+
+    case CNN_LAYER_CONV:
+        convolution_fp16(
+            &lay,
+            inputs,
+            layer_outputs,
+            weights,
+            weights + cnn_graph_weight_count(l),
+            1.0f / scale
+        );
+        break;
+
+    case CNN_LAYER_MAXPOOL:
+        max_pooling_fp16(
+            &lay,
+            inputs,
+            layer_outputs
+        );
+        break;
+
+    case CNN_LAYER_FC:
+        fully_connected_fp16(
+            &lay,
+            inputs,
+            layer_outputs,
+            weights,
+            weights + cnn_graph_weight_count(l),
+            1.0f / scale
+        );
+        break;
+    }
+
+    if (i + 1 == graph->layer_num) {
+        cnn_fp16_to_fp32(layer_outputs, outputs, graph->classes);
+        for (count = 0; count < graph->classes; count++) {
+            outputs[count] *= scale;
+        }
+    }
+
+    return 0;
+}
+#endif
+
+// A step is layer[i], and in conv mode #6 the pool that a conv at
+// layer[i] absorbs; it ends at layer[cnn_graph_step_last()].
+unsigned int cnn_graph_step_last(
+    const cnn_graph *graph,
+    const cnn_graph_plan *plan,
+    unsigned int i
+) {
+    return cnn_graph_fused(graph, i, plan->conv_mode) ? i + 1 : i;
+}
+
+// Units cnn_graph_eval_rows() splits a step into: output rows of a conv
+// or pool (pooled rows of a fused conv), FC_PANEL blocks of FC outputs.
+// The input layer and the engine, INT8 and fp16 kernels, which see the
+// whole tensor, are one unit.
+unsigned int cnn_graph_step_units(
+    const cnn_graph *graph,
+    const cnn_graph_plan *plan,
+    unsigned int i
+) {
+    const cnn_graph_layer *l = &graph->layer[i];
+    unsigned int conv_mode = plan->conv_mode;
+
+    if (l->type == CNN_LAYER_INPUT || conv_mode == 8 ||
+        (conv_mode == 5 && l->int8_weights != CNN_GRAPH_NONE)) {
+        return 1;
+    }
+    if (l->type == CNN_LAYER_FC) {
+        return (l->output_channel + FC_PANEL - 1) / FC_PANEL;
+    }
+    if (conv_mode == 3 && l->type == CNN_LAYER_CONV && !(i == 1 && plan->input_folded)) {
+        return 1;
+    }
+
+    return graph->layer[cnn_graph_step_last(graph, plan, i)].output_rows;
+}
+
+// Restrict lay to output rows [row_begin, row_end) and move the tensor
+// pointers to match. Tensors are HWC, so a band of rows is contiguous;
+// every kernel then works on the band unchanged.
+static void cnn_graph_slice_rows(
+    layer_structure *lay,
+    float **inputs,
+    float **outputs,
+    unsigned int stride,
+    unsigned int row_begin,
+    unsigned int row_end
+) {
+    *inputs += row_begin * stride * lay->input_columns * lay->input_channel;
+    *outputs += row_begin * lay->output_columns * lay->output_channel;
+    lay->output_rows = row_end - row_begin;
+    lay->input_rows = ((lay->output_rows - 1) * stride) + lay->filter_rows;
+}
+
+// Units [begin, end) of the step at layer[i] of one image, in the conv
+// mode and the workspace layout of plan: the input is the tensor of
+// layer[i - 1], the output that of the step's last layer, or outputs
+// for the last layer of the graph. Any split of a step into unit ranges
+// gives the tensor a whole-step call does, so the ranges of one step
+// can run on different cores.
+int cnn_graph_eval_rows(
+    const cnn_graph *graph,
+    const cnn_graph_plan *plan,
+    unsigned long params,
+    unsigned long int8_params,
+    unsigned long packed,
+    unsigned int *test_images,
+    unsigned int image_format,
+    unsigned long workspace,
+    unsigned long workspace_scratch,
+    float *outputs,
+    unsigned int i,
+    unsigned int begin,
+    unsigned int end
+) {
+    const cnn_graph_layer *l = &graph->layer[i];
+    layer_structure lay;
+    unsigned int conv_mode = plan->conv_mode;
+    unsigned int last = cnn_graph_step_last(graph, plan, i);
+    float *inputs = (i > 0) ? (float*)(workspace + plan->offset[i - 1]) : NULL;
+    float *layer_outputs;
+    unsigned long count;
+    unsigned long row_len;
+
+#ifdef CNN_FP16
+    if (conv_mode == 8) {
+        if (!packed) {
+            return -1;  // no fp16 parameters, and the tensors are planned as fp16
+        }
+        return cnn_graph_eval_fp16(graph, plan, packed, test_images, image_format, workspace, workspace_scratch, outputs, i);
+    }
+#endif
+    if (cnn_graph_step_units(graph, plan, i) == 1) {
+        begin = 0;
+        end = (l->type == CNN_LAYER_CONV) ? graph->layer[last].output_rows : 1;
+    }
+    if (last + 1 == graph->layer_num) {
+        layer_outputs = outputs;
+    }
+    else {
+        layer_outputs = (float*)(workspace + plan->offset[last]);
+    }
+    cnn_graph_layer_structure(l, &lay);
+
+    switch (l->type) {
+    case CNN_LAYER_INPUT:
+        if (plan->input_folded) {
+            break;      // read by layer[1]
+        }
+        for (count = 0; count < cnn_graph_volume(l); count++) {
+            layer_outputs[count] = cnn_graph_pixel(test_images, image_format, count) / 255.0;
+        }
+        break;
+
+    case CNN_LAYER_CONV:
+        if (i == 1 && plan->input_folded) {
+            row_len = begin * lay.input_columns * lay.input_channel;
+            lay.output_rows = end - begin;
+            lay.input_rows = (lay.output_rows - 1) + lay.filter_rows;
+            cnn_convolution_input(
+                &lay,
+                (image_format == CNN_PIXEL_U8) ?
+                    (const void*)((const unsigned char*)test_images + row_len) :
+                    (const void*)(test_images + row_len),
+                image_format,
+                layer_outputs + (begin * lay.output_columns * lay.output_channel),
+                packed ? packed + plan->input_offset : params + l->weights,
+                params + l->biases,
+                packed ? 1.0f : 1.0f / 255.0f,
+                workspace_scratch,
+                conv_mode
+            );
+            break;
+        }
+#ifdef CNN_FUSED
+        if (last != i) {
+            // pooled rows [begin, end) are conv rows [2 * begin, 2 * end)
+            layer_outputs += begin * (lay.output_columns / 2) * lay.output_channel;
+            inputs += 2 * begin * lay.input_columns * lay.input_channel;
+            lay.output_rows = 2 * (end - begin);
+            lay.input_rows = (lay.output_rows - 1) + lay.filter_rows;
+            CONVOLUTION_POOL(
+                &lay,
+                inputs,
+                layer_outputs,
+                (float*)(params + l->weights),
+                (float*)(params + l->biases)
+            );
+            break;
+        }
+#endif
+        cnn_graph_slice_rows(&lay, &inputs, &layer_outputs, 1, begin, end);
+        cnn_convolution(
+            &lay,
+            inputs,
+            layer_outputs,
+            params + l->weights,
+            params + l->biases,
+            int8_params + l->int8_weights,
+            int8_params + l->int8_scales,
+            int8_params + l->int8_biases,
+#ifdef CNN_CONV_7
+            (packed && cnn_graph_winograd(l)) ? packed + plan->packed_offset[i] : 0,
+#else
+            0,
+#endif
+            workspace_scratch,
+            (conv_mode == 5 && l->int8_weights == CNN_GRAPH_NONE) ? 1 : conv_mode
+        );
+        break;
+
+    case CNN_LAYER_MAXPOOL:
+        cnn_graph_slice_rows(&lay, &inputs, &layer_outputs, lay.filter_rows, begin, end);
+        MAX_POOLING(
+            &lay,
+            inputs,
+            layer_outputs
+        );
+        break;
+
+    case CNN_LAYER_FC:
+#ifdef CNN_CONV_5
+        if (conv_mode == 5 && l->int8_weights != CNN_GRAPH_NONE) {
+            fully_connected_int8(
+                &lay,
+                inputs,
+                layer_outputs,
+                (signed char*)(int8_params + l->int8_weights),
+                (float*)(int8_params + l->int8_scales),
+                (float*)(int8_params + l->int8_biases),
+                (signed char*)workspace_scratch
+            );
+            break;
+        }
+#endif
+        begin *= FC_PANEL;
+        end = (end * FC_PANEL < lay.output_channel) ? end * FC_PANEL : lay.output_channel;
+        if (packed) {
+            FULLY_CONNECTED_PACKED(
+                &lay,
+                inputs,
+                layer_outputs,
+                (float*)(packed + plan->packed_offset[i]),
+                begin,
+                end
+            );
+            break;
+        }
+        FULLY_CONNECTED_RANGE(
+            &lay,
+            inputs,
+            layer_outputs,
+            (float*)(params + l->weights),
+            (float*)(params + l->biases),
+            begin,
+            end
+        );
+        break;
+    }
+
+    return 0;
+}
+
+#ifdef CNN_BATCH
+// The FC layer[i] over batch images, inputs[batch][input_channel] into
+// outputs[batch][output_channel], with the weights streamed once per
+// pass. Returns -1 in the modes whose FC kernel takes one image at a
+// time (INT8, fp16); run those image by image.
+int cnn_graph_eval_batch(
+    const cnn_graph *graph,
+    const cnn_graph_plan *plan,
+    unsigned long params,
+    unsigned long packed,
+    unsigned int i,
+    float *inputs,
+    float *outputs,
+    unsigned int batch
+) {
+    const cnn_graph_layer *l = &graph->layer[i];
+    layer_structure lay;
+
+    if (l->type != CNN_LAYER_FC || plan->conv_mode == 8 ||
+        (plan->conv_mode == 5 && l->int8_weights != CNN_GRAPH_NONE)) {
+        return -1;
+    }
+    cnn_graph_layer_structure(l, &lay);
+
+    if (packed) {
+        FULLY_CONNECTED_BATCH_PACKED(
+            &lay,
+            inputs,
+            outputs,
+            (float*)(packed + plan->packed_offset[i]),
+            batch
+        );
+    }
+    else {
+        FULLY_CONNECTED_BATCH(
+            &lay,
+            inputs,
+            outputs,
+            (float*)(params + l->weights),
+            (float*)(params + l->biases),
+            batch
+        );
+    }
+
+    return 0;
+}
+#endif
+
+// Run every step of graph on one image, in the conv mode and the
+// workspace layout of plan
+int cnn_graph_eval(
+    const cnn_graph *graph,
+    const cnn_graph_plan *plan,
+    unsigned long params,
+    unsigned long int8_params,
+    unsigned long packed,
+    unsigned int *test_images,
+    unsigned int image_format,
+    unsigned long workspace,
+    unsigned long workspace_scratch,
+    float *outputs,
+    cnn_prof *prof,
+    cnn_trace_buf *trace
+) {
+    unsigned int last;
+    unsigned int i;
+    int err = 0;
+
+    for (i = 0; i < graph->layer_num && !err; i = last + 1) {
+        last = cnn_graph_step_last(graph, plan, i);
+        cnn_graph_layer_begin(prof, trace, graph, i, last);
+        err = cnn_graph_eval_rows(
+            graph,
+            plan,
+            params,
+            int8_params,
+            packed,
+            test_images,
+            image_format,
+            workspace,
+            workspace_scratch,
+            outputs,
+            i,
+            0,
+            cnn_graph_step_units(graph, plan, i)
+        );
+        cnn_graph_layer_end(prof, trace);
+    }
+
+    return err;
+}
+#endif
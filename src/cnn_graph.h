@@ -0,0 +1,169 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Simple CNN Application for Inference only
+ Network description and generic layer interpreter
+==================================================================
+*/
+#ifndef CNN_GRAPH_H
+#define CNN_GRAPH_H
+
+// A network is a list of layers, loaded next to the parameter blob (see
+// mnist/mnist_cnn_graph.py) and run by cnn_graph_eval(). Every field is
+// a little-endian 32-bit word; parameter offsets are bytes from the
+// start of the fp32 (or INT8) parameter blob. Tensors are HWC; an FC
+// layer takes the previous layer's tensor flattened.
+#define CNN_GRAPH_MAGIC         0x474E4E43  // "CNNG"
+#define CNN_GRAPH_VERSION       1
+#define CNN_GRAPH_MAX_LAYERS    32
+#define CNN_GRAPH_NONE          0xFFFFFFFF  // no INT8 parameters for this layer
+
+#define CNN_LAYER_INPUT         0   // image pixels / 255 -> float, must be first
+#define CNN_LAYER_CONV          1
+#define CNN_LAYER_MAXPOOL       2
+#define CNN_LAYER_FC            3
+
+typedef struct {
+    unsigned int type;
+    unsigned int relu_activation;
+    unsigned int input_channel, input_rows, input_columns;
+    unsigned int filter_rows, filter_columns;
+    unsigned int output_channel, output_rows, output_columns;
+    unsigned int weights, biases;                           // fp32 blob offsets
+    unsigned int int8_weights, int8_scales, int8_biases;    // INT8 blob offsets
+    unsigned int reserved;
+} cnn_graph_layer;
+
+typedef struct cnn_graph {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int layer_num;
+    unsigned int classes;       // output_channel of the last layer
+    cnn_graph_layer layer[CNN_GRAPH_MAX_LAYERS];    // layer[layer_num] in a blob
+} cnn_graph;
+
+// Workspace layout for one conv mode, from tensor lifetimes: a tensor
+// is live from the layer that writes it to the last layer that reads
+// it, and tensors that are never live together share bytes.
+typedef struct {
+    unsigned long offset[CNN_GRAPH_MAX_LAYERS];  // layer[i] output, bytes into the workspace
+    unsigned long peak;         // workspace bytes needed
+    unsigned long total;        // bytes with one buffer per tensor
+    unsigned long packed_offset[CNN_GRAPH_MAX_LAYERS];  // FC panels or Winograd conv weights of layer[i], bytes
+    unsigned long half_offset[CNN_GRAPH_MAX_LAYERS];    // fp16 weights then biases of layer[i], bytes
+    unsigned long input_offset; // layer[1] conv weights / 255, bytes
+    unsigned int input_folded;  // layer[1] reads the image, no input tensor
+    unsigned long packed_size;  // bytes for cnn_graph_pack_weights()
+    unsigned long scale_offset; // conv mode #8: the image's fp16 scale, bytes into the workspace
+    unsigned int conv_mode;
+} cnn_graph_plan;
+
+int cnn_graph_check(
+    const cnn_graph *graph
+);
+int cnn_graph_plan_memory(
+    const cnn_graph *graph,
+    cnn_graph_plan *plan,
+    unsigned int conv_mode
+);
+int cnn_graph_pack_weights(
+    const cnn_graph *graph,
+    const cnn_graph_plan *plan,
+    unsigned long params,
+    unsigned long packed            // plan->packed_size bytes
+);
+struct cnn_prof;
+struct cnn_trace_buf;
+int cnn_graph_eval(
+    const cnn_graph *graph,
+    const cnn_graph_plan *plan,     // from cnn_graph_plan_memory(graph)
+    unsigned long params,           // fp32 parameter blob
+    unsigned long int8_params,      // INT8 parameter blob, conv mode #5
+    unsigned long packed,           // from cnn_graph_pack_weights(), 0 if not packed (not for mode #8)
+    unsigned int *test_images,      // test_images[rows][columns][channel]
+    unsigned int image_format,      // CNN_PIXEL_U32 or CNN_PIXEL_U8
+    unsigned long workspace,        // activations, plan->peak bytes
+    unsigned long workspace_scratch,
+    float *outputs,                 // outputs[graph->classes]
+    struct cnn_prof *prof,          // per-layer counters, 0 if not profiling
+    struct cnn_trace_buf *trace     // per-layer begin/end events, 0 if not tracing
+);
+
+// The same one step at a time: the step at layer[i] ends at layer[last]
+// (a conv fused with its pool), and splits into units of output rows
+// or FC_PANEL blocks of FC outputs. Ranges of units of one step can run
+// on different cores, once every unit of the step before has finished.
+unsigned int cnn_graph_step_last(
+    const cnn_graph *graph,
+    const cnn_graph_plan *plan,
+    unsigned int i
+);
+unsigned int cnn_graph_step_units(
+    const cnn_graph *graph,
+    const cnn_graph_plan *plan,
+    unsigned int i
+);
+int cnn_graph_eval_rows(
+    const cnn_graph *graph,
+    const cnn_graph_plan *plan,
+    unsigned long params,
+    unsigned long int8_params,
+    unsigned long packed,
+    unsigned int *test_images,
+    unsigned int image_format,
+    unsigned long workspace,
+    unsigned long workspace_scratch,    // of the core running the range
+    float *outputs,                 // outputs[graph->classes], for the last step
+    unsigned int i,                 // first layer of the step
+    unsigned int begin,             // units [begin, end)
+    unsigned int end
+);
+// FC layer[i] over batch images: inputs[batch][input_channel] into
+// outputs[batch][output_channel]. -1 in conv modes #5 and #8.
+int cnn_graph_eval_batch(
+    const cnn_graph *graph,
+    const cnn_graph_plan *plan,
+    unsigned long params,
+    unsigned long packed,
+    unsigned int i,
+    float *inputs,
+    float *outputs,
+    unsigned int batch
+);
+// Name of the step at layer[i] in traces and profiles, e.g. "conv1+pool"
+void cnn_graph_step_name(
+    const cnn_graph *graph,
+    const cnn_graph_plan *plan,
+    unsigned int i,
+    char *name                      // name[16]
+);
+
+// The conv mode dispatch shared by the interpreter and mnist.c, and the
+// same for a first conv that reads the image pixels directly
+void cnn_convolution(
+    layer_structure *lay,
+    float *inputs,
+    float *outputs,
+    unsigned long weights,
+    unsigned long biases,
+    unsigned long int8_weights,
+    unsigned long int8_scales,
+    unsigned long int8_biases,
+    unsigned long winograd_weights,     // conv mode #7, 0 if not transformed
+    unsigned long workspace_scratch,
+    unsigned int conv_mode
+);
+void cnn_convolution_input(
+    layer_structure *lay,
+    const void *pixels,             // pixels[input_rows][input_columns][C]
+    unsigned int pixel_format,      // CNN_PIXEL_U32 or CNN_PIXEL_U8
+    float *outputs,
+    unsigned long weights,
+    unsigned long biases,
+    float input_scale,              // 1.0f when the weights carry the 1/255
+    unsigned long workspace_scratch,
+    unsigned int conv_mode
+);
+
+#endif
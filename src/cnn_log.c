@@ -0,0 +1,134 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Simple CNN Application for Inference only
+ Lock-free per-core log rings
+==================================================================
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "arm_cnn_inference.h"
+#include "cnn_log.h"
+
+#ifdef CNN_LOG
+
+// A core logs into its own ring with two plain stores and a release,
+// and never waits: printf() over semihosting happens only in
+// cnn_log_drain(), on whichever core drains, outside any timed region.
+// Records of different cores come out in the order they took their
+// global seq, which is the order they were logged up to records still
+// being written when the drain started.
+
+static const char cnn_log_dropped_fmt[] = "[CPU: %llu] %llu log records dropped\n";
+
+void cnn_log_init(cnn_log *log)
+{
+    memset(log, 0, sizeof(*log));
+}
+
+int cnn_log_put(
+    cnn_log *log,
+    unsigned int cpu,
+    const char *fmt,
+    unsigned long long a0,
+    unsigned long long a1,
+    unsigned long long a2,
+    unsigned long long a3
+) {
+    cnn_log_ring *ring;
+    cnn_log_record *rec;
+    unsigned long head;
+
+    if (cpu >= CNN_LOG_MAX_CPUS) {
+        return 0;
+    }
+    ring = &log->ring[cpu];
+    head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= CNN_LOG_RING_SIZE) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    rec = &ring->rec[head & (CNN_LOG_RING_SIZE - 1)];
+    rec->fmt = fmt;
+    rec->seq = __atomic_fetch_add(&log->seq, 1, __ATOMIC_RELAXED);
+    rec->args[0] = a0;
+    rec->args[1] = a1;
+    rec->args[2] = a2;
+    rec->args[3] = a3;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+static void cnn_log_emit(cnn_log_emit_fn emit, void *ctx, unsigned int cpu, const cnn_log_record *rec)
+{
+    if (emit) {
+        emit(ctx, cpu, rec);
+    }
+    else {
+        printf(rec->fmt, rec->args[0], rec->args[1], rec->args[2], rec->args[3]);
+    }
+}
+
+unsigned int cnn_log_drain(cnn_log *log, cnn_log_emit_fn emit, void *ctx)
+{
+    unsigned long head[CNN_LOG_MAX_CPUS];
+    unsigned long tail[CNN_LOG_MAX_CPUS];
+    unsigned long dropped;
+    unsigned long long seq = 0;
+    unsigned int cpu, next, count = 0, busy = 0;
+    cnn_log_ring *ring;
+    cnn_log_record note;
+
+    if (!__atomic_compare_exchange_n(&log->draining, &busy, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+
+    for (cpu = 0; cpu < CNN_LOG_MAX_CPUS; cpu++) {
+        ring = &log->ring[cpu];
+        head[cpu] = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        tail[cpu] = ring->tail;
+    }
+
+    // merge the rings oldest seq first
+    while (1) {
+        next = CNN_LOG_MAX_CPUS;
+        for (cpu = 0; cpu < CNN_LOG_MAX_CPUS; cpu++) {
+            if (tail[cpu] != head[cpu] &&
+                (next == CNN_LOG_MAX_CPUS || log->ring[cpu].rec[tail[cpu] & (CNN_LOG_RING_SIZE - 1)].seq < seq)) {
+                next = cpu;
+                seq = log->ring[cpu].rec[tail[cpu] & (CNN_LOG_RING_SIZE - 1)].seq;
+            }
+        }
+        if (next == CNN_LOG_MAX_CPUS) {
+            break;
+        }
+        ring = &log->ring[next];
+        cnn_log_emit(emit, ctx, next, &ring->rec[tail[next] & (CNN_LOG_RING_SIZE - 1)]);
+        tail[next]++;
+        __atomic_store_n(&ring->tail, tail[next], __ATOMIC_RELEASE);
+        count++;
+    }
+
+    for (cpu = 0; cpu < CNN_LOG_MAX_CPUS; cpu++) {
+        ring = &log->ring[cpu];
+        dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+        if (dropped != ring->dropped_seen) {
+            memset(&note, 0, sizeof(note));
+            note.fmt = cnn_log_dropped_fmt;
+            note.args[0] = cpu;
+            note.args[1] = dropped - ring->dropped_seen;
+            cnn_log_emit(emit, ctx, cpu, &note);
+            ring->dropped_seen = dropped;
+        }
+    }
+
+    __atomic_store_n(&log->draining, 0, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+#endif
@@ -0,0 +1,65 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Simple CNN Application for Inference only
+ Lock-free per-core log rings
+==================================================================
+*/
+#ifndef CNN_LOG_H
+#define CNN_LOG_H
+
+#define CNN_LOG_MAX_CPUS        8
+#define CNN_LOG_RING_SIZE       64      // records per core, power of 2
+#define CNN_LOG_MAX_ARGS        4
+
+// One log line, formatted only when drained. fmt is a string literal
+// (it is kept by pointer) whose conversions all take 64-bit integers:
+// %llu, %lld or %llx. seq orders records of different cores.
+typedef struct {
+    const char *fmt;
+    unsigned long long seq;
+    unsigned long long args[CNN_LOG_MAX_ARGS];
+} cnn_log_record;
+
+// Single producer (the owning core), single consumer (the drainer).
+// A full ring drops the new record rather than stall the producer.
+typedef struct {
+    unsigned long head __attribute__ ((aligned (64)));     // records written, producer
+    unsigned long dropped;
+    unsigned long tail __attribute__ ((aligned (64)));     // records drained, consumer
+    unsigned long dropped_seen;
+    cnn_log_record rec[CNN_LOG_RING_SIZE];
+} cnn_log_ring;
+
+typedef struct cnn_log {
+    cnn_log_ring ring[CNN_LOG_MAX_CPUS];
+    unsigned long long seq __attribute__ ((aligned (64)));
+    unsigned int draining;
+} cnn_log;
+
+// Called by the drainer for every record, oldest first; printf()s it
+// when cnn_log_drain() is given no emit function
+typedef void (*cnn_log_emit_fn)(void *ctx, unsigned int cpu, const cnn_log_record *rec);
+
+void cnn_log_init(cnn_log *log);
+int cnn_log_put(
+    cnn_log *log,
+    unsigned int cpu,
+    const char *fmt,
+    unsigned long long a0,
+    unsigned long long a1,
+    unsigned long long a2,
+    unsigned long long a3
+);
+// Empties every ring in seq order. Returns the number of records
+// drained, or 0 at once if another core is already draining.
+unsigned int cnn_log_drain(cnn_log *log, cnn_log_emit_fn emit, void *ctx);
+
+#define CNN_LOG0(log, cpu, fmt)             cnn_log_put(log, cpu, fmt, 0, 0, 0, 0)
+#define CNN_LOG1(log, cpu, fmt, a)          cnn_log_put(log, cpu, fmt, (unsigned long long)(a), 0, 0, 0)
+#define CNN_LOG2(log, cpu, fmt, a, b)       cnn_log_put(log, cpu, fmt, (unsigned long long)(a), (unsigned long long)(b), 0, 0)
+#define CNN_LOG3(log, cpu, fmt, a, b, c)    cnn_log_put(log, cpu, fmt, (unsigned long long)(a), (unsigned long long)(b), (unsigned long long)(c), 0)
+#define CNN_LOG4(log, cpu, fmt, a, b, c, d) cnn_log_put(log, cpu, fmt, (unsigned long long)(a), (unsigned long long)(b), (unsigned long long)(c), (unsigned long long)(d))
+
+#endif
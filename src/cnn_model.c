@@ -0,0 +1,226 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Simple CNN Application for Inference only
+ Versioned model container: parameters and network in one blob
+==================================================================
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include "arm_cnn_inference.h"
+#include "mnist.h"
+#include "cnn_graph.h"
+#include "cnn_model.h"
+
+#ifdef CNN_MODEL
+
+// CRC-32 (reflected 0xEDB88320, as zlib) a nibble at a time: a 64-byte
+// table instead of 1 KB, and fast enough for a check done once at load
+static const unsigned int cnn_model_crc_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+unsigned int cnn_model_crc32(unsigned int crc, const void *data, unsigned long size)
+{
+    const unsigned char *p = (const unsigned char*)data;
+    unsigned long idx;
+
+    crc = ~crc;
+    for (idx = 0; idx < size; idx++) {
+        crc ^= p[idx];
+        crc = (crc >> 4) ^ cnn_model_crc_table[crc & 0xF];
+        crc = (crc >> 4) ^ cnn_model_crc_table[crc & 0xF];
+    }
+
+    return ~crc;
+}
+
+static unsigned int cnn_model_dtype_size(unsigned int dtype)
+{
+    switch (dtype) {
+    case CNN_DTYPE_F32: return 4;
+    case CNN_DTYPE_I8:  return 1;
+    case CNN_DTYPE_U32: return 4;
+    case CNN_DTYPE_F16: return 2;
+    }
+
+    return 0;
+}
+
+static int cnn_model_check_tensor(const cnn_model_header *h, const cnn_model_tensor *t)
+{
+    unsigned long count = 1;
+    unsigned int dim;
+
+    if (!t->name[0] || !memchr(t->name, '\0', CNN_MODEL_NAME) ||
+        !cnn_model_dtype_size(t->dtype) || t->layout > CNN_LAYOUT_SDOT ||
+        !t->rank || t->rank > CNN_MODEL_MAX_RANK) {
+        return -1;
+    }
+    for (dim = 0; dim < CNN_MODEL_MAX_RANK; dim++) {
+        if (dim >= t->rank && t->shape[dim] != 1) {
+            return -1;
+        }
+        count *= t->shape[dim];
+    }
+    if (t->size != count * cnn_model_dtype_size(t->dtype) || t->offset % CNN_MODEL_ALIGN ||
+        t->offset < h->data_offset || (unsigned long)t->offset + t->size > h->file_size) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// offset is where a tensor of dtype and count elements starts
+static int cnn_model_check_param(const cnn_model *model, unsigned int offset, unsigned int dtype, unsigned long count)
+{
+    const cnn_model_tensor *t;
+    unsigned int idx;
+
+    for (idx = 0; idx < model->header->tensor_num; idx++) {
+        t = &model->table[idx];
+        if (t->offset == offset) {
+            return (t->dtype == dtype && t->size == count * cnn_model_dtype_size(dtype)) ? 0 : -1;
+        }
+    }
+
+    return -1;
+}
+
+// Every parameter offset of a conv or FC layer must be the start of a
+// tensor of the type and size that layer reads, so a graph and its
+// parameters cannot drift apart the way raw blob offsets can
+static int cnn_model_check_graph(const cnn_model *model, const cnn_model_tensor *t)
+{
+    const cnn_graph *graph = (const cnn_graph*)(model->base + t->offset);
+    const cnn_graph_layer *l;
+    unsigned long head = (unsigned long)&((cnn_graph*)0)->layer[0];
+    unsigned long k, n, kp, np;
+    unsigned int i;
+
+    if (t->dtype != CNN_DTYPE_U32 || t->size < head ||
+        graph->layer_num > CNN_GRAPH_MAX_LAYERS || t->size < head + graph->layer_num * sizeof(cnn_graph_layer) ||
+        cnn_graph_check(graph)) {
+        return -1;
+    }
+
+    for (i = 0; i < graph->layer_num; i++) {
+        l = &graph->layer[i];
+        if (l->type != CNN_LAYER_CONV && l->type != CNN_LAYER_FC) {
+            continue;
+        }
+        n = l->output_channel;
+        k = (l->type == CNN_LAYER_CONV) ? (unsigned long)l->filter_rows * l->filter_columns * l->input_channel : l->input_channel;
+        if (cnn_model_check_param(model, l->weights, CNN_DTYPE_F32, k * n) ||
+            cnn_model_check_param(model, l->biases, CNN_DTYPE_F32, n)) {
+            return -1;
+        }
+        if (l->int8_weights == CNN_GRAPH_NONE) {
+            continue;
+        }
+        // padded to whole SDOT blocks, see mnist_cnn_quantize.py
+        kp = (k + 3) & ~3UL;
+        np = (n + 3) & ~3UL;
+        if (cnn_model_check_param(model, l->int8_weights, CNN_DTYPE_I8, np * kp) ||
+            cnn_model_check_param(model, l->int8_scales, CNN_DTYPE_F32, np) ||
+            cnn_model_check_param(model, l->int8_biases, CNN_DTYPE_F32, np)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int cnn_model_open(cnn_model *model, const void *blob, unsigned long size)
+{
+    const cnn_model_header *h = (const cnn_model_header*)blob;
+    const cnn_model_tensor *t;
+    unsigned int idx;
+
+    memset(model, 0, sizeof(*model));
+    if (size < sizeof(cnn_model_header) || h->magic != CNN_MODEL_MAGIC) {
+        return CNN_MODEL_E_HEADER;
+    }
+    if (h->version != CNN_MODEL_VERSION) {
+        return CNN_MODEL_E_VERSION;
+    }
+    if (h->header_size != sizeof(cnn_model_header) || h->file_size > size ||
+        h->tensor_num > CNN_MODEL_MAX_TENSORS || h->table_offset < h->header_size || h->table_offset % 4 ||
+        (unsigned long)h->table_offset + h->tensor_num * sizeof(cnn_model_tensor) > h->data_offset ||
+        h->data_offset > h->file_size) {
+        return CNN_MODEL_E_HEADER;
+    }
+    if (cnn_model_crc32(0, (const unsigned char*)blob + h->header_size, h->file_size - h->header_size) != h->checksum) {
+        return CNN_MODEL_E_CHECKSUM;
+    }
+
+    t = (const cnn_model_tensor*)((const unsigned char*)blob + h->table_offset);
+    for (idx = 0; idx < h->tensor_num; idx++) {
+        if (cnn_model_check_tensor(h, &t[idx])) {
+            return CNN_MODEL_E_TENSOR;
+        }
+    }
+    model->base = (unsigned long)blob;
+    model->header = h;
+    model->table = t;
+
+    t = cnn_model_find(model, CNN_MODEL_GRAPH);
+    if (!t || cnn_model_check_graph(model, t)) {
+        memset(model, 0, sizeof(*model));
+        return CNN_MODEL_E_GRAPH;
+    }
+    model->graph = (const cnn_graph*)(model->base + t->offset);
+
+    return 0;
+}
+
+const char *cnn_model_error(int err)
+{
+    switch (err) {
+    case 0:                     return "ok";
+    case CNN_MODEL_E_HEADER:    return "not a model container, or truncated";
+    case CNN_MODEL_E_VERSION:   return "unsupported container version";
+    case CNN_MODEL_E_CHECKSUM:  return "checksum mismatch";
+    case CNN_MODEL_E_TENSOR:    return "bad tensor table entry";
+    case CNN_MODEL_E_GRAPH:     return "graph missing or not matching its tensors";
+    }
+
+    return "unknown error";
+}
+
+const cnn_model_tensor *cnn_model_find(const cnn_model *model, const char *name)
+{
+    unsigned int idx;
+
+    if (!model->header) {
+        return 0;
+    }
+    for (idx = 0; idx < model->header->tensor_num; idx++) {
+        if (!strncmp(model->table[idx].name, name, CNN_MODEL_NAME)) {
+            return &model->table[idx];
+        }
+    }
+
+    return 0;
+}
+
+const void *cnn_model_data(
+    const cnn_model *model,
+    const char *name,
+    unsigned int dtype,
+    unsigned long count
+) {
+    const cnn_model_tensor *t = cnn_model_find(model, name);
+
+    if (!t || t->dtype != dtype || t->size != count * cnn_model_dtype_size(dtype)) {
+        return 0;
+    }
+
+    return (const void*)(model->base + t->offset);
+}
+
+#endif
@@ -0,0 +1,99 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Simple CNN Application for Inference only
+ Versioned model container: parameters and network in one blob
+==================================================================
+*/
+#ifndef CNN_MODEL_H
+#define CNN_MODEL_H
+
+// A model container (see mnist/mnist_cnn_model.py) is a header, a table
+// of named tensors and their data, every field a little-endian 32-bit
+// word:
+//
+//   header   cnn_model_header, 64 bytes
+//   table    cnn_model_tensor[tensor_num] at table_offset
+//   data     each tensor at a CNN_MODEL_ALIGN-aligned offset
+//
+// checksum is the CRC-32 (as zlib's crc32()) of bytes [header_size,
+// file_size). The network description is the "graph" tensor, a cnn_graph
+// blob whose parameter offsets are bytes from the start of the container,
+// so the container is both the fp32 and the INT8 parameter blob of
+// cnn_graph_eval().
+#define CNN_MODEL_MAGIC         0x4D4E4E43  // "CNNM"
+#define CNN_MODEL_VERSION       1
+#define CNN_MODEL_ALIGN         64
+#define CNN_MODEL_NAME          28          // with the terminating NUL
+#define CNN_MODEL_MAX_RANK      4
+#define CNN_MODEL_MAX_TENSORS   64
+#define CNN_MODEL_GRAPH         "graph"
+
+#define CNN_DTYPE_F32           1
+#define CNN_DTYPE_I8            2
+#define CNN_DTYPE_U32           3           // the graph blob
+#define CNN_DTYPE_F16           4
+
+#define CNN_LAYOUT_FLAT         0           // biases, scales, blobs
+#define CNN_LAYOUT_HWIO         1           // conv weights[rows][columns][in][out]
+#define CNN_LAYOUT_IO           2           // FC weights[in][out]
+#define CNN_LAYOUT_SDOT         3           // INT8 weights[Np/4][Kp/4][4][4], see mnist_cnn_quantize.py
+
+// cnn_model_open() errors
+#define CNN_MODEL_E_HEADER      (-1)        // not a container, or truncated
+#define CNN_MODEL_E_VERSION     (-2)
+#define CNN_MODEL_E_CHECKSUM    (-3)
+#define CNN_MODEL_E_TENSOR      (-4)        // bad dtype, shape, size or alignment
+#define CNN_MODEL_E_GRAPH       (-5)        // graph missing, invalid, or not matching its tensors
+
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int header_size;   // sizeof(cnn_model_header)
+    unsigned int tensor_num;
+    unsigned int table_offset;
+    unsigned int data_offset;   // first tensor
+    unsigned int file_size;
+    unsigned int checksum;
+    unsigned int reserved[8];
+} cnn_model_header;
+
+typedef struct {
+    char name[CNN_MODEL_NAME];
+    unsigned int dtype;
+    unsigned int layout;
+    unsigned int rank;
+    unsigned int shape[CNN_MODEL_MAX_RANK];     // unused dims are 1
+    unsigned int offset;        // bytes from the start of the container
+    unsigned int size;          // bytes, elements x dtype size
+} cnn_model_tensor;
+
+typedef struct cnn_model {
+    unsigned long base;         // the container, read only
+    const cnn_model_header *header;
+    const cnn_model_tensor *table;
+    const struct cnn_graph *graph;  // the validated "graph" tensor
+} cnn_model;
+
+// Validate a container of size bytes once: header, version, checksum,
+// every tensor, and the graph against the tensors its layers point at.
+// Returns 0 or a CNN_MODEL_E_ error, after which model is not usable.
+int cnn_model_open(cnn_model *model, const void *blob, unsigned long size);
+const char *cnn_model_error(int err);
+
+// The tensor of that name, 0 if there is none
+const cnn_model_tensor *cnn_model_find(const cnn_model *model, const char *name);
+// Its data if it has that dtype and count elements, else 0
+const void *cnn_model_data(
+    const cnn_model *model,
+    const char *name,
+    unsigned int dtype,
+    unsigned long count
+);
+#define cnn_model_f32(model, name, count)   ((const float*)cnn_model_data(model, name, CNN_DTYPE_F32, count))
+#define cnn_model_i8(model, name, count)    ((const signed char*)cnn_model_data(model, name, CNN_DTYPE_I8, count))
+
+unsigned int cnn_model_crc32(unsigned int crc, const void *data, unsigned long size);
+
+#endif
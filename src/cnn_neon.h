@@ -0,0 +1,169 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ NEON intrinsics for the CNN kernels, with a portable fallback
+==================================================================
+*/
+#ifndef CNN_NEON_H
+#define CNN_NEON_H
+
+#if defined(__ARM_NEON)
+
+#include <arm_neon.h>
+
+#else
+
+// Portable stand-ins for the few float32x4_t intrinsics the kernels use,
+// so the NEON kernels also build and run on x86 hosts and with
+// -MFPU=none. Semantics follow the ACLE definitions.
+
+#if defined(__GNUC__)
+
+// GCC/clang vector extensions: the host SIMD unit keeps the accumulators
+// in registers, which the struct version below does not guarantee once a
+// kernel holds more than a few of them.
+#include <string.h>
+
+typedef float float32x4_t __attribute__((vector_size(16)));
+typedef int cnn_int32x4_t __attribute__((vector_size(16)));
+
+static inline float32x4_t vld1q_f32(const float *p)
+{
+    float32x4_t r;
+    memcpy(&r, p, sizeof(r));
+    return r;
+}
+
+static inline void vst1q_f32(float *p, float32x4_t a)
+{
+    memcpy(p, &a, sizeof(a));
+}
+
+static inline float32x4_t vdupq_n_f32(float x)
+{
+    float32x4_t r = {x, x, x, x};
+    return r;
+}
+
+static inline float32x4_t vaddq_f32(float32x4_t a, float32x4_t b)
+{
+    return a + b;
+}
+
+static inline float32x4_t vsubq_f32(float32x4_t a, float32x4_t b)
+{
+    return a - b;
+}
+
+// a + b * c
+static inline float32x4_t vfmaq_f32(float32x4_t a, float32x4_t b, float32x4_t c)
+{
+    return a + b * c;
+}
+
+// a - b * c
+static inline float32x4_t vfmsq_f32(float32x4_t a, float32x4_t b, float32x4_t c)
+{
+    return a - b * c;
+}
+
+// a + b * c, c broadcast to all lanes
+static inline float32x4_t vfmaq_n_f32(float32x4_t a, float32x4_t b, float c)
+{
+    return a + b * vdupq_n_f32(c);
+}
+
+static inline float32x4_t vmaxq_f32(float32x4_t a, float32x4_t b)
+{
+    cnn_int32x4_t m = a < b;
+    return (float32x4_t)(((cnn_int32x4_t)a & ~m) | ((cnn_int32x4_t)b & m));
+}
+
+#else
+
+typedef struct {
+    float val[4];
+} float32x4_t;
+
+static inline float32x4_t vld1q_f32(const float *p)
+{
+    float32x4_t r;
+    r.val[0] = p[0]; r.val[1] = p[1]; r.val[2] = p[2]; r.val[3] = p[3];
+    return r;
+}
+
+static inline void vst1q_f32(float *p, float32x4_t a)
+{
+    p[0] = a.val[0]; p[1] = a.val[1]; p[2] = a.val[2]; p[3] = a.val[3];
+}
+
+static inline float32x4_t vdupq_n_f32(float x)
+{
+    float32x4_t r;
+    r.val[0] = x; r.val[1] = x; r.val[2] = x; r.val[3] = x;
+    return r;
+}
+
+static inline float32x4_t vaddq_f32(float32x4_t a, float32x4_t b)
+{
+    int i;
+    for (i = 0; i < 4; i++) {
+        a.val[i] += b.val[i];
+    }
+    return a;
+}
+
+static inline float32x4_t vsubq_f32(float32x4_t a, float32x4_t b)
+{
+    int i;
+    for (i = 0; i < 4; i++) {
+        a.val[i] -= b.val[i];
+    }
+    return a;
+}
+
+// a + b * c
+static inline float32x4_t vfmaq_f32(float32x4_t a, float32x4_t b, float32x4_t c)
+{
+    int i;
+    for (i = 0; i < 4; i++) {
+        a.val[i] += b.val[i] * c.val[i];
+    }
+    return a;
+}
+
+// a - b * c
+static inline float32x4_t vfmsq_f32(float32x4_t a, float32x4_t b, float32x4_t c)
+{
+    int i;
+    for (i = 0; i < 4; i++) {
+        a.val[i] -= b.val[i] * c.val[i];
+    }
+    return a;
+}
+
+// a + b * c, c broadcast to all lanes
+static inline float32x4_t vfmaq_n_f32(float32x4_t a, float32x4_t b, float c)
+{
+    int i;
+    for (i = 0; i < 4; i++) {
+        a.val[i] += b.val[i] * c;
+    }
+    return a;
+}
+
+static inline float32x4_t vmaxq_f32(float32x4_t a, float32x4_t b)
+{
+    int i;
+    for (i = 0; i < 4; i++) {
+        a.val[i] = (a.val[i] < b.val[i]) ? b.val[i] : a.val[i];
+    }
+    return a;
+}
+
+#endif
+
+#endif
+
+#endif
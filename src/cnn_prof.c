@@ -0,0 +1,424 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Simple CNN Application for Inference only
+ Per-layer PMU profiling
+==================================================================
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "arm_cnn_inference.h"
+#include "pmu.h"
+#include "cnn_prof.h"
+#ifdef CNN_HOST_BUILD
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+// Record field names of the rotation, in CNN_PROF_EV_xxx order
+static const char *const cnn_prof_event_names[CNN_PROF_EVENTS] = {
+    "inst", "l1d_access", "l1d_refill", "ld", "st", "br_mis", "l2d_refill", "stall_be"
+};
+
+// -O level of the build, passed by the makefiles
+#define CNN_PROF_STR(x)         #x
+#define CNN_PROF_XSTR(x)        CNN_PROF_STR(x)
+#ifdef CNN_OPT_LEVEL
+#define CNN_PROF_OPT_LEVEL      "O" CNN_PROF_XSTR(CNN_OPT_LEVEL)
+#else
+#define CNN_PROF_OPT_LEVEL      ""
+#endif
+
+#ifdef CNN_PROF
+
+// The rotation; the report columns index it with CNN_PROF_EV_xxx
+#define CNN_PROF_EV_INST        0
+#define CNN_PROF_EV_L1D         1
+#define CNN_PROF_EV_L1D_REFILL  2
+#define CNN_PROF_EV_LD          3
+#define CNN_PROF_EV_ST          4
+#define CNN_PROF_EV_BR_MIS      5
+#define CNN_PROF_EV_L2D_REFILL  6
+#define CNN_PROF_EV_STALL_BE    7
+
+#ifndef CNN_HOST_BUILD
+static const unsigned int cnn_prof_events[CNN_PROF_EVENTS] = {
+    PMU_EVENT_INST_RETIRED,
+    PMU_EVENT_L1D_CACHE,
+    PMU_EVENT_L1D_CACHE_REFILL,
+    PMU_EVENT_LD_RETIRED,
+    PMU_EVENT_ST_RETIRED,
+    PMU_EVENT_BR_MIS_PRED,
+    PMU_EVENT_L2D_CACHE_REFILL,
+    PMU_EVENT_STALL_BACKEND
+};
+#else
+// perf_event_open() equivalents of cnn_prof_events[]. The L1D events
+// count loads only (stores for ST_RETIRED), which is what most hosts
+// expose; an event the host does not have reads as not counted.
+#define CNN_PROF_CACHE(cache, op, result) \
+    ((cache) | ((op) << 8) | ((result) << 16))
+
+static const struct {
+    unsigned int type;
+    unsigned long long config;
+} cnn_prof_perf_events[CNN_PROF_EVENTS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, CNN_PROF_CACHE(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_ACCESS) },
+    { PERF_TYPE_HW_CACHE, CNN_PROF_CACHE(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { PERF_TYPE_HW_CACHE, CNN_PROF_CACHE(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_ACCESS) },
+    { PERF_TYPE_HW_CACHE, CNN_PROF_CACHE(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_WRITE, PERF_COUNT_HW_CACHE_RESULT_ACCESS) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_HW_CACHE, CNN_PROF_CACHE(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND }
+};
+
+static int cnn_prof_perf_open(unsigned int type, unsigned long long config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static unsigned long long cnn_prof_perf_read(int fd)
+{
+    unsigned long long value = 0;
+
+    if (read(fd, &value, sizeof(value)) != sizeof(value)) {
+        return 0;
+    }
+    return value;
+}
+
+static void cnn_prof_close_events(cnn_prof *prof)
+{
+    unsigned int i;
+
+    for (i = 0; i < CNN_PROF_GROUP; i++) {
+        if (prof->fd[i] >= 0) {
+            close(prof->fd[i]);
+            prof->fd[i] = -1;
+        }
+    }
+}
+#endif
+
+void cnn_prof_init(cnn_prof *prof)
+{
+    unsigned int counters;
+
+    memset(prof, 0, sizeof(*prof));
+
+#ifdef CNN_HOST_BUILD
+    for (counters = 0; counters < CNN_PROF_GROUP; counters++) {
+        prof->fd[counters] = -1;
+    }
+    prof->cycle_fd = cnn_prof_perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    if (prof->cycle_fd < 0) {
+        // VMs and containers often have no hardware counters
+        prof->cycle_fd = cnn_prof_perf_open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+        prof->cycle_ns = 1;
+    }
+    counters = CNN_PROF_GROUP;
+#else
+    counters = pmu_get_number_of_counters();
+    if (counters > CNN_PROF_GROUP) {
+        counters = CNN_PROF_GROUP;
+    }
+#endif
+    prof->group = counters;
+    prof->passes = counters ? (CNN_PROF_EVENTS + counters - 1) / counters : 1;
+}
+
+void cnn_prof_close(cnn_prof *prof)
+{
+#ifdef CNN_HOST_BUILD
+    cnn_prof_close_events(prof);
+    if (prof->cycle_fd >= 0) {
+        close(prof->cycle_fd);
+        prof->cycle_fd = -1;
+    }
+#else
+    (void)prof;
+#endif
+}
+
+// [0] cycles, [1 + i] counter i
+static void cnn_prof_read(cnn_prof *prof, unsigned long long *now)
+{
+    unsigned int i;
+
+#ifdef CNN_HOST_BUILD
+    struct timespec ts;
+
+    if (prof->cycle_fd >= 0) {
+        now[0] = cnn_prof_perf_read(prof->cycle_fd);
+    }
+    else {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        now[0] = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+    for (i = 0; i < prof->group; i++) {
+        now[1 + i] = (prof->fd[i] >= 0) ? cnn_prof_perf_read(prof->fd[i]) : 0;
+    }
+#else
+    now[0] = pmu_cycle_counter_get_count();
+    for (i = 0; i < prof->group; i++) {
+        now[1 + i] = pmu_counter_get_event_count(i);
+    }
+#endif
+}
+
+void cnn_prof_run_begin(cnn_prof *prof)
+{
+    unsigned int pass = prof->runs % prof->passes;
+    unsigned int i, e;
+
+#ifdef CNN_HOST_BUILD
+    cnn_prof_close_events(prof);
+#else
+    pmu_stop();
+    pmu_cycle_counter_enable();
+#endif
+    for (i = 0; i < prof->group; i++) {
+        e = (pass * prof->group + i) % CNN_PROF_EVENTS;
+        prof->event[i] = e;
+#ifdef CNN_HOST_BUILD
+        prof->fd[i] = cnn_prof_perf_open(cnn_prof_perf_events[e].type, cnn_prof_perf_events[e].config);
+#else
+        pmu_counter_set_event_type(i, cnn_prof_events[e]);
+        pmu_counter_enable(i);
+#endif
+    }
+#ifndef CNN_HOST_BUILD
+    pmu_reset();
+    pmu_start();
+#endif
+}
+
+void cnn_prof_run_end(cnn_prof *prof)
+{
+    prof->runs++;
+}
+
+void cnn_prof_layer_begin(
+    cnn_prof *prof,
+    unsigned int layer,
+    const char *name,
+    unsigned long long macs
+) {
+    cnn_prof_layer *l;
+
+    if (layer >= CNN_PROF_MAX_LAYERS) {
+        layer = CNN_PROF_MAX_LAYERS - 1;
+    }
+    l = &prof->layer[layer];
+    if (!l->runs) {
+        strncpy(l->name, name, sizeof(l->name) - 1);
+        l->macs = macs;
+    }
+    if (prof->layer_num <= layer) {
+        prof->layer_num = layer + 1;
+    }
+    prof->open = layer;
+    cnn_prof_read(prof, prof->start);
+}
+
+void cnn_prof_layer_end(cnn_prof *prof)
+{
+    unsigned long long now[CNN_PROF_GROUP + 1];
+    cnn_prof_layer *l = &prof->layer[prof->open];
+    unsigned int i;
+
+    cnn_prof_read(prof, now);
+    l->cycles += now[0] - prof->start[0];
+    l->runs++;
+    for (i = 0; i < prof->group; i++) {
+#ifdef CNN_HOST_BUILD
+        if (prof->fd[i] < 0) {
+            continue;
+        }
+        l->count[prof->event[i]] += now[1 + i] - prof->start[1 + i];
+#else
+        // 32-bit event counters
+        l->count[prof->event[i]] += (unsigned int)(now[1 + i] - prof->start[1 + i]);
+#endif
+        l->counted[prof->event[i]]++;
+    }
+}
+
+// Per-run average of event e, < 0 if no run counted it
+static double cnn_prof_avg(const cnn_prof_layer *l, unsigned int e)
+{
+    if (!l->counted[e]) {
+        return -1.0;
+    }
+    return (double)l->count[e] / l->counted[e];
+}
+
+static void cnn_prof_cell(int valid, double value, const char *fmt)
+{
+    if (valid) {
+        printf(fmt, value);
+    }
+    else {
+        printf(" %9s", "-");
+    }
+}
+
+void cnn_prof_report(const cnn_prof *prof)
+{
+    const cnn_prof_layer *l;
+    double cycles, inst, l1d, refill, ld, st, br, l2d, stall;
+    int cyc_ok;
+    unsigned int i;
+
+#ifdef CNN_HOST_BUILD
+    cyc_ok = !prof->cycle_ns;
+#else
+    cyc_ok = 1;
+#endif
+    printf("Per-layer profile: %u runs, %u events in %u passes of %u\n",
+           prof->runs, CNN_PROF_EVENTS, prof->passes, prof->group);
+    printf("    %-12s %10s %10s %9s %9s %9s %9s %9s %9s %9s\n",
+           "layer", "MACs", cyc_ok ? "cycles" : "ns", "IPC", "L1D miss%",
+           "ld/MAC", "st/MAC", "br-mis", "L2D refil", "BE stall%");
+
+    for (i = 0; i < prof->layer_num; i++) {
+        l = &prof->layer[i];
+        if (!l->runs) {
+            continue;
+        }
+        cycles = (double)l->cycles / l->runs;
+        inst = cnn_prof_avg(l, CNN_PROF_EV_INST);
+        l1d = cnn_prof_avg(l, CNN_PROF_EV_L1D);
+        refill = cnn_prof_avg(l, CNN_PROF_EV_L1D_REFILL);
+        ld = cnn_prof_avg(l, CNN_PROF_EV_LD);
+        st = cnn_prof_avg(l, CNN_PROF_EV_ST);
+        br = cnn_prof_avg(l, CNN_PROF_EV_BR_MIS);
+        l2d = cnn_prof_avg(l, CNN_PROF_EV_L2D_REFILL);
+        stall = cnn_prof_avg(l, CNN_PROF_EV_STALL_BE);
+
+        printf("    %-12s %10llu %10.0f", l->name, l->macs, cycles);
+        cnn_prof_cell(cyc_ok && cycles > 0.0 && inst >= 0.0, inst / cycles, " %9.2f");
+        cnn_prof_cell(l1d > 0.0 && refill >= 0.0, 100.0 * refill / l1d, " %9.2f");
+        cnn_prof_cell(l->macs && ld >= 0.0, ld / l->macs, " %9.3f");
+        cnn_prof_cell(l->macs && st >= 0.0, st / l->macs, " %9.3f");
+        cnn_prof_cell(br >= 0.0, br, " %9.0f");
+        cnn_prof_cell(l2d >= 0.0, l2d, " %9.0f");
+        cnn_prof_cell(cyc_ok && cycles > 0.0 && stall >= 0.0, 100.0 * stall / cycles, " %9.1f");
+        printf("\n");
+    }
+}
+
+void cnn_prof_write(
+    const cnn_prof *prof,
+    FILE *out,
+    unsigned int format,
+    unsigned int conv_mode,
+    unsigned int core
+) {
+    const cnn_prof_layer *l;
+    const char *unit = "cycles";
+    double events[CNN_PROF_EVENTS];
+    double total[CNN_PROF_EVENTS];
+    double cycles, total_cycles = 0.0;
+    unsigned long long total_macs = 0;
+    unsigned int i, e;
+
+#ifdef CNN_HOST_BUILD
+    if (prof->cycle_ns) {
+        unit = "ns";
+    }
+#endif
+    for (e = 0; e < CNN_PROF_EVENTS; e++) {
+        total[e] = 0.0;
+    }
+
+    for (i = 0; i < prof->layer_num; i++) {
+        l = &prof->layer[i];
+        if (!l->runs) {
+            continue;
+        }
+        cycles = (double)l->cycles / l->runs;
+        for (e = 0; e < CNN_PROF_EVENTS; e++) {
+            events[e] = cnn_prof_avg(l, e);
+            // a layer that missed an event leaves the total not counted
+            total[e] = (events[e] < 0.0 || total[e] < 0.0) ? -1.0 : total[e] + events[e];
+        }
+        cnn_prof_write_record(out, format, conv_mode, core, l->name, l->macs, l->runs, unit, cycles, events);
+        total_cycles += cycles;
+        total_macs += l->macs;
+    }
+    cnn_prof_write_record(out, format, conv_mode, core, "total", total_macs, prof->runs, unit, total_cycles, total);
+}
+
+#endif
+
+void cnn_prof_write_header(FILE *out, unsigned int format)
+{
+    unsigned int e;
+
+    if (format != CNN_PROF_CSV) {
+        return;
+    }
+    fprintf(out, "conv_mode,opt_level,core,layer,macs,runs,unit,cycles");
+    for (e = 0; e < CNN_PROF_EVENTS; e++) {
+        fprintf(out, ",%s", cnn_prof_event_names[e]);
+    }
+    fprintf(out, "\n");
+}
+
+void cnn_prof_write_record(
+    FILE *out,
+    unsigned int format,
+    unsigned int conv_mode,
+    unsigned int core,
+    const char *layer,
+    unsigned long long macs,
+    unsigned long long runs,
+    const char *unit,
+    double cycles,
+    const double *events
+) {
+    unsigned int e;
+
+    if (format == CNN_PROF_JSON) {
+        fprintf(out, "{\"conv_mode\": %u, \"opt_level\": \"%s\", \"core\": %u, \"layer\": \"%s\", "
+                "\"macs\": %llu, \"runs\": %llu, \"unit\": \"%s\", \"cycles\": %.1f",
+                conv_mode, CNN_PROF_OPT_LEVEL, core, layer, macs, runs, unit, cycles);
+        for (e = 0; e < CNN_PROF_EVENTS; e++) {
+            if (events && events[e] >= 0.0) {
+                fprintf(out, ", \"%s\": %.1f", cnn_prof_event_names[e], events[e]);
+            }
+            else {
+                fprintf(out, ", \"%s\": null", cnn_prof_event_names[e]);
+            }
+        }
+        fprintf(out, "}\n");
+        return;
+    }
+
+    fprintf(out, "%u,%s,%u,%s,%llu,%llu,%s,%.1f",
+            conv_mode, CNN_PROF_OPT_LEVEL, core, layer, macs, runs, unit, cycles);
+    for (e = 0; e < CNN_PROF_EVENTS; e++) {
+        if (events && events[e] >= 0.0) {
+            fprintf(out, ",%.1f", events[e]);
+        }
+        else {
+            fprintf(out, ",");
+        }
+    }
+    fprintf(out, "\n");
+}
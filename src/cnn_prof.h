@@ -0,0 +1,94 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Simple CNN Application for Inference only
+ Per-layer PMU profiling
+==================================================================
+*/
+#ifndef CNN_PROF_H
+#define CNN_PROF_H
+
+#include <stdio.h>
+
+#define CNN_PROF_MAX_LAYERS     34      // graph layers, plus post-proc
+#define CNN_PROF_EVENTS         8       // events in the rotation, see cnn_prof.c
+#define CNN_PROF_GROUP          4       // events counted per run, besides cycles
+
+// Record formats of cnn_prof_write(), read back by host/bench_compare
+#define CNN_PROF_CSV            0       // header line, then one line per record
+#define CNN_PROF_JSON           1       // one flat object per line
+
+// Cycles are counted on every run; the events are multiplexed across
+// repeated runs, CNN_PROF_GROUP at a time, and averaged over the runs
+// that counted them.
+typedef struct {
+    char name[16];
+    unsigned long long macs;                        // per run, 0 for pooling
+    unsigned long long runs;
+    unsigned long long cycles;                      // over all runs
+    unsigned long long count[CNN_PROF_EVENTS];      // over the runs in counted[]
+    unsigned long long counted[CNN_PROF_EVENTS];
+} cnn_prof_layer;
+
+typedef struct cnn_prof {
+    cnn_prof_layer layer[CNN_PROF_MAX_LAYERS];
+    unsigned int layer_num;
+    unsigned int runs;
+    unsigned int passes;        // runs to count every event once
+    unsigned int group;         // counters programmed for this run
+    unsigned int event[CNN_PROF_GROUP];             // event of each counter
+    unsigned long long start[CNN_PROF_GROUP + 1];   // [0] cycles, at cnn_prof_layer_begin()
+    unsigned int open;          // layer being measured
+#ifdef CNN_HOST_BUILD
+    int cycle_fd;               // perf_event_open() fds, -1 if not available
+    int fd[CNN_PROF_GROUP];
+    unsigned int cycle_ns;      // no cycle counter: task clock in ns
+#endif
+} cnn_prof;
+
+void cnn_prof_init(cnn_prof *prof);
+void cnn_prof_close(cnn_prof *prof);
+
+// One inference: program the next event group, then bracket each layer
+void cnn_prof_run_begin(cnn_prof *prof);
+void cnn_prof_run_end(cnn_prof *prof);
+void cnn_prof_layer_begin(
+    cnn_prof *prof,
+    unsigned int layer,         // < CNN_PROF_MAX_LAYERS, the same every run
+    const char *name,
+    unsigned long long macs
+);
+void cnn_prof_layer_end(cnn_prof *prof);
+
+// Per-layer table: cycles, IPC, L1D miss rate, loads and stores per MAC
+void cnn_prof_report(const cnn_prof *prof);
+
+// The same table as records, one per layer plus a "total", tagged with
+// the conv mode, the -O level of the build and the core; the CSV header
+// is cnn_prof_write_header(). Lines that are not records (console output
+// around them) are skipped when comparing, so they can go to stdout.
+void cnn_prof_write(
+    const cnn_prof *prof,
+    FILE *out,
+    unsigned int format,
+    unsigned int conv_mode,
+    unsigned int core
+);
+void cnn_prof_write_header(FILE *out, unsigned int format);
+// One record; events[CNN_PROF_EVENTS] are per-run averages, < 0 (or no
+// events at all) for not counted. unit is "cycles" or "ns".
+void cnn_prof_write_record(
+    FILE *out,
+    unsigned int format,
+    unsigned int conv_mode,
+    unsigned int core,
+    const char *layer,
+    unsigned long long macs,
+    unsigned long long runs,
+    const char *unit,
+    double cycles,
+    const double *events
+);
+
+#endif
@@ -0,0 +1,292 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Simple CNN Application for Inference only
+ Work-stealing task scheduler for multi-core evaluation
+==================================================================
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "arm_cnn_inference.h"
+#include "cnn_sched.h"
+#ifdef CNN_HOST_BUILD
+#include <sched.h>
+#endif
+
+#ifdef CNN_SCHED
+
+// Each core owns a deque of (image, layer, row-tile) tasks. It works
+// LIFO from its own deque, so the tiles it just produced are still in
+// its cache, and an idle core steals the oldest task of another core.
+// When the last tile of a stage finishes, that core pushes every tile of
+// the next stage, which other cores are then free to steal. A core with
+// no work admits the next image while a workspace slot is free.
+
+#define TASK_PACK(image, slot, stage, tile) \
+    (((unsigned long long)(image) << 32) | ((slot) << 24) | ((stage) << 16) | (tile))
+#define TASK_IMAGE(t)   ((unsigned int)((t) >> 32))
+#define TASK_SLOT(t)    ((unsigned int)((t) >> 24) & 0xFF)
+#define TASK_STAGE(t)   ((unsigned int)((t) >> 16) & 0xFF)
+#define TASK_TILE(t)    ((unsigned int)(t) & 0xFFFF)
+
+static void cnn_sched_relax(void)
+{
+#ifdef CNN_HOST_BUILD
+    sched_yield();
+#elif defined(__aarch64__)
+    __asm__ volatile ("yield");
+#endif
+}
+
+static int cnn_deque_push(cnn_deque *dq, unsigned long long task)
+{
+    long b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED);
+    long t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+
+    if (b - t >= CNN_SCHED_DEQUE_SIZE) {
+        return 0;
+    }
+    __atomic_store_n(&dq->tasks[b & (CNN_SCHED_DEQUE_SIZE - 1)], task, __ATOMIC_RELAXED);
+    __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+static int cnn_deque_pop(cnn_deque *dq, unsigned long long *task)
+{
+    long b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED) - 1;
+    long t;
+    int found = 1;
+
+    __atomic_store_n(&dq->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    t = __atomic_load_n(&dq->top, __ATOMIC_RELAXED);
+
+    if (t > b) {
+        // empty
+        __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    *task = __atomic_load_n(&dq->tasks[b & (CNN_SCHED_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (t == b) {
+        // last task, race the thieves for it
+        if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            found = 0;
+        }
+        __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+
+    return found;
+}
+
+static int cnn_deque_steal(cnn_deque *dq, unsigned long long *task)
+{
+    long t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+    long b;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    b = __atomic_load_n(&dq->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) {
+        return 0;
+    }
+    *task = __atomic_load_n(&dq->tasks[t & (CNN_SCHED_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+
+    return __atomic_compare_exchange_n(&dq->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static void cnn_sched_execute(cnn_sched *sched, unsigned long long packed, unsigned int cpu);
+
+// Queue every tile of one stage on this core's deque
+static void cnn_sched_start_stage(
+    cnn_sched *sched,
+    unsigned int image,
+    unsigned int slot,
+    unsigned int stage,
+    unsigned int cpu
+) {
+    const cnn_stage *st = &sched->stages[stage];
+    unsigned int tiles = (st->rows + st->tile_rows - 1) / st->tile_rows;
+    unsigned int tile;
+
+    __atomic_store_n(&sched->pending[slot][stage], tiles, __ATOMIC_RELAXED);
+    for (tile = tiles; tile-- > 0; ) {
+        if (!cnn_deque_push(&sched->deque[cpu], TASK_PACK(image, slot, stage, tile))) {
+            // deque full, run it here
+            cnn_sched_execute(sched, TASK_PACK(image, slot, stage, tile), cpu);
+        }
+    }
+}
+
+static void cnn_sched_execute(cnn_sched *sched, unsigned long long packed, unsigned int cpu)
+{
+    cnn_task task;
+    const cnn_stage *st;
+    unsigned int tile = TASK_TILE(packed);
+
+    task.image = TASK_IMAGE(packed);
+    task.slot = TASK_SLOT(packed);
+    task.stage = TASK_STAGE(packed);
+    st = &sched->stages[task.stage];
+    task.row_begin = tile * st->tile_rows;
+    task.row_end = task.row_begin + st->tile_rows;
+    if (task.row_end > st->rows) {
+        task.row_end = st->rows;
+    }
+
+    sched->run(sched->ctx, &task, cpu);
+    sched->executed[cpu]++;
+
+    if (__atomic_sub_fetch(&sched->pending[task.slot][task.stage], 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+    if (task.stage + 1 < sched->stage_num) {
+        cnn_sched_start_stage(sched, task.image, task.slot, task.stage + 1, cpu);
+    }
+    else {
+        __atomic_store_n(&sched->slot_busy[task.slot], 0, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&sched->images_done, 1, __ATOMIC_RELEASE);
+    }
+}
+
+// Claim a free workspace slot and start the next image in it
+static int cnn_sched_admit(cnn_sched *sched, unsigned int cpu)
+{
+    unsigned int slot, image, busy;
+
+    for (slot = 0; slot < sched->slot_num; slot++) {
+        busy = 0;
+        if (__atomic_load_n(&sched->slot_busy[slot], __ATOMIC_RELAXED) ||
+            !__atomic_compare_exchange_n(&sched->slot_busy[slot], &busy, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        image = __atomic_fetch_add(&sched->next_image, 1, __ATOMIC_RELAXED);
+        if (image >= sched->image_num) {
+            __atomic_store_n(&sched->slot_busy[slot], 0, __ATOMIC_RELEASE);
+            return 0;
+        }
+        cnn_sched_start_stage(sched, image, slot, 0, cpu);
+        return 1;
+    }
+
+    return 0;
+}
+
+void cnn_sched_init(
+    cnn_sched *sched,
+    const cnn_stage *stages,
+    unsigned int stage_num,
+    unsigned int image_num,
+    unsigned int slot_num,
+    unsigned int cpu_num,
+    cnn_task_fn run,
+    void *ctx
+) {
+    memset(sched, 0, sizeof(*sched));
+    memcpy(sched->stages, stages, stage_num * sizeof(cnn_stage));
+    sched->stage_num = stage_num;
+    sched->image_num = image_num;
+    sched->slot_num = (slot_num < CNN_SCHED_MAX_SLOTS) ? slot_num : CNN_SCHED_MAX_SLOTS;
+    sched->cpu_num = (cpu_num < CNN_SCHED_MAX_CPUS) ? cpu_num : CNN_SCHED_MAX_CPUS;
+    sched->run = run;
+    sched->ctx = ctx;
+}
+
+// Run by every participating core once cnn_sched_init() is visible to
+// it; returns when all images are done
+void cnn_sched_worker(cnn_sched *sched, unsigned int cpu)
+{
+    unsigned long long task;
+    unsigned int victim, i;
+
+    while (__atomic_load_n(&sched->images_done, __ATOMIC_ACQUIRE) < sched->image_num) {
+        if (cnn_deque_pop(&sched->deque[cpu], &task)) {
+            cnn_sched_execute(sched, task, cpu);
+            continue;
+        }
+        if (cnn_sched_admit(sched, cpu)) {
+            continue;
+        }
+        for (i = 1; i < sched->cpu_num; i++) {
+            victim = (cpu + i) % sched->cpu_num;
+            if (cnn_deque_steal(&sched->deque[victim], &task)) {
+                sched->stolen[cpu]++;
+                cnn_sched_execute(sched, task, cpu);
+                break;
+            }
+        }
+        if (i == sched->cpu_num) {
+            cnn_sched_relax();
+        }
+    }
+}
+
+// Fork/join: tiles are claimed by CAS on (generation, next tile), so a
+// helper that wakes up late can never run a tile of a finished layer.
+// The job fields are written before the release store that publishes a
+// generation, and are not rewritten until every tile has completed.
+
+static int cnn_team_run_one(cnn_team *team, unsigned int cpu, unsigned int gen)
+{
+    unsigned long long claim = __atomic_load_n(&team->claim, __ATOMIC_ACQUIRE);
+    unsigned int tile = (unsigned int)claim;
+    cnn_team_fn fn;
+    void *ctx;
+
+    if ((unsigned int)(claim >> 32) != gen) {
+        return -1;
+    }
+    if (tile >= __atomic_load_n(&team->tiles, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    fn = __atomic_load_n(&team->fn, __ATOMIC_RELAXED);
+    ctx = __atomic_load_n(&team->ctx, __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&team->claim, &claim, claim + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return 1;   // lost the race, try again
+    }
+
+    fn(ctx, tile, cpu);
+    team->executed[cpu]++;
+    __atomic_add_fetch(&team->done, 1, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+void cnn_team_fork(cnn_team *team, cnn_team_fn fn, void *ctx, unsigned int tiles, unsigned int cpu)
+{
+    unsigned int gen = (unsigned int)(__atomic_load_n(&team->claim, __ATOMIC_RELAXED) >> 32) + 1;
+
+    __atomic_store_n(&team->fn, fn, __ATOMIC_RELAXED);
+    __atomic_store_n(&team->ctx, ctx, __ATOMIC_RELAXED);
+    __atomic_store_n(&team->tiles, tiles, __ATOMIC_RELAXED);
+    __atomic_store_n(&team->done, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&team->claim, (unsigned long long)gen << 32, __ATOMIC_RELEASE);
+
+    while (cnn_team_run_one(team, cpu, gen) > 0) {
+    }
+    // join
+    while (__atomic_load_n(&team->done, __ATOMIC_ACQUIRE) < tiles) {
+        cnn_sched_relax();
+    }
+}
+
+// Run by every core except the master until cnn_team_release()
+void cnn_team_helper(cnn_team *team, unsigned int cpu)
+{
+    unsigned int gen;
+
+    while (!__atomic_load_n(&team->quit, __ATOMIC_ACQUIRE)) {
+        gen = (unsigned int)(__atomic_load_n(&team->claim, __ATOMIC_ACQUIRE) >> 32);
+        if (cnn_team_run_one(team, cpu, gen) <= 0) {
+            cnn_sched_relax();
+        }
+    }
+}
+
+void cnn_team_release(cnn_team *team)
+{
+    __atomic_store_n(&team->quit, 1, __ATOMIC_RELEASE);
+}
+
+#endif
@@ -0,0 +1,96 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Simple CNN Application for Inference only
+ Work-stealing task scheduler for multi-core evaluation
+==================================================================
+*/
+#ifndef CNN_SCHED_H
+#define CNN_SCHED_H
+
+#define CNN_SCHED_MAX_CPUS      8
+#define CNN_SCHED_MAX_SLOTS     16      // images in flight, one workspace each
+#define CNN_SCHED_MAX_STAGES    8
+#define CNN_SCHED_DEQUE_SIZE    256     // power of 2
+
+// One tile of one layer of one image: output rows [row_begin, row_end)
+typedef struct {
+    unsigned int image;
+    unsigned int slot;
+    unsigned int stage;
+    unsigned int row_begin, row_end;
+} cnn_task;
+
+// A stage is split into tiles of tile_rows output rows; all tiles of a
+// stage finish before any tile of the next stage of that image starts.
+typedef struct {
+    unsigned int rows;
+    unsigned int tile_rows;
+} cnn_stage;
+
+typedef void (*cnn_task_fn)(void *ctx, cnn_task *task, unsigned int cpu);
+
+// Chase-Lev deque: the owner pushes and pops at bottom, thieves take
+// from top. Tasks are packed into 64 bits so every slot is one atomic.
+typedef struct {
+    long top __attribute__ ((aligned (64)));
+    long bottom __attribute__ ((aligned (64)));
+    unsigned long long tasks[CNN_SCHED_DEQUE_SIZE];
+} cnn_deque;
+
+typedef struct cnn_sched {
+    cnn_deque deque[CNN_SCHED_MAX_CPUS];
+    cnn_stage stages[CNN_SCHED_MAX_STAGES];
+    unsigned int stage_num;
+    unsigned int slot_num;
+    unsigned int cpu_num;
+    unsigned int image_num;
+
+    unsigned int pending[CNN_SCHED_MAX_SLOTS][CNN_SCHED_MAX_STAGES];   // tiles left
+    unsigned int slot_busy[CNN_SCHED_MAX_SLOTS];
+    unsigned int next_image __attribute__ ((aligned (64)));
+    unsigned int images_done __attribute__ ((aligned (64)));
+
+    cnn_task_fn run;
+    void *ctx;
+
+    // per-core statistics
+    unsigned int executed[CNN_SCHED_MAX_CPUS];
+    unsigned int stolen[CNN_SCHED_MAX_CPUS];
+} cnn_sched;
+
+void cnn_sched_init(
+    cnn_sched *sched,
+    const cnn_stage *stages,
+    unsigned int stage_num,
+    unsigned int image_num,
+    unsigned int slot_num,
+    unsigned int cpu_num,
+    cnn_task_fn run,
+    void *ctx
+);
+void cnn_sched_worker(cnn_sched *sched, unsigned int cpu);
+
+// Fork/join team for one image: the master core forks a layer as a
+// number of tiles, helpers and the master run them, and the master
+// returns once every tile has finished. Helpers may join at any time.
+typedef void (*cnn_team_fn)(void *ctx, unsigned int tile, unsigned int cpu);
+
+typedef struct cnn_team {
+    unsigned long long claim __attribute__ ((aligned (64)));   // generation << 32 | next tile
+    unsigned int done __attribute__ ((aligned (64)));
+    unsigned int tiles;
+    cnn_team_fn fn;
+    void *ctx;
+    unsigned int quit;
+
+    // per-core statistics
+    unsigned int executed[CNN_SCHED_MAX_CPUS];
+} cnn_team;
+
+void cnn_team_fork(cnn_team *team, cnn_team_fn fn, void *ctx, unsigned int tiles, unsigned int cpu);
+void cnn_team_helper(cnn_team *team, unsigned int cpu);
+void cnn_team_release(cnn_team *team);
+
+#endif
@@ -0,0 +1,598 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Simple CNN Application for Inference only
+ Kernel self-tests (CNN_SELFTEST): each kernel against its reference
+==================================================================
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include "arm_cnn_inference.h"
+#include "mnist.h"
+#include "cnn_api_c.h"
+#include "cnn_graph.h"
+#include "cnn_log.h"
+#include "cnn_model.h"
+#include "cnn_selftest.h"
+
+#ifdef CNN_SELFTEST
+
+// Every check runs a kernel and its reference on the same pseudo-random
+// layer and compares. Shapes are picked so every vector block and scalar
+// tail path is taken at least once. The buffers are shared by all
+// checks, sized for the largest of them.
+
+#define SELFTEST_TOLERANCE          1e-4f   // fp32 kernels: summation order only
+#define SELFTEST_FP16_TOLERANCE     4e-3f   // a few half-precision ulps
+
+static float selftest_inputs[9 * 9 * 6];
+static float selftest_weights[384 * 22];
+static float selftest_biases[22];
+static float selftest_ref[7 * 7 * 20];
+static float selftest_out[7 * 7 * 20];
+
+static unsigned int selftest_seed;
+
+// 15 bits of a linear congruential generator
+static unsigned int selftest_rand(void)
+{
+    selftest_seed = selftest_seed * 1103515245 + 12345;
+    return (selftest_seed >> 16) & 0x7FFF;
+}
+
+// buf[len] in [-1, 1)
+static void selftest_fill(float *buf, unsigned int len)
+{
+    unsigned int i;
+
+    for (i = 0; i < len; i++) {
+        buf[i] = (float)selftest_rand() / 16384.0f - 1.0f;
+    }
+}
+
+// Fresh inputs, weights and biases for the checks that follow
+static void selftest_layer_data(unsigned int seed)
+{
+    selftest_seed = seed;
+    selftest_fill(selftest_inputs, sizeof(selftest_inputs) / sizeof(float));
+    selftest_fill(selftest_weights, sizeof(selftest_weights) / sizeof(float));
+    selftest_fill(selftest_biases, sizeof(selftest_biases) / sizeof(float));
+}
+
+static unsigned int selftest_report(const char *name, unsigned int mismatch, unsigned int checks)
+{
+    printf("    %-22s %s (%u/%u mismatches)\n", name, mismatch ? "[Fail !!!]" : "[Pass]", mismatch, checks);
+
+    return mismatch;
+}
+
+// out[len] against ref[len], relative to 1 + |ref|
+static unsigned int selftest_compare(
+    const char *name,
+    const float *ref,
+    const float *out,
+    unsigned int len,
+    float tolerance
+) {
+    unsigned int i;
+    unsigned int mismatch = 0;
+    float diff, max_diff = 0.0f;
+
+    for (i = 0; i < len; i++) {
+        diff = fabsf(ref[i] - out[i]) / (1.0f + fabsf(ref[i]));
+        if (diff > tolerance) {
+            mismatch++;
+        }
+        if (max_diff < diff) {
+            max_diff = diff;
+        }
+    }
+    printf("    %-22s %s (%u/%u mismatches, max rel. error %.1e)\n",
+           name, mismatch ? "[Fail !!!]" : "[Pass]", mismatch, len, max_diff);
+
+    return mismatch;
+}
+
+static void selftest_conv_layer(layer_structure *lay)
+{
+    // conv 8x8x6 -> 6x6x20, 3x3 filter: a 16-channel block + 4 channels
+    lay->input_channel = 6;
+    lay->input_rows = 8;
+    lay->input_columns = 8;
+    lay->filter_rows = 3;
+    lay->filter_columns = 3;
+    lay->output_channel = 20;
+    lay->output_rows = 6;
+    lay->output_columns = 6;
+    lay->relu_activation = 1;
+}
+
+static void selftest_fc_layer(layer_structure *lay, unsigned int K, unsigned int N)
+{
+    memset(lay, 0, sizeof(*lay));
+    lay->input_channel = K;
+    lay->output_channel = N;
+    lay->relu_activation = 1;
+}
+
+#ifdef CNN_NEON
+#ifdef CNN_FUSED
+static float selftest_pool[3 * 3 * 20];
+#endif
+#ifdef CNN_CONV_4
+static float selftest_gemm[CONV_GEMM_MC * CONV_GEMM_KC];
+#endif
+static float selftest_packed[FC_PACKED_SIZE(384, 22)];
+
+static unsigned int selftest_neon(void)
+{
+    layer_structure lay;
+#ifdef CNN_BATCH
+    unsigned int i;
+#endif
+    unsigned int mismatch = 0;
+
+    printf("NEON kernel self-test\n");
+    selftest_layer_data(1);
+
+    selftest_conv_layer(&lay);
+    convolution(&lay, selftest_inputs, selftest_ref, selftest_weights, selftest_biases);
+    convolution_neon(&lay, selftest_inputs, selftest_out, selftest_weights, selftest_biases);
+    mismatch += selftest_compare("convolution", selftest_ref, selftest_out, 6 * 6 * 20, SELFTEST_TOLERANCE);
+
+#ifdef CNN_CONV_2
+    // same conv as conv mode #2: one 4-pixel tile + 2 leftover columns per row
+    convolution_conv2(&lay, selftest_inputs, selftest_out, selftest_weights, selftest_biases);
+    mismatch += selftest_compare("convolution_conv2 (C)", selftest_ref, selftest_out, 6 * 6 * 20, SELFTEST_TOLERANCE);
+    convolution_conv2_neon(&lay, selftest_inputs, selftest_out, selftest_weights, selftest_biases);
+    mismatch += selftest_compare("convolution_conv2", selftest_ref, selftest_out, 6 * 6 * 20, SELFTEST_TOLERANCE);
+#endif
+
+#ifdef CNN_CONV_4
+    // same conv as conv mode #4: M = 36 (a 4-pixel edge panel), N = 20 (a 4-channel edge)
+    convolution_conv4_neon(&lay, selftest_inputs, selftest_out, selftest_weights, selftest_biases, selftest_gemm);
+    mismatch += selftest_compare("convolution_conv4", selftest_ref, selftest_out, 6 * 6 * 20, SELFTEST_TOLERANCE);
+#endif
+
+    // pool 8x8x6 -> 4x4x6: one 4-channel block + 2 scalar channels
+    lay.filter_rows = 2;
+    lay.filter_columns = 2;
+    lay.output_channel = 6;
+    lay.output_rows = 4;
+    lay.output_columns = 4;
+    lay.relu_activation = 0;
+    max_pooling(&lay, selftest_inputs, selftest_ref);
+    max_pooling_neon(&lay, selftest_inputs, selftest_out);
+    mismatch += selftest_compare("max_pooling", selftest_ref, selftest_out, 4 * 4 * 6, SELFTEST_TOLERANCE);
+
+#ifdef CNN_FUSED
+    // conv 8x8x6 -> 6x6x20 + pool -> 3x3x20: two 8-channel blocks + one 4-channel block
+    selftest_conv_layer(&lay);
+    convolution(&lay, selftest_inputs, selftest_out, selftest_weights, selftest_biases);
+    convolution_pool_neon(&lay, selftest_inputs, selftest_ref, selftest_weights, selftest_biases);
+    lay.input_channel = 20;
+    lay.input_rows = 6;
+    lay.input_columns = 6;
+    lay.filter_rows = 2;
+    lay.filter_columns = 2;
+    lay.output_rows = 3;
+    lay.output_columns = 3;
+    lay.relu_activation = 0;
+    max_pooling(&lay, selftest_out, selftest_pool);
+    mismatch += selftest_compare("convolution_pool", selftest_pool, selftest_ref, 3 * 3 * 20, SELFTEST_TOLERANCE);
+#endif
+
+    // FC 384 -> 22: one 16-output block, one 4-output block, 2 scalar outputs
+    selftest_fc_layer(&lay, 384, 22);
+    fully_connected(&lay, selftest_inputs, selftest_ref, selftest_weights, selftest_biases);
+    fully_connected_neon(&lay, selftest_inputs, selftest_out, selftest_weights, selftest_biases);
+    mismatch += selftest_compare("fully_connected", selftest_ref, selftest_out, 22, SELFTEST_TOLERANCE);
+
+    // packed FC 384 -> 22: one full panel + one partial panel
+    fully_connected_pack(&lay, selftest_weights, selftest_biases, selftest_packed);
+    fully_connected_packed_neon(&lay, selftest_inputs, selftest_out, selftest_packed, 0, 22);
+    mismatch += selftest_compare("fully_connected_packed", selftest_ref, selftest_out, 22, SELFTEST_TOLERANCE);
+
+#ifdef CNN_BATCH
+    // FC 128 -> 22 over 18 images: a full 16-image pass + 2 images, five
+    // 4-output blocks + 2 scalar outputs. The images are taken from the
+    // tail of selftest_weights, past the 128x22 weights.
+    lay.input_channel = 128;
+    for (i = 0; i < 18; i++) {
+        fully_connected(&lay, selftest_weights + (128 * 22) + (i * 128), selftest_ref + (i * 22), selftest_weights, selftest_biases);
+    }
+    fully_connected_batch(&lay, selftest_weights + (128 * 22), selftest_out, selftest_weights, selftest_biases, 18);
+    mismatch += selftest_compare("fully_connected_batch (C)", selftest_ref, selftest_out, 18 * 22, SELFTEST_TOLERANCE);
+    fully_connected_batch_neon(&lay, selftest_weights + (128 * 22), selftest_out, selftest_weights, selftest_biases, 18);
+    mismatch += selftest_compare("fully_connected_batch", selftest_ref, selftest_out, 18 * 22, SELFTEST_TOLERANCE);
+
+    // and over panels: a full panel + a partial one of 6 outputs
+    fully_connected_pack(&lay, selftest_weights, selftest_biases, selftest_packed);
+    fully_connected_batch_packed(&lay, selftest_weights + (128 * 22), selftest_out, selftest_packed, 18);
+    mismatch += selftest_compare("fc_batch_packed (C)", selftest_ref, selftest_out, 18 * 22, SELFTEST_TOLERANCE);
+    fully_connected_batch_packed_neon(&lay, selftest_weights + (128 * 22), selftest_out, selftest_packed, 18);
+    mismatch += selftest_compare("fc_batch_packed", selftest_ref, selftest_out, 18 * 22, SELFTEST_TOLERANCE);
+#endif
+
+    return mismatch;
+}
+#endif
+
+#ifdef CNN_CONV_5
+static signed char selftest_x[512];
+static signed char selftest_w[128 * 512];
+static int selftest_acc_ref[128];
+static int selftest_acc[128];
+
+// The dot-product kernel must match the scalar reference exactly,
+// since both are integer
+static unsigned int selftest_int8(void)
+{
+    unsigned int i;
+    unsigned int mismatch = 0;
+
+    printf("INT8 kernel self-test\n");
+    selftest_seed = 7;
+    for (i = 0; i < sizeof(selftest_w); i++) {
+        selftest_w[i] = (signed char)((int)(selftest_rand() % 255) - 127);
+    }
+    for (i = 0; i < sizeof(selftest_x); i++) {
+        selftest_x[i] = (signed char)((int)(selftest_rand() % 255) - 127);
+    }
+
+    // 500 inputs exercises both the 16-wide and the 4-wide SDOT loops
+    int8_gemv_ref(selftest_x, selftest_w, 500, 128, selftest_acc_ref);
+    int8_gemv(selftest_x, selftest_w, 500, 128, selftest_acc);
+    for (i = 0; i < 128; i++) {
+        if (selftest_acc_ref[i] != selftest_acc[i]) {
+            mismatch++;
+        }
+    }
+
+    return selftest_report("int8_gemv", mismatch, 128);
+}
+#endif
+
+#ifdef CNN_CONV_7
+static float selftest_transformed[WINOGRAD_WEIGHTS_SIZE(6, 20)];
+static float selftest_workspace[WINOGRAD_WORKSPACE_SIZE(6)];
+
+static unsigned int selftest_winograd_layer(const char *name, layer_structure *lay)
+{
+    convolution(lay, selftest_inputs, selftest_ref, selftest_weights, selftest_biases);
+    convolution_winograd_transform(lay, selftest_weights, selftest_transformed);
+    convolution_winograd(lay, selftest_inputs, selftest_out, selftest_transformed, selftest_biases, selftest_workspace);
+
+    return selftest_compare(name, selftest_ref, selftest_out,
+                            lay->output_rows * lay->output_columns * lay->output_channel, SELFTEST_TOLERANCE);
+}
+
+// Winograd is not bit-exact, so both tile sizes are checked against
+// convolution() with a tolerance, on shapes with partial tiles and a
+// partial channel block
+static unsigned int selftest_winograd(void)
+{
+    layer_structure lay;
+    unsigned int mismatch = 0;
+
+    printf("Winograd kernel self-test\n");
+    selftest_layer_data(11);
+
+    // 9x9x6 -> 5x5x20, 5x5 filter: F(2x2, 5x5), 3x3 tiles with a partial
+    // last row and column, one 16-channel block + 4 channels
+    lay.input_channel = 6;
+    lay.input_rows = 9;
+    lay.input_columns = 9;
+    lay.filter_rows = 5;
+    lay.filter_columns = 5;
+    lay.output_channel = 20;
+    lay.output_rows = 5;
+    lay.output_columns = 5;
+    lay.relu_activation = 1;
+    mismatch += selftest_winograd_layer("winograd F(2x2, 5x5)", &lay);
+
+    // 9x9x6 -> 7x7x20, 3x3 filter: F(4x4, 3x3), 2x2 tiles, partial
+    lay.filter_rows = 3;
+    lay.filter_columns = 3;
+    lay.output_rows = 7;
+    lay.output_columns = 7;
+    mismatch += selftest_winograd_layer("winograd F(4x4, 3x3)", &lay);
+
+    return mismatch;
+}
+#endif
+
+#ifdef CNN_FP16
+static cnn_half selftest_inputs_h[sizeof(selftest_inputs) / sizeof(float)];
+static cnn_half selftest_weights_h[sizeof(selftest_weights) / sizeof(float)];
+static cnn_half selftest_biases_h[sizeof(selftest_biases) / sizeof(float)];
+static cnn_half selftest_out_h[sizeof(selftest_out) / sizeof(float)];
+
+// fp32 copy of buf[len] rounded to fp16, so both paths start from the
+// same values
+static void selftest_half(float *buf, cnn_half *buf_h, unsigned int len)
+{
+    cnn_fp32_to_fp16(buf, buf_h, len);
+    cnn_fp16_to_fp32(buf_h, buf, len);
+}
+
+static unsigned int selftest_fp16_compare(const char *name, unsigned int len)
+{
+    cnn_fp16_to_fp32(selftest_out_h, selftest_out, len);
+
+    return selftest_compare(name, selftest_ref, selftest_out, len, SELFTEST_FP16_TOLERANCE);
+}
+
+// Each fp16 kernel against its fp32 counterpart: only the fp16 rounding
+// of the stored outputs may differ
+static unsigned int selftest_fp16(void)
+{
+    layer_structure lay;
+    unsigned int i;
+    unsigned int mismatch = 0;
+
+    printf("FP16 kernel self-test\n");
+    selftest_layer_data(13);
+    selftest_half(selftest_inputs, selftest_inputs_h, sizeof(selftest_inputs) / sizeof(float));
+    selftest_half(selftest_weights, selftest_weights_h, sizeof(selftest_weights) / sizeof(float));
+    selftest_half(selftest_biases, selftest_biases_h, sizeof(selftest_biases) / sizeof(float));
+
+    // with range-scaled activations: biases / 4
+    selftest_conv_layer(&lay);
+    for (i = 0; i < 22; i++) {
+        selftest_biases[i] *= 0.25f;
+    }
+    convolution(&lay, selftest_inputs, selftest_ref, selftest_weights, selftest_biases);
+    convolution_fp16(&lay, selftest_inputs_h, selftest_out_h, selftest_weights_h, selftest_biases_h, 0.25f);
+    cnn_fp16_to_fp32(selftest_biases_h, selftest_biases, 22);
+    mismatch += selftest_fp16_compare("convolution_fp16", 6 * 6 * 20);
+
+    // pool 8x4x12 -> 4x2x12: one 8-channel block + 4 channels
+    lay.input_channel = 12;
+    lay.input_columns = 4;
+    lay.filter_rows = 2;
+    lay.filter_columns = 2;
+    lay.output_channel = 12;
+    lay.output_rows = 4;
+    lay.output_columns = 2;
+    lay.relu_activation = 0;
+    max_pooling(&lay, selftest_inputs, selftest_ref);
+    max_pooling_fp16(&lay, selftest_inputs_h, selftest_out_h);
+    mismatch += selftest_fp16_compare("max_pooling_fp16", 4 * 2 * 12);
+
+    // FC 384 -> 22: one 16-output block + 6 outputs
+    selftest_fc_layer(&lay, 384, 22);
+    fully_connected(&lay, selftest_inputs, selftest_ref, selftest_weights, selftest_biases);
+    fully_connected_fp16(&lay, selftest_inputs_h, selftest_out_h, selftest_weights_h, selftest_biases_h, 1.0f);
+    mismatch += selftest_fp16_compare("fully_connected_fp16", 22);
+
+    return mismatch;
+}
+#endif
+
+#ifdef CNN_LOG
+// Interleaved producers come out in log order, and a full ring drops
+// and reports its overflow instead of overwriting undrained records
+static const char selftest_log_fmt[] = "selftest %llu\n";
+static cnn_log selftest_log;
+
+typedef struct {
+    unsigned int next;
+    unsigned int mismatch;
+    unsigned int records;
+    unsigned long long dropped;
+} selftest_log_state;
+
+static void selftest_log_emit(void *ctx, unsigned int cpu, const cnn_log_record *rec)
+{
+    selftest_log_state *st = (selftest_log_state*)ctx;
+
+    // anything else is the ring's own "records dropped" note
+    if (rec->fmt != selftest_log_fmt) {
+        st->dropped += rec->args[1];
+        return;
+    }
+    if (rec->args[0] != st->next || rec->args[1] != cpu) {
+        st->mismatch++;
+    }
+    st->next++;
+    st->records++;
+}
+
+static unsigned int selftest_cnn_log(void)
+{
+    selftest_log_state st;
+    unsigned int idx, accepted = 0;
+    unsigned int mismatch, total = 0;
+
+    printf("Log ring self-test\n");
+
+    cnn_log_init(&selftest_log);
+    memset(&st, 0, sizeof(st));
+    for (idx = 0; idx < 3 * CNN_LOG_RING_SIZE; idx++) {
+        accepted += CNN_LOG2(&selftest_log, idx % 3, selftest_log_fmt, idx, idx % 3);
+    }
+    cnn_log_drain(&selftest_log, selftest_log_emit, &st);
+    mismatch = st.mismatch + (st.records != accepted) + (accepted != 3 * CNN_LOG_RING_SIZE) + (st.dropped != 0);
+    total += selftest_report("cnn_log_drain", mismatch, st.records);
+
+    cnn_log_init(&selftest_log);
+    memset(&st, 0, sizeof(st));
+    accepted = 0;
+    for (idx = 0; idx < CNN_LOG_RING_SIZE + 5; idx++) {
+        accepted += CNN_LOG2(&selftest_log, 1, selftest_log_fmt, idx, 1);
+    }
+    cnn_log_drain(&selftest_log, selftest_log_emit, &st);
+    mismatch = st.mismatch + (accepted != CNN_LOG_RING_SIZE) + (st.records != CNN_LOG_RING_SIZE) + (st.dropped != 5);
+    mismatch += (CNN_LOG2(&selftest_log, 1, selftest_log_fmt, 0, 1) != 1);
+    total += selftest_report("cnn_log_put (full)", mismatch, st.records);
+
+    return total;
+}
+#endif
+
+#ifdef CNN_MODEL
+// A two-layer container (input 1x2x2, FC 4 -> 2) built in memory: it
+// opens and hands out its tensors, and every kind of damage is caught
+#define SELFTEST_TABLE      64
+#define SELFTEST_GRAPH      256
+// byte offsets of a field of tensor entry t and of graph layer[l]
+#define SELFTEST_ENTRY(t, field)    (SELFTEST_TABLE + (t) * sizeof(cnn_model_tensor) + offsetof(cnn_model_tensor, field))
+#define SELFTEST_LAYER(l, field)    (SELFTEST_GRAPH + offsetof(cnn_graph, layer) + (l) * sizeof(cnn_graph_layer) + \
+                                     offsetof(cnn_graph_layer, field))
+#define SELFTEST_WEIGHTS    448
+#define SELFTEST_BIASES     512
+#define SELFTEST_SIZE       520
+
+static unsigned char selftest_blob[SELFTEST_SIZE] __attribute__ ((aligned (64)));
+
+static void selftest_model_tensor(
+    cnn_model_tensor *t,
+    const char *name,
+    unsigned int dtype,
+    unsigned int shape0,
+    unsigned int shape1,
+    unsigned int offset
+) {
+    memset(t, 0, sizeof(*t));
+    strcpy(t->name, name);
+    t->dtype = dtype;
+    t->layout = shape1 > 1 ? CNN_LAYOUT_IO : CNN_LAYOUT_FLAT;
+    t->rank = 2;
+    t->shape[0] = shape0;
+    t->shape[1] = shape1;
+    t->shape[2] = 1;
+    t->shape[3] = 1;
+    t->offset = offset;
+    t->size = shape0 * shape1 * 4;      // CNN_DTYPE_F32 and CNN_DTYPE_U32
+}
+
+static void selftest_model_build(void)
+{
+    cnn_model_header *h = (cnn_model_header*)selftest_blob;
+    cnn_model_tensor *t = (cnn_model_tensor*)(selftest_blob + SELFTEST_TABLE);
+    // the graph header, then only the layer_num layers the blob holds
+    unsigned int *graph = (unsigned int*)(selftest_blob + SELFTEST_GRAPH);
+    cnn_graph_layer *layer = (cnn_graph_layer*)(selftest_blob + SELFTEST_GRAPH + offsetof(cnn_graph, layer));
+    float *weights = (float*)(selftest_blob + SELFTEST_WEIGHTS);
+    unsigned int idx;
+
+    memset(selftest_blob, 0, sizeof(selftest_blob));
+    graph[0] = CNN_GRAPH_MAGIC;
+    graph[1] = CNN_GRAPH_VERSION;
+    graph[2] = 2;       // layer_num
+    graph[3] = 2;       // classes
+    layer[0].type = CNN_LAYER_INPUT;
+    layer[0].input_channel = layer[0].output_channel = 1;
+    layer[0].input_rows = layer[0].output_rows = 2;
+    layer[0].input_columns = layer[0].output_columns = 2;
+    layer[0].int8_weights = layer[0].int8_scales = layer[0].int8_biases = CNN_GRAPH_NONE;
+    layer[1].type = CNN_LAYER_FC;
+    layer[1].input_channel = 4;
+    layer[1].output_channel = 2;
+    layer[1].weights = SELFTEST_WEIGHTS;
+    layer[1].biases = SELFTEST_BIASES;
+    layer[1].int8_weights = layer[1].int8_scales = layer[1].int8_biases = CNN_GRAPH_NONE;
+    for (idx = 0; idx < 8; idx++) {
+        weights[idx] = (float)idx;
+    }
+
+    selftest_model_tensor(&t[0], CNN_MODEL_GRAPH, CNN_DTYPE_U32, 36, 1, SELFTEST_GRAPH);
+    selftest_model_tensor(&t[1], "fc.weights", CNN_DTYPE_F32, 4, 2, SELFTEST_WEIGHTS);
+    selftest_model_tensor(&t[2], "fc.biases", CNN_DTYPE_F32, 2, 1, SELFTEST_BIASES);
+
+    h->magic = CNN_MODEL_MAGIC;
+    h->version = CNN_MODEL_VERSION;
+    h->header_size = sizeof(cnn_model_header);
+    h->tensor_num = 3;
+    h->table_offset = SELFTEST_TABLE;
+    h->data_offset = SELFTEST_GRAPH;
+    h->file_size = SELFTEST_SIZE;
+    h->checksum = cnn_model_crc32(0, selftest_blob + h->header_size, SELFTEST_SIZE - h->header_size);
+}
+
+// Damage the built container, reseal it so only the damage is seen
+static int selftest_model_open(unsigned int offset, unsigned int value, unsigned int reseal)
+{
+    cnn_model_header *h = (cnn_model_header*)selftest_blob;
+    cnn_model model;
+
+    selftest_model_build();
+    *(unsigned int*)(selftest_blob + offset) = value;
+    if (reseal) {
+        h->checksum = cnn_model_crc32(0, selftest_blob + h->header_size, SELFTEST_SIZE - h->header_size);
+    }
+
+    return cnn_model_open(&model, selftest_blob, SELFTEST_SIZE);
+}
+
+static unsigned int selftest_model(void)
+{
+    cnn_model model;
+    const float *weights;
+    unsigned int mismatch = 0;
+    unsigned int checks = 0;
+
+    printf("Model container self-test\n");
+
+    // the CRC-32 check value
+    checks++;
+    mismatch += (cnn_model_crc32(0, "123456789", 9) != 0xCBF43926);
+
+    selftest_model_build();
+    checks++;
+    mismatch += (cnn_model_open(&model, selftest_blob, SELFTEST_SIZE) != 0);
+    weights = cnn_model_f32(&model, "fc.weights", 8);
+    checks++;
+    mismatch += (!weights || weights[7] != 7.0f || model.graph != (const cnn_graph*)(selftest_blob + SELFTEST_GRAPH));
+    checks++;
+    mismatch += (cnn_model_f32(&model, "fc.weights", 4) != 0 || cnn_model_i8(&model, "fc.weights", 32) != 0 ||
+                 cnn_model_find(&model, "fc") != 0);
+    checks++;
+    mismatch += (cnn_model_open(&model, selftest_blob, SELFTEST_SIZE - 1) != CNN_MODEL_E_HEADER);
+
+    checks += 5;
+    mismatch += (selftest_model_open(offsetof(cnn_model_header, version), CNN_MODEL_VERSION + 1, 0) != CNN_MODEL_E_VERSION);
+    mismatch += (selftest_model_open(SELFTEST_WEIGHTS, 0x3F800000, 0) != CNN_MODEL_E_CHECKSUM);
+    // fc.weights offset off its alignment
+    mismatch += (selftest_model_open(SELFTEST_ENTRY(1, offset), SELFTEST_WEIGHTS + 4, 1) != CNN_MODEL_E_TENSOR);
+    // fc.biases shape not matching its size
+    mismatch += (selftest_model_open(SELFTEST_ENTRY(2, shape), 3, 1) != CNN_MODEL_E_TENSOR);
+    // the FC layer's weights offset at its biases
+    mismatch += (selftest_model_open(SELFTEST_LAYER(1, weights), SELFTEST_BIASES, 1) != CNN_MODEL_E_GRAPH);
+
+    return selftest_report("cnn_model_open", mismatch, checks);
+}
+#endif
+
+unsigned int cnn_selftest(void)
+{
+    unsigned int mismatch = 0;
+
+#ifdef CNN_NEON
+    mismatch += selftest_neon();
+#endif
+#ifdef CNN_CONV_5
+    mismatch += selftest_int8();
+#endif
+#ifdef CNN_CONV_7
+    mismatch += selftest_winograd();
+#endif
+#ifdef CNN_FP16
+    mismatch += selftest_fp16();
+#endif
+#ifdef CNN_LOG
+    mismatch += selftest_cnn_log();
+#endif
+#ifdef CNN_MODEL
+    mismatch += selftest_model();
+#endif
+
+    return mismatch;
+}
+
+#endif
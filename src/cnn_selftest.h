@@ -0,0 +1,16 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Simple CNN Application for Inference only
+ Kernel self-tests (CNN_SELFTEST)
+==================================================================
+*/
+#ifndef CNN_SELFTEST_H
+#define CNN_SELFTEST_H
+
+// Each kernel against its reference on pseudo-random data, one
+// "[Pass]" / "[Fail !!!]" line per check. Returns the mismatches.
+unsigned int cnn_selftest(void);
+
+#endif
@@ -0,0 +1,147 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Simple CNN Application for Inference only
+ Per-core begin/end trace events, dumped as Chrome trace JSON
+==================================================================
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "arm_cnn_inference.h"
+#include "cnn_trace.h"
+#ifdef CNN_HOST_BUILD
+#include <time.h>
+#endif
+
+#ifdef CNN_TRACE
+
+// The generic counter ticks at the same rate on every core and needs no
+// timer interrupt, unlike getTimerTicks(), so the cores line up
+static unsigned long long cnn_trace_now(void)
+{
+#ifdef CNN_HOST_BUILD
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#else
+    unsigned long long ticks;
+
+    asm volatile ("isb\n mrs %0, cntvct_el0" : "=r" (ticks) :: "memory");
+    return ticks;
+#endif
+}
+
+// Ticks per us
+static double cnn_trace_rate(void)
+{
+#ifdef CNN_HOST_BUILD
+    return 1000.0;
+#else
+    unsigned long long freq;
+
+    asm volatile ("mrs %0, cntfrq_el0" : "=r" (freq));
+    return freq ? freq / 1e6 : 1.0;
+#endif
+}
+
+void cnn_trace_init(cnn_trace *trace)
+{
+    unsigned int cpu;
+
+    memset(trace, 0, sizeof(*trace));
+    for (cpu = 0; cpu < CNN_TRACE_MAX_CPUS; cpu++) {
+        trace->buf[cpu].cpu = cpu;
+    }
+}
+
+cnn_trace_buf *cnn_trace_cpu(cnn_trace *trace, unsigned int cpu)
+{
+    return (trace && cpu < CNN_TRACE_MAX_CPUS) ? &trace->buf[cpu] : 0;
+}
+
+void cnn_trace_begin(cnn_trace_buf *buf, const char *name)
+{
+    cnn_trace_event *ev;
+
+    if (!buf) {
+        return;
+    }
+    // room for this begin, its end and the ends of every open begin
+    if (buf->lost || buf->count + buf->depth + 2 > CNN_TRACE_EVENTS) {
+        buf->lost++;
+        buf->dropped++;
+        return;
+    }
+    ev = &buf->event[buf->count++];
+    strncpy(ev->name, name, CNN_TRACE_NAME - 1);
+    ev->name[CNN_TRACE_NAME - 1] = '\0';
+    ev->phase = 'B';
+    buf->depth++;
+    ev->ts = cnn_trace_now();
+}
+
+void cnn_trace_end(cnn_trace_buf *buf)
+{
+    cnn_trace_event *ev;
+    unsigned long long ts;
+
+    if (!buf) {
+        return;
+    }
+    ts = cnn_trace_now();
+    if (buf->lost) {
+        buf->lost--;
+        buf->dropped++;
+        return;
+    }
+    if (!buf->depth) {
+        return;
+    }
+    ev = &buf->event[buf->count++];
+    ev->ts = ts;
+    ev->name[0] = '\0';
+    ev->phase = 'E';
+    buf->depth--;
+}
+
+unsigned int cnn_trace_write(const cnn_trace *trace, FILE *out)
+{
+    const cnn_trace_buf *buf;
+    const cnn_trace_event *ev;
+    unsigned long long origin = ~0ull;
+    double rate = cnn_trace_rate();
+    unsigned int cpu, idx, dropped = 0;
+    const char *sep = "";
+
+    for (cpu = 0; cpu < CNN_TRACE_MAX_CPUS; cpu++) {
+        buf = &trace->buf[cpu];
+        if (buf->count && buf->event[0].ts < origin) {
+            origin = buf->event[0].ts;
+        }
+    }
+
+    fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    for (cpu = 0; cpu < CNN_TRACE_MAX_CPUS; cpu++) {
+        buf = &trace->buf[cpu];
+        dropped += buf->dropped;
+        if (!buf->count) {
+            continue;
+        }
+        fprintf(out, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %u, \"args\": {\"name\": \"CPU %u\"}}",
+                sep, buf->cpu, buf->cpu);
+        sep = ",\n";
+        for (idx = 0; idx < buf->count; idx++) {
+            ev = &buf->event[idx];
+            fprintf(out, "%s{\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": 0, \"tid\": %u}",
+                    sep, ev->name, ev->phase, (ev->ts - origin) / rate, buf->cpu);
+        }
+    }
+    fprintf(out, "\n]}\n");
+
+    return dropped;
+}
+
+#endif
@@ -0,0 +1,56 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Simple CNN Application for Inference only
+ Per-core begin/end trace events, dumped as Chrome trace JSON
+==================================================================
+*/
+#ifndef CNN_TRACE_H
+#define CNN_TRACE_H
+
+#include <stdio.h>
+
+#define CNN_TRACE_MAX_CPUS      8
+#ifndef CNN_TRACE_EVENTS
+#define CNN_TRACE_EVENTS        1024    // per core
+#endif
+#define CNN_TRACE_NAME          15
+
+// ts is the generic counter (CNTVCT_EL0) on the target, CLOCK_MONOTONIC
+// ns on the host. The name is copied, so it can be built on the stack.
+typedef struct {
+    unsigned long long ts;
+    char name[CNN_TRACE_NAME];
+    char phase;                 // 'B' or 'E'
+} cnn_trace_event;
+
+// Written by its own core only, read once every core is done. A full
+// buffer drops new begin events, and the end events that match them,
+// but always keeps room to close what it has opened.
+typedef struct cnn_trace_buf {
+    cnn_trace_event event[CNN_TRACE_EVENTS];
+    unsigned int count;
+    unsigned int depth;         // recorded begins not yet ended
+    unsigned int lost;          // dropped begins not yet ended
+    unsigned int dropped;
+    unsigned int cpu;
+} cnn_trace_buf;
+
+typedef struct cnn_trace {
+    cnn_trace_buf buf[CNN_TRACE_MAX_CPUS];
+} cnn_trace;
+
+void cnn_trace_init(cnn_trace *trace);
+// The buffer of cpu, 0 if out of range, so that it can be passed as is
+cnn_trace_buf *cnn_trace_cpu(cnn_trace *trace, unsigned int cpu);
+
+// Both take a 0 buffer as tracing off
+void cnn_trace_begin(cnn_trace_buf *buf, const char *name);
+void cnn_trace_end(cnn_trace_buf *buf);
+
+// Chrome trace-event JSON (chrome://tracing, Perfetto): one thread per
+// core, ts in us from the first event. Returns the events dropped.
+unsigned int cnn_trace_write(const cnn_trace *trace, FILE *out);
+
+#endif
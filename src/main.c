@@ -19,23 +19,106 @@
 #include "timer_interrupt.h"
 #include "mnist.h"
 #include "cnn_api_c.h"
+#include "cnn_sched.h"
+#include "cnn_log.h"
+#include "cnn_prof.h"
+#include "cnn_trace.h"
+#include "cnn_model.h"
+#include "cnn_selftest.h"
+#include "mnist_aot.h"
 
 // compile-time control for the max number of CPUs in the device
 #define nCPUs 8
 
 #define CNN_MODE       1
 
+// images per mnist_cnn_eval() call in autotest mode without CNN_SCHED;
+// more than 1 claims that many images at once and runs them through
+// mnist_cnn_eval_batch()
+#define AUTOTEST_BATCH 1
+
+#ifdef CNN_PROF
+// mnist_cnn_eval() runs of the selected image for the per-layer table,
+// so that every event group is counted several times
+#define PROFILE_RUNS   16
+
+static cnn_prof image_prof;
+#endif
+
+#ifdef CNN_TRACE
+// Every core's image, layer and task spans, plus its waits, written by
+// the last core to finish: over semihosting into the working directory
+// of the model, or to the console if that fails
+#define MAIN_TRACE_FILE "mnist_trace.json"
+
+// The rings (24 bytes per event) are far too big for the image, which
+// must fit below the heap and stacks (see layout.scat): they live in the
+// DDR window instead
+#define MAIN_TRACE      ((cnn_trace*)(MNIST_EVAL_BASE + MNIST_TRACE_BASE))
+#if (CNN_TRACE_MAX_CPUS * (CNN_TRACE_EVENTS + 1) * 24) > MNIST_TRACE_SIZE
+#error "CNN_TRACE_EVENTS does not fit in MNIST_TRACE_SIZE"
+#endif
+
+#define MAIN_TRACE_BEGIN(core, name)        cnn_trace_begin(cnn_trace_cpu(MAIN_TRACE, core), name)
+#define MAIN_TRACE_END(core)                cnn_trace_end(cnn_trace_cpu(MAIN_TRACE, core))
+#else
+#define MAIN_TRACE_BEGIN(core, name)        do { } while (0)
+#define MAIN_TRACE_END(core)                do { } while (0)
+#endif
+
 
 static unsigned int cpu_active_count = 0;
 static unsigned int cpu_finished_count = 0;
 
 static unsigned int next_image;
+static unsigned int model_ready;    // set by core 0 once the weights are packed
 //static unsigned int conv_mode;
 
+#ifdef CNN_SCHED
+// autotest images shared by all CPUs through the work-stealing scheduler
+static cnn_sched autotest_sched;
+static mnist_sched_job autotest_job;
+static unsigned int *autotest_images[TESTMODE_IMAGE_NUM];
+static cnn_result autotest_results[TESTMODE_IMAGE_NUM];
+static unsigned int autotest_sched_ready;
+
+// selected image, every layer split across all CPUs
+static cnn_team image_team;
+#endif
+
 
 // printf lock to regulate CPU access to an output device
 mutex print_lock __attribute__ ((aligned (64)));
 
+#ifdef CNN_LOG
+// MainApp status lines: each core appends to its own ring and never
+// waits; core 0 prints them between its own images and the last core
+// to finish flushes the rest. Formats take 64-bit integer arguments.
+static cnn_log main_log;
+
+#define MAIN_LOG0(core, fmt)                CNN_LOG0(&main_log, core, fmt)
+#define MAIN_LOG1(core, fmt, a)             CNN_LOG1(&main_log, core, fmt, a)
+#define MAIN_LOG2(core, fmt, a, b)          CNN_LOG2(&main_log, core, fmt, a, b)
+#define MAIN_LOG3(core, fmt, a, b, c)       CNN_LOG3(&main_log, core, fmt, a, b, c)
+#define MAIN_LOG4(core, fmt, a, b, c, d)    CNN_LOG4(&main_log, core, fmt, a, b, c, d)
+#define MAIN_LOG_DRAIN()                    cnn_log_drain(&main_log, 0, 0)
+#else
+#define MAIN_LOG_PRINT(core, args) \
+    do { \
+        MAIN_TRACE_BEGIN(core, "print_lock"); \
+        _mutex_acquire(&print_lock); \
+        MAIN_TRACE_END(core); \
+        printf args; \
+        _mutex_release(&print_lock); \
+    } while (0)
+#define MAIN_LOG0(core, fmt)                MAIN_LOG_PRINT(core, (fmt))
+#define MAIN_LOG1(core, fmt, a)             MAIN_LOG_PRINT(core, (fmt, (unsigned long long)(a)))
+#define MAIN_LOG2(core, fmt, a, b)          MAIN_LOG_PRINT(core, (fmt, (unsigned long long)(a), (unsigned long long)(b)))
+#define MAIN_LOG3(core, fmt, a, b, c)       MAIN_LOG_PRINT(core, (fmt, (unsigned long long)(a), (unsigned long long)(b), (unsigned long long)(c)))
+#define MAIN_LOG4(core, fmt, a, b, c, d)    MAIN_LOG_PRINT(core, (fmt, (unsigned long long)(a), (unsigned long long)(b), (unsigned long long)(c), (unsigned long long)(d)))
+#define MAIN_LOG_DRAIN()                    do { } while (0)
+#endif
+
 // example code from fixstars
 // http://www.fixstars.com/en/news/?p=125
 
@@ -50,7 +133,11 @@ void add_scalar(uint8_t * A, uint8_t * B, uint8_t * C)
 
 void test_scalar_neon()
 {
-
+#ifdef CNN_SELFTEST
+    _mutex_acquire(&print_lock);
+    cnn_selftest();
+    _mutex_release(&print_lock);
+#endif
 }
 
 /*
@@ -70,8 +157,43 @@ void test_scalar_neon()
 
 #define MEMTEST_START        ((unsigned int*) 0x80100000) // to 0x8120_0000 // len: 0x0110_0000
 
+// Result of one image, logged once the PMU has stopped
+static void main_log_result(unsigned long core, unsigned int image_result, const cnn_result *result)
+{
+    if (image_result != result->class_idx) {
+        MAIN_LOG3(core, "\timage[%llu] from CPU: %llu, result: %llu, \t\t[Fail !!!]\n", image_result, core, result->class_idx);
+    }
+    else {
+        MAIN_LOG3(core, "\timage[%llu] from CPU: %llu, result: %llu, \t\t[Pass]\n", image_result, core, result->class_idx);
+    }
+    MAIN_LOG4(core, "\t\t2nd: %llu, margin: %llu.%02llu, confidence: %llu%%\n",
+              result->second_idx,
+              (unsigned int)(result->margin * 100.0f) / 100,
+              (unsigned int)(result->margin * 100.0f) % 100,
+              (unsigned int)(result->confidence * 100.0f));
+}
 
 
+#ifdef CNN_TRACE
+static void main_trace_write(void)
+{
+    FILE *out = fopen(MAIN_TRACE_FILE, "w");
+    unsigned int dropped;
+
+    if (out) {
+        dropped = cnn_trace_write(MAIN_TRACE, out);
+        fclose(out);
+        printf("Trace written to %s\n", MAIN_TRACE_FILE);
+    }
+    else {
+        dropped = cnn_trace_write(MAIN_TRACE, stdout);
+    }
+    if (dropped) {
+        printf("%u trace events dropped\n", dropped);
+    }
+}
+#endif
+
 __attribute__((noreturn)) void MainApp(void)
 {
     unsigned long core;
@@ -80,9 +202,20 @@ __attribute__((noreturn)) void MainApp(void)
     unsigned int test_model;
     unsigned int user_cmd;
 	unsigned int image_result;
-    unsigned int inference_0;
-    unsigned int inference_1;
+    cnn_result inference_0;
+    cnn_result inference_1;
     unsigned int get_image_idx = 0;
+#ifdef CNN_PROF
+    unsigned int prof_run;
+#endif
+#ifdef CNN_MODEL
+    int model_err;
+#endif
+#if defined(CNN_BATCH) && (AUTOTEST_BATCH > 1)
+    unsigned int *batch_images[AUTOTEST_BATCH];
+    cnn_result batch_results[AUTOTEST_BATCH];
+    unsigned int batch_num, batch_idx;
+#endif
 
     core = GetCoreNumber();
 
@@ -127,80 +260,224 @@ __attribute__((noreturn)) void MainApp(void)
 
     if (core == 0) {
 		user_cmd = *AUTOTESTIMG;
-        printf("[0x%x]: %x !!!!!\n", AUTOTESTIMG, user_cmd);
+        MAIN_LOG2(core, "[0x%llx]: %llx !!!!!\n", (unsigned long)AUTOTESTIMG, user_cmd);
 		if (user_cmd == 0xFF) {
 			test_mode = TESTMODE_IMAGE;
 		}
 
 		user_cmd = *CNNSELECTING;
-        printf("[0x%x]: %x !!!!!\n", CNNSELECTING, user_cmd);
+        MAIN_LOG2(core, "[0x%llx]: %llx !!!!!\n", (unsigned long)CNNSELECTING, user_cmd);
 		if (user_cmd == 0xFF) {
 			test_model = TESTMODEL_CIFAR;
 		}
 
-		_mutex_acquire(&print_lock);
-        printf("\n\n");
-        printf("Select test mode\n");
+        MAIN_LOG0(core, "\n\n");
+        MAIN_LOG0(core, "Select test mode\n");
 		if (test_mode == TESTMODE_AUTO) {
-			printf("CNN Auto Evaluation\n\n");
+			MAIN_LOG0(core, "CNN Auto Evaluation\n\n");
 		}
 		else {
-			printf("CNN Selected Image Evaluation\n\n");
+			MAIN_LOG0(core, "CNN Selected Image Evaluation\n\n");
 		}
 
 		conv_mode = *CONVMODE;
 		if (conv_mode == 1) {
-			printf("Conv mode #1 \n\n");
+			MAIN_LOG0(core, "Conv mode #1 \n\n");
 		}
 		else if (conv_mode == 2) {
-			printf("Conv mode #2\n\n");
+			MAIN_LOG0(core, "Conv mode #2\n\n");
 		}
 		else if (conv_mode == 3) {
-			printf("Conv mode #3\n\n");
+			MAIN_LOG0(core, "Conv mode #3\n\n");
+		}
+		else if (conv_mode == 4) {
+			MAIN_LOG0(core, "Conv mode #4\n\n");
 		}
+		else if (conv_mode == 5) {
+			MAIN_LOG0(core, "Conv mode #5 (INT8)\n\n");
+		}
+		else if (conv_mode == 6) {
+			MAIN_LOG0(core, "Conv mode #6 (fused conv+pool)\n\n");
+		}
+		else if (conv_mode == 7) {
+			MAIN_LOG0(core, "Conv mode #7 (Winograd)\n\n");
+		}
+		else if (conv_mode == 8) {
+			MAIN_LOG0(core, "Conv mode #8 (FP16)\n\n");
+		}
+#ifdef CNN_AOT
+		else if (conv_mode == MNIST_AOT_CONV_MODE) {
+			MAIN_LOG0(core, "Conv mode #9 (AOT compiled)\n\n");
+		}
+#endif
 		else {
 			conv_mode = 2;
-			printf("Conv deafult mode #2\n\n");
+			MAIN_LOG0(core, "Conv deafult mode #2\n\n");
 		}
 
-		printf("Select test model\n");
+		MAIN_LOG0(core, "Select test model\n");
 		if (test_model == TESTMODEL_MNIST) {
-			printf("MNIST CNN\n\n");
+			MAIN_LOG0(core, "MNIST CNN\n\n");
 		}
 		else {
-			printf("CIFAR CNN\n\n");
+			MAIN_LOG0(core, "CIFAR CNN\n\n");
+		}
+
+#ifdef CNN_MODEL
+		// a container restored at MNIST_MODEL_BASE replaces the raw
+		// parameter blobs and the graph at MNIST_GRAPH_BASE
+		if (((const cnn_model_header*)(MNIST_EVAL_BASE + MNIST_MODEL_BASE))->magic == CNN_MODEL_MAGIC) {
+			model_err = mnist_cnn_model((const void*)(MNIST_EVAL_BASE + MNIST_MODEL_BASE), MNIST_MODEL_SIZE);
+			if (model_err) {
+				MAIN_LOG1(core, "Model container rejected (error %lld), running the raw blobs\n", model_err);
+			}
+			else {
+				MAIN_LOG1(core, "Model container: %llu tensors\n", ((const cnn_model_header*)(MNIST_EVAL_BASE + MNIST_MODEL_BASE))->tensor_num);
+			}
+		}
+#endif
+		MAIN_LOG_DRAIN();
+
+		mnist_cnn_load();
+#ifdef CNN_TRACE
+		mnist_cnn_trace(MAIN_TRACE);
+#endif
+		__atomic_store_n(&model_ready, 1, __ATOMIC_RELEASE);
+
+#ifdef CNN_SCHED
+		for (get_image_idx = 0; get_image_idx < TESTMODE_IMAGE_NUM; get_image_idx++) {
+			autotest_images[get_image_idx] = (unsigned int*)TEST_IMAGE_X(get_image_idx);
 		}
-		_mutex_release(&print_lock);
+		autotest_job.test_images = autotest_images;
+		autotest_job.results = autotest_results;
+		mnist_cnn_sched_init(&autotest_sched, &autotest_job, TESTMODE_IMAGE_NUM, nCPUs);
+		__atomic_store_n(&autotest_sched_ready, 1, __ATOMIC_RELEASE);
+#endif
     }
+    else {
+    	// FC weights are repacked by core 0 before any core evaluates
+    	MAIN_TRACE_BEGIN(core, "wait model");
+    	while (!__atomic_load_n(&model_ready, __ATOMIC_ACQUIRE)) {
+    		asm("yield");
+    	}
+    	MAIN_TRACE_END(core);
+    }
+#ifdef CNN_SCHED
+    if (core != 0 && *AUTOTESTIMG == 0xFF) {
+    	// help core 0 with the selected image instead of running autotest
+    	test_mode = TESTMODE_IMAGE;
+    }
+#endif
 
+#ifdef CNN_SCHED
+    if (test_mode && core != 0) {
+        MAIN_TRACE_BEGIN(core, "team helper");
+        cnn_team_helper(&image_team, core);
+        MAIN_TRACE_END(core);
+    }
+    else
+#endif
     if (test_mode) {
-        inference_0 = 0;
         image_result = *TEST_IMAGE_RES(0);
-        _mutex_acquire(&print_lock);
-        printf("\n---------------------------------------\n");
-        printf("Inf selected image [%d] from CPU: %lu\n", image_result, core);
-        _mutex_release(&print_lock);
+        MAIN_LOG0(core, "\n---------------------------------------\n");
+        MAIN_LOG2(core, "Inf selected image [%llu] from CPU: %llu\n", image_result, core);
         pmu_reset();
         pmu_start();
+#ifdef CNN_SCHED
+        mnist_cnn_eval_team((unsigned int*)TEST_IMAGE_0, &image_team, core, &inference_0);
+        cnn_team_release(&image_team);
+#else
         mnist_cnn_eval((unsigned int*)TEST_IMAGE_0, core, &inference_0);
+#endif
         pmu_stop();
-        _mutex_acquire(&print_lock);
-        printf("\tselected image [%d] from CPU: %lu, inference: %d, \t\t", image_result, core, inference_0);
-    	if (image_result != inference_0) {
-    		printf("[Fail !!!]\n");
+        main_log_result(core, image_result, &inference_0);
+        MAIN_LOG1(core, "\t\tInstr count is %llu\n", pmu_cycle_counter_get_count());
+        MAIN_LOG1(core, "\t\t\t Cnt 0 is %llu\n", pmu_counter_get_event_count(0));
+        MAIN_LOG1(core, "\t\t\t Cnt 1 is %llu\n", pmu_counter_get_event_count(1));
+        MAIN_LOG1(core, "\t\t\t Cnt 2 is %llu\n", pmu_counter_get_event_count(2));
+        MAIN_LOG1(core, "\t\t\t Cnt 3 is %llu\n", pmu_counter_get_event_count(3));
+        MAIN_LOG1(core, "\t\t\t Cnt 4 is %llu\n", pmu_counter_get_event_count(4));
+        MAIN_LOG0(core, "\n");
+#ifdef CNN_PROF
+        if (core == 0) {
+        	// same image again, layer by layer, the PMU events rotating
+        	cnn_prof_init(&image_prof);
+        	mnist_cnn_profile(&image_prof);
+        	for (prof_run = 0; prof_run < PROFILE_RUNS; prof_run++) {
+        		mnist_cnn_eval((unsigned int*)TEST_IMAGE_0, core, &inference_0);
+        	}
+        	mnist_cnn_profile(0);
+        	MAIN_LOG_DRAIN();
+        	_mutex_acquire(&print_lock);
+        	cnn_prof_report(&image_prof);
+        	// the same as records for host/bench_compare, which skips the
+        	// rest of a saved console log
+        	cnn_prof_write_header(stdout, CNN_PROF_CSV);
+        	cnn_prof_write(&image_prof, stdout, CNN_PROF_CSV, inference_0.conv_mode, core);
+        	_mutex_release(&print_lock);
+        }
+#endif
+    }
+#if defined(CNN_SCHED)
+    else {
+    	// every core pulls (image, layer, row-tile) tasks until all
+    	// images are done, so no core idles while another has work
+    	MAIN_TRACE_BEGIN(core, "wait sched");
+    	while (!__atomic_load_n(&autotest_sched_ready, __ATOMIC_ACQUIRE)) {
+    		asm("yield");
     	}
-    	else {
-    		printf("[Pass]\n");
+    	MAIN_TRACE_END(core);
+    	pmu_reset();
+    	pmu_start();
+    	MAIN_TRACE_BEGIN(core, "sched worker");
+    	cnn_sched_worker(&autotest_sched, core);
+    	MAIN_TRACE_END(core);
+    	pmu_stop();
+    	MAIN_LOG4(core, "\n[CPU: %llu] %llu tasks, %llu stolen, cycle count is %llu\n",
+    			core, autotest_sched.executed[core], autotest_sched.stolen[core], pmu_cycle_counter_get_count());
+    	if (core == 0) {
+    		for (get_image_idx = 0; get_image_idx < TESTMODE_IMAGE_NUM; get_image_idx++) {
+    			image_result = *TEST_IMAGE_RES(get_image_idx);
+    			main_log_result(core, image_result, &autotest_results[get_image_idx]);
+    		}
+    		MAIN_LOG_DRAIN();
     	}
-        printf("\t\tInstr count is %llu\n", pmu_cycle_counter_get_count());
-        printf("\t\t\t Cnt 0 is %u\n", pmu_counter_get_event_count(0));
-        printf("\t\t\t Cnt 1 is %u\n", pmu_counter_get_event_count(1));
-        printf("\t\t\t Cnt 2 is %u\n", pmu_counter_get_event_count(2));
-        printf("\t\t\t Cnt 3 is %u\n", pmu_counter_get_event_count(3));
-        printf("\t\t\t Cnt 4 is %u\n", pmu_counter_get_event_count(4));
-        printf("\n");
-        _mutex_release(&print_lock);
     }
+#elif defined(CNN_BATCH) && (AUTOTEST_BATCH > 1)
+    else {
+
+    	while(1) {
+
+        	get_image_idx = __atomic_fetch_add(&next_image, AUTOTEST_BATCH, __ATOMIC_RELAXED);
+        	if ( get_image_idx >= TESTMODE_IMAGE_NUM ) {
+        		break;
+        	}
+        	batch_num = TESTMODE_IMAGE_NUM - get_image_idx;
+        	if ( batch_num > AUTOTEST_BATCH ) {
+        		batch_num = AUTOTEST_BATCH;
+        	}
+        	for (batch_idx = 0; batch_idx < batch_num; batch_idx++) {
+        		batch_images[batch_idx] = (unsigned int*)TEST_IMAGE_X(get_image_idx + batch_idx);
+        	}
+
+        	MAIN_LOG0(core, "\n---------------------------------------\n");
+        	MAIN_LOG3(core, "\nGet next images: %llu - %llu from CPU: %llu\n", get_image_idx, get_image_idx + batch_num - 1, core);
+        	pmu_reset();
+        	pmu_start();
+        	mnist_cnn_eval_batch(batch_images, batch_num, core, batch_results);
+        	pmu_stop();
+        	for (batch_idx = 0; batch_idx < batch_num; batch_idx++) {
+        		image_result = *TEST_IMAGE_RES(get_image_idx + batch_idx);
+        		main_log_result(core, image_result, &batch_results[batch_idx]);
+        	}
+            MAIN_LOG2(core, "\t\tCycle count is %llu (%llu images)\n", pmu_cycle_counter_get_count(), batch_num);
+        	if (core == 0) {
+        		MAIN_LOG_DRAIN();
+        	}
+
+      	}
+    }
+#else
     else {
 
     	while(1) {
@@ -210,33 +487,24 @@ __attribute__((noreturn)) void MainApp(void)
         		break;
         	}
 
-        	inference_1 = 0;
             image_result = *TEST_IMAGE_RES(get_image_idx);
-        	_mutex_acquire(&print_lock);
-        	printf("\n---------------------------------------\n");
-        	printf("\nGet next image: %d\n", get_image_idx);
-        	printf("Inf image[%d] from CPU: %lu\n", image_result, core);
-        	_mutex_release(&print_lock);
+        	MAIN_LOG0(core, "\n---------------------------------------\n");
+        	MAIN_LOG1(core, "\nGet next image: %llu\n", get_image_idx);
+        	MAIN_LOG2(core, "Inf image[%llu] from CPU: %llu\n", image_result, core);
         	pmu_reset();
         	pmu_start();
         	mnist_cnn_eval((unsigned int*)TEST_IMAGE_X(get_image_idx), core, &inference_1);
         	pmu_stop();
-        	_mutex_acquire(&print_lock);
-        	printf("\timage[%d] from CPU: %lu, result: %d, \t\t", image_result, core, inference_1);
-        	if (image_result != inference_1) {
-        		printf("[Fail !!!]\n");
+        	main_log_result(core, image_result, &inference_1);
+            MAIN_LOG1(core, "\t\tCycle count is %llu\n", pmu_cycle_counter_get_count());
+        	if (core == 0) {
+        		MAIN_LOG_DRAIN();
         	}
-        	else {
-        		printf("[Pass]\n");
-        	}
-            printf("\t\tCycle count is %llu\n", pmu_cycle_counter_get_count());
-        	_mutex_release(&print_lock);
 
       	}
     }
-	_mutex_acquire(&print_lock);
-	printf("\n\n[CPU: %lu] End of MNIST CNN Evaluation\n\n", core);
-	_mutex_release(&print_lock);
+#endif
+	MAIN_LOG1(core, "\n\n[CPU: %llu] End of MNIST CNN Evaluation\n\n", core);
 
 
 #else
@@ -257,11 +525,9 @@ __attribute__((noreturn)) void MainApp(void)
 
 #endif
 
-    _mutex_acquire(&print_lock);
-    printf("CPU %lu: finished\n", core);
-    _mutex_release(&print_lock);
+    MAIN_LOG1(core, "CPU %llu: finished\n", core);
 
-    if (__atomic_add_fetch(&cpu_finished_count, 1, __ATOMIC_RELAXED) < cpu_active_count)
+    if (__atomic_add_fetch(&cpu_finished_count, 1, __ATOMIC_ACQ_REL) < cpu_active_count)
     {
       /*
        * CPUs that finish early wait for termination
@@ -272,8 +538,16 @@ __attribute__((noreturn)) void MainApp(void)
     else
     {
       /*
-       * The last CPU to finish terminates the program
+       * The last CPU to finish terminates the program, once every
+       * core's log is out
        */
+#ifdef CNN_LOG
+      while (cnn_log_drain(&main_log, 0, 0)) {
+      }
+#endif
+#ifdef CNN_TRACE
+      main_trace_write();
+#endif
       printf("All CPUs finished\n");
       exit(0);
     }
@@ -294,6 +568,12 @@ __attribute__((noreturn)) void MainApp(void)
 int main(void)
 {
     _mutex_initialize(&print_lock);
+#ifdef CNN_LOG
+    cnn_log_init(&main_log);
+#endif
+#ifdef CNN_TRACE
+    cnn_trace_init(MAIN_TRACE);
+#endif
 
     printf("\r\nDS-5 PMUv3 Example, based on ARMv8-A SMP Prime Number Generator Example\r\n\r\n");
 
@@ -7,36 +7,161 @@
 */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "arm_cnn_inference.h"
 #include "mnist.h"
 #include "cnn_api_c.h"
+#include "cnn_graph.h"
+#include "cnn_sched.h"
+#include "cnn_prof.h"
+#include "cnn_trace.h"
+#include "cnn_model.h"
+#include "mnist_aot.h"
+
+// Where mnist_tensor() finds each parameter: by name, dtype and element
+// count in a model container, or at its offset in the raw blobs
+typedef struct {
+    const char *name;
+    unsigned int dtype;
+    unsigned int count;
+    unsigned long blob;     // MNIST_PARAMETER_BASE or MNIST_PARAMETER_INT8_BASE
+    unsigned long offset;
+} mnist_tensor_desc;
+
+static const mnist_tensor_desc mnist_tensors[MNIST_TENSOR_NUM] = {
+    { "keras_lay[0].biases",        CNN_DTYPE_F32, 16,          MNIST_PARAMETER_BASE,       0x0 },
+    { "keras_lay[0].weights",       CNN_DTYPE_F32, 5 * 5 * 16,  MNIST_PARAMETER_BASE,       0x40 },
+    { "keras_lay[2].biases",        CNN_DTYPE_F32, 32,          MNIST_PARAMETER_BASE,       0x680 },
+    { "keras_lay[2].weights",       CNN_DTYPE_F32, 5 * 5 * 16 * 32, MNIST_PARAMETER_BASE,   0x700 },
+    { "keras_lay[6].biases",        CNN_DTYPE_F32, 128,         MNIST_PARAMETER_BASE,       0xcf00 },
+    { "keras_lay[6].weights",       CNN_DTYPE_F32, 512 * 128,   MNIST_PARAMETER_BASE,       0xd100 },
+    { "keras_lay[8].biases",        CNN_DTYPE_F32, 10,          MNIST_PARAMETER_BASE,       0x4d100 },
+    { "keras_lay[8].weights",       CNN_DTYPE_F32, 128 * 10,    MNIST_PARAMETER_BASE,       0x4d128 },
+    // K and N padded to multiples of 4
+    { "keras_lay[0].int8_biases",   CNN_DTYPE_F32, 16,          MNIST_PARAMETER_INT8_BASE,  0x0 },
+    { "keras_lay[0].int8_scales",   CNN_DTYPE_F32, 16,          MNIST_PARAMETER_INT8_BASE,  0x40 },
+    { "keras_lay[0].int8_weights",  CNN_DTYPE_I8,  16 * 28,     MNIST_PARAMETER_INT8_BASE,  0x80 },
+    { "keras_lay[2].int8_biases",   CNN_DTYPE_F32, 32,          MNIST_PARAMETER_INT8_BASE,  0x240 },
+    { "keras_lay[2].int8_scales",   CNN_DTYPE_F32, 32,          MNIST_PARAMETER_INT8_BASE,  0x2c0 },
+    { "keras_lay[2].int8_weights",  CNN_DTYPE_I8,  32 * 400,    MNIST_PARAMETER_INT8_BASE,  0x340 },
+    { "keras_lay[6].int8_biases",   CNN_DTYPE_F32, 128,         MNIST_PARAMETER_INT8_BASE,  0x3540 },
+    { "keras_lay[6].int8_scales",   CNN_DTYPE_F32, 128,         MNIST_PARAMETER_INT8_BASE,  0x3740 },
+    { "keras_lay[6].int8_weights",  CNN_DTYPE_I8,  128 * 512,   MNIST_PARAMETER_INT8_BASE,  0x3940 },
+    { "keras_lay[8].int8_biases",   CNN_DTYPE_F32, 12,          MNIST_PARAMETER_INT8_BASE,  0x13940 },
+    { "keras_lay[8].int8_scales",   CNN_DTYPE_F32, 12,          MNIST_PARAMETER_INT8_BASE,  0x13970 },
+    { "keras_lay[8].int8_weights",  CNN_DTYPE_I8,  12 * 128,    MNIST_PARAMETER_INT8_BASE,  0x139a0 },
+};
+
+#ifdef CNN_MODEL
+// The container given to mnist_cnn_model(), model.graph 0 if none
+static cnn_model mnist_model;
+static unsigned long mnist_model_tensors[MNIST_TENSOR_NUM];
+#endif
+
+unsigned long mnist_tensor(unsigned int id)
+{
+#ifdef CNN_MODEL
+    if (mnist_model.graph) {
+        return mnist_model_tensors[id];
+    }
+#endif
+    return MNIST_EVAL_BASE + mnist_tensors[id].blob + mnist_tensors[id].offset;
+}
+
+// The blobs the graph's fp32 and INT8 parameter offsets are relative to:
+// both are the container itself
+static unsigned long mnist_params(void)
+{
+#ifdef CNN_MODEL
+    if (mnist_model.graph) {
+        return mnist_model.base;
+    }
+#endif
+    return MNIST_EVAL_BASE + MNIST_PARAMETER_BASE;
+}
+
+static unsigned long mnist_int8_params(void)
+{
+#ifdef CNN_MODEL
+    if (mnist_model.graph) {
+        return mnist_model.base;
+    }
+#endif
+    return MNIST_EVAL_BASE + MNIST_PARAMETER_INT8_BASE;
+}
+
+#ifdef CNN_MODEL
+// Nothing is copied: the container stays where it was loaded or mapped,
+// and every parameter is checked against its name, dtype and size here,
+// once, instead of trusting fixed offsets on every use
+int mnist_cnn_model(const void *blob, unsigned long size)
+{
+    const void *data;
+    unsigned int id;
+    int err;
+
+    err = cnn_model_open(&mnist_model, blob, size);
+    for (id = 0; !err && id < MNIST_TENSOR_NUM; id++) {
+        data = cnn_model_data(&mnist_model, mnist_tensors[id].name, mnist_tensors[id].dtype, mnist_tensors[id].count);
+        if (!data) {
+            err = CNN_MODEL_E_TENSOR;
+        }
+        mnist_model_tensors[id] = (unsigned long)data;
+    }
+    if (err) {
+        memset(&mnist_model, 0, sizeof(mnist_model));
+    }
+
+    return err;
+}
+#endif
 
-int mnist_cnn_eval(
-    unsigned int *test_images,    // test_images[IMAGE_ROWS][IMAGE_COLUMNS]
-	unsigned long idx,
-    unsigned int *result
-) {
-    static layer_structure lay;
 #ifdef CNN_CONV_1
-    unsigned int conv_mode;
+#define MNIST_CONV_MODES    10      // conv modes #1 .. #9, any other runs #2
 
-//    unsigned int workspace_inout = MNIST_TEST_BASE + MNIST_WORKSPACE_BASE + 0x18000 * idx;
-    unsigned int workspace_inout = WORK_IMAGE_X(idx);
-    unsigned int workspace_layer1 = workspace_inout + 0x1000;
-    unsigned int workspace_layer2 = workspace_inout + 0xB000;
-    unsigned int workspace_layer3 = workspace_inout + 0xE000;
-    unsigned int workspace_layer4 = workspace_inout + 0x10000;
-    unsigned int workspace_layer5 = workspace_inout + 0x11000;
-    unsigned int workspace_output = workspace_inout + 0x11300;
+static unsigned int mnist_conv_mode(void)
+{
+    unsigned int conv_mode;
 
 	conv_mode = *CONVMODE;
-	if (!conv_mode) {
+	if (!conv_mode || conv_mode >= MNIST_CONV_MODES) {
 		conv_mode = 2;  // default mode
 	}
 
+    return conv_mode;
+}
+
+static unsigned int mnist_image_format(void)
+{
+    return (*IMAGEFORMAT == CNN_PIXEL_U8) ? CNN_PIXEL_U8 : CNN_PIXEL_U32;
+}
+
+#ifdef CNN_GRAPH
+// The graph whose weights mnist_cnn_load() packed, or NULL
+static const cnn_graph *mnist_packed_graph;
+// The graph mnist_cnn_plan() planned, or NULL, and its workspace plan
+// for each conv mode (mnist_plans[conv_mode], [0] unused)
+static const cnn_graph *mnist_planned_graph;
+static cnn_graph_plan mnist_plans[MNIST_CONV_MODES];
+#else
+// Without CNN_GRAPH the network is hand-coded, each core in its
+// WORK_IMAGE_X() workspace: pre-proc .. keras_lay[3] into features[512]
+static void mnist_cnn_features(
+    unsigned int *test_images,    // test_images[IMAGE_ROWS][IMAGE_COLUMNS]
+    unsigned long workspace_inout,
+    float *features,
+    unsigned int conv_mode
+) {
+    layer_structure lay;
+    unsigned long workspace_layer1 = workspace_inout + 0x1000;
+    unsigned long workspace_layer2 = workspace_inout + 0xB000;
+    unsigned long workspace_layer3 = workspace_inout + 0xE000;
+    unsigned long workspace_scratch = workspace_inout + 0x12000;    // conv scratch (0x4000)
+
     mnist_pre_proc(
         test_images,
-	    (float*)workspace_inout
+        mnist_image_format(),
+        (float*)workspace_inout
     );
 
     // keras_lay[0]
@@ -49,53 +174,49 @@ int mnist_cnn_eval(
     lay.output_rows = 24;
     lay.output_columns = 24;
     lay.relu_activation = 1;    // Activation:ReLU
-#ifdef CNN_CONV_2
-    if (conv_mode == 2) {
-    	convolution_conv2(
-    			&lay,
-				(float*)workspace_inout,
-				(float*)workspace_layer1,
-				(float*)KERASLAYER0_WEIGHTS,
-				(float*)KERASLAYER0_BIASES
-    	);
-    } else
-#endif
-#ifdef CNN_CONV_3
-    if (conv_mode == 3) {
-    	convolution_conv3(
-    			&lay,
-				(float*)workspace_inout,
-				(float*)workspace_layer1,
-				(float*)KERASLAYER0_WEIGHTS,
-				(float*)KERASLAYER0_BIASES
-    	);
+#ifdef CNN_FUSED
+    if (conv_mode == 6) {
+        // + keras_lay[1]
+        CONVOLUTION_POOL(
+            &lay,
+            (float*)workspace_inout,
+            (float*)workspace_layer2,
+            (float*)KERASLAYER0_WEIGHTS,
+            (float*)KERASLAYER0_BIASES
+        );
     } else
 #endif
     {
-    	convolution(
-    			&lay,
-				(float*)workspace_inout,
-				(float*)workspace_layer1,
-				(float*)KERASLAYER0_WEIGHTS,
-				(float*)KERASLAYER0_BIASES
-    	);
-    }
+        cnn_convolution(
+            &lay,
+            (float*)workspace_inout,
+            (float*)workspace_layer1,
+            KERASLAYER0_WEIGHTS,
+            KERASLAYER0_BIASES,
+            KERASLAYER0_INT8_WEIGHTS,
+            KERASLAYER0_INT8_SCALES,
+            KERASLAYER0_INT8_BIASES,
+            0,
+            workspace_scratch,
+            conv_mode
+        );
 
-    // keras_lay[1]
-    lay.input_channel = 16;
-    lay.input_rows = 24;
-    lay.input_columns = 24;
-    lay.filter_rows = 2;
-    lay.filter_columns = 2;
-    lay.output_channel = 16;
-    lay.output_rows = 12;
-    lay.output_columns = 12;
-    lay.relu_activation = 0;
-    max_pooling(
-        &lay,
-        (float*)workspace_layer1,
-        (float*)workspace_layer2
-    );
+        // keras_lay[1]
+        lay.input_channel = 16;
+        lay.input_rows = 24;
+        lay.input_columns = 24;
+        lay.filter_rows = 2;
+        lay.filter_columns = 2;
+        lay.output_channel = 16;
+        lay.output_rows = 12;
+        lay.output_columns = 12;
+        lay.relu_activation = 0;
+        MAX_POOLING(
+            &lay,
+            (float*)workspace_layer1,
+            (float*)workspace_layer2
+        );
+    }
 
     // keras_lay[2]
     lay.input_channel = 16;
@@ -107,37 +228,32 @@ int mnist_cnn_eval(
     lay.output_rows = 8;
     lay.output_columns = 8;
     lay.relu_activation = 1;    // Activation:ReLU
-#ifdef CNN_CONV_2
-    if (conv_mode == 2) {
-    	convolution_conv2(
-    			&lay,
-				(float*)workspace_layer2,
-				(float*)workspace_layer3,
-				(float*)KERASLAYER2_WEIGHTS,
-				(float*)KERASLAYER2_BIASES
-    	);
-    } else
-#endif
-#ifdef CNN_CONV_3
-    if (conv_mode == 3) {
-    	convolution_conv3(
-    			&lay,
-				(float*)workspace_layer2,
-				(float*)workspace_layer3,
-				(float*)KERASLAYER2_WEIGHTS,
-				(float*)KERASLAYER2_BIASES
-    	);
-    } else
-#endif
-    {
-    	convolution(
-    			&lay,
-				(float*)workspace_layer2,
-				(float*)workspace_layer3,
-				(float*)KERASLAYER2_WEIGHTS,
-				(float*)KERASLAYER2_BIASES
-    	);
+#ifdef CNN_FUSED
+    if (conv_mode == 6) {
+        // + keras_lay[3]
+        CONVOLUTION_POOL(
+            &lay,
+            (float*)workspace_layer2,
+            features,
+            (float*)KERASLAYER2_WEIGHTS,
+            (float*)KERASLAYER2_BIASES
+        );
+        return;
     }
+#endif
+    cnn_convolution(
+        &lay,
+        (float*)workspace_layer2,
+        (float*)workspace_layer3,
+        KERASLAYER2_WEIGHTS,
+        KERASLAYER2_BIASES,
+        KERASLAYER2_INT8_WEIGHTS,
+        KERASLAYER2_INT8_SCALES,
+        KERASLAYER2_INT8_BIASES,
+        0,
+        workspace_scratch,
+        conv_mode
+    );
 
     // keras_lay[3]
     lay.input_channel = 32;
@@ -149,11 +265,22 @@ int mnist_cnn_eval(
     lay.output_rows = 4;
     lay.output_columns = 4;
     lay.relu_activation = 0;
-    max_pooling(
+    MAX_POOLING(
         &lay,
         (float*)workspace_layer3,
-        (float*)workspace_layer4
+        features
     );
+}
+
+// keras_lay[4] .. keras_lay[8]: features[512] into scores[10]
+static void mnist_cnn_classifier(
+    float *features,
+    float *hidden,                // hidden[128]
+    float *scores,
+    unsigned long workspace_scratch,
+    unsigned int conv_mode
+) {
+    layer_structure lay;
 
     // keras_lay[4]
 
@@ -169,13 +296,28 @@ int mnist_cnn_eval(
     lay.output_rows = 0;
     lay.output_columns = 0;
     lay.relu_activation = 1;    // Activation:ReLU
-    fully_connected(
-        &lay,
-        (float*)workspace_layer4,
-        (float*)workspace_layer5,
-        (float*)KERASLAYER6_WEIGHTS,
-        (float*)KERASLAYER6_BIASES
-    );
+#ifdef CNN_CONV_5
+    if (conv_mode == 5) {
+        fully_connected_int8(
+            &lay,
+            features,
+            hidden,
+            (signed char*)KERASLAYER6_INT8_WEIGHTS,
+            (float*)KERASLAYER6_INT8_SCALES,
+            (float*)KERASLAYER6_INT8_BIASES,
+            (signed char*)workspace_scratch
+        );
+    } else
+#endif
+    {
+        FULLY_CONNECTED(
+            &lay,
+            features,
+            hidden,
+            (float*)KERASLAYER6_WEIGHTS,
+            (float*)KERASLAYER6_BIASES
+        );
+    }
 
     // keras_lay[7]
 
@@ -189,17 +331,711 @@ int mnist_cnn_eval(
     lay.output_rows = 0;
     lay.output_columns = 0;
     lay.relu_activation = 0;
-    fully_connected(
-        &lay,
+#ifdef CNN_CONV_5
+    if (conv_mode == 5) {
+        fully_connected_int8(
+            &lay,
+            hidden,
+            scores,
+            (signed char*)KERASLAYER8_INT8_WEIGHTS,
+            (float*)KERASLAYER8_INT8_SCALES,
+            (float*)KERASLAYER8_INT8_BIASES,
+            (signed char*)workspace_scratch
+        );
+    } else
+#endif
+    {
+        FULLY_CONNECTED(
+            &lay,
+            hidden,
+            scores,
+            (float*)KERASLAYER8_WEIGHTS,
+            (float*)KERASLAYER8_BIASES
+        );
+    }
+}
+#endif
+#endif
+
+#if defined(CNN_CONV_1) && defined(CNN_GRAPH)
+// keras_lay[0] .. keras_lay[8] as a graph, run when no description has
+// been loaded at MNIST_GRAPH_BASE; offsets as in mnist.h and
+// mnist_cnn_quantize.py
+static const cnn_graph mnist_cnn_graph = {
+    CNN_GRAPH_MAGIC, CNN_GRAPH_VERSION, 7, MNIST_CLASSES,
+    {
+        // type, relu, input c/r/c, filter r/c, output c/r/c, weights, biases, INT8 weights/scales/biases
+        { CNN_LAYER_INPUT,   0,   1, 28, 28, 0, 0,   1, 28, 28, 0x0,     0x0,     CNN_GRAPH_NONE, CNN_GRAPH_NONE, CNN_GRAPH_NONE, 0 },
+        { CNN_LAYER_CONV,    1,   1, 28, 28, 5, 5,  16, 24, 24, 0x40,    0x0,     0x80,           0x40,           0x0,            0 },   // keras_lay[0]
+        { CNN_LAYER_MAXPOOL, 0,  16, 24, 24, 2, 2,  16, 12, 12, 0x0,     0x0,     CNN_GRAPH_NONE, CNN_GRAPH_NONE, CNN_GRAPH_NONE, 0 },   // keras_lay[1]
+        { CNN_LAYER_CONV,    1,  16, 12, 12, 5, 5,  32,  8,  8, 0x700,   0x680,   0x340,          0x2c0,          0x240,          0 },   // keras_lay[2]
+        { CNN_LAYER_MAXPOOL, 0,  32,  8,  8, 2, 2,  32,  4,  4, 0x0,     0x0,     CNN_GRAPH_NONE, CNN_GRAPH_NONE, CNN_GRAPH_NONE, 0 },   // keras_lay[3]
+        { CNN_LAYER_FC,      1, 512,  0,  0, 0, 0, 128,  0,  0, 0xd100,  0xcf00,  0x3940,         0x3740,         0x3540,         0 },   // keras_lay[6]
+        { CNN_LAYER_FC,      0, 128,  0,  0, 0, 0,  10,  0,  0, 0x4d128, 0x4d100, 0x139a0,        0x13970,        0x13940,        0 },   // keras_lay[8]
+    }
+};
+
+static const cnn_graph *mnist_graph(void)
+{
+    const cnn_graph *graph = (const cnn_graph*)(MNIST_EVAL_BASE + MNIST_GRAPH_BASE);
+
+#ifdef CNN_MODEL
+    if (mnist_model.graph) {
+        return mnist_model.graph;
+    }
+#endif
+    if (graph->magic == CNN_GRAPH_MAGIC) {
+        return graph;
+    }
+
+    return &mnist_cnn_graph;
+}
+
+const cnn_graph *mnist_cnn_network(void)
+{
+    return mnist_graph();
+}
+
+// mnist_cnn_eval() workspaces are packed one per core at the planned
+// size, instead of 0x18000 each: activations, then the scores. Conv
+// scratch is the core's WORK_SCRATCH_X().
+static unsigned long mnist_graph_workspace_size(const cnn_graph *graph, const cnn_graph_plan *plan)
+{
+    return (plan->peak + (graph->classes * sizeof(float)) + 0xFFF) & ~0xFFFUL;
+}
+
+// The plan mnist_cnn_plan() made for graph in the current conv mode and
+// core idx's workspace; no planning per image
+static int mnist_graph_layout(
+    unsigned long idx,
+    const cnn_graph *graph,
+    const cnn_graph_plan **plan,
+    unsigned long *workspace
+) {
+    unsigned long size;
+    unsigned int conv_mode = mnist_conv_mode();
+
+    if (conv_mode == 8 && mnist_packed_graph != graph) {
+        conv_mode = 1;  // the fp16 parameters come from mnist_cnn_load()
+    }
+    if (mnist_planned_graph != graph) {
+        return -1;      // not planned, or the graph changed since
+    }
+    *plan = &mnist_plans[conv_mode];
+    size = mnist_graph_workspace_size(graph, *plan);
+    if ((idx + 1) * size > MNIST_WORKSPACE_SIZE) {
+        return -1;
+    }
+    *workspace = MNIST_EVAL_BASE + MNIST_WORKSPACE_BASE + (idx * size);
+
+    return 0;
+}
+
+// The weights mnist_cnn_load() packed for graph, 0 if none
+static unsigned long mnist_packed(const cnn_graph *graph)
+{
+    return (mnist_packed_graph == graph) ? MNIST_EVAL_BASE + MNIST_PARAMETER_PACKED_BASE : 0;
+}
+
+unsigned long mnist_cnn_workspace_size(void)
+{
+    const cnn_graph_plan *plan;
+    unsigned long workspace;
+
+    if (mnist_graph_layout(0, mnist_graph(), &plan, &workspace)) {
+        return 0;
+    }
+
+    return mnist_graph_workspace_size(mnist_graph(), plan);
+}
+
+int mnist_cnn_plan(void)
+{
+    const cnn_graph *graph = mnist_graph();
+    unsigned int conv_mode;
+
+    mnist_planned_graph = NULL;
+    for (conv_mode = 1; conv_mode < MNIST_CONV_MODES; conv_mode++) {
+        if (cnn_graph_plan_memory(graph, &mnist_plans[conv_mode], conv_mode)) {
+            return -1;
+        }
+    }
+    mnist_planned_graph = graph;
+
+    return 0;
+}
+
+// Repack the FC weights of the current graph into fully_connected_pack()
+// panels, transform the conv weights for mode #7, convert all of the
+// parameters to fp16 for mode #8 and fold the 1/255 of pre-processing
+// into the keras_lay[0] weights. Call once the parameters and graph are
+// loaded, before any core evaluates; without it every FC reads the
+// [K][N] weights, modes #7 and #8 run as mode #1 and conv1 scales the
+// pixels itself.
+int mnist_cnn_load(void)
+{
+    const cnn_graph *graph = mnist_graph();
+
+    mnist_packed_graph = NULL;
+    if (mnist_cnn_plan() || mnist_plans[2].packed_size > MNIST_PARAMETER_PACKED_SIZE) {
+        return -1;
+    }
+    cnn_graph_pack_weights(graph, &mnist_plans[2], mnist_params(), MNIST_EVAL_BASE + MNIST_PARAMETER_PACKED_BASE);
+    mnist_packed_graph = graph;
+
+    return 0;
+}
+
+float *mnist_cnn_eval_scores(unsigned long idx)
+{
+    const cnn_graph_plan *plan;
+    unsigned long workspace;
+
+    if (mnist_graph_layout(idx, mnist_graph(), &plan, &workspace)) {
+        return NULL;
+    }
+
+    return (float*)(workspace + plan->peak);
+}
+
+#ifdef CNN_PROF
+static cnn_prof *mnist_prof;
+
+void mnist_cnn_profile(cnn_prof *prof)
+{
+    mnist_prof = prof;
+}
+#endif
+#endif
+
+#ifdef CNN_TRACE
+static cnn_trace *mnist_trace;
+
+void mnist_cnn_trace(cnn_trace *trace)
+{
+    mnist_trace = trace;
+}
+#endif
+
+#if defined(CNN_AOT) && defined(CNN_CONV_1) && defined(CNN_GRAPH)
+// Conv mode #9: the whole network is mnist_aot_eval(), generated from the
+// model at build time; it only takes the workspace and the score slot of
+// the graph's layout, so the results land where mnist_cnn_eval_scores()
+// looks for them. It profiles as a single layer.
+static int mnist_cnn_eval_aot(
+    unsigned int *test_images,
+    unsigned long idx,
+    cnn_result *result
+) {
+    const cnn_graph *graph = mnist_graph();
+    const cnn_graph_plan *plan;
+    unsigned long workspace_inout;
+    unsigned long workspace_output;
+    cnn_trace_buf *trace = 0;
+
+    if (mnist_graph_layout(idx, graph, &plan, &workspace_inout) ||
+        mnist_aot_workspace_size() > plan->peak || mnist_aot_classes() != graph->classes) {
+        printf("Error: the compiled model does not fit the network graph\n");
+        return -1;
+    }
+    workspace_output = workspace_inout + plan->peak;
+#ifdef CNN_TRACE
+    trace = cnn_trace_cpu(mnist_trace, idx);
+    cnn_trace_begin(trace, "mnist_cnn_eval");
+    cnn_trace_begin(trace, "mnist_aot");
+#endif
+#ifdef CNN_PROF
+    if (mnist_prof) {
+        cnn_prof_run_begin(mnist_prof);
+        cnn_prof_layer_begin(mnist_prof, 0, "mnist_aot", mnist_aot_macs());
+    }
+#endif
+
+    mnist_aot_eval(test_images, mnist_image_format(), (float*)workspace_inout, (float*)workspace_output);
+
+#ifdef CNN_TRACE
+    cnn_trace_end(trace);       // mnist_aot
+    cnn_trace_begin(trace, "post-proc");
+#endif
+#ifdef CNN_PROF
+    if (mnist_prof) {
+        cnn_prof_layer_end(mnist_prof);
+        cnn_prof_layer_begin(mnist_prof, 1, "post-proc", 0);
+        post_proc((float*)workspace_output, graph->classes, result);
+        cnn_prof_layer_end(mnist_prof);
+        cnn_prof_run_end(mnist_prof);
+    }
+    else
+#endif
+    post_proc((float*)workspace_output, graph->classes, result);
+    result->conv_mode = MNIST_AOT_CONV_MODE;
+#ifdef CNN_TRACE
+    cnn_trace_end(trace);       // post-proc
+    cnn_trace_end(trace);       // mnist_cnn_eval
+#endif
+
+    return 0;
+}
+#endif
+
+int mnist_cnn_eval(
+    unsigned int *test_images,    // test_images[IMAGE_ROWS][IMAGE_COLUMNS]
+	unsigned long idx,
+    cnn_result *result
+) {
+#if defined(CNN_CONV_1) && defined(CNN_GRAPH)
+    const cnn_graph *graph = mnist_graph();
+    const cnn_graph_plan *plan;
+    unsigned long workspace_inout;
+    unsigned long workspace_output;
+    cnn_trace_buf *trace = 0;
+
+#ifdef CNN_AOT
+    if (mnist_conv_mode() == MNIST_AOT_CONV_MODE) {
+        return mnist_cnn_eval_aot(test_images, idx, result);
+    }
+#endif
+    if (mnist_graph_layout(idx, graph, &plan, &workspace_inout)) {
+        printf("Error: invalid network graph\n");
+        return -1;
+    }
+    workspace_output = workspace_inout + plan->peak;
+#ifdef CNN_TRACE
+    trace = cnn_trace_cpu(mnist_trace, idx);
+    cnn_trace_begin(trace, "mnist_cnn_eval");
+#endif
+#ifdef CNN_PROF
+    if (mnist_prof) {
+        cnn_prof_run_begin(mnist_prof);
+    }
+#endif
+
+    cnn_graph_eval(
+        graph,
+        plan,
+        mnist_params(),
+        mnist_int8_params(),
+        mnist_packed(graph),
+        test_images,
+        mnist_image_format(),
+        workspace_inout,
+        WORK_SCRATCH_X(idx),
+        (float*)workspace_output,
+#ifdef CNN_PROF
+        mnist_prof,
+#else
+        0,
+#endif
+        trace
+    );
+
+#ifdef CNN_TRACE
+    cnn_trace_begin(trace, "post-proc");
+#endif
+#ifdef CNN_PROF
+    if (mnist_prof) {
+        cnn_prof_layer_begin(mnist_prof, graph->layer_num, "post-proc", 0);
+        post_proc((float*)workspace_output, graph->classes, result);
+        cnn_prof_layer_end(mnist_prof);
+        cnn_prof_run_end(mnist_prof);
+    }
+    else
+#endif
+    post_proc((float*)workspace_output, graph->classes, result);
+    result->conv_mode = plan->conv_mode;
+#ifdef CNN_TRACE
+    cnn_trace_end(trace);       // post-proc
+    cnn_trace_end(trace);       // mnist_cnn_eval
+#endif
+#elif defined(CNN_CONV_1)
+    unsigned int conv_mode;
+
+//    unsigned int workspace_inout = MNIST_TEST_BASE + MNIST_WORKSPACE_BASE + 0x18000 * idx;
+    unsigned long workspace_inout = WORK_IMAGE_X(idx);
+    unsigned long workspace_layer4 = workspace_inout + 0x10000;
+    unsigned long workspace_layer5 = workspace_inout + 0x11000;
+    unsigned long workspace_output = workspace_inout + MNIST_WORKSPACE_OUTPUT_OFFSET;
+    unsigned long workspace_scratch = workspace_inout + 0x12000;    // conv scratch (0x4000)
+
+    conv_mode = mnist_conv_mode();
+
+    mnist_cnn_features(test_images, workspace_inout, (float*)workspace_layer4, conv_mode);
+    mnist_cnn_classifier(
+        (float*)workspace_layer4,
         (float*)workspace_layer5,
         (float*)workspace_output,
-        (float*)KERASLAYER8_WEIGHTS,
-        (float*)KERASLAYER8_BIASES
+        workspace_scratch,
+        conv_mode
     );
 
-    *result = post_proc((float*)workspace_output, lay.output_channel);
-	printf("Conv_mode: %d", conv_mode);
+    post_proc((float*)workspace_output, MNIST_CLASSES, result);
+    result->conv_mode = conv_mode;
 #endif
 
     return 0;
 }
+
+#if defined(CNN_BATCH) && defined(CNN_GRAPH)
+// The FC layers that end the graph run as matrix-matrix products over
+// a pass of images, in two buffers of WORK_BATCH_X(idx) that take
+// turns: the features (the input of the first of them), then each FC
+// layer's outputs. Returns the first of those layers, layer_num if the
+// graph does not end in one, and the images per pass (0 if not even
+// one image fits).
+static unsigned int mnist_batch_layout(
+    const cnn_graph *graph,
+    unsigned long idx,
+    float **buffer,                 // buffer[2]
+    unsigned int *pass
+) {
+    unsigned int first = graph->layer_num;
+    unsigned long width = graph->classes;
+    unsigned long images;
+
+    while (first > 1 && graph->layer[first - 1].type == CNN_LAYER_FC) {
+        first--;
+        if (width < graph->layer[first].input_channel) {
+            width = graph->layer[first].input_channel;
+        }
+        if (width < graph->layer[first].output_channel) {
+            width = graph->layer[first].output_channel;
+        }
+    }
+    images = MNIST_BATCH_SIZE / (2 * width * sizeof(float));
+    *pass = (images < MNIST_BATCH_MAX) ? (unsigned int)images : MNIST_BATCH_MAX;
+    buffer[0] = (float*)WORK_BATCH_X(idx);
+    buffer[1] = buffer[0] + (*pass * width);
+
+    return first;
+}
+
+float *mnist_cnn_eval_batch_scores(unsigned long idx)
+{
+    const cnn_graph *graph = mnist_graph();
+    float *buffer[2];
+    unsigned int pass;
+    unsigned int first = mnist_batch_layout(graph, idx, buffer, &pass);
+
+    return buffer[(graph->layer_num - first) % 2];
+}
+
+int mnist_cnn_eval_batch(
+    unsigned int *test_images[],  // test_images[batch] -> [IMAGE_ROWS][IMAGE_COLUMNS]
+    unsigned int batch,
+	unsigned long idx,
+    cnn_result *results           // results[batch]
+) {
+    const cnn_graph *graph = mnist_graph();
+    const cnn_graph_plan *plan;
+    unsigned long workspace_inout;
+    unsigned long packed = mnist_packed(graph);
+    float *buffer[2];
+    float *features;
+    float *scores;
+    unsigned int pass, first, batched;
+    unsigned int b, chunk, done;
+    unsigned int i, last;
+
+    first = mnist_batch_layout(graph, idx, buffer, &pass);
+    if (mnist_graph_layout(idx, graph, &plan, &workspace_inout) || !pass) {
+        printf("Error: invalid network graph\n");
+        return -1;
+    }
+    features = buffer[0];
+    scores = buffer[(graph->layer_num - first) % 2];
+    // INT8 and fp16 FC kernels take one image, and conv mode #9 is a
+    // single compiled function: those run image by image
+    batched = first < graph->layer_num && plan->conv_mode != 5 && plan->conv_mode != 8;
+#ifdef CNN_AOT
+    batched = batched && mnist_conv_mode() != MNIST_AOT_CONV_MODE;
+#endif
+
+    for (done = 0; done < batch; done += chunk) {
+        chunk = (batch - done < pass) ? (batch - done) : pass;
+
+        // conv weights stay cache resident, so the layers before the
+        // FC ones run image by image in this core's workspace
+        for (b = 0; b < chunk; b++) {
+            if (!batched) {
+                mnist_cnn_eval(test_images[done + b], idx, &results[done + b]);
+                memcpy(scores + (b * graph->classes), mnist_cnn_eval_scores(idx), graph->classes * sizeof(float));
+                continue;
+            }
+            for (i = 0; i < first; i = last + 1) {
+                last = cnn_graph_step_last(graph, plan, i);
+                cnn_graph_eval_rows(
+                    graph,
+                    plan,
+                    mnist_params(),
+                    mnist_int8_params(),
+                    packed,
+                    test_images[done + b],
+                    mnist_image_format(),
+                    workspace_inout,
+                    WORK_SCRATCH_X(idx),
+                    0,
+                    i,
+                    0,
+                    cnn_graph_step_units(graph, plan, i)
+                );
+            }
+            memcpy(features + (b * graph->layer[first].input_channel),
+                   (float*)(workspace_inout + plan->offset[first - 1]),
+                   graph->layer[first].input_channel * sizeof(float));
+        }
+        if (!batched) {
+            continue;
+        }
+
+        for (i = first; i < graph->layer_num; i++) {
+            cnn_graph_eval_batch(
+                graph,
+                plan,
+                mnist_params(),
+                packed,
+                i,
+                buffer[(i - first) % 2],
+                buffer[(i - first + 1) % 2],
+                chunk
+            );
+        }
+        for (b = 0; b < chunk; b++) {
+            post_proc(scores + (b * graph->classes), graph->classes, &results[done + b]);
+            results[done + b].conv_mode = plan->conv_mode;
+        }
+    }
+
+    return 0;
+}
+#endif
+
+#if defined(CNN_SCHED) && defined(CNN_GRAPH)
+// Output rows per scheduler tile: 6 conv1 tiles, 3 pool1, 2 conv2, 1 pool2
+#define MNIST_SCHED_TILE_ROWS   4
+
+// The steps of the graph run by mnist_cnn_sched_init()'s job, one
+// scheduler stage each; one scheduled run at a time
+static struct {
+    const cnn_graph *graph;
+    const cnn_graph_plan *plan;
+    unsigned long packed;
+    unsigned long workspace_size;
+    unsigned int step_layer[CNN_SCHED_MAX_STAGES];  // first layer of each stage
+    unsigned int step_num;
+} mnist_sched;
+
+// One scheduler task: a unit range of one step of one image. Image
+// data lives in the planned workspace of its slot, packed one after
+// the other as mnist_cnn_eval()'s are; conv scratch belongs to the core
+// running the tile. The last step is one tile and also post-procs.
+static void mnist_cnn_sched_task(void *ctx, cnn_task *task, unsigned int cpu)
+{
+    mnist_sched_job *job = (mnist_sched_job*)ctx;
+    unsigned long workspace_inout = MNIST_EVAL_BASE + MNIST_WORKSPACE_BASE + (task->slot * mnist_sched.workspace_size);
+    float *scores = (float*)(workspace_inout + mnist_sched.plan->peak);
+
+    cnn_graph_eval_rows(
+        mnist_sched.graph,
+        mnist_sched.plan,
+        mnist_params(),
+        mnist_int8_params(),
+        mnist_sched.packed,
+        job->test_images[task->image],
+        mnist_image_format(),
+        workspace_inout,
+        WORK_SCRATCH_X(cpu),
+        scores,
+        mnist_sched.step_layer[task->stage],
+        task->row_begin,
+        task->row_end
+    );
+    if (task->stage + 1 == mnist_sched.step_num) {
+        post_proc(scores, mnist_sched.graph->classes, &job->results[task->image]);
+        job->results[task->image].conv_mode = job->conv_mode;
+    }
+}
+
+// One trace span per task, on the core that ran it
+static void mnist_cnn_sched_run(void *ctx, cnn_task *task, unsigned int cpu)
+{
+#ifdef CNN_TRACE
+    cnn_trace_buf *trace = cnn_trace_cpu(mnist_trace, cpu);
+    char step[16];
+    char name[32];
+
+    if (trace) {
+        cnn_graph_step_name(mnist_sched.graph, mnist_sched.plan, mnist_sched.step_layer[task->stage], step);
+        sprintf(name, "%s i%u r%u", step, task->image, task->row_begin);
+        cnn_trace_begin(trace, name);
+    }
+    mnist_cnn_sched_task(ctx, task, cpu);
+    cnn_trace_end(trace);
+#else
+    mnist_cnn_sched_task(ctx, task, cpu);
+#endif
+}
+
+int mnist_cnn_sched_init(
+    cnn_sched *sched,
+    mnist_sched_job *job,
+    unsigned int image_num,
+    unsigned int cpu_num
+) {
+    cnn_stage stages[CNN_SCHED_MAX_STAGES];
+    const cnn_graph *graph = mnist_graph();
+    unsigned long workspace;
+    unsigned int i, last, step;
+    unsigned int slot_num = 0;
+    int err;
+
+    err = mnist_graph_layout(0, graph, &mnist_sched.plan, &workspace);
+    mnist_sched.graph = graph;
+    mnist_sched.packed = mnist_packed(graph);
+    mnist_sched.workspace_size = mnist_graph_workspace_size(graph, mnist_sched.plan);
+    job->conv_mode = mnist_sched.plan->conv_mode;
+    // as many images in flight as planned workspaces fit
+    if (!err) {
+        slot_num = MNIST_WORKSPACE_SIZE / mnist_sched.workspace_size;
+    }
+
+    // one stage per step, split in row tiles; FC steps stay whole, and
+    // so does the last, which post-procs
+    step = 0;
+    for (i = 0; !err && i < graph->layer_num; i = last + 1) {
+        if (step == CNN_SCHED_MAX_STAGES) {
+            err = -1;
+            break;
+        }
+        last = cnn_graph_step_last(graph, mnist_sched.plan, i);
+        mnist_sched.step_layer[step] = i;
+        stages[step].rows = cnn_graph_step_units(graph, mnist_sched.plan, i);
+        stages[step].tile_rows = MNIST_SCHED_TILE_ROWS;
+        if (graph->layer[i].type == CNN_LAYER_FC || last + 1 == graph->layer_num) {
+            stages[step].tile_rows = stages[step].rows;
+        }
+        step++;
+    }
+    mnist_sched.step_num = step;
+    if (err) {
+        printf("Error: invalid network graph for the scheduler\n");
+        image_num = 0;      // cnn_sched_worker() returns at once
+    }
+
+    cnn_sched_init(
+        sched,
+        stages,
+        mnist_sched.step_num,
+        image_num,
+        slot_num,
+        cpu_num,
+        mnist_cnn_sched_run,
+        job
+    );
+
+    return err;
+}
+
+// Single image split across cores: each step of the graph is forked as
+// up to MNIST_TEAM_TILES ranges of its units (rows, or FC_PANEL blocks
+// of FC outputs), and the master joins before the next step. A step of
+// one unit runs on the master alone.
+#define MNIST_TEAM_TILES        12
+
+typedef struct {
+    unsigned int *test_images;
+    const cnn_graph *graph;
+    const cnn_graph_plan *plan;
+    unsigned long packed;
+    unsigned long workspace_inout;
+    float *scores;
+    unsigned int layer;         // first layer of the step
+    unsigned int units;
+    unsigned int tile_units;
+} mnist_team_job;
+
+static void mnist_cnn_team_tile(void *ctx, unsigned int tile, unsigned int cpu)
+{
+    mnist_team_job *job = (mnist_team_job*)ctx;
+    unsigned int begin = tile * job->tile_units;
+    unsigned int end = begin + job->tile_units;
+
+    cnn_graph_eval_rows(
+        job->graph,
+        job->plan,
+        mnist_params(),
+        mnist_int8_params(),
+        job->packed,
+        job->test_images,
+        mnist_image_format(),
+        job->workspace_inout,
+        WORK_SCRATCH_X(cpu),
+        job->scores,
+        job->layer,
+        begin,
+        (end < job->units) ? end : job->units
+    );
+}
+
+// One trace span per tile, on the core that ran it
+static void mnist_cnn_team_run(void *ctx, unsigned int tile, unsigned int cpu)
+{
+#ifdef CNN_TRACE
+    mnist_team_job *job = (mnist_team_job*)ctx;
+    cnn_trace_buf *trace = cnn_trace_cpu(mnist_trace, cpu);
+    char step[16];
+    char name[32];
+
+    if (trace) {
+        cnn_graph_step_name(job->graph, job->plan, job->layer, step);
+        sprintf(name, "%s t%u", step, tile);
+        cnn_trace_begin(trace, name);
+    }
+    mnist_cnn_team_tile(ctx, tile, cpu);
+    cnn_trace_end(trace);
+#else
+    mnist_cnn_team_tile(ctx, tile, cpu);
+#endif
+}
+
+// Called by the master core only; the other cores run cnn_team_helper().
+// The image goes through the master's mnist_cnn_eval() workspace, so
+// its scores are at mnist_cnn_eval_scores(cpu).
+int mnist_cnn_eval_team(
+    unsigned int *test_images,    // test_images[IMAGE_ROWS][IMAGE_COLUMNS]
+    struct cnn_team *team,
+    unsigned long cpu,
+    cnn_result *result
+) {
+    mnist_team_job job;
+    const cnn_graph_plan *plan;
+    unsigned int tiles;
+
+    job.graph = mnist_graph();
+    if (mnist_graph_layout(cpu, job.graph, &plan, &job.workspace_inout)) {
+        printf("Error: invalid network graph\n");
+        return -1;
+    }
+    job.test_images = test_images;
+    job.plan = plan;
+    job.packed = mnist_packed(job.graph);
+    job.scores = (float*)(job.workspace_inout + plan->peak);
+
+    for (job.layer = 0; job.layer < job.graph->layer_num;
+         job.layer = cnn_graph_step_last(job.graph, plan, job.layer) + 1) {
+        job.units = cnn_graph_step_units(job.graph, plan, job.layer);
+        job.tile_units = (job.units + MNIST_TEAM_TILES - 1) / MNIST_TEAM_TILES;
+        tiles = (job.units + job.tile_units - 1) / job.tile_units;
+        if (tiles == 1) {
+            mnist_cnn_team_run(&job, 0, cpu);
+        }
+        else {
+            cnn_team_fork(team, mnist_cnn_team_run, &job, tiles, cpu);
+        }
+    }
+
+    post_proc(job.scores, job.graph->classes, result);
+    result->conv_mode = plan->conv_mode;
+
+    return 0;
+}
+#endif
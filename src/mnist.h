@@ -8,30 +8,83 @@
 #define SECURE_BUFFER			0x80100000
 #define MNIST_WORKSPACE_BASE	0x60000
 
+// Parameters of the hand-coded stages, one id per tensor. mnist_tensor()
+// is its address: the tensor of the same name in the model container
+// given to mnist_cnn_model(), else its offset in the raw fp32 or INT8
+// blob below (the table is in mnist.c).
+#define MNIST_TENSOR_L0_BIASES          0
+#define MNIST_TENSOR_L0_WEIGHTS         1
+#define MNIST_TENSOR_L2_BIASES          2
+#define MNIST_TENSOR_L2_WEIGHTS         3
+#define MNIST_TENSOR_L6_BIASES          4
+#define MNIST_TENSOR_L6_WEIGHTS         5
+#define MNIST_TENSOR_L8_BIASES          6
+#define MNIST_TENSOR_L8_WEIGHTS         7
+#define MNIST_TENSOR_L0_INT8_BIASES     8
+#define MNIST_TENSOR_L0_INT8_SCALES     9
+#define MNIST_TENSOR_L0_INT8_WEIGHTS    10
+#define MNIST_TENSOR_L2_INT8_BIASES     11
+#define MNIST_TENSOR_L2_INT8_SCALES     12
+#define MNIST_TENSOR_L2_INT8_WEIGHTS    13
+#define MNIST_TENSOR_L6_INT8_BIASES     14
+#define MNIST_TENSOR_L6_INT8_SCALES     15
+#define MNIST_TENSOR_L6_INT8_WEIGHTS    16
+#define MNIST_TENSOR_L8_INT8_BIASES     17
+#define MNIST_TENSOR_L8_INT8_SCALES     18
+#define MNIST_TENSOR_L8_INT8_WEIGHTS    19
+#define MNIST_TENSOR_NUM                20
+unsigned long mnist_tensor(unsigned int id);
+
 // keras_lay[0]
 // biases{Array[16]}, weights{Array[5][5][1][16]}
 //  biases  S:0x80100000 - S:0x80100040
 //  weights S:0x80100040 - S:0x80100680
-#define KERASLAYER0_BIASES		(MNIST_EVAL_BASE + MNIST_PARAMETER_BASE + 0x0)
-#define KERASLAYER0_WEIGHTS		(MNIST_EVAL_BASE + MNIST_PARAMETER_BASE + 0x40)
+#define KERASLAYER0_BIASES		mnist_tensor(MNIST_TENSOR_L0_BIASES)
+#define KERASLAYER0_WEIGHTS		mnist_tensor(MNIST_TENSOR_L0_WEIGHTS)
 // keras_lay[2]
 // biases{Array[32]}, weights{Array[5][5][16][32]}
 //  biases  S:0x80100680 - S:0x80100700
 //  weights S:0x80100700 - S:0x8010cf00
-#define KERASLAYER2_BIASES 		(MNIST_EVAL_BASE + MNIST_PARAMETER_BASE + 0x680)
-#define KERASLAYER2_WEIGHTS 	(MNIST_EVAL_BASE + MNIST_PARAMETER_BASE + 0x700)
+#define KERASLAYER2_BIASES 		mnist_tensor(MNIST_TENSOR_L2_BIASES)
+#define KERASLAYER2_WEIGHTS 	mnist_tensor(MNIST_TENSOR_L2_WEIGHTS)
 // keras_lay[6]
 // biases{Array[128]}, weights{Array[512][128]}
 //  biases  S:0x8010cf00 - S:0x8010d100
 //  weights S:0x8010d100 - S:0x8014d100
-#define KERASLAYER6_BIASES 		(MNIST_EVAL_BASE + MNIST_PARAMETER_BASE + 0xcf00)
-#define KERASLAYER6_WEIGHTS 	(MNIST_EVAL_BASE + MNIST_PARAMETER_BASE + 0xd100)
+#define KERASLAYER6_BIASES 		mnist_tensor(MNIST_TENSOR_L6_BIASES)
+#define KERASLAYER6_WEIGHTS 	mnist_tensor(MNIST_TENSOR_L6_WEIGHTS)
 // keras_lay[8]
 // biases{Array[10]}, weights{Array[128][10]}
 //  biases  S:0x8014d100 - S:0x8014d128
 //  weights S:0x8014d128 - S:0x8014e528
-#define KERASLAYER8_BIASES		(MNIST_EVAL_BASE + MNIST_PARAMETER_BASE + 0x4d100)
-#define KERASLAYER8_WEIGHTS 	(MNIST_EVAL_BASE + MNIST_PARAMETER_BASE + 0x4d128)
+#define KERASLAYER8_BIASES		mnist_tensor(MNIST_TENSOR_L8_BIASES)
+#define KERASLAYER8_WEIGHTS 	mnist_tensor(MNIST_TENSOR_L8_WEIGHTS)
+
+// INT8 parameters, generated by mnist/mnist_cnn_quantize.py
+// biases{float[Np]}, scales{float[Np]}, weights{int8[Np/4][Kp/4][4][4]}
+//  keras_lay[0] +0x0, keras_lay[2] +0x240, keras_lay[6] +0x3540,
+//  keras_lay[8] +0x13940 from MNIST_PARAMETER_INT8_BASE
+#define KERASLAYER0_INT8_BIASES		mnist_tensor(MNIST_TENSOR_L0_INT8_BIASES)
+#define KERASLAYER0_INT8_SCALES		mnist_tensor(MNIST_TENSOR_L0_INT8_SCALES)
+#define KERASLAYER0_INT8_WEIGHTS	mnist_tensor(MNIST_TENSOR_L0_INT8_WEIGHTS)
+#define KERASLAYER2_INT8_BIASES		mnist_tensor(MNIST_TENSOR_L2_INT8_BIASES)
+#define KERASLAYER2_INT8_SCALES		mnist_tensor(MNIST_TENSOR_L2_INT8_SCALES)
+#define KERASLAYER2_INT8_WEIGHTS	mnist_tensor(MNIST_TENSOR_L2_INT8_WEIGHTS)
+#define KERASLAYER6_INT8_BIASES		mnist_tensor(MNIST_TENSOR_L6_INT8_BIASES)
+#define KERASLAYER6_INT8_SCALES		mnist_tensor(MNIST_TENSOR_L6_INT8_SCALES)
+#define KERASLAYER6_INT8_WEIGHTS	mnist_tensor(MNIST_TENSOR_L6_INT8_WEIGHTS)
+#define KERASLAYER8_INT8_BIASES		mnist_tensor(MNIST_TENSOR_L8_INT8_BIASES)
+#define KERASLAYER8_INT8_SCALES		mnist_tensor(MNIST_TENSOR_L8_INT8_SCALES)
+#define KERASLAYER8_INT8_WEIGHTS	mnist_tensor(MNIST_TENSOR_L8_INT8_WEIGHTS)
+#define MNIST_PARAMETER_INT8_SIZE	0x13fa0
+
+// keras_lay[8] scores in each WORK_IMAGE_X() workspace
+#define MNIST_WORKSPACE_OUTPUT_OFFSET	0x11300
+#define MNIST_CLASSES					10
+
+// mnist_cnn_eval_batch() images per pass at most; fewer if the FC
+// layers of the graph are too wide for two of them in WORK_BATCH_X()
+#define MNIST_BATCH_MAX					16
 
 
 // MNIST image[image_num][IMAGE_ROWS][IMAGE_COLUMNS]
@@ -42,8 +95,79 @@ typedef struct {
     char relu_activation;
 } layer_structure;
 
+// result: post_proc() of the class scores, print it with post_proc_report()
+struct cnn_result;
 int mnist_cnn_eval(
 		unsigned int *test,
 		unsigned long idx,
-		unsigned int *result
+		struct cnn_result *result
+);
+// Once the parameter and graph blobs are loaded, before any evaluation:
+// plan the workspace of the graph for every conv mode, so switching
+// CONVMODE between images needs no planning
+int mnist_cnn_plan(void);
+// The same, then repack the FC weights into streaming panels, the conv
+// weights into their Winograd form for conv mode #7, and every
+// parameter into fp16 for conv mode #8
+int mnist_cnn_load(void);
+// Run from the model container (cnn_model.h) of size bytes at blob
+// instead of the raw parameter blobs and MNIST_GRAPH_BASE, before
+// mnist_cnn_load(). Returns 0 or a CNN_MODEL_E_ error, also if a tensor
+// of the hand-coded stages is missing; the raw blobs stay in use then.
+int mnist_cnn_model(const void *blob, unsigned long size);
+// The network mnist_cnn_eval() runs: the model container's, else the
+// description at MNIST_GRAPH_BASE, else the built-in one
+struct cnn_graph;
+const struct cnn_graph *mnist_cnn_network(void);
+
+// mnist_cnn_eval() workspace bytes per core for the current graph and
+// conv mode (0 if the graph is unusable), and where core idx left the
+// scores of its last image
+unsigned long mnist_cnn_workspace_size(void);
+float *mnist_cnn_eval_scores(unsigned long idx);
+
+// Profile every following mnist_cnn_eval() layer by layer into prof
+// (see cnn_prof.h), 0 to stop; one core at a time
+struct cnn_prof;
+void mnist_cnn_profile(struct cnn_prof *prof);
+// Record begin/end events of every following mnist_cnn_eval() and its
+// layers into the buffer of the calling core (idx), 0 to stop
+struct cnn_trace;
+void mnist_cnn_trace(struct cnn_trace *trace);
+int mnist_cnn_eval_batch(
+		unsigned int *test[],
+		unsigned int batch,
+		unsigned long idx,
+		struct cnn_result *results
+);
+// Scores of the last pass of core idx's mnist_cnn_eval_batch(),
+// float[pass][classes]
+float *mnist_cnn_eval_batch_scores(unsigned long idx);
+
+// Work-stealing evaluation of image_num images on up to cpu_num cores,
+// see cnn_sched.h: one stage per step of the graph, cut in row tiles.
+// Every core calls cnn_sched_worker() once initialised, also when this
+// returns -1 for a graph the scheduler cannot run (no image is run then).
+struct cnn_sched;
+struct cnn_team;
+typedef struct {
+		unsigned int **test_images;		// test_images[image_num]
+		struct cnn_result *results;		// results[image_num]
+		unsigned int conv_mode;
+} mnist_sched_job;
+
+int mnist_cnn_sched_init(
+		struct cnn_sched *sched,
+		mnist_sched_job *job,
+		unsigned int image_num,
+		unsigned int cpu_num
+);
+
+// One image with every layer split across the cores of a cnn_team;
+// called by the master core while the others run cnn_team_helper()
+int mnist_cnn_eval_team(
+		unsigned int *test,
+		struct cnn_team *team,
+		unsigned long idx,
+		struct cnn_result *result
 );
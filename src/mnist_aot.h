@@ -0,0 +1,34 @@
+/*
+==================================================================
+ Copyright ARM Ltd 2017. All rights reserved.
+
+ Simple CNN Application for Inference only
+ Conv mode #9: the network compiled ahead of time
+==================================================================
+*/
+#ifndef MNIST_AOT_H
+#define MNIST_AOT_H
+
+// mnist/mnist_cnn_compile.py turns a trained model into mnist_aot.c:
+// one function per layer with every shape a constant, the filter
+// windows unrolled tap by tap and the weights in aligned const arrays
+// (the 1/255 of pre-proc folded into the first conv's). The build
+// generates it with make AOT=1, which also defines CNN_AOT; the
+// parameter blobs and the graph are then not read in conv mode #9.
+#define MNIST_AOT_CONV_MODE     9
+
+// Activation bytes mnist_aot_eval() needs in workspace, and the
+// classes it writes to outputs
+unsigned long mnist_aot_workspace_size(void);
+unsigned int mnist_aot_classes(void);
+// Multiply-accumulates per image, for cnn_prof
+unsigned long long mnist_aot_macs(void);
+
+void mnist_aot_eval(
+    const unsigned int *test_images,    // CNN_PIXEL_U32 or CNN_PIXEL_U8
+    unsigned int image_format,
+    float *workspace,
+    float *outputs
+);
+
+#endif